@@ -14,6 +14,8 @@
 // graspdb
 #include "GraspDemonstration.h"
 #include "GraspModel.h"
+#include "LatencyRecorder.h"
+#include "Summary.h"
 
 // ROS
 #include <sensor_msgs/PointCloud2.h>
@@ -21,8 +23,13 @@
 // PostgreSQL
 #include <pqxx/pqxx>
 
+// Boost
+#include <boost/function.hpp>
+
 // C++ Standard Library
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace rail
 {
@@ -42,6 +49,14 @@ class Client
 public:
   /*! The default PostgreSQL port. */
   static const unsigned int DEFAULT_PORT = 5432;
+  /*! The default number of rows fetched at a time when streaming. */
+  static const size_t DEFAULT_BATCH_SIZE = 16;
+  /*! Store point clouds and images as raw serialized ROS messages (readable by all versions of the client). */
+  static const uint8_t ENCODING_RAW = 0;
+  /*! Store point clouds with packed fields and compress point clouds and images with zlib (lossless). */
+  static const uint8_t ENCODING_COMPRESSED = 1;
+  /*! Store point clouds with 16-bit quantized XYZ fields in addition to ENCODING_COMPRESSED (lossy). */
+  static const uint8_t ENCODING_QUANTIZED = 2;
 
   /*!
    * \brief Create a new Client.
@@ -118,6 +133,44 @@ public:
    */
   const std::string &getDatabase() const;
 
+  /*!
+   * \brief Binary encoding value accessor.
+   *
+   * Get the encoding used when storing point clouds and images with this Client.
+   *
+   * \return The binary encoding value (ENCODING_RAW, ENCODING_COMPRESSED, or ENCODING_QUANTIZED).
+   */
+  uint8_t getBinaryEncoding() const;
+
+  /*!
+   * \brief Binary encoding value mutator.
+   *
+   * Set the encoding used when storing point clouds and images with this Client. Loading always detects the encoding
+   * of each stored value, so rows stored with any encoding remain readable.
+   *
+   * \param binary_encoding The new binary encoding value (ENCODING_RAW, ENCODING_COMPRESSED, or ENCODING_QUANTIZED).
+   */
+  void setBinaryEncoding(const uint8_t binary_encoding);
+
+  /*!
+   * \brief Latency recorder accessor.
+   *
+   * Get the latency recorder used to time database loads and point cloud deserialization.
+   *
+   * \return The latency recorder (or NULL if timing is disabled).
+   */
+  LatencyRecorder *getLatencyRecorder() const;
+
+  /*!
+   * \brief Latency recorder mutator.
+   *
+   * Set the latency recorder used to time database loads and point cloud deserialization. The recorder is not owned
+   * by this Client and must outlive it.
+   *
+   * \param latency_recorder The latency recorder (or NULL to disable timing).
+   */
+  void setLatencyRecorder(LatencyRecorder *latency_recorder);
+
   /*!
    * \brief Check if there is a connection to the database.
    *
@@ -162,6 +215,20 @@ public:
    */
   bool loadGraspDemonstrations(std::vector<GraspDemonstration> &gds) const;
 
+  /*!
+   * \brief Load grasp demonstrations from the database from their IDs.
+   *
+   * Load the grasp demonstrations with the given IDs in a single query and append them to the given vector in the
+   * order of the given IDs. IDs that do not exist are skipped.
+   *
+   * \param ids The IDs of the grasp demonstrations to load.
+   * \param gds The vector to append the GraspDemonstration objects with the loaded data to.
+   * \param include_images If the images should be loaded (otherwise each image is left empty).
+   * \return bool Returns true if at least one grasp demonstration was loaded.
+   */
+  bool loadGraspDemonstrations(const std::vector<uint32_t> &ids, std::vector<GraspDemonstration> &gds,
+      const bool include_images = true) const;
+
   /*!
    * \brief Load grasp demonstrations from the database from an object name.
    *
@@ -174,6 +241,79 @@ public:
    */
   bool loadGraspDemonstrationsByObjectName(const std::string &object_name, std::vector<GraspDemonstration> &gds) const;
 
+  /*!
+   * \brief Stream all grasp demonstrations from the database.
+   *
+   * Fetch the grasp demonstrations in ID order, a fixed number of rows at a time, and pass each to the given callback.
+   * Only a single batch is held in memory at once. Each batch is read in its own transaction that is committed before
+   * the callback runs, so the callback may use this Client (e.g., to look up or insert other entities). Rows added
+   * with a higher ID while streaming are included. The callback may modify (e.g., swap out the point cloud of) the
+   * demonstration it is given and returns false to stop early.
+   *
+   * \param callback The function called with each grasp demonstration.
+   * \param batch_size The number of rows fetched at a time.
+   * \param include_images If the image column should be loaded (otherwise each image is left empty).
+   * \return The number of grasp demonstrations passed to the callback.
+   */
+  size_t forEachGraspDemonstration(const boost::function<bool(GraspDemonstration &)> &callback,
+      const size_t batch_size = DEFAULT_BATCH_SIZE, const bool include_images = true) const;
+
+  /*!
+   * \brief Stream grasp demonstrations from the database from an object name.
+   *
+   * Fetch the grasp demonstrations with the given object name in ID order, a batch at a time, exactly as
+   * forEachGraspDemonstration does (the callback may also use this Client).
+   *
+   * \param object_name The object name of the grasp demonstrations to stream.
+   * \param callback The function called with each grasp demonstration.
+   * \param batch_size The number of rows fetched at a time.
+   * \param include_images If the image column should be loaded (otherwise each image is left empty).
+   * \return The number of grasp demonstrations passed to the callback.
+   */
+  size_t forEachGraspDemonstrationByObjectName(const std::string &object_name,
+      const boost::function<bool(GraspDemonstration &)> &callback, const size_t batch_size = DEFAULT_BATCH_SIZE,
+      const bool include_images = true) const;
+
+  /*!
+   * \brief Load summaries of all grasp demonstrations from the database.
+   *
+   * Load only the ID, object name, and created timestamp of every grasp demonstration and store them in the given
+   * vector. No point cloud or image data is transferred; use loadGraspDemonstration to load a full entry on demand.
+   *
+   * \param summaries The vector to fill with Summary objects with the loaded data.
+   * \return bool Returns true if a successful load was completed and the data was set correctly.
+   */
+  bool loadGraspDemonstrationSummaries(std::vector<Summary> &summaries) const;
+
+  /*!
+   * \brief Load summaries of grasp demonstrations from the database from an object name.
+   *
+   * Load only the ID, object name, and created timestamp of the grasp demonstrations with the given object name and
+   * store them in the given vector. No point cloud or image data is transferred.
+   *
+   * \param object_name The object name of the grasp demonstrations to load.
+   * \param summaries The vector to fill with Summary objects with the loaded data.
+   * \return bool Returns true if a successful load was completed and the data was set correctly.
+   */
+  bool loadGraspDemonstrationSummariesByObjectName(const std::string &object_name,
+      std::vector<Summary> &summaries) const;
+
+  /*!
+   * \brief Load a page of grasp demonstration summaries from the database from an object name.
+   *
+   * Load the summaries of up to the given number of grasp demonstrations with the given object name and an ID above
+   * the given ID, in ID order, and append them to the given vector. Passing the ID of the last summary of a page as
+   * the next after_id walks every page without rescanning earlier rows.
+   *
+   * \param object_name The object name of the grasp demonstrations to load.
+   * \param after_id Only grasp demonstrations with an ID above this ID are loaded (0 for the first page).
+   * \param limit The maximum number of summaries to load.
+   * \param summaries The vector to append the Summary objects with the loaded data to.
+   * \return bool Returns true if at least one summary was loaded.
+   */
+  bool loadGraspDemonstrationSummariesByObjectName(const std::string &object_name, const uint32_t after_id,
+      const size_t limit, std::vector<Summary> &summaries) const;
+
   /*!
    * \brief Load a grasp from the database.
    *
@@ -218,6 +358,19 @@ public:
    */
   bool loadGraspModels(std::vector<GraspModel> &gms) const;
 
+  /*!
+   * \brief Load grasp models from the database from their IDs.
+   *
+   * Load the grasp models with the given IDs and append them to the given vector in the order of the given IDs. The
+   * models and all of their grasps are loaded with one query each in a single transaction. IDs that do not exist are
+   * skipped.
+   *
+   * \param ids The IDs of the grasp models to load.
+   * \param gms The vector to append the GraspModel objects with the loaded data to.
+   * \return bool Returns true if at least one grasp model was loaded.
+   */
+  bool loadGraspModels(const std::vector<uint32_t> &ids, std::vector<GraspModel> &gms) const;
+
   /*!
    * \brief Load grasp models from the database from an object name.
    *
@@ -229,6 +382,45 @@ public:
    */
   bool loadGraspModelsByObjectName(const std::string &object_name, std::vector<GraspModel> &gms) const;
 
+  /*!
+   * \brief Load summaries of all grasp models from the database.
+   *
+   * Load only the ID, object name, number of grasps, and created timestamp of every grasp model and store them in the
+   * given vector. No point cloud or grasp data is transferred; use loadGraspModel to load a full entry on demand.
+   *
+   * \param summaries The vector to fill with Summary objects with the loaded data.
+   * \return bool Returns true if a successful load was completed and the data was set correctly.
+   */
+  bool loadGraspModelSummaries(std::vector<Summary> &summaries) const;
+
+  /*!
+   * \brief Load summaries of grasp models from the database from an object name.
+   *
+   * Load only the ID, object name, number of grasps, and created timestamp of the grasp models with the given object
+   * name and store them in the given vector. No point cloud or grasp data is transferred.
+   *
+   * \param object_name The object name of the grasp models to load.
+   * \param summaries The vector to fill with Summary objects with the loaded data.
+   * \return bool Returns true if a successful load was completed and the data was set correctly.
+   */
+  bool loadGraspModelSummariesByObjectName(const std::string &object_name, std::vector<Summary> &summaries) const;
+
+  /*!
+   * \brief Load a page of grasp model summaries from the database from an object name.
+   *
+   * Load the summaries of up to the given number of grasp models with the given object name and an ID above the given
+   * ID, in ID order, and append them to the given vector. Passing the ID of the last summary of a page as the next
+   * after_id walks every page without rescanning earlier rows.
+   *
+   * \param object_name The object name of the grasp models to load.
+   * \param after_id Only grasp models with an ID above this ID are loaded (0 for the first page).
+   * \param limit The maximum number of summaries to load.
+   * \param summaries The vector to append the Summary objects with the loaded data to.
+   * \return bool Returns true if at least one summary was loaded.
+   */
+  bool loadGraspModelSummariesByObjectName(const std::string &object_name, const uint32_t after_id,
+      const size_t limit, std::vector<Summary> &summaries) const;
+
   /*!
    * \brief Load the unique demonstration object names from the database.
    *
@@ -249,6 +441,29 @@ public:
    */
   bool getUniqueGraspModelObjectNames(std::vector<std::string> &names) const;
 
+  /*!
+   * \brief Load the current state of the grasp models table.
+   *
+   * Load the largest grasp model ID and the number of grasp models in the database. This is a cheap query that can be
+   * used to check if the grasp models have changed without transferring any point cloud data.
+   *
+   * \param max_id The value to fill with the largest grasp model ID (0 if no grasp models exist).
+   * \param count The value to fill with the number of grasp models.
+   * \return bool Returns true if a successful load was completed and the data was set correctly.
+   */
+  bool getGraspModelsState(uint32_t &max_id, uint32_t &count) const;
+
+  /*!
+   * \brief Load the ID and created timestamp of all grasp models from the database.
+   *
+   * Load only the ID and created timestamp of every grasp model and store them in the given vector. No point cloud or
+   * grasp data is transferred.
+   *
+   * \param entities The vector to fill with Entity objects with the loaded data.
+   * \return bool Returns true if a successful load was completed and the data was set correctly.
+   */
+  bool loadGraspModelEntities(std::vector<Entity> &entities) const;
+
   /*!
    * \brief Add a grasp to the database.
    *
@@ -274,14 +489,27 @@ public:
   /*!
    * \brief Add a grasp model and its associated grasps to the database.
    *
-   * Stores the given grasp model data and its associated grasps to the database. If the entity was successfully
-   * added, the ID and created fields of the GraspModel are set accordingly.
+   * Stores the given grasp model data and its associated grasps to the database in a single transaction. If the
+   * entity was successfully added, the ID and created fields of the GraspModel and its grasps are set accordingly.
    *
    * \param gm The GraspModel with the data to store.
    * \return Returns true if the entity was added to the database.
    */
   bool addGraspModel(GraspModel &gm) const;
 
+  /*!
+   * \brief Add grasp models and their associated grasps to the database.
+   *
+   * Stores the given grasp models and their associated grasps to the database in a single transaction. The grasps of
+   * each model are inserted with a single statement. If any insert fails, the whole transaction is rolled back and
+   * the given grasp models are left unchanged. Otherwise, the ID and created fields of every GraspModel and its grasps
+   * are set accordingly.
+   *
+   * \param gms The GraspModels with the data to store.
+   * \return Returns true if every entity was added to the database.
+   */
+  bool addGraspModels(std::vector<GraspModel> &gms) const;
+
   /*!
    * \brief Delete a grasp from the database.
    *
@@ -309,7 +537,40 @@ public:
    */
   void deleteGraspModel(uint32_t id) const;
 
+  /*!
+   * \brief Delete grasp demonstrations from the database.
+   *
+   * Deletes every grasp demonstration with one of the given IDs in a single statement.
+   *
+   * \param ids The IDs of the grasp demonstrations to delete.
+   */
+  void deleteGraspDemonstrations(const std::vector<uint32_t> &ids) const;
+
+  /*!
+   * \brief Delete grasp models from the database.
+   *
+   * Deletes every grasp model with one of the given IDs in a single statement. All associated grasps are also
+   * deleted.
+   *
+   * \param ids The IDs of the grasp models to delete.
+   */
+  void deleteGraspModels(const std::vector<uint32_t> &ids) const;
+
 private:
+  /*!
+   * \struct InsertedGraspModel
+   * \brief The values set by the database for an inserted grasp model, applied once the transaction is committed.
+   */
+  struct InsertedGraspModel
+  {
+    /*! The ID of the grasp model. */
+    uint32_t id;
+    /*! The created timestamp of the grasp model. */
+    time_t created;
+    /*! The ID and created timestamp of each grasp (in the order of the grasps of the model). */
+    std::vector<std::pair<uint32_t, time_t> > grasps;
+  };
+
   /*!
    * \brief Check for a supported version of the libpqxx API.
    *
@@ -321,11 +582,33 @@ private:
   /*!
    * \brief Creates tables and types.
    *
-   * Creates the initial table and composite type schemas needed for the database. If these already exist, no action
-    * is taken.
+   * Creates the initial table and composite type schemas needed for the database, along with indexes on the upper
+   * case object names and on the grasp model ID of each grasp. If these already exist, no action is taken other than
+   * adding columns that are missing from tables created by older versions.
    */
   void createTables() const;
 
+  /*!
+   * \brief Create an index if it does not exist.
+   *
+   * Creates the index of the given name with the given definition in its own transaction unless an index of that
+   * name already exists.
+   *
+   * \param index The name of the index.
+   * \param definition The table and columns to index (e.g., "grasps (grasp_model_id)").
+   */
+  void createIndex(const std::string &index, const std::string &definition) const;
+
+  /*!
+   * \brief Check if an index exists in the database.
+   *
+   * Makes an SQL call to the database to check if an index of the given name exists.
+   *
+   * \param index The name of the index to check for.
+   * \return True if the index exists in the database.
+   */
+  bool doesIndexExist(const std::string &index) const;
+
   /*!
    * \brief Check if a composite type exists in the database.
    *
@@ -336,6 +619,17 @@ private:
    */
   bool doesTypeExist(const std::string &type) const;
 
+  /*!
+   * \brief Check if a column exists in the database.
+   *
+   * Makes an SQL call to the database to check if a table of the given name has a column of the given name.
+   *
+   * \param table The name of the table to check.
+   * \param column The name of the column to check for.
+   * \return True if the column exists in the table.
+   */
+  bool doesColumnExist(const std::string &table, const std::string &column) const;
+
   /*!
    * \brief Extract a string column from the database.
    *
@@ -361,6 +655,42 @@ private:
    */
   std::string toSQL(const Pose &p) const;
 
+  /*!
+   * \brief Add grasp models and their associated grasps to the database.
+   *
+   * Stores the given grasp models in a single transaction (see addGraspModels). The ID and created fields are only
+   * set once the transaction is committed, so nothing is copied and the models are left unchanged on failure.
+   *
+   * \param gms The GraspModels with the data to store.
+   * \return Returns true if every entity was added to the database.
+   */
+  bool insertGraspModels(const std::vector<GraspModel *> &gms) const;
+
+  /*!
+   * \brief Insert a grasp model as part of a transaction.
+   *
+   * Inserts the grasp model and all of its grasps (with a single multi-row statement) using the given transaction and
+   * stores the ID and created values set by the database. Nothing is committed and the grasp model is not changed.
+   *
+   * \param w The transaction to insert with.
+   * \param gm The GraspModel with the data to store.
+   * \param inserted The values set by the database to fill.
+   * \return Returns true if the grasp model and all of its grasps were inserted.
+   */
+  bool insertGraspModel(pqxx::work &w, const GraspModel &gm, InsertedGraspModel &inserted) const;
+
+  /*!
+   * \brief Load the grasps of a set of grasp models as part of a transaction.
+   *
+   * Loads the grasps of every grasp model from the given index onwards with a single query and adds each grasp to its
+   * grasp model.
+   *
+   * \param w The transaction to load with.
+   * \param gms The GraspModels to add the grasps to.
+   * \param first The index of the first GraspModel to load the grasps for.
+   */
+  void loadGraspsIntoGraspModels(pqxx::work &w, std::vector<GraspModel> &gms, const size_t first) const;
+
   /*!
    * \brief Convert a Position to a PostgreSQL object string.
    *
@@ -385,7 +715,7 @@ private:
    * \brief Extract PointCloud2 values from a binary string.
    *
    * Extracts PointCloud2 values from the given PostgreSQL binary string and places them in a new ROS PointCloud2
-   * message.
+   * message. Both raw and encoded (compressed or quantized) point clouds are detected automatically.
    *
    * \param bs The binary string representation of the serialized PointCloud2.
    * \return The PointCloud2 with values from the binary string.
@@ -395,7 +725,8 @@ private:
   /*!
    * \brief Extract Image values from a binary string.
    *
-   * Extracts Image values from the given PostgreSQL binary string and places them in a new ROS Image message.
+   * Extracts Image values from the given PostgreSQL binary string and places them in a new ROS Image message. Both raw
+   * and compressed images are detected automatically.
    *
    * \param bs The binary string representation of the serialized Image.
    * \return The Image with values from the binary string.
@@ -403,14 +734,34 @@ private:
   sensor_msgs::Image extractImageFromBinaryString(const pqxx::binarystring &bs) const;
 
   /*!
-   * \brief Extract array values from a string array with vector creation.
+   * \brief Extract array values from a string array.
    *
-   * Extracts double values from the given PostgreSQL array string (e.g., "{1,2,3}") and places them in a new vector.
+   * Extracts double values from the given PostgreSQL array string (e.g., "{1,2,3}") in place and stores them in the
+   * given array without any allocation. Both DOUBLE PRECISION and NUMERIC arrays are supported.
    *
    * \param array The array string representation of the array.
-   * \return The vector to populated with values from the string.
+   * \param values The array to fill with values from the string.
+   * \param max_values The maximum number of values to extract.
+   * \return The number of values extracted.
+   */
+  size_t extractArrayFromString(const char *array, double *values, const size_t max_values) const;
+
+  /*!
+   * \brief Stream grasp demonstrations in batches.
+   *
+   * Select the grasp demonstrations matching the given condition in ID order, one batch after the last ID per
+   * transaction, and pass each to the given callback until it returns false. No transaction is open while the callback
+   * runs.
+   *
+   * \param condition The SQL condition (already escaped), or TRUE for every grasp demonstration.
+   * \param callback The function called with each grasp demonstration.
+   * \param batch_size The number of rows fetched at a time.
+   * \param include_images If the image column should be loaded.
+   * \return The number of grasp demonstrations passed to the callback.
    */
-  std::vector<double> extractArrayFromString(std::string &array) const;
+  size_t streamGraspDemonstrations(const std::string &condition,
+      const boost::function<bool(GraspDemonstration &)> &callback, const size_t batch_size,
+      const bool include_images) const;
 
   /*!
    * \brief Extract grasp demonstration information from the SQL result tuple.
@@ -442,6 +793,16 @@ private:
    */
   GraspModel extractGraspModelFromTuple(const pqxx::result::tuple &tuple) const;
 
+  /*!
+   * \brief Extract summary information from the SQL result tuple.
+   *
+   * Extracts values from the given SQL result tuple and places them in a new Summary object.
+   *
+   * \param result The SQL result tuple containing the correct values.
+   * \return The Summary populated with values from the SQL result tuple.
+   */
+  Summary extractSummaryFromTuple(const pqxx::result::tuple &tuple) const;
+
   /*!
    * \brief Extract a time from a timestamp.
    *
@@ -459,7 +820,8 @@ private:
   /*!
    * \brief Convert a ROS PointCloud2 to a PostgreSQL binary string.
    *
-   * Converts the given ROS PointCloud2 message to a PostgreSQL binary string for use in SQL queries.
+   * Converts the given ROS PointCloud2 message to a PostgreSQL binary string for use in SQL queries using the current
+   * binary encoding.
    *
    * \param pc The ROS PointCloud2 message to convert to a PostgreSQL binary string.
    */
@@ -468,7 +830,8 @@ private:
   /*!
    * \brief Convert a ROS Image to a PostgreSQL binary string.
    *
-   * Converts the given ROS Image message to a PostgreSQL binary string for use in SQL queries.
+   * Converts the given ROS Image message to a PostgreSQL binary string for use in SQL queries using the current binary
+   * encoding.
    *
    * \param pc The ROS Image message to convert to a PostgreSQL binary string.
    */
@@ -480,8 +843,18 @@ private:
   std::string host_, user_, password_, db_;
   /*! Database port information. */
   uint16_t port_;
+  /*! The encoding used when storing point clouds and images. */
+  uint8_t binary_encoding_;
   /*! The main database connection client. */
   pqxx::connection *connection_;
+  /*! The optional latency recorder (not owned). */
+  LatencyRecorder *latency_recorder_;
+  /*! The latency recorder stage indices. */
+  size_t demonstrations_stage_, models_stage_, deserialize_stage_;
+  /*! Reusable heap buffers for serializing and compressing point clouds and images (a Client is not thread safe). */
+  mutable std::vector<uint8_t> serialization_buffer_, encoding_buffer_;
+  /*! Reusable packed point cloud for encoding. */
+  mutable sensor_msgs::PointCloud2 packed_point_cloud_;
 };
 
 }
@@ -0,0 +1,190 @@
+/*!
+ * \file ClientPool.h
+ * \brief A thread safe pool of grasp database clients.
+ *
+ * The client pool keeps a fixed number of grasp database clients, each with its own connection and prepared
+ * statements, that can be checked out and returned by concurrent callers.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_GRASPDB_CLIENT_POOL_H_
+#define RAIL_PICK_AND_PLACE_GRASPDB_CLIENT_POOL_H_
+
+// graspdb
+#include "Client.h"
+
+// Boost
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+// C++ Standard Library
+#include <string>
+#include <vector>
+
+namespace rail
+{
+namespace pick_and_place
+{
+namespace graspdb
+{
+
+/*!
+ * \class ClientPool
+ * \brief A thread safe pool of grasp database clients.
+ *
+ * The client pool keeps a fixed number of grasp database clients, each with its own connection and prepared
+ * statements, that can be checked out and returned by concurrent callers. A single Client is not thread safe, but
+ * each checked out Client is only used by one caller at a time so reads from different threads run in parallel.
+ * Clients that have lost their connection are reconnected when they are checked out.
+ */
+class ClientPool : private boost::noncopyable
+{
+public:
+  /*! The default number of connections. */
+  static const size_t DEFAULT_NUM_CONNECTIONS = 4;
+
+  /*!
+   * \class ScopedClient
+   * \brief A Client checked out of a pool for the lifetime of this object.
+   *
+   * The Client is checked out when this object is created and returned to the pool when it is destroyed.
+   */
+  class ScopedClient : private boost::noncopyable
+  {
+  public:
+    /*!
+     * \brief Check out a Client.
+     *
+     * Check out a Client from the given pool, blocking until one is available.
+     *
+     * \param pool The pool to check the Client out of.
+     */
+    ScopedClient(ClientPool &pool);
+
+    /*!
+     * \brief Return the Client.
+     *
+     * Returns the checked out Client to the pool.
+     */
+    virtual ~ScopedClient();
+
+    /*!
+     * \brief Client accessor.
+     *
+     * Get the checked out Client.
+     *
+     * \return The checked out Client.
+     */
+    Client &operator*() const;
+
+    /*!
+     * \brief Client accessor.
+     *
+     * Get the checked out Client.
+     *
+     * \return The checked out Client.
+     */
+    Client *operator->() const;
+
+  private:
+    /*! The pool the Client was checked out of. */
+    ClientPool &pool_;
+    /*! The checked out Client. */
+    Client *client_;
+  };
+
+  /*!
+   * \brief Create a new ClientPool.
+   *
+   * Creates a new ClientPool with the given connection information. Connections are not made by default.
+   *
+   * \param host The host IP of the database.
+   * \param port The host port of the database.
+   * \param user The user of the database.
+   * \param password The password for the user of the database.
+   * \param db The database name.
+   * \param num_connections The number of connections in the pool (defaults to 4, at least 1 is used).
+   */
+  ClientPool(const std::string &host, const uint16_t port, const std::string &user, const std::string &password,
+      const std::string &db, const size_t num_connections = DEFAULT_NUM_CONNECTIONS);
+
+  /*!
+   * \brief Cleans up a ClientPool.
+   *
+   * Disconnects and cleans up every Client. No Client may be checked out.
+   */
+  virtual ~ClientPool();
+
+  /*!
+   * \brief Number of connections accessor.
+   *
+   * Get the number of connections in the pool.
+   *
+   * \return The number of connections in the pool.
+   */
+  size_t getNumConnections() const;
+
+  /*!
+   * \brief Binary encoding value mutator.
+   *
+   * Set the binary encoding of every Client in the pool (see Client::setBinaryEncoding). No Client may be checked out.
+   *
+   * \param binary_encoding The new binary encoding value.
+   */
+  void setBinaryEncoding(const uint8_t binary_encoding);
+
+  /*!
+   * \brief Create a connection for every Client.
+   *
+   * Attempts to create a connection to the grasp database for every Client. No Client may be checked out.
+   *
+   * \return True if every connection was sucessfully made.
+   */
+  bool connect();
+
+  /*!
+   * \brief Close every connection.
+   *
+   * Closes the connection of every Client. No Client may be checked out.
+   */
+  void disconnect();
+
+  /*!
+   * \brief Check out a Client.
+   *
+   * Check out a Client from the pool, blocking until one is available. If the Client has lost its connection a
+   * reconnect is attempted; callers should check Client::connected before use. The Client must be returned with
+   * release (see ScopedClient).
+   *
+   * \return The checked out Client.
+   */
+  Client *checkout();
+
+  /*!
+   * \brief Return a Client.
+   *
+   * Return a Client that was checked out of this pool.
+   *
+   * \param client The Client to return.
+   */
+  void release(Client *client);
+
+private:
+  /*! Every Client in the pool. */
+  std::vector<Client *> clients_;
+  /*! The Clients that are not checked out. */
+  std::vector<Client *> available_;
+  /*! Mutex for the available Clients. */
+  boost::mutex mutex_;
+  /*! Signals a returned Client. */
+  boost::condition_variable available_condition_;
+};
+
+}
+}
+}
+
+#endif
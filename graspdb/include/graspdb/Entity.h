@@ -82,6 +82,15 @@ public:
    */
   void setCreated(const time_t created);
 
+  /*!
+   * \brief Swap the values of two Entity objects.
+   *
+   * Swap the ID and created timestamp values of this Entity with the given Entity.
+   *
+   * \param other The Entity to swap values with.
+   */
+  void swap(Entity &other);
+
 private:
   /*! The ID. */
   uint32_t id_;
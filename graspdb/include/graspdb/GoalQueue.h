@@ -0,0 +1,228 @@
+/*!
+ * \file GoalQueue.h
+ * \brief A queue of action server goals served by a set of goal threads.
+ *
+ * The goal queue holds the goals of an action server until one of its goal threads is free to execute them. Goals
+ * that are still queued can be cancelled and any goals left when the queue is shut down are rejected.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_GRASPDB_GOAL_QUEUE_H_
+#define RAIL_PICK_AND_PLACE_GRASPDB_GOAL_QUEUE_H_
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+#include <deque>
+#include <string>
+
+namespace rail
+{
+namespace pick_and_place
+{
+namespace graspdb
+{
+
+/*!
+ * \class GoalQueue
+ * \brief A queue of action server goals served by a set of goal threads.
+ *
+ * The goal queue is the goal and cancel callback of an actionlib ActionServer. Each new goal is queued and accepted by
+ * the next free goal thread, which then runs the execute callback on it. Cancelling a queued goal removes it from the
+ * queue; goals that are already running are finished. Once the queue is shut down, the running goals are finished,
+ * the goal threads are stopped, and every queued or new goal is rejected. The execute callback must set the final
+ * state of the goal.
+ *
+ * \tparam GoalHandle The goal handle type of the action server.
+ * \tparam Result The result type of the action.
+ */
+template<class GoalHandle, class Result>
+class GoalQueue : private boost::noncopyable
+{
+public:
+  /*! The callback that executes an accepted goal. */
+  typedef boost::function<void(GoalHandle &)> ExecuteCallback;
+
+  /*!
+   * \brief Create a new GoalQueue.
+   *
+   * Creates a new GoalQueue with the given execute callback. No goal threads are started until start is called.
+   *
+   * \param execute The callback that executes an accepted goal.
+   * \param shutdown_text The text of the rejected state for goals left when the queue is shut down.
+   * \param cancel_text The text of the cancelled state for goals cancelled while queued.
+   */
+  GoalQueue(const ExecuteCallback &execute, const std::string &shutdown_text, const std::string &cancel_text)
+      : execute_(execute), shutdown_text_(shutdown_text), cancel_text_(cancel_text)
+  {
+    shutdown_ = false;
+    num_threads_ = 0;
+  }
+
+  /*!
+   * \brief Cleans up a GoalQueue.
+   *
+   * Shuts down the queue if it is still running.
+   */
+  virtual ~GoalQueue()
+  {
+    this->shutdown();
+  }
+
+  /*!
+   * \brief Start the goal threads.
+   *
+   * Start the given number of goal threads (at least 1 is used). This should be called once, before the action server
+   * is started.
+   *
+   * \param num_threads The number of goals served concurrently.
+   */
+  void start(const int num_threads)
+  {
+    num_threads_ = std::max(num_threads, 1);
+    for (int i = 0; i < num_threads_; i++)
+    {
+      threads_.create_thread(boost::bind(&GoalQueue::goalLoop, this));
+    }
+  }
+
+  /*!
+   * \brief Number of goal threads accessor.
+   *
+   * Get the number of goal threads that were started.
+   *
+   * \return The number of goal threads.
+   */
+  int getNumThreads() const
+  {
+    return num_threads_;
+  }
+
+  /*!
+   * \brief The action server goal callback.
+   *
+   * Queue the goal for the next free goal thread, or reject it if the queue was shut down.
+   *
+   * \param goal_handle The handle of the new goal.
+   */
+  void goalCallback(GoalHandle goal_handle)
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (!shutdown_)
+      {
+        goals_.push_back(goal_handle);
+        condition_.notify_one();
+        return;
+      }
+    }
+    goal_handle.setRejected(Result(), shutdown_text_);
+  }
+
+  /*!
+   * \brief The action server cancel callback.
+   *
+   * Cancel the goal if it is still queued. Goals that are already running are finished.
+   *
+   * \param goal_handle The handle of the goal to cancel.
+   */
+  void cancelCallback(GoalHandle goal_handle)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    typename std::deque<GoalHandle>::iterator it = std::find(goals_.begin(), goals_.end(), goal_handle);
+    if (it != goals_.end())
+    {
+      goals_.erase(it);
+      goal_handle.setCanceled(Result(), cancel_text_);
+    }
+  }
+
+  /*!
+   * \brief Shut down the queue.
+   *
+   * Wait for the running goals to finish, stop the goal threads, and reject every queued goal. Calling this more than
+   * once has no effect.
+   */
+  void shutdown()
+  {
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      shutdown_ = true;
+    }
+    condition_.notify_all();
+    threads_.join_all();
+
+    // no goal thread is left to take the remaining goals
+    std::deque<GoalHandle> remaining;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      remaining.swap(goals_);
+    }
+    for (size_t i = 0; i < remaining.size(); i++)
+    {
+      remaining[i].setRejected(Result(), shutdown_text_);
+    }
+  }
+
+private:
+  /*!
+   * \brief The main goal thread loop.
+   *
+   * Accept and execute queued goals until the queue is shut down.
+   */
+  void goalLoop()
+  {
+    while (true)
+    {
+      GoalHandle goal_handle;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (!shutdown_ && goals_.empty())
+        {
+          condition_.wait(lock);
+        }
+        if (shutdown_)
+        {
+          return;
+        }
+        goal_handle = goals_.front();
+        goals_.pop_front();
+      }
+
+      goal_handle.setAccepted();
+      execute_(goal_handle);
+    }
+  }
+
+  /*! The callback that executes an accepted goal. */
+  ExecuteCallback execute_;
+  /*! The text used for rejected and cancelled goals. */
+  std::string shutdown_text_, cancel_text_;
+  /*! The shutdown flag. */
+  bool shutdown_;
+  /*! The number of goal threads. */
+  int num_threads_;
+  /*! Mutex for the goal queue. */
+  boost::mutex mutex_;
+  /*! Condition used to wake the goal threads. */
+  boost::condition_variable condition_;
+  /*! The goals waiting for a goal thread. */
+  std::deque<GoalHandle> goals_;
+  /*! The goal threads. */
+  boost::thread_group threads_;
+};
+
+}
+}
+}
+
+#endif
@@ -194,6 +194,15 @@ public:
    */
   double getSuccessRate() const;
 
+  /*!
+   * \brief Swap the values of two Grasp objects.
+   *
+   * Swap every value of this Grasp with the given Grasp without copying the strings.
+   *
+   * \param other The Grasp to swap values with.
+   */
+  void swap(Grasp &other);
+
   /*!
    * Converts this Grasp object into a ROS GraspWithSuccessRate message.
    *
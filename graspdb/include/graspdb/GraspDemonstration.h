@@ -205,6 +205,16 @@ public:
    */
   void setImage(const sensor_msgs::Image &image);
 
+  /*!
+   * \brief Swap the values of two GraspDemonstration objects.
+   *
+   * Swap every value of this GraspDemonstration with the given GraspDemonstration. The point cloud and image data are
+   * exchanged rather than copied, so this can be used to hand over a demonstration without duplicating its data.
+   *
+   * \param other The GraspDemonstration to swap values with.
+   */
+  void swap(GraspDemonstration &other);
+
   /*!
    * Converts this GraspDemonstration object into a ROS GraspDemonstration message.
    *
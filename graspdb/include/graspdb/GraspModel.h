@@ -269,12 +269,50 @@ public:
   /*!
    * \brief Point cloud mutator.
    *
-   * Set the point cloud message to the given values based on the ROS message.
+   * Set the point cloud message to the given values based on the ROS message. Any precomputed features no longer
+   * describe the point cloud, so they are cleared.
    *
    * \param point_cloud The ROS PointCloud2 message to store.
    */
   void setPointCloud(const sensor_msgs::PointCloud2 &point_cloud);
 
+  /*!
+   * \brief Release the point cloud.
+   *
+   * Clear the point cloud message and free the memory used by its data (e.g., once it has been converted).
+   */
+  void releasePointCloud();
+
+  /*!
+   * \brief Features accessor.
+   *
+   * Get the precomputed features of the point cloud. The features are an opaque, versioned blob written by the
+   * producer of the model (e.g., model generation) so consumers do not have to derive them from the point cloud again.
+   * An empty blob means no features are stored.
+   *
+   * \return The precomputed features.
+   */
+  const std::vector<uint8_t> &getFeatures() const;
+
+  /*!
+   * \brief Features mutator.
+   *
+   * Set the precomputed features of the point cloud.
+   *
+   * \param features The new precomputed features (empty to store none).
+   */
+  void setFeatures(const std::vector<uint8_t> &features);
+
+  /*!
+   * \brief Swap the values of two GraspModel objects.
+   *
+   * Swap every value of this GraspModel with the given GraspModel. The grasps, point cloud, and feature data are
+   * exchanged rather than copied, so this can be used to take over a loaded model without duplicating its point cloud.
+   *
+   * \param other The GraspModel to swap values with.
+   */
+  void swap(GraspModel &other);
+
   /*!
    * Converts this GraspModel object into a ROS GraspModel message.
    *
@@ -289,6 +327,8 @@ private:
   std::vector<Grasp> grasps_;
   /*! The point cloud data. */
   sensor_msgs::PointCloud2 point_cloud_;
+  /*! The precomputed features of the point cloud. */
+  std::vector<uint8_t> features_;
 };
 
 }
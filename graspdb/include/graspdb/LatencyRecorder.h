@@ -0,0 +1,202 @@
+/*!
+ * \file LatencyRecorder.h
+ * \brief A thread safe set of latency histograms for named stages.
+ *
+ * The latency recorder aggregates the duration of named stages (e.g., database loads or registration steps) into
+ * fixed size histograms that can be summarized and published periodically.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_GRASPDB_LATENCY_RECORDER_H_
+#define RAIL_PICK_AND_PLACE_GRASPDB_LATENCY_RECORDER_H_
+
+// ROS
+#include <ros/time.h>
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+// C++ Standard Library
+#include <string>
+#include <vector>
+
+namespace rail
+{
+namespace pick_and_place
+{
+namespace graspdb
+{
+
+/*!
+ * \class LatencyRecorder
+ * \brief A thread safe set of latency histograms for named stages.
+ *
+ * The latency recorder aggregates the duration of named stages into histograms with four logarithmic buckets per
+ * doubling of microseconds, so percentiles are within about 19% of the exact value. Recording a sample only takes a
+ * short lock and a few additions, so recorders can be left enabled under load. Stages are registered once by name and
+ * then recorded by index.
+ */
+class LatencyRecorder : private boost::noncopyable
+{
+public:
+  /*! The number of histogram buckets for each doubling of the sample duration. */
+  static const size_t BUCKETS_PER_OCTAVE = 4;
+  /*! The number of histogram buckets (bucket i holds samples below 2^((i + 1) / 4) microseconds). */
+  static const size_t NUM_BUCKETS = 32 * BUCKETS_PER_OCTAVE;
+
+  /*!
+   * \struct Statistics
+   * \brief A summary of the samples of a single stage in milliseconds.
+   */
+  struct Statistics
+  {
+    /*! The name of the stage. */
+    std::string name;
+    /*! The number of samples. */
+    uint64_t count;
+    /*! The mean, approximate percentiles (the upper bound of their bucket), and the maximum in milliseconds. */
+    double mean, p50, p90, p99, max;
+  };
+
+  /*!
+   * \class ScopedTimer
+   * \brief Records the lifetime of this object as a sample of a stage.
+   *
+   * A timer created with a NULL recorder does nothing, so instrumented code does not need to check if recording is
+   * enabled.
+   */
+  class ScopedTimer : private boost::noncopyable
+  {
+  public:
+    /*!
+     * \brief Start timing a stage.
+     *
+     * Start timing the given stage of the given recorder.
+     *
+     * \param recorder The recorder to add the sample to (or NULL to do nothing).
+     * \param stage The index of the stage.
+     */
+    ScopedTimer(LatencyRecorder *recorder, const size_t stage);
+
+    /*!
+     * \brief Stop timing the stage.
+     *
+     * Record the elapsed time as a sample of the stage.
+     */
+    virtual ~ScopedTimer();
+
+  private:
+    /*! The recorder to add the sample to. */
+    LatencyRecorder *recorder_;
+    /*! The index of the stage. */
+    size_t stage_;
+    /*! The start time. */
+    ros::WallTime start_;
+  };
+
+  /*!
+   * \brief Creates a new LatencyRecorder.
+   *
+   * Creates a new LatencyRecorder with no stages.
+   */
+  LatencyRecorder();
+
+  /*!
+   * \brief Register a stage.
+   *
+   * Register a stage with the given name. If a stage with the name already exists, its index is returned.
+   *
+   * \param name The name of the stage.
+   * \return The index of the stage.
+   */
+  size_t addStage(const std::string &name);
+
+  /*!
+   * \brief Record a sample.
+   *
+   * Add a sample to the given stage. Invalid stage indices are ignored.
+   *
+   * \param stage The index of the stage.
+   * \param seconds The duration of the sample in seconds.
+   */
+  void record(const size_t stage, const double seconds);
+
+  /*!
+   * \brief Summarize the samples.
+   *
+   * Fill the given list with a summary of each stage that has at least one sample.
+   *
+   * \param statistics The list of summaries to fill.
+   * \param reset If the samples of every stage should be cleared afterwards.
+   */
+  void getStatistics(std::vector<Statistics> &statistics, const bool reset = false);
+
+  /*!
+   * \brief Clear the samples.
+   *
+   * Clear the samples of every stage. The stages remain registered.
+   */
+  void reset();
+
+private:
+  /*!
+   * \struct Stage
+   * \brief The histogram of a single stage.
+   */
+  struct Stage
+  {
+    /*! The name of the stage. */
+    std::string name;
+    /*! The number of samples. */
+    uint64_t count;
+    /*! The sum and maximum of the samples in seconds. */
+    double total, max;
+    /*! The number of samples in each bucket. */
+    uint64_t buckets[NUM_BUCKETS];
+  };
+
+  /*!
+   * \brief Clear the samples of a stage.
+   *
+   * Clear the samples of the given stage. The mutex must be held.
+   *
+   * \param stage The stage to clear.
+   */
+  static void clearStage(Stage &stage);
+
+  /*!
+   * \brief Find a percentile.
+   *
+   * Find the upper bound of the bucket holding the given fraction of the samples of the stage.
+   *
+   * \param stage The stage to search.
+   * \param fraction The fraction of samples in [0, 1].
+   * \return The upper bound of the bucket in milliseconds (capped at the maximum sample).
+   */
+  static double findPercentile(const Stage &stage, const double fraction);
+
+  /*!
+   * \brief Bucket upper bound accessor.
+   *
+   * Get the upper bound of the given bucket.
+   *
+   * \param bucket The index of the bucket.
+   * \return The upper bound of the bucket in microseconds.
+   */
+  static double getBucketUpperBound(const size_t bucket);
+
+  /*! Mutex for the stages. */
+  boost::mutex mutex_;
+  /*! The registered stages. */
+  std::vector<Stage> stages_;
+};
+
+}
+}
+}
+
+#endif
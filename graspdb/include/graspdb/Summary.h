@@ -0,0 +1,99 @@
+/*!
+ * \file Summary.h
+ * \brief Lightweight grasp demonstration or grasp model information.
+ *
+ * A summary contains only the metadata of a grasp demonstration or grasp model: the ID, object name, number of grasps,
+ * and created timestamp. No point cloud or image data is included, making summaries cheap to load for listings.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_GRASPDB_SUMMARY_H_
+#define RAIL_PICK_AND_PLACE_GRASPDB_SUMMARY_H_
+
+// graspdb
+#include "Entity.h"
+
+// C++ Standard Library
+#include <string>
+
+namespace rail
+{
+namespace pick_and_place
+{
+namespace graspdb
+{
+
+/*!
+ * \class Summary
+ * \brief Lightweight grasp demonstration or grasp model information.
+ *
+ * A summary contains only the metadata of a grasp demonstration or grasp model: the ID, object name, number of grasps,
+ * and created timestamp. No point cloud or image data is included, making summaries cheap to load for listings. The
+ * full entry can be loaded on demand by its ID.
+ */
+class Summary : public Entity
+{
+public:
+  /*!
+   * \brief Create a new Summary.
+   *
+   * Creates a new Summary with the given values.
+   *
+   * \param id The unique ID of the database entry (defaults to 0).
+   * \param object_name The name of the object grasped (defaults to the empty string).
+   * \param num_grasps The number of grasps of the entry (defaults to 0).
+   * \param created The created timestamp (defaults to 0).
+   */
+  Summary(const uint32_t id = Entity::UNSET_ID, const std::string &object_name = "", const uint32_t num_grasps = 0,
+      const time_t created = Entity::UNSET_TIME);
+
+  /*!
+   * \brief Object name value accessor.
+   *
+   * Get the object name value of this Summary.
+   *
+   * \return The object name value.
+   */
+  const std::string &getObjectName() const;
+
+  /*!
+   * \brief Object name value mutator.
+   *
+   * Set the object name value of this Summary.
+   *
+   * \param object_name The new object name value.
+   */
+  void setObjectName(const std::string &object_name);
+
+  /*!
+   * \brief Number of grasps value accessor.
+   *
+   * Get the number of grasps of this Summary (always 1 for a grasp demonstration).
+   *
+   * \return The number of grasps value.
+   */
+  uint32_t getNumGrasps() const;
+
+  /*!
+   * \brief Number of grasps value mutator.
+   *
+   * Set the number of grasps of this Summary.
+   *
+   * \param num_grasps The new number of grasps value.
+   */
+  void setNumGrasps(const uint32_t num_grasps);
+
+private:
+  /*! The object name. */
+  std::string object_name_;
+  /*! The number of grasps. */
+  uint32_t num_grasps_;
+};
+
+}
+}
+}
+
+#endif
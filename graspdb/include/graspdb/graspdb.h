@@ -12,12 +12,16 @@
 #define RAIL_PICK_AND_PLACE_GRASPDB_GRASPDB_H_
 
 #include "Client.h"
+#include "ClientPool.h"
 #include "Entity.h"
+#include "GoalQueue.h"
 #include "Grasp.h"
 #include "GraspDemonstration.h"
 #include "GraspModel.h"
+#include "LatencyRecorder.h"
 #include "Orientation.h"
 #include "Pose.h"
 #include "Position.h"
+#include "Summary.h"
 
 #endif
@@ -14,14 +14,368 @@
 // ROS
 #include <ros/ros.h>
 
+// zlib
+#include <zlib.h>
+
+// C++ Standard Library
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+
 using namespace std;
 using namespace rail::pick_and_place::graspdb;
 
+/*! The bytes that start an encoded point cloud or image (raw rows start with the message header instead). */
+static const uint8_t ENCODED_MAGIC[] = {'G', 'D', 'B', 'Z'};
+/*! The version of the encoded format written by this client. */
+static const uint8_t ENCODED_VERSION = 1;
+/*! The size of the encoded header (magic, version, flags, and uncompressed payload size). */
+static const size_t ENCODED_HEADER_SIZE = 10;
+/*! Header flag set if the XYZ fields of an encoded point cloud were quantized. */
+static const uint8_t ENCODED_QUANTIZED_FLAG = 0x01;
+/*! The number of quantized axes. */
+static const size_t NUM_QUANTIZED_AXES = 3;
+/*! The names of the quantized point cloud fields. */
+static const char *QUANTIZED_FIELD_NAMES[] = {"x", "y", "z"};
+/*! The largest quantized coordinate value (the value above is reserved for non-finite coordinates). */
+static const uint16_t QUANTIZED_MAX = 65534;
+/*! The quantized value used for non-finite coordinates. */
+static const uint16_t QUANTIZED_NAN = 65535;
+/*! The size of the buffer used to format position and orientation arrays (room for four 17 digit doubles). */
+static const size_t TO_SQL_BUFFER_SIZE = 128;
+
+/*!
+ * \brief Create an SQL ID array.
+ *
+ * Format the given IDs as a PostgreSQL array literal (e.g., {1,2,3}) for use as an INTEGER[] parameter.
+ *
+ * \param ids The IDs to format.
+ * \return The array literal.
+ */
+static string createIDArray(const vector<uint32_t> &ids)
+{
+  stringstream ss;
+  ss << "{";
+  for (size_t i = 0; i < ids.size(); i++)
+  {
+    ss << ((i > 0) ? "," : "") << ids[i];
+  }
+  ss << "}";
+  return ss.str();
+}
+
+/*!
+ * \brief Get the size of a point cloud field type.
+ *
+ * Get the size in bytes of a single value of the given sensor_msgs/PointField datatype.
+ *
+ * \param datatype The sensor_msgs/PointField datatype.
+ * \return The size in bytes of a single value (0 if unknown).
+ */
+static uint32_t sizeOfPointField(const uint8_t datatype)
+{
+  switch (datatype)
+  {
+    case sensor_msgs::PointField::INT8:
+    case sensor_msgs::PointField::UINT8:
+      return 1;
+    case sensor_msgs::PointField::INT16:
+    case sensor_msgs::PointField::UINT16:
+      return 2;
+    case sensor_msgs::PointField::INT32:
+    case sensor_msgs::PointField::UINT32:
+    case sensor_msgs::PointField::FLOAT32:
+      return 4;
+    case sensor_msgs::PointField::FLOAT64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+/*!
+ * \brief Get the quantized axis of a point cloud field.
+ *
+ * Get which axis the given field is if it is a single value XYZ field with the given datatype.
+ *
+ * \param field The sensor_msgs/PointField to check.
+ * \param datatype The datatype the field must have.
+ * \return The axis index or NUM_QUANTIZED_AXES if the field is not quantized.
+ */
+static size_t quantizedAxis(const sensor_msgs::PointField &field, const uint8_t datatype)
+{
+  if (field.datatype == datatype && field.count == 1)
+  {
+    for (size_t i = 0; i < NUM_QUANTIZED_AXES; i++)
+    {
+      if (field.name == QUANTIZED_FIELD_NAMES[i])
+      {
+        return i;
+      }
+    }
+  }
+  return NUM_QUANTIZED_AXES;
+}
+
+/*!
+ * \brief Pack the fields of a point cloud.
+ *
+ * Copy the point cloud with each field stored back to back, removing any padding between fields, points, and rows.
+ * If quantize is set the XYZ FLOAT32 fields are stored as UINT16 values between the minimum and maximum coordinates
+ * along each axis and the offset and scale of each axis is stored in bounds.
+ *
+ * \param in The point cloud to pack.
+ * \param quantize If the XYZ fields should be quantized.
+ * \param out The packed point cloud to fill.
+ * \param bounds The offset and then the scale of each quantized axis (only set if quantize is true).
+ */
+static void packPointCloud2(const sensor_msgs::PointCloud2 &in, const bool quantize, sensor_msgs::PointCloud2 &out,
+    float bounds[2 * NUM_QUANTIZED_AXES])
+{
+  out.header = in.header;
+  out.height = in.height;
+  out.width = in.width;
+  out.is_bigendian = in.is_bigendian;
+  out.is_dense = in.is_dense;
+
+  // lay out each field back to back
+  const size_t num_points = in.width * in.height;
+  vector<size_t> axes(in.fields.size(), NUM_QUANTIZED_AXES);
+  vector<uint32_t> sizes(in.fields.size());
+  out.fields = in.fields;
+  uint32_t step = 0;
+  for (size_t i = 0; i < in.fields.size(); i++)
+  {
+    if (quantize)
+    {
+      axes[i] = quantizedAxis(in.fields[i], sensor_msgs::PointField::FLOAT32);
+    }
+    sizes[i] = sizeOfPointField(in.fields[i].datatype) * in.fields[i].count;
+    out.fields[i].offset = step;
+    if (axes[i] < NUM_QUANTIZED_AXES)
+    {
+      out.fields[i].datatype = sensor_msgs::PointField::UINT16;
+      step += sizeof(uint16_t);
+    } else
+    {
+      step += sizes[i];
+    }
+  }
+  out.point_step = step;
+  out.row_step = step * in.width;
+  out.data.resize(out.row_step * in.height);
+
+  // find the range of each quantized axis
+  float min[NUM_QUANTIZED_AXES], max[NUM_QUANTIZED_AXES];
+  for (size_t i = 0; i < NUM_QUANTIZED_AXES; i++)
+  {
+    min[i] = numeric_limits<float>::max();
+    max[i] = -numeric_limits<float>::max();
+  }
+  for (size_t i = 0; i < in.fields.size(); i++)
+  {
+    if (axes[i] < NUM_QUANTIZED_AXES)
+    {
+      for (size_t j = 0; j < num_points; j++)
+      {
+        float value;
+        memcpy(&value, &in.data[(j / in.width) * in.row_step + (j % in.width) * in.point_step + in.fields[i].offset],
+               sizeof(float));
+        if (isfinite(value))
+        {
+          min[axes[i]] = std::min(min[axes[i]], value);
+          max[axes[i]] = std::max(max[axes[i]], value);
+        }
+      }
+    }
+  }
+  if (quantize)
+  {
+    for (size_t i = 0; i < NUM_QUANTIZED_AXES; i++)
+    {
+      bounds[i] = (min[i] <= max[i]) ? min[i] : 0;
+      bounds[NUM_QUANTIZED_AXES + i] = (min[i] < max[i]) ? (max[i] - min[i]) / QUANTIZED_MAX : 0;
+    }
+  }
+
+  // copy each point
+  for (size_t j = 0; j < num_points; j++)
+  {
+    const uint8_t *src = &in.data[(j / in.width) * in.row_step + (j % in.width) * in.point_step];
+    uint8_t *dest = &out.data[j * out.point_step];
+    for (size_t i = 0; i < in.fields.size(); i++)
+    {
+      if (axes[i] < NUM_QUANTIZED_AXES)
+      {
+        float value;
+        memcpy(&value, src + in.fields[i].offset, sizeof(float));
+        const float scale = bounds[NUM_QUANTIZED_AXES + axes[i]];
+        uint16_t q = QUANTIZED_NAN;
+        if (isfinite(value))
+        {
+          q = (scale > 0) ? (uint16_t) std::min((float) QUANTIZED_MAX,
+                                                floor((value - bounds[axes[i]]) / scale + 0.5f)) : 0;
+        }
+        memcpy(dest + out.fields[i].offset, &q, sizeof(uint16_t));
+      } else
+      {
+        memcpy(dest + out.fields[i].offset, src + in.fields[i].offset, sizes[i]);
+      }
+    }
+  }
+}
+
+/*!
+ * \brief Restore the quantized fields of a point cloud.
+ *
+ * Copy the packed point cloud with each quantized UINT16 XYZ field converted back to a FLOAT32 field.
+ *
+ * \param in The packed point cloud with quantized fields.
+ * \param bounds The offset and then the scale of each quantized axis.
+ * \param out The point cloud to fill.
+ */
+static void unquantizePointCloud2(const sensor_msgs::PointCloud2 &in, const float bounds[2 * NUM_QUANTIZED_AXES],
+    sensor_msgs::PointCloud2 &out)
+{
+  out.header = in.header;
+  out.height = in.height;
+  out.width = in.width;
+  out.is_bigendian = in.is_bigendian;
+  out.is_dense = in.is_dense;
+
+  // lay out each field back to back
+  const size_t num_points = in.width * in.height;
+  vector<size_t> axes(in.fields.size());
+  vector<uint32_t> sizes(in.fields.size());
+  out.fields = in.fields;
+  uint32_t step = 0;
+  for (size_t i = 0; i < in.fields.size(); i++)
+  {
+    axes[i] = quantizedAxis(in.fields[i], sensor_msgs::PointField::UINT16);
+    sizes[i] = sizeOfPointField(in.fields[i].datatype) * in.fields[i].count;
+    out.fields[i].offset = step;
+    if (axes[i] < NUM_QUANTIZED_AXES)
+    {
+      out.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+      step += sizeof(float);
+    } else
+    {
+      step += sizes[i];
+    }
+  }
+  out.point_step = step;
+  out.row_step = step * in.width;
+  out.data.resize(out.row_step * in.height);
+
+  // copy each point
+  for (size_t j = 0; j < num_points; j++)
+  {
+    const uint8_t *src = &in.data[(j / in.width) * in.row_step + (j % in.width) * in.point_step];
+    uint8_t *dest = &out.data[j * out.point_step];
+    for (size_t i = 0; i < in.fields.size(); i++)
+    {
+      if (axes[i] < NUM_QUANTIZED_AXES)
+      {
+        uint16_t q;
+        memcpy(&q, src + in.fields[i].offset, sizeof(uint16_t));
+        const float value = (q == QUANTIZED_NAN) ? numeric_limits<float>::quiet_NaN()
+                                                 : bounds[axes[i]] + q * bounds[NUM_QUANTIZED_AXES + axes[i]];
+        memcpy(dest + out.fields[i].offset, &value, sizeof(float));
+      } else
+      {
+        memcpy(dest + out.fields[i].offset, src + in.fields[i].offset, sizes[i]);
+      }
+    }
+  }
+}
+
+/*!
+ * \brief Compress an encoded payload.
+ *
+ * Compress the payload with zlib and prefix it with the encoded header.
+ *
+ * \param payload The payload to compress.
+ * \param size The size of the payload.
+ * \param flags The header flags.
+ * \param encoded The buffer to fill with the header and compressed payload.
+ * \return True if the payload was compressed.
+ */
+static bool compressPayload(const uint8_t *payload, const uint32_t size, const uint8_t flags, vector<uint8_t> &encoded)
+{
+  uLongf compressed_size = compressBound(size);
+  encoded.resize(ENCODED_HEADER_SIZE + compressed_size);
+  memcpy(&encoded[0], ENCODED_MAGIC, sizeof(ENCODED_MAGIC));
+  encoded[4] = ENCODED_VERSION;
+  encoded[5] = flags;
+  memcpy(&encoded[6], &size, sizeof(uint32_t));
+  if (compress2(&encoded[ENCODED_HEADER_SIZE], &compressed_size, payload, size, Z_DEFAULT_COMPRESSION) != Z_OK)
+  {
+    return false;
+  }
+  encoded.resize(ENCODED_HEADER_SIZE + compressed_size);
+  return true;
+}
+
+/*!
+ * \brief Decompress an encoded payload.
+ *
+ * Check for the encoded header and decompress the payload that follows it.
+ *
+ * \param data The stored data.
+ * \param size The size of the stored data.
+ * \param flags Set to the header flags.
+ * \param payload The buffer to fill with the decompressed payload.
+ * \return True if the data was encoded and the payload was decompressed, false for raw data.
+ */
+static bool decompressPayload(const uint8_t *data, const size_t size, uint8_t &flags, vector<uint8_t> &payload)
+{
+  // check the header
+  if (size < ENCODED_HEADER_SIZE || memcmp(data, ENCODED_MAGIC, sizeof(ENCODED_MAGIC)) != 0
+      || data[4] != ENCODED_VERSION)
+  {
+    return false;
+  }
+  flags = data[5];
+  uint32_t payload_size;
+  memcpy(&payload_size, &data[6], sizeof(uint32_t));
+
+  payload.resize(payload_size);
+  uLongf decompressed_size = payload_size;
+  return uncompress(payload.empty() ? NULL : &payload[0], &decompressed_size, &data[ENCODED_HEADER_SIZE],
+                    size - ENCODED_HEADER_SIZE) == Z_OK && decompressed_size == payload_size;
+}
+
+/*!
+ * \brief Serialize a ROS message into a buffer.
+ *
+ * Serialize the given message into the buffer starting at the given offset, resizing the buffer as needed. Reusing
+ * the same buffer avoids a new allocation once it is large enough.
+ *
+ * \param msg The ROS message to serialize.
+ * \param offset The offset in the buffer to start at.
+ * \param buffer The buffer to serialize into.
+ */
+template<class T>
+static void serializeMessage(const T &msg, const size_t offset, vector<uint8_t> &buffer)
+{
+  const uint32_t size = ros::serialization::serializationLength(msg);
+  buffer.resize(offset + size);
+  ros::serialization::OStream stream(&buffer[offset], size);
+  ros::serialization::serialize(stream, msg);
+}
+
 Client::Client(const Client &c)
     : host_(c.getHost()), user_(c.getUser()), password_(c.getPassword()), db_(c.getDatabase())
 {
   port_ = c.getPort();
+  binary_encoding_ = c.getBinaryEncoding();
   connection_ = NULL;
+  this->setLatencyRecorder(c.getLatencyRecorder());
 
   // check if a connection was made
   if (c.connected())
@@ -37,7 +391,9 @@ Client::Client(const string &host, const uint16_t port, const string &user, cons
     host_(host), user_(user), password_(password), db_(db)
 {
   port_ = port;
+  binary_encoding_ = ENCODING_RAW;
   connection_ = NULL;
+  this->setLatencyRecorder(NULL);
 
   // check API versions
   this->checkAPIVersion();
@@ -82,6 +438,35 @@ const string &Client::getDatabase() const
   return db_;
 }
 
+uint8_t Client::getBinaryEncoding() const
+{
+  return binary_encoding_;
+}
+
+void Client::setBinaryEncoding(const uint8_t binary_encoding)
+{
+  binary_encoding_ = binary_encoding;
+}
+
+LatencyRecorder *Client::getLatencyRecorder() const
+{
+  return latency_recorder_;
+}
+
+void Client::setLatencyRecorder(LatencyRecorder *latency_recorder)
+{
+  latency_recorder_ = latency_recorder;
+  demonstrations_stage_ = 0;
+  models_stage_ = 0;
+  deserialize_stage_ = 0;
+  if (latency_recorder_ != NULL)
+  {
+    demonstrations_stage_ = latency_recorder_->addStage("graspdb.load_grasp_demonstrations");
+    models_stage_ = latency_recorder_->addStage("graspdb.load_grasp_models");
+    deserialize_stage_ = latency_recorder_->addStage("graspdb.deserialize_point_cloud");
+  }
+}
+
 bool Client::connected() const
 {
   return connection_ != NULL && connection_->is_open();
@@ -104,9 +489,15 @@ bool Client::connect()
     {
       // general statements
       connection_->prepare("pg_type.exists", "SELECT EXISTS (SELECT 1 FROM pg_type WHERE typname=$1)");
+      connection_->prepare("columns.exists", "SELECT EXISTS (SELECT 1 FROM information_schema.columns " \
+          "WHERE table_name=$1 AND column_name=$2)");
+      connection_->prepare("pg_class.index_exists",
+                           "SELECT EXISTS (SELECT 1 FROM pg_class WHERE relname=$1 AND relkind='i')");
 
       // grasp_demonstrations statements
       connection_->prepare("grasp_demonstrations.delete", "DELETE FROM grasp_demonstrations WHERE id=$1");
+      connection_->prepare("grasp_demonstrations.delete_ids",
+                           "DELETE FROM grasp_demonstrations WHERE id=ANY($1::INTEGER[])");
       connection_->prepare("grasp_demonstrations.insert",
                            "INSERT INTO grasp_demonstrations " \
                            "(object_name, grasp_pose, eef_frame_id, point_cloud, image) " \
@@ -121,18 +512,54 @@ bool Client::connect()
                            "SELECT id, object_name, (grasp_pose).robot_fixed_frame_id, (grasp_pose).position, " \
           "(grasp_pose).orientation, eef_frame_id, point_cloud, image, created " \
           "FROM grasp_demonstrations WHERE UPPER(object_name)=UPPER($1)");
+      connection_->prepare("grasp_demonstrations.select_ids",
+                           "SELECT id, object_name, (grasp_pose).robot_fixed_frame_id, (grasp_pose).position, " \
+          "(grasp_pose).orientation, eef_frame_id, point_cloud, image, created " \
+          "FROM grasp_demonstrations WHERE id=ANY($1::INTEGER[])");
+      connection_->prepare("grasp_demonstrations.select_ids_no_images",
+                           "SELECT id, object_name, (grasp_pose).robot_fixed_frame_id, (grasp_pose).position, " \
+          "(grasp_pose).orientation, eef_frame_id, point_cloud, NULL::BYTEA AS image, created " \
+          "FROM grasp_demonstrations WHERE id=ANY($1::INTEGER[])");
       connection_->prepare("grasp_demonstrations.unique", "SELECT DISTINCT object_name FROM grasp_demonstrations");
+      connection_->prepare("grasp_demonstrations.select_summaries",
+                           "SELECT id, object_name, 1 AS num_grasps, created FROM grasp_demonstrations");
+      connection_->prepare("grasp_demonstrations.select_summaries_object_name",
+                           "SELECT id, object_name, 1 AS num_grasps, created FROM grasp_demonstrations " \
+                           "WHERE UPPER(object_name)=UPPER($1)");
+      connection_->prepare("grasp_demonstrations.select_summaries_object_name_page",
+                           "SELECT id, object_name, 1 AS num_grasps, created FROM grasp_demonstrations " \
+                           "WHERE UPPER(object_name)=UPPER($1) AND id>$2 ORDER BY id LIMIT $3");
 
       // grasp_models statements
       connection_->prepare("grasp_models.delete", "DELETE FROM grasp_models WHERE id=$1");
-      connection_->prepare("grasp_models.insert", "INSERT INTO grasp_models (object_name, point_cloud) " \
-                           "VALUES (UPPER($1), $2, $3, $4, $5) RETURNING id, created");
+      connection_->prepare("grasp_models.delete_ids", "DELETE FROM grasp_models WHERE id=ANY($1::INTEGER[])");
+      connection_->prepare("grasp_models.insert", "INSERT INTO grasp_models (object_name, point_cloud, features) " \
+                           "VALUES (UPPER($1), $2, $3) RETURNING id, created");
       connection_->prepare("grasp_models.select",
-                           "SELECT id, object_name, point_cloud, created FROM grasp_models WHERE id=$1");
-      connection_->prepare("grasp_models.select_all", "SELECT id, object_name, point_cloud, created FROM grasp_models");
-      connection_->prepare("grasp_models.select_object_name", "SELECT id, object_name, point_cloud, created " \
-                           "FROM grasp_models WHERE UPPER(object_name)=UPPER($1)");
+                           "SELECT id, object_name, point_cloud, features, created FROM grasp_models WHERE id=$1");
+      connection_->prepare("grasp_models.select_all",
+                           "SELECT id, object_name, point_cloud, features, created FROM grasp_models");
+      connection_->prepare("grasp_models.select_ids", "SELECT id, object_name, point_cloud, features, created " \
+          "FROM grasp_models WHERE id=ANY($1::INTEGER[])");
+      connection_->prepare("grasp_models.select_object_name", "SELECT id, object_name, point_cloud, features, " \
+                           "created FROM grasp_models WHERE UPPER(object_name)=UPPER($1)");
       connection_->prepare("grasp_models.unique", "SELECT DISTINCT object_name FROM grasp_models");
+      connection_->prepare("grasp_models.state",
+                           "SELECT COALESCE(MAX(id), 0) AS max_id, COUNT(*) AS count FROM grasp_models");
+      connection_->prepare("grasp_models.select_entities", "SELECT id, created FROM grasp_models");
+      connection_->prepare("grasp_models.select_summaries",
+                           "SELECT grasp_models.id, grasp_models.object_name, COUNT(grasps.id) AS num_grasps, " \
+          "grasp_models.created FROM grasp_models LEFT JOIN grasps ON grasps.grasp_model_id=grasp_models.id " \
+          "GROUP BY grasp_models.id");
+      connection_->prepare("grasp_models.select_summaries_object_name",
+                           "SELECT grasp_models.id, grasp_models.object_name, COUNT(grasps.id) AS num_grasps, " \
+          "grasp_models.created FROM grasp_models LEFT JOIN grasps ON grasps.grasp_model_id=grasp_models.id " \
+          "WHERE UPPER(grasp_models.object_name)=UPPER($1) GROUP BY grasp_models.id");
+      connection_->prepare("grasp_models.select_summaries_object_name_page",
+                           "SELECT grasp_models.id, grasp_models.object_name, COUNT(grasps.id) AS num_grasps, " \
+          "grasp_models.created FROM grasp_models LEFT JOIN grasps ON grasps.grasp_model_id=grasp_models.id " \
+          "WHERE UPPER(grasp_models.object_name)=UPPER($1) AND grasp_models.id>$2 GROUP BY grasp_models.id " \
+          "ORDER BY grasp_models.id LIMIT $3");
 
       // grasps statements
       connection_->prepare("grasps.delete", "DELETE FROM grasps WHERE id=$1");
@@ -145,6 +572,10 @@ bool Client::connect()
       connection_->prepare("grasps.select_grasp_model_id",
                            "SELECT id, grasp_model_id, (grasp_pose).robot_fixed_frame_id, (grasp_pose).position, " \
           "(grasp_pose).orientation, eef_frame_id, successes, attempts, created FROM grasps  WHERE grasp_model_id=$1");
+      connection_->prepare("grasps.select_grasp_model_ids",
+                           "SELECT id, grasp_model_id, (grasp_pose).robot_fixed_frame_id, (grasp_pose).position, " \
+          "(grasp_pose).orientation, eef_frame_id, successes, attempts, created FROM grasps " \
+          "WHERE grasp_model_id=ANY($1::INTEGER[]) ORDER BY id");
 
       // create the tables in the DB if they do not exist
       this->createTables();
@@ -179,8 +610,8 @@ void Client::createTables() const
     pqxx::work w(*connection_);
     string sql = "CREATE TYPE pose AS (" \
                    "robot_fixed_frame_id VARCHAR," \
-                   "position NUMERIC[3]," \
-                   "orientation NUMERIC[4]" \
+                   "position DOUBLE PRECISION[3]," \
+                   "orientation DOUBLE PRECISION[4]" \
                  ");";
     w.exec(sql);
     w.commit();
@@ -205,6 +636,7 @@ void Client::createTables() const
                               "id SERIAL PRIMARY KEY," \
                               "object_name VARCHAR NOT NULL," \
                               "point_cloud BYTEA NOT NULL," \
+                              "features BYTEA," \
                               "created TIMESTAMP WITH TIME ZONE NOT NULL DEFAULT NOW()" \
                             ");";
   w.exec(grasp_models_sql);
@@ -223,6 +655,31 @@ void Client::createTables() const
 
   // commit the changes
   w.commit();
+
+  // tables created before the features were stored are missing the column (existing models have no features)
+  if (!this->doesColumnExist("grasp_models", "features"))
+  {
+    pqxx::work alter(*connection_);
+    alter.exec("ALTER TABLE grasp_models ADD COLUMN features BYTEA;");
+    alter.commit();
+  }
+
+  // index the case insensitive object name queries and the grasp lookups of each model (checked first since older
+  // servers do not support CREATE INDEX IF NOT EXISTS)
+  this->createIndex("grasp_demonstrations_object_name_idx", "grasp_demonstrations (UPPER(object_name))");
+  this->createIndex("grasp_models_object_name_idx", "grasp_models (UPPER(object_name))");
+  this->createIndex("grasps_grasp_model_id_idx", "grasps (grasp_model_id)");
+}
+
+void Client::createIndex(const string &index, const string &definition) const
+{
+  if (!this->doesIndexExist(index))
+  {
+    // each index has its own transaction so a failure can not undo the tables
+    pqxx::work w(*connection_);
+    w.exec("CREATE INDEX " + index + " ON " + definition + ";");
+    w.commit();
+  }
 }
 
 bool Client::doesTypeExist(const string &type) const
@@ -235,8 +692,29 @@ bool Client::doesTypeExist(const string &type) const
   return result[0][0].as<bool>();
 }
 
+bool Client::doesIndexExist(const string &index) const
+{
+  pqxx::work w(*connection_);
+  // create and execute the query
+  pqxx::result result = w.prepared("pg_class.index_exists")(index).exec();
+  w.commit();
+  // return the result
+  return result[0][0].as<bool>();
+}
+
+bool Client::doesColumnExist(const string &table, const string &column) const
+{
+  pqxx::work w(*connection_);
+  // create and execute the query
+  pqxx::result result = w.prepared("columns.exists")(table)(column).exec();
+  w.commit();
+  // return the result
+  return result[0][0].as<bool>();
+}
+
 bool Client::loadGraspDemonstration(uint32_t id, GraspDemonstration &gd) const
 {
+  LatencyRecorder::ScopedTimer timer(latency_recorder_, demonstrations_stage_);
   // create and execute the query
   pqxx::work w(*connection_);
   pqxx::result result = w.prepared("grasp_demonstrations.select")(id).exec();
@@ -256,6 +734,7 @@ bool Client::loadGraspDemonstration(uint32_t id, GraspDemonstration &gd) const
 
 bool Client::loadGraspDemonstrations(vector<GraspDemonstration> &gds) const
 {
+  LatencyRecorder::ScopedTimer timer(latency_recorder_, demonstrations_stage_);
   // create and execute the query
   pqxx::work w(*connection_);
   pqxx::result result = w.prepared("grasp_demonstrations.select_all").exec();
@@ -276,8 +755,43 @@ bool Client::loadGraspDemonstrations(vector<GraspDemonstration> &gds) const
   }
 }
 
+bool Client::loadGraspDemonstrations(const vector<uint32_t> &ids, vector<GraspDemonstration> &gds,
+    const bool include_images) const
+{
+  if (ids.empty())
+  {
+    return false;
+  }
+
+  LatencyRecorder::ScopedTimer timer(latency_recorder_, demonstrations_stage_);
+  // create and execute a single query for every ID
+  pqxx::work w(*connection_);
+  const string statement = include_images ? "grasp_demonstrations.select_ids"
+      : "grasp_demonstrations.select_ids_no_images";
+  pqxx::result result = w.prepared(statement)(createIDArray(ids)).exec();
+  w.commit();
+
+  // extract each result in the order of the given IDs
+  map<uint32_t, size_t> rows;
+  for (size_t i = 0; i < result.size(); i++)
+  {
+    rows[result[i]["id"].as<uint32_t>()] = i;
+  }
+  const size_t first = gds.size();
+  for (size_t i = 0; i < ids.size(); i++)
+  {
+    map<uint32_t, size_t>::const_iterator row = rows.find(ids[i]);
+    if (row != rows.end())
+    {
+      gds.push_back(this->extractGraspDemonstrationFromTuple(result[row->second]));
+    }
+  }
+  return gds.size() > first;
+}
+
 bool Client::loadGraspDemonstrationsByObjectName(const string &object_name, vector<GraspDemonstration> &gds) const
 {
+  LatencyRecorder::ScopedTimer timer(latency_recorder_, demonstrations_stage_);
   // create and execute the query
   pqxx::work w(*connection_);
   pqxx::result result = w.prepared("grasp_demonstrations.select_object_name")(object_name).exec();
@@ -298,6 +812,88 @@ bool Client::loadGraspDemonstrationsByObjectName(const string &object_name, vect
   }
 }
 
+size_t Client::forEachGraspDemonstration(const boost::function<bool(GraspDemonstration &)> &callback,
+    const size_t batch_size, const bool include_images) const
+{
+  return this->streamGraspDemonstrations("TRUE", callback, batch_size, include_images);
+}
+
+size_t Client::forEachGraspDemonstrationByObjectName(const string &object_name,
+    const boost::function<bool(GraspDemonstration &)> &callback, const size_t batch_size,
+    const bool include_images) const
+{
+  return this->streamGraspDemonstrations("UPPER(object_name)=UPPER(" + connection_->quote(object_name) + ")",
+                                         callback, batch_size, include_images);
+}
+
+bool Client::loadGraspDemonstrationSummaries(vector<Summary> &summaries) const
+{
+  // create and execute the query
+  pqxx::work w(*connection_);
+  pqxx::result result = w.prepared("grasp_demonstrations.select_summaries").exec();
+  w.commit();
+
+  // check the result
+  if (result.empty())
+  {
+    return false;
+  } else
+  {
+    // extract each result
+    for (size_t i = 0; i < result.size(); i++)
+    {
+      summaries.push_back(this->extractSummaryFromTuple(result[i]));
+    }
+    return true;
+  }
+}
+
+bool Client::loadGraspDemonstrationSummariesByObjectName(const string &object_name, vector<Summary> &summaries) const
+{
+  // create and execute the query
+  pqxx::work w(*connection_);
+  pqxx::result result = w.prepared("grasp_demonstrations.select_summaries_object_name")(object_name).exec();
+  w.commit();
+
+  // check the result
+  if (result.empty())
+  {
+    return false;
+  } else
+  {
+    // extract each result
+    for (size_t i = 0; i < result.size(); i++)
+    {
+      summaries.push_back(this->extractSummaryFromTuple(result[i]));
+    }
+    return true;
+  }
+}
+
+bool Client::loadGraspDemonstrationSummariesByObjectName(const string &object_name, const uint32_t after_id,
+    const size_t limit, vector<Summary> &summaries) const
+{
+  // create and execute the query
+  pqxx::work w(*connection_);
+  pqxx::result result = w.prepared("grasp_demonstrations.select_summaries_object_name_page")(object_name)(after_id)
+      (limit).exec();
+  w.commit();
+
+  // check the result
+  if (result.empty())
+  {
+    return false;
+  } else
+  {
+    // extract each result
+    for (size_t i = 0; i < result.size(); i++)
+    {
+      summaries.push_back(this->extractSummaryFromTuple(result[i]));
+    }
+    return true;
+  }
+}
+
 bool Client::loadGrasp(uint32_t id, Grasp &grasp) const
 {
   // create and execute the query
@@ -341,67 +937,150 @@ bool Client::loadGraspByGraspModelID(const uint32_t grasp_model_id, vector<Grasp
 
 bool Client::loadGraspModel(uint32_t id, GraspModel &gm) const
 {
+  LatencyRecorder::ScopedTimer timer(latency_recorder_, models_stage_);
   // create and execute the query
   pqxx::work w(*connection_);
   pqxx::result result = w.prepared("grasp_models.select")(id).exec();
-  w.commit();
 
   // check the result
   if (result.empty())
   {
+    w.commit();
     return false;
   } else
   {
-    // extract the information
-    gm = this->extractGraspModelFromTuple(result[0]);
-    // now load the grasps
-    vector<Grasp> grasps;
-    this->loadGraspByGraspModelID(id, grasps);
-    // add each grasp
-    for (size_t i = 0; i < grasps.size(); i++)
-    {
-      gm.addGrasp(grasps[i]);
-    }
+    // extract the information and load the grasps in the same transaction
+    vector<GraspModel> gms(1, this->extractGraspModelFromTuple(result[0]));
+    this->loadGraspsIntoGraspModels(w, gms, 0);
+    w.commit();
+    gm = gms[0];
     return true;
   }
 }
 
 bool Client::loadGraspModels(vector<GraspModel> &gms) const
 {
+  LatencyRecorder::ScopedTimer timer(latency_recorder_, models_stage_);
   // create and execute the query
   pqxx::work w(*connection_);
   pqxx::result result = w.prepared("grasp_models.select_all").exec();
-  w.commit();
 
   // check the result
   if (result.empty())
   {
+    w.commit();
     return false;
   } else
   {
     // extract each result
+    const size_t first = gms.size();
     for (size_t i = 0; i < result.size(); i++)
     {
-      GraspModel gm = this->extractGraspModelFromTuple(result[i]);
-      // now load the grasps
-      vector<Grasp> grasps;
-      this->loadGraspByGraspModelID(gm.getID(), grasps);
-      // add each grasp
-      for (size_t i = 0; i < grasps.size(); i++)
-      {
-        gm.addGrasp(grasps[i]);
-      }
-      gms.push_back(gm);
+      gms.push_back(this->extractGraspModelFromTuple(result[i]));
     }
+    // now load all of the grasps at once
+    this->loadGraspsIntoGraspModels(w, gms, first);
+    w.commit();
     return true;
   }
 }
 
+bool Client::loadGraspModels(const vector<uint32_t> &ids, vector<GraspModel> &gms) const
+{
+  if (ids.empty())
+  {
+    return false;
+  }
+
+  LatencyRecorder::ScopedTimer timer(latency_recorder_, models_stage_);
+  // create and execute a single query for every ID
+  pqxx::work w(*connection_);
+  pqxx::result result = w.prepared("grasp_models.select_ids")(createIDArray(ids)).exec();
+
+  // extract each result in the order of the given IDs
+  map<uint32_t, size_t> rows;
+  for (size_t i = 0; i < result.size(); i++)
+  {
+    rows[result[i]["id"].as<uint32_t>()] = i;
+  }
+  const size_t first = gms.size();
+  for (size_t i = 0; i < ids.size(); i++)
+  {
+    map<uint32_t, size_t>::const_iterator row = rows.find(ids[i]);
+    if (row != rows.end())
+    {
+      gms.push_back(this->extractGraspModelFromTuple(result[row->second]));
+    }
+  }
+  // now load all of the grasps at once
+  this->loadGraspsIntoGraspModels(w, gms, first);
+  w.commit();
+  return gms.size() > first;
+}
+
 bool Client::loadGraspModelsByObjectName(const string &object_name, vector<GraspModel> &gms) const
 {
+  LatencyRecorder::ScopedTimer timer(latency_recorder_, models_stage_);
   // create and execute the query
   pqxx::work w(*connection_);
   pqxx::result result = w.prepared("grasp_models.select_object_name")(object_name).exec();
+
+  // check the result
+  if (result.empty())
+  {
+    w.commit();
+    return false;
+  } else
+  {
+    // extract each result
+    const size_t first = gms.size();
+    for (size_t i = 0; i < result.size(); i++)
+    {
+      gms.push_back(this->extractGraspModelFromTuple(result[i]));
+    }
+    // now load all of the grasps at once
+    this->loadGraspsIntoGraspModels(w, gms, first);
+    w.commit();
+    return true;
+  }
+}
+
+void Client::loadGraspsIntoGraspModels(pqxx::work &w, vector<GraspModel> &gms, const size_t first) const
+{
+  if (first >= gms.size())
+  {
+    return;
+  }
+
+  // build the ID array and a lookup back to each model
+  stringstream ids;
+  map<uint32_t, size_t> indices;
+  ids << "{";
+  for (size_t i = first; i < gms.size(); i++)
+  {
+    ids << ((i > first) ? "," : "") << gms[i].getID();
+    indices[gms[i].getID()] = i;
+  }
+  ids << "}";
+
+  // a single query for every grasp, grouped into the models here
+  pqxx::result result = w.prepared("grasps.select_grasp_model_ids")(ids.str()).exec();
+  for (size_t i = 0; i < result.size(); i++)
+  {
+    Grasp grasp = this->extractGraspFromTuple(result[i]);
+    map<uint32_t, size_t>::const_iterator it = indices.find(grasp.getGraspModelID());
+    if (it != indices.end())
+    {
+      gms[it->second].addGrasp(grasp);
+    }
+  }
+}
+
+bool Client::loadGraspModelSummaries(vector<Summary> &summaries) const
+{
+  // create and execute the query
+  pqxx::work w(*connection_);
+  pqxx::result result = w.prepared("grasp_models.select_summaries").exec();
   w.commit();
 
   // check the result
@@ -413,16 +1092,53 @@ bool Client::loadGraspModelsByObjectName(const string &object_name, vector<Grasp
     // extract each result
     for (size_t i = 0; i < result.size(); i++)
     {
-      GraspModel gm = this->extractGraspModelFromTuple(result[i]);
-      // now load the grasps
-      vector<Grasp> grasps;
-      this->loadGraspByGraspModelID(gm.getID(), grasps);
-      // add each grasp
-      for (size_t i = 0; i < grasps.size(); i++)
-      {
-        gm.addGrasp(grasps[i]);
-      }
-      gms.push_back(gm);
+      summaries.push_back(this->extractSummaryFromTuple(result[i]));
+    }
+    return true;
+  }
+}
+
+bool Client::loadGraspModelSummariesByObjectName(const string &object_name, vector<Summary> &summaries) const
+{
+  // create and execute the query
+  pqxx::work w(*connection_);
+  pqxx::result result = w.prepared("grasp_models.select_summaries_object_name")(object_name).exec();
+  w.commit();
+
+  // check the result
+  if (result.empty())
+  {
+    return false;
+  } else
+  {
+    // extract each result
+    for (size_t i = 0; i < result.size(); i++)
+    {
+      summaries.push_back(this->extractSummaryFromTuple(result[i]));
+    }
+    return true;
+  }
+}
+
+bool Client::loadGraspModelSummariesByObjectName(const string &object_name, const uint32_t after_id,
+    const size_t limit, vector<Summary> &summaries) const
+{
+  // create and execute the query
+  pqxx::work w(*connection_);
+  pqxx::result result = w.prepared("grasp_models.select_summaries_object_name_page")(object_name)(after_id)(limit)
+      .exec();
+  w.commit();
+
+  // check the result
+  if (result.empty())
+  {
+    return false;
+  } else
+  {
+    // extract each result
+    for (size_t i = 0; i < result.size(); i++)
+    {
+      summaries.push_back(this->extractSummaryFromTuple(result[i]));
     }
     return true;
   }
@@ -438,6 +1154,49 @@ bool Client::getUniqueGraspModelObjectNames(vector<string> &names) const
   return this->getStringArrayFromPrepared("grasp_models.unique", "object_name", names);
 }
 
+bool Client::getGraspModelsState(uint32_t &max_id, uint32_t &count) const
+{
+  // create and execute the query
+  pqxx::work w(*connection_);
+  pqxx::result result = w.prepared("grasp_models.state").exec();
+  w.commit();
+
+  // check the result
+  if (result.empty())
+  {
+    return false;
+  } else
+  {
+    // extract the information
+    max_id = result[0]["max_id"].as<uint32_t>();
+    count = result[0]["count"].as<uint32_t>();
+    return true;
+  }
+}
+
+bool Client::loadGraspModelEntities(vector<Entity> &entities) const
+{
+  // create and execute the query
+  pqxx::work w(*connection_);
+  pqxx::result result = w.prepared("grasp_models.select_entities").exec();
+  w.commit();
+
+  // check the result
+  if (result.empty())
+  {
+    return false;
+  } else
+  {
+    // extract each result
+    for (size_t i = 0; i < result.size(); i++)
+    {
+      Entity entity(result[i]["id"].as<uint32_t>(), this->extractTimeFromString(result[i]["created"].as<string>()));
+      entities.push_back(entity);
+    }
+    return true;
+  }
+}
+
 bool Client::addGrasp(Grasp &grasp) const
 {
   // build the SQL bits we need
@@ -499,54 +1258,108 @@ bool Client::addGraspDemonstration(GraspDemonstration &gd) const
 
 bool Client::addGraspModel(GraspModel &gm) const
 {
-  // build the SQL bits we need
-  const string &object_name = gm.getObjectName();
-  pqxx::binarystring pc = this->toBinaryString(gm.getPointCloud());
-
-  // create and execute the query
-  pqxx::work w(*connection_);
-  pqxx::result result = w.prepared("grasp_models.insert")(object_name)(pc).exec();
-  w.commit();
+  return this->insertGraspModels(vector<GraspModel *>(1, &gm));
+}
 
-  // check the result
-  if (!result.empty())
+bool Client::addGraspModels(vector<GraspModel> &gms) const
+{
+  vector<GraspModel *> pointers(gms.size());
+  for (size_t i = 0; i < gms.size(); i++)
   {
-    gm.setID(result[0]["id"].as<uint32_t>());
-    gm.setCreated(this->extractTimeFromString(result[0]["created"].as<string>()));
-
-    // used to add back the grasps with the correct ID and created fields
-    vector<Grasp> addedGrasps;
-
-    // now add each grasp to the database
+    pointers[i] = &gms[i];
+  }
+  return this->insertGraspModels(pointers);
+}
 
-    for (size_t i = 0; i < gm.getNumGrasps(); i++)
+bool Client::insertGraspModels(const vector<GraspModel *> &gms) const
+{
+  // only the values set by the database are kept until everything is committed
+  vector<InsertedGraspModel> inserted(gms.size());
+  try
+  {
+    // a single transaction for every model and grasp
+    pqxx::work w(*connection_);
+    for (size_t i = 0; i < gms.size(); i++)
     {
-      // set the model ID and attempt to add it
-      Grasp grasp = gm.getGrasp(i);
-      grasp.setGraspModelID(gm.getID());
-      if (this->addGrasp(grasp))
+      if (!this->insertGraspModel(w, *gms[i], inserted[i]))
       {
-        addedGrasps.push_back(grasp);
+        // the transaction is rolled back when it goes out of scope
+        return false;
       }
     }
+    w.commit();
+  } catch (const exception &e)
+  {
+    ROS_ERROR("%s", e.what());
+    return false;
+  }
 
-    // clear out the old grasp values
-    while (gm.getNumGrasps() > 0)
+  // everything is stored, so the models can be updated
+  for (size_t i = 0; i < gms.size(); i++)
+  {
+    GraspModel &gm = *gms[i];
+    gm.setID(inserted[i].id);
+    gm.setCreated(inserted[i].created);
+    for (size_t j = 0; j < gm.getNumGrasps(); j++)
     {
-      gm.removeGrasp(0);
+      Grasp &grasp = gm.getGrasp(j);
+      grasp.setGraspModelID(inserted[i].id);
+      grasp.setID(inserted[i].grasps[j].first);
+      grasp.setCreated(inserted[i].grasps[j].second);
     }
+  }
+  return true;
+}
 
-    // add each new grasp
-    for (size_t i = 0; i < addedGrasps.size(); i++)
-    {
-      gm.addGrasp(addedGrasps[i]);
-    }
+bool Client::insertGraspModel(pqxx::work &w, const GraspModel &gm, InsertedGraspModel &inserted) const
+{
+  // build the SQL bits we need
+  const string &object_name = gm.getObjectName();
+  pqxx::binarystring pc = this->toBinaryString(gm.getPointCloud());
+  const vector<uint8_t> &features = gm.getFeatures();
+  pqxx::binarystring features_blob(features.empty() ? NULL : &features[0], features.size());
 
-    return true;
-  } else
+  // insert the model (without features the column is left NULL)
+  pqxx::result result = w.prepared("grasp_models.insert")(object_name)(pc)(features_blob, !features.empty()).exec();
+  if (result.empty())
   {
     return false;
   }
+  inserted.id = result[0]["id"].as<uint32_t>();
+  inserted.created = this->extractTimeFromString(result[0]["created"].as<string>());
+  inserted.grasps.clear();
+
+  if (gm.getNumGrasps() > 0)
+  {
+    // insert every grasp with a single statement, feeding the rows in order so the IDs follow the grasp order
+    stringstream sql;
+    sql << "INSERT INTO grasps (grasp_model_id, grasp_pose, eef_frame_id, successes, attempts) "
+        << "SELECT grasp_model_id, grasp_pose, eef_frame_id, successes, attempts FROM (VALUES ";
+    for (size_t i = 0; i < gm.getNumGrasps(); i++)
+    {
+      const Grasp &grasp = gm.getGrasp(i);
+      sql << ((i > 0) ? "," : "") << "(" << i << "," << inserted.id << ","
+          << w.quote(this->toSQL(grasp.getGraspPose())) << "::pose," << w.quote(grasp.getEefFrameID()) << ","
+          << grasp.getSuccesses() << "," << grasp.getAttempts() << ")";
+    }
+    sql << ") AS v (ordinal, grasp_model_id, grasp_pose, eef_frame_id, successes, attempts) ORDER BY ordinal "
+        << "RETURNING id, created";
+    pqxx::result grasps_result = w.exec(sql.str());
+    if (grasps_result.size() != gm.getNumGrasps())
+    {
+      return false;
+    }
+
+    // RETURNING does not guarantee any order, but the IDs of a single statement increase with the ordinal
+    for (pqxx::result::size_type i = 0; i < grasps_result.size(); i++)
+    {
+      inserted.grasps.push_back(make_pair(grasps_result[i]["id"].as<uint32_t>(),
+                                          this->extractTimeFromString(grasps_result[i]["created"].as<string>())));
+    }
+    sort(inserted.grasps.begin(), inserted.grasps.end());
+  }
+
+  return true;
 }
 
 #else
@@ -557,6 +1370,12 @@ bool Client::addGraspModel(GraspModel &gm) const
   return false;
 }
 
+bool Client::addGraspModels(vector<GraspModel> &gms) const
+{
+  ROS_WARN("libpqxx-%s does not support binary string insertion. Add grasp models ignored.", PQXX_VERSION);
+  return false;
+}
+
 bool Client::addGraspDemonstration(GraspDemonstration &gd) const
 {
   ROS_WARN("libpqxx-%s does not support binary string insertion. Add grasp demonstration ignored.", PQXX_VERSION);
@@ -589,19 +1408,90 @@ void Client::deleteGraspModel(uint32_t id) const
   w.commit();
 }
 
+void Client::deleteGraspDemonstrations(const vector<uint32_t> &ids) const
+{
+  if (!ids.empty())
+  {
+    // create and execute a single query for every ID
+    pqxx::work w(*connection_);
+    pqxx::result result = w.prepared("grasp_demonstrations.delete_ids")(createIDArray(ids)).exec();
+    w.commit();
+  }
+}
+
+void Client::deleteGraspModels(const vector<uint32_t> &ids) const
+{
+  if (!ids.empty())
+  {
+    // create and execute a single query for every ID
+    pqxx::work w(*connection_);
+    pqxx::result result = w.prepared("grasp_models.delete_ids")(createIDArray(ids)).exec();
+    w.commit();
+  }
+}
+
+size_t Client::streamGraspDemonstrations(const string &condition,
+    const boost::function<bool(GraspDemonstration &)> &callback, const size_t batch_size,
+    const bool include_images) const
+{
+  // the batch query is built here since the condition is dynamic (a NULL image is extracted as empty)
+  string sql = "SELECT id, object_name, (grasp_pose).robot_fixed_frame_id, (grasp_pose).position, " \
+               "(grasp_pose).orientation, eef_frame_id, point_cloud, ";
+  sql += include_images ? "image" : "NULL::BYTEA AS image";
+  sql += ", created FROM grasp_demonstrations WHERE (" + condition + ") AND id>";
+  const size_t limit = max(batch_size, (size_t) 1);
+
+  size_t count = 0;
+  uint32_t last_id = 0;
+  bool keep_going = true;
+  while (keep_going)
+  {
+    // each batch is read in its own transaction, so none is open while the callback runs
+    vector<GraspDemonstration> gds;
+    {
+      // only the fetches count as database time
+      LatencyRecorder::ScopedTimer timer(latency_recorder_, demonstrations_stage_);
+      stringstream ss;
+      ss << sql << last_id << " ORDER BY id LIMIT " << limit;
+      pqxx::work w(*connection_);
+      pqxx::result batch = w.exec(ss.str());
+      w.commit();
+      gds.reserve(batch.size());
+      for (size_t i = 0; i < batch.size(); i++)
+      {
+        gds.push_back(this->extractGraspDemonstrationFromTuple(batch[i]));
+      }
+    }
+    if (gds.empty())
+    {
+      break;
+    }
+    last_id = gds.back().getID();
+
+    for (size_t i = 0; keep_going && i < gds.size(); i++)
+    {
+      count++;
+      keep_going = callback(gds[i]);
+    }
+    // a short batch is the last one
+    keep_going = keep_going && gds.size() == limit;
+  }
+  return count;
+}
+
 GraspDemonstration Client::extractGraspDemonstrationFromTuple(const pqxx::result::tuple &tuple) const
 {
   // to return
   GraspDemonstration gd;
 
   // create the Position element
-  string position_string = tuple["position"].as<string>();
-  vector<double> position_values = this->extractArrayFromString(position_string);
+  double position_values[3] = {0, 0, 0};
+  this->extractArrayFromString(tuple["position"].c_str(), position_values, 3);
   Position pos(position_values[0], position_values[1], position_values[2]);
 
   // create the Orientation element
-  string orientation_string = tuple["orientation"].as<string>();
-  vector<double> orientation_values = this->extractArrayFromString(orientation_string);
+  double orientation_values[4] = {0, 0, 0, 1};
+  this->extractArrayFromString(tuple["orientation"].c_str(), orientation_values, 4);
   Orientation ori(orientation_values[0], orientation_values[1], orientation_values[2], orientation_values[3]);
 
   // create the Pose element
@@ -637,13 +1527,13 @@ Grasp Client::extractGraspFromTuple(const pqxx::result::tuple &tuple) const
   Grasp grasp;
 
   // create the Position element
-  string position_string = tuple["position"].as<string>();
-  vector<double> position_values = this->extractArrayFromString(position_string);
+  double position_values[3] = {0, 0, 0};
+  this->extractArrayFromString(tuple["position"].c_str(), position_values, 3);
   Position pos(position_values[0], position_values[1], position_values[2]);
 
   // create the Orientation element
-  string orientation_string = tuple["orientation"].as<string>();
-  vector<double> orientation_values = this->extractArrayFromString(orientation_string);
+  double orientation_values[4] = {0, 0, 0, 1};
+  this->extractArrayFromString(tuple["orientation"].c_str(), orientation_values, 4);
   Orientation ori(orientation_values[0], orientation_values[1], orientation_values[2], orientation_values[3]);
 
   // create the Pose element
@@ -678,50 +1568,105 @@ GraspModel Client::extractGraspModelFromTuple(const pqxx::result::tuple &tuple)
     gm.setPointCloud(this->extractPointCloud2FromBinaryString(blob));
   }
 
+  // extract the precomputed features if there are any (set after the point cloud, which clears them)
+  if (!tuple["features"].is_null())
+  {
+    pqxx::binarystring blob(tuple["features"]);
+    gm.setFeatures(vector<uint8_t>(blob.data(), blob.data() + blob.size()));
+  }
+
   return gm;
 }
 
+Summary Client::extractSummaryFromTuple(const pqxx::result::tuple &tuple) const
+{
+  return Summary(tuple["id"].as<uint32_t>(), tuple["object_name"].as<string>(), tuple["num_grasps"].as<uint32_t>(),
+                 this->extractTimeFromString(tuple["created"].as<string>()));
+}
+
 sensor_msgs::PointCloud2 Client::extractPointCloud2FromBinaryString(const pqxx::binarystring &bs) const
 {
+  LatencyRecorder::ScopedTimer timer(latency_recorder_, deserialize_stage_);
   sensor_msgs::PointCloud2 pc;
-  // deserialize from memory
-  ros::serialization::IStream stream((uint8_t *) bs.data(), bs.size());
-  ros::serialization::Serializer<sensor_msgs::PointCloud2>::read(stream, pc);
+  // check for the encoded format
+  uint8_t flags;
+  vector<uint8_t> &payload = serialization_buffer_;
+  if (decompressPayload(bs.data(), bs.size(), flags, payload))
+  {
+    if (flags & ENCODED_QUANTIZED_FLAG)
+    {
+      // the quantization bounds come before the message
+      float bounds[2 * NUM_QUANTIZED_AXES];
+      if (payload.size() < sizeof(bounds))
+      {
+        ROS_WARN("Quantized point cloud is missing its bounds.");
+        return pc;
+      }
+      memcpy(bounds, &payload[0], sizeof(bounds));
+      sensor_msgs::PointCloud2 quantized;
+      ros::serialization::IStream stream(&payload[sizeof(bounds)], payload.size() - sizeof(bounds));
+      ros::serialization::Serializer<sensor_msgs::PointCloud2>::read(stream, quantized);
+      unquantizePointCloud2(quantized, bounds, pc);
+    } else if (!payload.empty())
+    {
+      ros::serialization::IStream stream(&payload[0], payload.size());
+      ros::serialization::Serializer<sensor_msgs::PointCloud2>::read(stream, pc);
+    }
+  } else
+  {
+    // deserialize directly from the result field
+    ros::serialization::IStream stream((uint8_t *) bs.data(), bs.size());
+    ros::serialization::Serializer<sensor_msgs::PointCloud2>::read(stream, pc);
+  }
   return pc;
 }
 
 sensor_msgs::Image Client::extractImageFromBinaryString(const pqxx::binarystring &bs) const
 {
   sensor_msgs::Image image;
-  // deserialize from memory
-  ros::serialization::IStream stream((uint8_t *) bs.data(), bs.size());
-  ros::serialization::Serializer<sensor_msgs::Image>::read(stream, image);
+  // check for the encoded format
+  uint8_t flags;
+  vector<uint8_t> &payload = serialization_buffer_;
+  if (decompressPayload(bs.data(), bs.size(), flags, payload))
+  {
+    if (!payload.empty())
+    {
+      ros::serialization::IStream stream(&payload[0], payload.size());
+      ros::serialization::Serializer<sensor_msgs::Image>::read(stream, image);
+    }
+  } else
+  {
+    // deserialize directly from the result field
+    ros::serialization::IStream stream((uint8_t *) bs.data(), bs.size());
+    ros::serialization::Serializer<sensor_msgs::Image>::read(stream, image);
+  }
   return image;
 }
 
-vector<double> Client::extractArrayFromString(string &array) const
+size_t Client::extractArrayFromString(const char *array, double *values, const size_t max_values) const
 {
-  // to return
-  vector<double> values;
-
-  // remove the brackets and spaces
-  array.erase(remove(array.begin(), array.end(), '{'), array.end());
-  array.erase(remove(array.begin(), array.end(), '}'), array.end());
-  array.erase(remove(array.begin(), array.end(), ' '), array.end());
-
-  // split on the ','
-  stringstream ss(array);
-  string str;
-  double dbl;
-  while (getline(ss, str, ','))
+  // parse in place, skipping the brackets, separators, and any whitespace
+  size_t count = 0;
+  const char *cur = array;
+  while (*cur != '\0' && count < max_values)
   {
-    // store as the double value
-    istringstream i(str);
-    i >> dbl;
-    values.push_back(dbl);
+    if (*cur == '{' || *cur == '}' || *cur == ',' || *cur == ' ')
+    {
+      cur++;
+    } else
+    {
+      char *end;
+      const double value = strtod(cur, &end);
+      if (end == cur)
+      {
+        // not a number
+        break;
+      }
+      values[count++] = value;
+      cur = end;
+    }
   }
-
-  return values;
+  return count;
 }
 
 time_t Client::extractTimeFromString(const string &str) const
@@ -775,18 +1720,18 @@ string Client::toSQL(const Pose &p) const
 
 string Client::toSQL(const Position &p) const
 {
-  // build the SQL
-  stringstream ss;
-  ss << "{" << p.getX() << "," << p.getY() << "," << p.getZ() << "}";
-  return ss.str();
+  // build the SQL (17 significant digits round trip a double exactly)
+  char buffer[TO_SQL_BUFFER_SIZE];
+  snprintf(buffer, sizeof(buffer), "{%.17g,%.17g,%.17g}", p.getX(), p.getY(), p.getZ());
+  return string(buffer);
 }
 
 string Client::toSQL(const Orientation &o) const
 {
-  // build the SQL
-  stringstream ss;
-  ss << "{" << o.getX() << "," << o.getY() << ", " << o.getZ() << "," << o.getW() << "}";
-  return ss.str();
+  // build the SQL (17 significant digits round trip a double exactly)
+  char buffer[TO_SQL_BUFFER_SIZE];
+  snprintf(buffer, sizeof(buffer), "{%.17g,%.17g,%.17g,%.17g}", o.getX(), o.getY(), o.getZ(), o.getW());
+  return string(buffer);
 }
 
 // check API versions
@@ -796,32 +1741,46 @@ string Client::toSQL(const Orientation &o) const
 
 pqxx::binarystring Client::toBinaryString(const sensor_msgs::PointCloud2 &pc) const
 {
-  // determine the size for the buffer
-  uint32_t size = ros::serialization::serializationLength(pc);
-  uint8_t buffer[size];
+  if (binary_encoding_ != ENCODING_RAW)
+  {
+    // pack (and optionally quantize) the point cloud, quantization bounds come first
+    const bool quantize = (binary_encoding_ == ENCODING_QUANTIZED);
+    float bounds[2 * NUM_QUANTIZED_AXES];
+    packPointCloud2(pc, quantize, packed_point_cloud_, bounds);
+    const size_t offset = quantize ? sizeof(bounds) : 0;
+    serializeMessage(packed_point_cloud_, offset, serialization_buffer_);
+    if (quantize)
+    {
+      memcpy(&serialization_buffer_[0], bounds, sizeof(bounds));
+    }
 
-  // serilize the message
-  ros::serialization::OStream stream(buffer, size);
-  ros::serialization::serialize(stream, pc);
+    if (compressPayload(&serialization_buffer_[0], serialization_buffer_.size(),
+                        quantize ? ENCODED_QUANTIZED_FLAG : 0, encoding_buffer_))
+    {
+      return pqxx::binarystring(&encoding_buffer_[0], encoding_buffer_.size());
+    }
+    ROS_WARN("Point cloud compression failed, storing the raw point cloud.");
+  }
 
-  // construct a binary string
-  pqxx::binarystring binary(buffer, size);
-  return binary;
+  // serialize into the reusable heap buffer and construct a binary string
+  serializeMessage(pc, 0, serialization_buffer_);
+  return pqxx::binarystring(&serialization_buffer_[0], serialization_buffer_.size());
 }
 
 pqxx::binarystring Client::toBinaryString(const sensor_msgs::Image &image) const
 {
-  // determine the size for the buffer
-  uint32_t size = ros::serialization::serializationLength(image);
-  uint8_t buffer[size];
-
-  // serilize the message
-  ros::serialization::OStream stream(buffer, size);
-  ros::serialization::serialize(stream, image);
+  serializeMessage(image, 0, serialization_buffer_);
+  if (binary_encoding_ != ENCODING_RAW)
+  {
+    if (compressPayload(&serialization_buffer_[0], serialization_buffer_.size(), 0, encoding_buffer_))
+    {
+      return pqxx::binarystring(&encoding_buffer_[0], encoding_buffer_.size());
+    }
+    ROS_WARN("Image compression failed, storing the raw image.");
+  }
 
-  // construct a binary string
-  pqxx::binarystring binary(buffer, size);
-  return binary;
+  // construct a binary string from the reusable heap buffer
+  return pqxx::binarystring(&serialization_buffer_[0], serialization_buffer_.size());
 }
 
 #endif
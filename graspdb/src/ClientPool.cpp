@@ -0,0 +1,126 @@
+/*!
+ * \file ClientPool.cpp
+ * \brief A thread safe pool of grasp database clients.
+ *
+ * The client pool keeps a fixed number of grasp database clients, each with its own connection and prepared
+ * statements, that can be checked out and returned by concurrent callers.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// graspdb
+#include "graspdb/ClientPool.h"
+
+// ROS
+#include <ros/ros.h>
+
+using namespace std;
+using namespace rail::pick_and_place::graspdb;
+
+ClientPool::ScopedClient::ScopedClient(ClientPool &pool) : pool_(pool)
+{
+  client_ = pool_.checkout();
+}
+
+ClientPool::ScopedClient::~ScopedClient()
+{
+  pool_.release(client_);
+}
+
+Client &ClientPool::ScopedClient::operator*() const
+{
+  return *client_;
+}
+
+Client *ClientPool::ScopedClient::operator->() const
+{
+  return client_;
+}
+
+ClientPool::ClientPool(const string &host, const uint16_t port, const string &user, const string &password,
+    const string &db, const size_t num_connections)
+{
+  // always keep at least one client
+  const size_t size = (num_connections < 1) ? 1 : num_connections;
+  for (size_t i = 0; i < size; i++)
+  {
+    clients_.push_back(new Client(host, port, user, password, db));
+  }
+  available_ = clients_;
+}
+
+ClientPool::~ClientPool()
+{
+  // cleanup
+  for (size_t i = 0; i < clients_.size(); i++)
+  {
+    delete clients_[i];
+  }
+}
+
+size_t ClientPool::getNumConnections() const
+{
+  return clients_.size();
+}
+
+void ClientPool::setBinaryEncoding(const uint8_t binary_encoding)
+{
+  for (size_t i = 0; i < clients_.size(); i++)
+  {
+    clients_[i]->setBinaryEncoding(binary_encoding);
+  }
+}
+
+bool ClientPool::connect()
+{
+  bool okay = true;
+  for (size_t i = 0; i < clients_.size(); i++)
+  {
+    okay &= clients_[i]->connect();
+  }
+  return okay;
+}
+
+void ClientPool::disconnect()
+{
+  for (size_t i = 0; i < clients_.size(); i++)
+  {
+    clients_[i]->disconnect();
+  }
+}
+
+Client *ClientPool::checkout()
+{
+  Client *client;
+  {
+    // wait for a free client
+    boost::mutex::scoped_lock lock(mutex_);
+    while (available_.empty())
+    {
+      available_condition_.wait(lock);
+    }
+    client = available_.back();
+    available_.pop_back();
+  }
+
+  // reconnect outside of the lock so other callers are not blocked
+  if (!client->connected())
+  {
+    ROS_WARN("Grasp database connection lost, attempting to reconnect...");
+    if (client->connect())
+    {
+      ROS_INFO("Reconnected to the grasp database.");
+    }
+  }
+  return client;
+}
+
+void ClientPool::release(Client *client)
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    available_.push_back(client);
+  }
+  available_condition_.notify_one();
+}
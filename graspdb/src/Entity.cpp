@@ -11,6 +11,9 @@
 // graspdb
 #include "graspdb/Entity.h"
 
+// C++ Standard Library
+#include <algorithm>
+
 using namespace rail::pick_and_place::graspdb;
 
 Entity::Entity(const uint32_t id, const time_t created)
@@ -38,3 +41,9 @@ void Entity::setCreated(const time_t created)
 {
   created_ = created;
 }
+
+void Entity::swap(Entity &other)
+{
+  std::swap(id_, other.id_);
+  std::swap(created_, other.created_);
+}
@@ -14,6 +14,9 @@
 // graspdb
 #include "graspdb/Grasp.h"
 
+// C++ Standard Library
+#include <algorithm>
+
 using namespace std;
 using namespace rail::pick_and_place::graspdb;
 
@@ -106,6 +109,15 @@ double Grasp::getSuccessRate() const
   return (attempts_ == 0) ? 0 : ((double) successes_) / ((double) attempts_);
 }
 
+void Grasp::swap(Grasp &other)
+{
+  Entity::swap(other);
+  std::swap(grasp_model_id_, other.grasp_model_id_);
+  eef_frame_id_.swap(other.eef_frame_id_);
+  std::swap(grasp_pose_, other.grasp_pose_);
+  std::swap(successes_, other.successes_);
+  std::swap(attempts_, other.attempts_);
+}
 
 rail_pick_and_place_msgs::GraspWithSuccessRate Grasp::toROSGraspWithSuccessRateMessage() const
 {
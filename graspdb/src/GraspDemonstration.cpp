@@ -14,9 +14,52 @@
 // graspdb
 #include "graspdb/GraspDemonstration.h"
 
+// C++ Standard Library
+#include <algorithm>
+
 using namespace std;
 using namespace rail::pick_and_place::graspdb;
 
+/*!
+ * Swap the values of two point cloud messages without copying their fields or data.
+ *
+ * \param a The first point cloud message.
+ * \param b The second point cloud message.
+ */
+static void swapPointCloud(sensor_msgs::PointCloud2 &a, sensor_msgs::PointCloud2 &b)
+{
+  swap(a.header.seq, b.header.seq);
+  swap(a.header.stamp, b.header.stamp);
+  a.header.frame_id.swap(b.header.frame_id);
+  swap(a.height, b.height);
+  swap(a.width, b.width);
+  a.fields.swap(b.fields);
+  swap(a.is_bigendian, b.is_bigendian);
+  swap(a.point_step, b.point_step);
+  swap(a.row_step, b.row_step);
+  a.data.swap(b.data);
+  swap(a.is_dense, b.is_dense);
+}
+
+/*!
+ * Swap the values of two image messages without copying their data.
+ *
+ * \param a The first image message.
+ * \param b The second image message.
+ */
+static void swapImage(sensor_msgs::Image &a, sensor_msgs::Image &b)
+{
+  swap(a.header.seq, b.header.seq);
+  swap(a.header.stamp, b.header.stamp);
+  a.header.frame_id.swap(b.header.frame_id);
+  swap(a.height, b.height);
+  swap(a.width, b.width);
+  a.encoding.swap(b.encoding);
+  swap(a.is_bigendian, b.is_bigendian);
+  swap(a.step, b.step);
+  a.data.swap(b.data);
+}
+
 GraspDemonstration::GraspDemonstration(const uint32_t id, const string &object_name, const Pose &grasp_pose,
                                        const string &eef_frame_id, const sensor_msgs::PointCloud2 &point_cloud,
                                        const sensor_msgs::Image &image, const time_t created)
@@ -105,6 +148,17 @@ void GraspDemonstration::setImage(const sensor_msgs::Image &image)
   image_ = image;
 }
 
+void GraspDemonstration::swap(GraspDemonstration &other)
+{
+  Entity::swap(other);
+  object_name_.swap(other.object_name_);
+  eef_frame_id_.swap(other.eef_frame_id_);
+  // the pose is small, so it is simply exchanged by value
+  std::swap(grasp_pose_, other.grasp_pose_);
+  swapPointCloud(point_cloud_, other.point_cloud_);
+  swapImage(image_, other.image_);
+}
+
 rail_pick_and_place_msgs::GraspDemonstration GraspDemonstration::toROSGraspDemonstrationMessage() const
 {
   rail_pick_and_place_msgs::GraspDemonstration gd;
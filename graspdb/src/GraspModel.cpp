@@ -17,9 +17,33 @@
 // ROS
 #include <ros/ros.h>
 
+// C++ Standard Library
+#include <algorithm>
+
 using namespace std;
 using namespace rail::pick_and_place::graspdb;
 
+/*!
+ * Swap the values of two point cloud messages without copying their fields or data.
+ *
+ * \param a The first point cloud message.
+ * \param b The second point cloud message.
+ */
+static void swapPointCloud(sensor_msgs::PointCloud2 &a, sensor_msgs::PointCloud2 &b)
+{
+  swap(a.header.seq, b.header.seq);
+  swap(a.header.stamp, b.header.stamp);
+  a.header.frame_id.swap(b.header.frame_id);
+  swap(a.height, b.height);
+  swap(a.width, b.width);
+  a.fields.swap(b.fields);
+  swap(a.is_bigendian, b.is_bigendian);
+  swap(a.point_step, b.point_step);
+  swap(a.row_step, b.row_step);
+  a.data.swap(b.data);
+  swap(a.is_dense, b.is_dense);
+}
+
 GraspModel::GraspModel(const uint32_t id, const string &object_name, const vector<Grasp> &grasps,
     const sensor_msgs::PointCloud2 &point_cloud, const time_t created)
     : Entity(id, created),
@@ -275,6 +299,33 @@ sensor_msgs::PointCloud2 &GraspModel::getPointCloud()
 void GraspModel::setPointCloud(const sensor_msgs::PointCloud2 &point_cloud)
 {
   point_cloud_ = point_cloud;
+  features_.clear();
+}
+
+void GraspModel::releasePointCloud()
+{
+  // clearing the message would keep the capacity of its data
+  sensor_msgs::PointCloud2 empty;
+  swapPointCloud(point_cloud_, empty);
+}
+
+const vector<uint8_t> &GraspModel::getFeatures() const
+{
+  return features_;
+}
+
+void GraspModel::setFeatures(const vector<uint8_t> &features)
+{
+  features_ = features;
+}
+
+void GraspModel::swap(GraspModel &other)
+{
+  Entity::swap(other);
+  object_name_.swap(other.object_name_);
+  grasps_.swap(other.grasps_);
+  swapPointCloud(point_cloud_, other.point_cloud_);
+  features_.swap(other.features_);
 }
 
 rail_pick_and_place_msgs::GraspModel GraspModel::toROSGraspModelMessage() const
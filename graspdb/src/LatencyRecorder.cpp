@@ -0,0 +1,147 @@
+/*!
+ * \file LatencyRecorder.cpp
+ * \brief A thread safe set of latency histograms for named stages.
+ *
+ * The latency recorder aggregates the duration of named stages (e.g., database loads or registration steps) into
+ * fixed size histograms that can be summarized and published periodically.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// graspdb
+#include "graspdb/LatencyRecorder.h"
+
+// C++ Standard Library
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace rail::pick_and_place::graspdb;
+
+LatencyRecorder::ScopedTimer::ScopedTimer(LatencyRecorder *recorder, const size_t stage)
+    : recorder_(recorder), stage_(stage)
+{
+  if (recorder_ != NULL)
+  {
+    start_ = ros::WallTime::now();
+  }
+}
+
+LatencyRecorder::ScopedTimer::~ScopedTimer()
+{
+  if (recorder_ != NULL)
+  {
+    recorder_->record(stage_, (ros::WallTime::now() - start_).toSec());
+  }
+}
+
+LatencyRecorder::LatencyRecorder()
+{
+}
+
+size_t LatencyRecorder::addStage(const string &name)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  for (size_t i = 0; i < stages_.size(); i++)
+  {
+    if (stages_[i].name == name)
+    {
+      return i;
+    }
+  }
+
+  Stage stage;
+  stage.name = name;
+  LatencyRecorder::clearStage(stage);
+  stages_.push_back(stage);
+  return stages_.size() - 1;
+}
+
+void LatencyRecorder::record(const size_t stage, const double seconds)
+{
+  // find the bucket outside of the lock
+  const double microseconds = seconds * 1e6;
+  size_t bucket = 0;
+  if (microseconds >= 1.0)
+  {
+    const double index = floor(BUCKETS_PER_OCTAVE * log(microseconds) / log(2.0));
+    bucket = (size_t) min(index, (double) (NUM_BUCKETS - 1));
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  if (stage < stages_.size())
+  {
+    Stage &s = stages_[stage];
+    s.count++;
+    s.total += seconds;
+    s.max = max(s.max, seconds);
+    s.buckets[bucket]++;
+  }
+}
+
+void LatencyRecorder::getStatistics(vector<Statistics> &statistics, const bool reset)
+{
+  statistics.clear();
+  boost::mutex::scoped_lock lock(mutex_);
+  for (size_t i = 0; i < stages_.size(); i++)
+  {
+    Stage &stage = stages_[i];
+    if (stage.count > 0)
+    {
+      Statistics s;
+      s.name = stage.name;
+      s.count = stage.count;
+      s.mean = 1000.0 * stage.total / stage.count;
+      s.p50 = LatencyRecorder::findPercentile(stage, 0.5);
+      s.p90 = LatencyRecorder::findPercentile(stage, 0.9);
+      s.p99 = LatencyRecorder::findPercentile(stage, 0.99);
+      s.max = 1000.0 * stage.max;
+      statistics.push_back(s);
+    }
+
+    if (reset)
+    {
+      LatencyRecorder::clearStage(stage);
+    }
+  }
+}
+
+void LatencyRecorder::reset()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  for (size_t i = 0; i < stages_.size(); i++)
+  {
+    LatencyRecorder::clearStage(stages_[i]);
+  }
+}
+
+void LatencyRecorder::clearStage(Stage &stage)
+{
+  stage.count = 0;
+  stage.total = 0;
+  stage.max = 0;
+  fill(stage.buckets, stage.buckets + NUM_BUCKETS, 0);
+}
+
+double LatencyRecorder::findPercentile(const Stage &stage, const double fraction)
+{
+  // the rank of the sample (1-based)
+  const uint64_t rank = max((uint64_t) ceil(fraction * stage.count), (uint64_t) 1);
+  uint64_t seen = 0;
+  for (size_t i = 0; i < NUM_BUCKETS; i++)
+  {
+    seen += stage.buckets[i];
+    if (seen >= rank)
+    {
+      // bucket bounds are in microseconds
+      return min(LatencyRecorder::getBucketUpperBound(i) / 1000.0, 1000.0 * stage.max);
+    }
+  }
+  return 1000.0 * stage.max;
+}
+
+double LatencyRecorder::getBucketUpperBound(const size_t bucket)
+{
+  return pow(2.0, (double) (bucket + 1) / BUCKETS_PER_OCTAVE);
+}
@@ -0,0 +1,42 @@
+/*!
+ * \file Summary.cpp
+ * \brief Lightweight grasp demonstration or grasp model information.
+ *
+ * A summary contains only the metadata of a grasp demonstration or grasp model: the ID, object name, number of grasps,
+ * and created timestamp. No point cloud or image data is included, making summaries cheap to load for listings.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// graspdb
+#include "graspdb/Summary.h"
+
+using namespace std;
+using namespace rail::pick_and_place::graspdb;
+
+Summary::Summary(const uint32_t id, const string &object_name, const uint32_t num_grasps, const time_t created)
+    : Entity(id, created), object_name_(object_name)
+{
+  num_grasps_ = num_grasps;
+}
+
+const string &Summary::getObjectName() const
+{
+  return object_name_;
+}
+
+void Summary::setObjectName(const string &object_name)
+{
+  object_name_ = object_name;
+}
+
+uint32_t Summary::getNumGrasps() const
+{
+  return num_grasps_;
+}
+
+void Summary::setNumGrasps(const uint32_t num_grasps)
+{
+  num_grasps_ = num_grasps;
+}
@@ -0,0 +1,124 @@
+/*!
+ * \file DemonstrationWriter.h
+ * \brief A background writer for grasp demonstrations.
+ *
+ * The demonstration writer stores grasp demonstrations in the grasp database from a background thread using a bounded
+ * queue so callers are not blocked by serialization and insertion.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_DEMONSTRATION_WRITER_H_
+#define RAIL_PICK_AND_PLACE_DEMONSTRATION_WRITER_H_
+
+// ROS
+#include <graspdb/graspdb.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+// C++ Standard Library
+#include <deque>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class DemonstrationWriter
+ * \brief A background writer for grasp demonstrations.
+ *
+ * The demonstration writer stores grasp demonstrations in the grasp database from a background thread using a bounded
+ * queue so callers are not blocked by serialization and insertion. Once created, the grasp database client is only
+ * used by the writer thread.
+ */
+class DemonstrationWriter : private boost::noncopyable
+{
+public:
+  /*! The default maximum number of queued grasp demonstrations. */
+  static const int DEFAULT_MAX_QUEUE_SIZE = 4;
+
+  /*!
+   * \brief Create a DemonstrationWriter.
+   *
+   * Creates a DemonstrationWriter and starts the writer thread.
+   *
+   * \param graspdb The connected grasp database client to write with.
+   * \param max_queue_size The maximum number of queued grasp demonstrations (defaults to 4, at least 1 is used).
+   */
+  DemonstrationWriter(graspdb::Client &graspdb, const int max_queue_size = DEFAULT_MAX_QUEUE_SIZE);
+
+  /*!
+   * \brief Cleans up a DemonstrationWriter.
+   *
+   * Finishes writing every queued grasp demonstration and stops the writer thread.
+   */
+  virtual ~DemonstrationWriter();
+
+  /*!
+   * \brief Queue size accessor.
+   *
+   * Get the number of grasp demonstrations waiting to be written.
+   *
+   * \return The number of grasp demonstrations waiting to be written.
+   */
+  size_t getQueueSize() const;
+
+  /*!
+   * \brief Queue a grasp demonstration to be written.
+   *
+   * Queue the grasp demonstration to be written by the writer thread, blocking while the queue is full. The data is
+   * swapped into the queue rather than copied, so the given grasp demonstration is left empty.
+   *
+   * \param gd The grasp demonstration to write (emptied).
+   * \return A future with the ID of the stored grasp demonstration, or 0 if the insert failed.
+   */
+  boost::shared_future<uint32_t> write(graspdb::GraspDemonstration &gd);
+
+private:
+  /*!
+   * \struct Request
+   * \brief A queued grasp demonstration and the promise for its ID.
+   */
+  struct Request
+  {
+    /*! The grasp demonstration to write. */
+    graspdb::GraspDemonstration gd;
+    /*! The promise for the ID of the stored grasp demonstration. */
+    boost::shared_ptr<boost::promise<uint32_t> > id;
+  };
+
+  /*!
+   * \brief The main writer thread loop.
+   *
+   * Writes queued grasp demonstrations until the writer is shut down and the queue is empty.
+   */
+  void writerLoop();
+
+  /*! The grasp database connection. */
+  graspdb::Client &graspdb_;
+  /*! The maximum number of queued grasp demonstrations. */
+  size_t max_queue_size_;
+  /*! The queued grasp demonstrations. */
+  std::deque<Request> queue_;
+  /*! Mutex for the queue. */
+  mutable boost::mutex mutex_;
+  /*! Signals for a non-empty and a non-full queue. */
+  boost::condition_variable not_empty_condition_, not_full_condition_;
+  /*! If the writer thread should exit once the queue is empty. */
+  bool shutdown_;
+  /*! The writer thread. */
+  boost::thread thread_;
+};
+
+}
+}
+
+#endif
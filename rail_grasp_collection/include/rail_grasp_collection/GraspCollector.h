@@ -13,6 +13,9 @@
 #ifndef RAIL_PICK_AND_PLACE_GRASP_COLLECTOR_H_
 #define RAIL_PICK_AND_PLACE_GRASP_COLLECTOR_H_
 
+// RAIL Grasp Collection
+#include "DemonstrationWriter.h"
+
 // ROS
 #include <actionlib/client/simple_action_client.h>
 #include <actionlib/server/simple_action_server.h>
@@ -24,7 +27,6 @@
 #include <rail_manipulation_msgs/VerifyGraspAction.h>
 #include <rail_pick_and_place_msgs/GraspAndStoreAction.h>
 #include <ros/ros.h>
-#include <sensor_msgs/point_cloud_conversion.h>
 #include <tf2_ros/transform_listener.h>
 
 // Boost
@@ -47,16 +49,24 @@ class GraspCollector
 public:
   /*! If a topic should be created to display debug information such as point clouds. */
   static const bool DEFAULT_DEBUG = false;
+  /*! If the action should finish before the grasp demonstration is stored in the database. */
+  static const bool DEFAULT_ASYNC_STORE = false;
+  /*! The default number of objects closest by centroid to check point by point (less than 1 checks every object). */
+  static const int DEFAULT_CLOSEST_OBJECT_CANDIDATES = 3;
   /*! The default wait time for action servers in seconds. */
   static const int AC_WAIT_TIME = 10;
 
   /*!
    * \brief Create a GraspCollector and associated ROS information.
    *
-   * Creates a ROS node handle, subscribes to the relevant topics and servers, and creates a client to the grasp
-   * database.
+   * Subscribes to the relevant topics and servers with the given node handles and creates a client to the grasp
+   * database. The node handles allow the collector to run inside a nodelet.
+   *
+   * \param node The public node handle to use (defaults to the global namespace).
+   * \param private_node The private node handle to use for parameters and advertised servers (defaults to "~").
    */
-  GraspCollector();
+  GraspCollector(const ros::NodeHandle &node = ros::NodeHandle(),
+      const ros::NodeHandle &private_node = ros::NodeHandle("~"));
 
   /*!
    * \brief Cleans up a GraspCollector.
@@ -85,6 +95,34 @@ private:
    */
   void graspAndStore(const rail_pick_and_place_msgs::GraspAndStoreGoalConstPtr &goal);
 
+  /*!
+   * \brief Prepare the grasp demonstration of the closest segmented object.
+   *
+   * Captures the segmented object closest to the end effector, transforms its point cloud into the robot fixed frame,
+   * and builds the grasp demonstration to store. The point cloud and image are copied once, straight from the shared
+   * object list into the demonstration. This runs while the grasp verification is still executing so the demonstration
+   * can be written as soon as the verification returns.
+   *
+   * \param object_name The name of the object grasped.
+   * \param grasp The grasp pose in the robot fixed frame.
+   * \param gd The grasp demonstration to fill.
+   * \param error The reason the grasp demonstration could not be prepared (set on failure).
+   * \return True if the grasp demonstration was prepared.
+   */
+  bool prepareGraspDemonstration(const std::string &object_name, const geometry_msgs::TransformStamped &grasp,
+      graspdb::GraspDemonstration &gd, std::string &error);
+
+  /*!
+   * \brief Find the segmented object closest to the end effector.
+   *
+   * Ranks the objects by the distance from the end effector to their centroids and then checks every point of the
+   * closest candidates to find the object with the closest point.
+   *
+   * \param object_list The segmented objects to search.
+   * \return The index of the closest object or -1 if no end effector transform was found.
+   */
+  int findClosestObject(const rail_manipulation_msgs::SegmentedObjectList &object_list);
+
   /*!
    * \brief Callback for the segmented objects topic.
    *
@@ -92,17 +130,21 @@ private:
    *
    * \param object_list The object list returned from the segmented objects topic.
    */
-  void segmentedObjectsCallback(const rail_manipulation_msgs::SegmentedObjectList::Ptr &object_list);
+  void segmentedObjectsCallback(const rail_manipulation_msgs::SegmentedObjectList::ConstPtr &object_list);
 
   /*! Mutex for locking on the segmented object list. */
   boost::mutex mutex_;
 
-  /*! The debug and okay check flags. */
-  bool debug_, okay_;
+  /*! The debug, asynchronous store, and okay check flags. */
+  bool debug_, async_store_, okay_;
+  /*! The number of objects closest by centroid to check point by point. */
+  int closest_object_candidates_;
   /*! Frame IDs to use. */
   std::string robot_fixed_frame_id_, eef_frame_id_;
   /*! The grasp database connection. */
   graspdb::Client *graspdb_;
+  /*! The background writer for the grasp database (the only user of the connection after initialization). */
+  DemonstrationWriter *writer_;
 
   /*! The public and private ROS node handles. */
   ros::NodeHandle node_, private_node_;
@@ -111,7 +153,7 @@ private:
   /*! The listener for the segmented objects. */
   ros::Subscriber segmented_objects_sub_;
   /*! The most recent segmented objects. */
-  rail_manipulation_msgs::SegmentedObjectList::Ptr object_list_;
+  rail_manipulation_msgs::SegmentedObjectList::ConstPtr object_list_;
   /*! The main grasp collection action server. */
   actionlib::SimpleActionServer<rail_pick_and_place_msgs::GraspAndStoreAction> as_;
   /*! The gripper action client. */
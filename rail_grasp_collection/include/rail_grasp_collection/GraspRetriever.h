@@ -14,7 +14,7 @@
 #define RAIL_PICK_AND_PLACE_GRASP_RETRIEVER_H_
 
 // ROS
-#include <actionlib/server/simple_action_server.h>
+#include <actionlib/server/action_server.h>
 #include <graspdb/graspdb.h>
 #include <rail_pick_and_place_msgs/RetrieveGraspDemonstrationAction.h>
 #include <ros/ros.h>
@@ -29,15 +29,21 @@ namespace pick_and_place
  * \brief The grasp retriever node object.
  *
  * The grasp retriever allows for loading stored grasps from the grasp database training set. An action server is
- * started as the main entry point to grasp retrieval.
+ * started as the main entry point to grasp retrieval. Goals are queued and served concurrently by a set of goal
+ * threads. A database connection is not thread safe, so each goal checks a connection out of a pool with one
+ * connection for each goal thread (lost connections are reconnected when they are checked out).
  */
 class GraspRetriever
 {
 public:
+  /*! The default number of retrieval goals served concurrently. */
+  static const int DEFAULT_NUM_GOAL_THREADS = 4;
+
   /*!
    * \brief Create a GraspRetriever and associated ROS information.
    *
-   * Creates a ROS node handle, creates a client to the grasp database, and starts the action server.
+   * Creates a ROS node handle, creates a pool of grasp database clients with one client for each goal thread, and
+   * starts the goal threads and action server.
    */
   GraspRetriever();
 
@@ -58,24 +64,33 @@ public:
   bool okay() const;
 
 private:
+  /*! The retrieve grasp action server goal handle. */
+  typedef actionlib::ActionServer<rail_pick_and_place_msgs::RetrieveGraspDemonstrationAction>::GoalHandle GoalHandle;
+  /*! The queue of retrieve grasp goals. */
+  typedef graspdb::GoalQueue<GoalHandle, rail_pick_and_place_msgs::RetrieveGraspDemonstrationResult> GoalQueue;
+
   /*!
-   * \brief Callback for the retrieve grasp action server.
+   * \brief Retrieve the grasp demonstration of a goal.
    *
-   * The retrieve grasp action will attempt to load a stored grasp demonstration from the grasp database.
+   * The retrieve grasp action will attempt to load a stored grasp demonstration from the grasp database with a client
+   * checked out of the pool. The goal must be accepted.
    *
-   * \param goal The goal object specifying the parameters.
+   * \param goal_handle The handle of the goal specifying the parameters.
    */
-  void retrieveGrasp(const rail_pick_and_place_msgs::RetrieveGraspDemonstrationGoalConstPtr &goal);
+  void retrieveGrasp(GoalHandle &goal_handle);
 
   /*! The okay check flag. */
   bool okay_;
-  /*! The grasp database connection. */
-  graspdb::Client *graspdb_;
+  /*! The grasp database connections shared by the goal threads. */
+  graspdb::ClientPool *graspdb_pool_;
+
+  /*! The goals waiting for a goal thread. */
+  GoalQueue goal_queue_;
 
   /*! The public and private ROS node handles. */
   ros::NodeHandle node_, private_node_;
   /*! The main action server. */
-  actionlib::SimpleActionServer<rail_pick_and_place_msgs::RetrieveGraspDemonstrationAction> as_;
+  actionlib::ActionServer<rail_pick_and_place_msgs::RetrieveGraspDemonstrationAction> as_;
   /*! The latched publishers for retrieved data. */
   ros::Publisher point_cloud_pub_, pose_pub_;
 };
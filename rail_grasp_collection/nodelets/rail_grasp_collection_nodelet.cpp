@@ -0,0 +1,58 @@
+/*!
+ * \file rail_grasp_collection_nodelet.cpp
+ * \brief The grasp collector nodelet.
+ *
+ * Runs the grasp collector inside a nodelet manager so segmented objects are shared by pointer with no serialization or
+ * copy.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Grasp Collection
+#include "rail_grasp_collection/GraspCollector.h"
+
+// ROS
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class GraspCollectorNodelet
+ * \brief The grasp collector nodelet.
+ *
+ * Runs the grasp collector inside a nodelet manager so segmented objects are shared by pointer with no serialization or
+ * copy.
+ */
+class GraspCollectorNodelet : public nodelet::Nodelet
+{
+private:
+  /*!
+   * \brief Initialize the nodelet.
+   *
+   * Creates the GraspCollector with the node handles of this nodelet.
+   */
+  virtual void onInit()
+  {
+    collector_.reset(new GraspCollector(this->getNodeHandle(), this->getPrivateNodeHandle()));
+    if (!collector_->okay())
+    {
+      NODELET_ERROR("GraspCollector could not be initialized.");
+    }
+  }
+
+  /*! The grasp collector. */
+  boost::shared_ptr<GraspCollector> collector_;
+};
+
+}
+}
+
+PLUGINLIB_EXPORT_CLASS(rail::pick_and_place::GraspCollectorNodelet, nodelet::Nodelet)
@@ -0,0 +1,115 @@
+/*!
+ * \file DemonstrationWriter.cpp
+ * \brief A background writer for grasp demonstrations.
+ *
+ * The demonstration writer stores grasp demonstrations in the grasp database from a background thread using a bounded
+ * queue so callers are not blocked by serialization and insertion.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Grasp Collection
+#include "rail_grasp_collection/DemonstrationWriter.h"
+
+// ROS
+#include <ros/ros.h>
+
+// Boost
+#include <boost/bind.hpp>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+DemonstrationWriter::DemonstrationWriter(graspdb::Client &graspdb, const int max_queue_size)
+    : graspdb_(graspdb)
+{
+  max_queue_size_ = (max_queue_size < 1) ? 1 : max_queue_size;
+  shutdown_ = false;
+  thread_ = boost::thread(boost::bind(&DemonstrationWriter::writerLoop, this));
+}
+
+DemonstrationWriter::~DemonstrationWriter()
+{
+  // let the writer finish the queue
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    shutdown_ = true;
+  }
+  not_empty_condition_.notify_all();
+  thread_.join();
+}
+
+size_t DemonstrationWriter::getQueueSize() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return queue_.size();
+}
+
+boost::shared_future<uint32_t> DemonstrationWriter::write(graspdb::GraspDemonstration &gd)
+{
+  boost::shared_ptr<boost::promise<uint32_t> > promise(new boost::promise<uint32_t>());
+  boost::shared_future<uint32_t> id(promise->get_future());
+
+  // wait for room in the queue
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (queue_.size() >= max_queue_size_)
+    {
+      not_full_condition_.wait(lock);
+    }
+    // queue an empty request and hand the data over without copying it
+    queue_.push_back(Request());
+    queue_.back().gd.swap(gd);
+    queue_.back().id = promise;
+  }
+  not_empty_condition_.notify_one();
+
+  return id;
+}
+
+void DemonstrationWriter::writerLoop()
+{
+  while (true)
+  {
+    // wait for a grasp demonstration
+    Request request;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!shutdown_ && queue_.empty())
+      {
+        not_empty_condition_.wait(lock);
+      }
+      if (queue_.empty())
+      {
+        // shut down with nothing left to write
+        return;
+      }
+      // take the data out of the queue without copying it
+      request.gd.swap(queue_.front().gd);
+      request.id = queue_.front().id;
+      queue_.pop_front();
+    }
+    not_full_condition_.notify_one();
+
+    // store the data (a database error must not stop the writer thread)
+    bool stored = false;
+    try
+    {
+      stored = graspdb_.addGraspDemonstration(request.gd);
+    } catch (const exception &e)
+    {
+      ROS_ERROR("%s", e.what());
+    }
+
+    if (stored)
+    {
+      ROS_INFO("Stored grasp demonstration %u.", request.gd.getID());
+      request.id->set_value(request.gd.getID());
+    } else
+    {
+      ROS_ERROR("Could not insert the grasp demonstration into the database.");
+      request.id->set_value(graspdb::Entity::UNSET_ID);
+    }
+  }
+}
@@ -14,18 +14,26 @@
 #include "rail_grasp_collection/GraspCollector.h"
 
 // ROS
+#include <sensor_msgs/point_cloud2_iterator.h>
 #include <tf2_sensor_msgs/tf2_sensor_msgs.h>
 
+// C++ Standard Library
+#include <algorithm>
+#include <map>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
-GraspCollector::GraspCollector()
-    : private_node_("~"), ac_wait_time_(AC_WAIT_TIME), tf_listener_(tf_buffer_),
+GraspCollector::GraspCollector(const ros::NodeHandle &node, const ros::NodeHandle &private_node)
+    : node_(node), private_node_(private_node), ac_wait_time_(AC_WAIT_TIME), tf_listener_(tf_buffer_),
       robot_fixed_frame_id_("base_footprint"), eef_frame_id_("eef_link"),
       as_(private_node_, "grasp_and_store", boost::bind(&GraspCollector::graspAndStore, this, _1), false)
 {
   // set defaults
   debug_ = DEFAULT_DEBUG;
+  async_store_ = DEFAULT_ASYNC_STORE;
+  int max_store_queue_size = DemonstrationWriter::DEFAULT_MAX_QUEUE_SIZE;
+  closest_object_candidates_ = DEFAULT_CLOSEST_OBJECT_CANDIDATES;
   int port = graspdb::Client::DEFAULT_PORT;
   string segmented_objects_topic("/segmentation/segmented_objects");
   string gripper_action_server("/manipulation/gripper");
@@ -35,9 +43,13 @@ GraspCollector::GraspCollector()
   string user("ros");
   string password("");
   string db("graspdb");
+  int binary_encoding = graspdb::Client::ENCODING_RAW;
 
   // grab any parameters we need
   private_node_.getParam("debug", debug_);
+  private_node_.getParam("async_store", async_store_);
+  private_node_.getParam("max_store_queue_size", max_store_queue_size);
+  private_node_.getParam("closest_object_candidates", closest_object_candidates_);
   private_node_.getParam("robot_fixed_frame_id", robot_fixed_frame_id_);
   private_node_.getParam("eef_frame_id", eef_frame_id_);
   private_node_.getParam("segmented_objects_topic", segmented_objects_topic);
@@ -49,10 +61,13 @@ GraspCollector::GraspCollector()
   node_.getParam("/graspdb/user", user);
   node_.getParam("/graspdb/password", password);
   node_.getParam("/graspdb/db", db);
+  node_.getParam("/graspdb/binary_encoding", binary_encoding);
 
   // set up a connection to the grasp database
   graspdb_ = new graspdb::Client(host, port, user, password, db);
+  graspdb_->setBinaryEncoding(binary_encoding);
   okay_ = graspdb_->connect();
+  writer_ = new DemonstrationWriter(*graspdb_, max_store_queue_size);
 
   // setup a debug publisher if we need it
   if (debug_)
@@ -84,6 +99,8 @@ GraspCollector::~GraspCollector()
 {
   // cleanup
   as_.shutdown();
+  // finishes any queued writes
+  delete writer_;
   graspdb_->disconnect();
   delete gripper_ac_;
   delete lift_ac_;
@@ -157,14 +174,25 @@ void GraspCollector::graspAndStore(const rail_pick_and_place_msgs::GraspAndStore
     }
   }
 
-  // check if we are doing a grasp verification check
+  // start the grasp verification without waiting so the grasp data is prepared while the arm is busy
   if (goal->verify)
   {
-    // request a grasp verification from the arm
     feedback.message = "Requesting grasp verification...";
     as_.publishFeedback(feedback);
     rail_manipulation_msgs::VerifyGraspGoal verify_grasp_goal;
     verify_grasp_ac_->sendGoal(verify_grasp_goal);
+  }
+
+  // the arm is done moving the object, so it is captured while the verification runs
+  feedback.message = "Searching for the closest segmented object...";
+  as_.publishFeedback(feedback);
+  graspdb::GraspDemonstration gd;
+  string prepare_error;
+  const bool prepared = this->prepareGraspDemonstration(goal->object_name, grasp, gd, prepare_error);
+
+  // a failed verification takes priority since it would have stopped the collection first
+  if (goal->verify)
+  {
     completed = verify_grasp_ac_->waitForResult(ac_wait_time_);
     succeeded = (verify_grasp_ac_->getState() == actionlib::SimpleClientGoalState::SUCCEEDED);
     rail_manipulation_msgs::VerifyGraspResultConstPtr verify_result = verify_grasp_ac_->getResult();
@@ -179,95 +207,174 @@ void GraspCollector::graspAndStore(const rail_pick_and_place_msgs::GraspAndStore
       return;
     }
   }
+  if (!prepared)
+  {
+    as_.setSucceeded(result, prepare_error);
+    return;
+  }
 
-  // check for the closest object
-  feedback.message = "Searching for the closest segmented object...";
+  // the prepared data is swapped into the background writer queue (gd is left empty)
+  feedback.message = "Storing grasp data...";
   as_.publishFeedback(feedback);
-  // lock for the vector
+  boost::shared_future<uint32_t> id = writer_->write(gd);
+  if (!async_store_)
   {
-    boost::mutex::scoped_lock lock(mutex_);
-    // check if we actually have some objects
-    int closest = 0;
-    if (object_list_->objects.size() == 0)
+    // wait for the stored ID
+    result.id = id.get();
+    if (result.id == graspdb::Entity::UNSET_ID)
     {
-      as_.setSucceeded(result, "No segmented objects found.");
+      as_.setSucceeded(result, "Could not insert into database.");
       return;
-    } else if (object_list_->objects.size() > 1)
+    }
+  }
+
+  // success
+  result.success = true;
+  as_.setSucceeded(result, "Success!");
+}
+
+bool GraspCollector::prepareGraspDemonstration(const string &object_name, const geometry_msgs::TransformStamped &grasp,
+    graspdb::GraspDemonstration &gd, string &error)
+{
+  // only lock long enough to grab the current list (the callback replaces the list instead of modifying it)
+  rail_manipulation_msgs::SegmentedObjectList::ConstPtr object_list;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    object_list = object_list_;
+  }
+
+  // check if we actually have some objects
+  if (!object_list || object_list->objects.size() == 0)
+  {
+    error = "No segmented objects found.";
+    return false;
+  }
+  const int closest = this->findClosestObject(*object_list);
+  if (closest < 0)
+  {
+    error = "Could not find the closest segmented object.";
+    return false;
+  }
+  // the point cloud and image are copied straight from the shared list into the demonstration (never modified)
+  const rail_manipulation_msgs::SegmentedObject &object = object_list->objects[closest];
+  // check if we need to transform the point cloud
+  if (object.point_cloud.header.frame_id != robot_fixed_frame_id_)
+  {
+    try
     {
-      // find the closest point
-      float min = numeric_limits<float>::infinity();
-      //geometry_msgs::Vector3 &v = grasp.transform.translation;
-      // check each segmented object
-      for (size_t i = 0; i < object_list_->objects.size(); i++)
-      {
-        geometry_msgs::TransformStamped eef_transform = tf_buffer_.lookupTransform(
-            object_list_->objects[i].point_cloud.header.frame_id, eef_frame_id_, ros::Time(0)
-        );
-        geometry_msgs::Vector3 &v = eef_transform.transform.translation;
-        //convert PointCloud2 to PointCloud to access the data easily
-        sensor_msgs::PointCloud cloud;
-        sensor_msgs::convertPointCloud2ToPointCloud(object_list_->objects[i].point_cloud, cloud);
-        // check each point in the cloud
-        for (size_t j = 0; j < cloud.points.size(); j++)
-        {
-          // euclidean distance to the point
-          float dist = sqrt(
-              pow(cloud.points[j].x - v.x, 2) + pow(cloud.points[j].y - v.y, 2) + pow(cloud.points[j].z - v.z, 2)
-          );
-          if (dist < min)
-          {
-            min = dist;
-            closest = i;
-          }
-        }
-      }
+      tf_buffer_.transform(object.point_cloud, gd.getPointCloud(), robot_fixed_frame_id_, ros::Time(0),
+                           object.point_cloud.header.frame_id);
+      gd.getPointCloud().header.frame_id = robot_fixed_frame_id_;
+    } catch (tf2::TransformException &ex)
+    {
+      ROS_WARN("%s", ex.what());
+      error = "Could not transform the segemented object to the robot fixed frame.";
+      return false;
     }
-    // check if we need to transform the point cloud
-    rail_manipulation_msgs::SegmentedObject &object = object_list_->objects[closest];
-    if (object.point_cloud.header.frame_id != robot_fixed_frame_id_)
+  } else
+  {
+    gd.setPointCloud(object.point_cloud);
+  }
+  // check if we are going to publish some debug info
+  if (debug_)
+  {
+    debug_pub_.publish(gd.getPointCloud());
+  }
+
+  // the writer takes the demonstration over with a swap, so these are the only copies of the point cloud and image
+  gd.setObjectName(object_name);
+  gd.setGraspPose(graspdb::Pose(grasp));
+  gd.setEefFrameID(eef_frame_id_);
+  gd.setImage(object.image);
+  return true;
+}
+
+/*!
+ * \brief Squared distance from an end effector position to the closest point of a point cloud.
+ *
+ * Reads the XYZ fields of the point cloud directly without any conversion.
+ *
+ * \param pc The point cloud to check.
+ * \param v The end effector position in the frame of the point cloud.
+ * \return The squared distance to the closest point (infinity if the point cloud is empty).
+ */
+static double squaredDistanceToPointCloud(const sensor_msgs::PointCloud2 &pc, const geometry_msgs::Vector3 &v)
+{
+  double min = numeric_limits<double>::infinity();
+  if (pc.width * pc.height == 0)
+  {
+    return min;
+  }
+  for (sensor_msgs::PointCloud2ConstIterator<float> it(pc, "x"); it != it.end(); ++it)
+  {
+    const double dx = it[0] - v.x;
+    const double dy = it[1] - v.y;
+    const double dz = it[2] - v.z;
+    min = std::min(min, dx * dx + dy * dy + dz * dz);
+  }
+  return min;
+}
+
+int GraspCollector::findClosestObject(const rail_manipulation_msgs::SegmentedObjectList &object_list)
+{
+  // check for the simple case
+  if (object_list.objects.size() == 1)
+  {
+    return 0;
+  }
+
+  // find the end effector in each point cloud frame (objects normally share a frame, so look it up once per frame)
+  map<string, geometry_msgs::Vector3> eef_positions;
+  vector<pair<double, size_t> > ranked;
+  for (size_t i = 0; i < object_list.objects.size(); i++)
+  {
+    const rail_manipulation_msgs::SegmentedObject &object = object_list.objects[i];
+    const string &frame_id = object.point_cloud.header.frame_id;
+    if (eef_positions.find(frame_id) == eef_positions.end())
     {
       try
       {
-        sensor_msgs::PointCloud2 transformed_cloud = tf_buffer_.transform(object.point_cloud, robot_fixed_frame_id_,
-                                                                          ros::Time(0),
-                                                                          object.point_cloud.header.frame_id);
-        object.point_cloud = transformed_cloud;
-        object.point_cloud.header.frame_id = robot_fixed_frame_id_;
+        geometry_msgs::TransformStamped eef_transform = tf_buffer_.lookupTransform(frame_id, eef_frame_id_,
+                                                                                   ros::Time(0));
+        eef_positions[frame_id] = eef_transform.transform.translation;
       } catch (tf2::TransformException &ex)
       {
         ROS_WARN("%s", ex.what());
-        as_.setSucceeded(result, "Could not transform the segemented object to the robot fixed frame.");
-        return;
+        continue;
       }
     }
-    // check if we are going to publish some debug info
-    if (debug_)
-    {
-      debug_pub_.publish(object.point_cloud);
-    }
 
-    // store the data
-    feedback.message = "Storing grasp data...";
-    as_.publishFeedback(feedback);
-    graspdb::GraspDemonstration gd(goal->object_name, graspdb::Pose(grasp), eef_frame_id_, object.point_cloud,
-                                   object.image);
-    if (graspdb_->addGraspDemonstration(gd))
-    {
-      // store the ID
-      result.id = gd.getID();
-    } else
+    // rank by the squared distance to the centroid
+    const geometry_msgs::Vector3 &v = eef_positions[frame_id];
+    const double dx = object.centroid.x - v.x;
+    const double dy = object.centroid.y - v.y;
+    const double dz = object.centroid.z - v.z;
+    ranked.push_back(make_pair(dx * dx + dy * dy + dz * dz, i));
+  }
+  sort(ranked.begin(), ranked.end());
+
+  // only check every point of the closest few candidates
+  const size_t num_candidates = (closest_object_candidates_ < 1) ? ranked.size()
+                                                                 : min((size_t) closest_object_candidates_,
+                                                                       ranked.size());
+  int closest = -1;
+  double min = numeric_limits<double>::infinity();
+  for (size_t i = 0; i < num_candidates; i++)
+  {
+    const rail_manipulation_msgs::SegmentedObject &object = object_list.objects[ranked[i].second];
+    const double distance = squaredDistanceToPointCloud(object.point_cloud,
+                                                        eef_positions[object.point_cloud.header.frame_id]);
+    if (closest < 0 || distance < min)
     {
-      as_.setSucceeded(result, "Could not insert into database.");
-      return;
+      min = distance;
+      closest = ranked[i].second;
     }
   }
-
-  // success
-  result.success = true;
-  as_.setSucceeded(result, "Success!");
+  return closest;
 }
 
-void GraspCollector::segmentedObjectsCallback(const rail_manipulation_msgs::SegmentedObjectList::Ptr &object_list)
+void GraspCollector::segmentedObjectsCallback(
+    const rail_manipulation_msgs::SegmentedObjectList::ConstPtr &object_list)
 {
   ROS_INFO("Updated segmented object list received.");
   // lock for the vector
@@ -13,14 +13,21 @@
 // RAIL Grasp Collection
 #include "rail_grasp_collection/GraspRetriever.h"
 
+// C++ Standard Library
+#include <algorithm>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
 GraspRetriever::GraspRetriever()
-    : private_node_("~"),
-      as_(private_node_, "retrieve_grasp", boost::bind(&GraspRetriever::retrieveGrasp, this, _1), false)
+    : goal_queue_(boost::bind(&GraspRetriever::retrieveGrasp, this, _1), "Grasp retriever shut down.",
+                  "Goal cancelled before retrieval."),
+      private_node_("~"),
+      as_(private_node_, "retrieve_grasp", boost::bind(&GoalQueue::goalCallback, &goal_queue_, _1),
+          boost::bind(&GoalQueue::cancelCallback, &goal_queue_, _1), false)
 {
   // set defaults
+  int num_goal_threads = DEFAULT_NUM_GOAL_THREADS;
   int port = graspdb::Client::DEFAULT_PORT;
   string host("127.0.0.1");
   string user("ros");
@@ -28,21 +35,24 @@ GraspRetriever::GraspRetriever()
   string db("graspdb");
 
   // grab any parameters we need
+  private_node_.getParam("num_goal_threads", num_goal_threads);
   node_.getParam("/graspdb/host", host);
   node_.getParam("/graspdb/port", port);
   node_.getParam("/graspdb/user", user);
   node_.getParam("/graspdb/password", password);
   node_.getParam("/graspdb/db", db);
 
-  // set up a connection to the grasp database
-  graspdb_ = new graspdb::Client(host, port, user, password, db);
-  okay_ = graspdb_->connect();
+  // set up a connection to the grasp database for each goal thread
+  graspdb_pool_ = new graspdb::ClientPool(host, port, user, password, db, max(num_goal_threads, 1));
+  okay_ = graspdb_pool_->connect();
 
   // set up the latched publishers we need
   point_cloud_pub_ = private_node_.advertise<sensor_msgs::PointCloud2>("point_cloud", 1, true);
   pose_pub_ = private_node_.advertise<geometry_msgs::PoseStamped>("pose", 1, true);
 
-  // start the action server
+  // start the goal threads and the action server
+  goal_queue_.start(num_goal_threads);
+  ROS_INFO("Serving up to %d goal(s) at once.", goal_queue_.getNumThreads());
   as_.start();
 
   if (okay_)
@@ -53,10 +63,12 @@ GraspRetriever::GraspRetriever()
 
 GraspRetriever::~GraspRetriever()
 {
+  // stop the goal threads (running goals are finished first)
+  goal_queue_.shutdown();
+
   // cleanup
-  as_.shutdown();
-  graspdb_->disconnect();
-  delete graspdb_;
+  graspdb_pool_->disconnect();
+  delete graspdb_pool_;
 }
 
 bool GraspRetriever::okay() const
@@ -64,19 +76,26 @@ bool GraspRetriever::okay() const
   return okay_;
 }
 
-void GraspRetriever::retrieveGrasp(const rail_pick_and_place_msgs::RetrieveGraspDemonstrationGoalConstPtr &goal)
+void GraspRetriever::retrieveGrasp(GoalHandle &goal_handle)
 {
+  const rail_pick_and_place_msgs::RetrieveGraspDemonstrationGoalConstPtr goal = goal_handle.getGoal();
   rail_pick_and_place_msgs::RetrieveGraspDemonstrationFeedback feedback;
   rail_pick_and_place_msgs::RetrieveGraspDemonstrationResult result;
 
   // attempt to load the grasp from the database
   feedback.message = "Requesting grasp demonstration from database...";
-  as_.publishFeedback(feedback);
+  goal_handle.publishFeedback(feedback);
   graspdb::GraspDemonstration gd;
-  if (!graspdb_->loadGraspDemonstration(goal->id, gd))
+  bool loaded;
+  {
+    // only hold the connection for the load (it is reconnected on checkout if it was lost)
+    graspdb::ClientPool::ScopedClient graspdb(*graspdb_pool_);
+    loaded = graspdb->connected() && graspdb->loadGraspDemonstration(goal->id, gd);
+  }
+  if (!loaded)
   {
     result.success = false;
-    as_.setSucceeded(result, "Could not load grasp from database.");
+    goal_handle.setSucceeded(result, "Could not load grasp from database.");
     return;
   } else
   {
@@ -85,7 +104,7 @@ void GraspRetriever::retrieveGrasp(const rail_pick_and_place_msgs::RetrieveGrasp
 
     // publish the data
     feedback.message = "Publishing to latched topics...";
-    as_.publishFeedback(feedback);
+    goal_handle.publishFeedback(feedback);
     // send the resulting point cloud message from the goal
     point_cloud_pub_.publish(result.grasp.point_cloud);
     // create and send a PoseStamped
@@ -93,6 +112,6 @@ void GraspRetriever::retrieveGrasp(const rail_pick_and_place_msgs::RetrieveGrasp
 
     // success
     result.success = true;
-    as_.setSucceeded(result, "Success!");
+    goal_handle.setSucceeded(result, "Success!");
   }
 }
@@ -0,0 +1,184 @@
+/*!
+ * \file DatabaseWorker.h
+ * \brief A shared background thread for the grasp database requests of the RViz panels.
+ *
+ * The database worker owns a single grasp database connection and runs every request of the panels on its own
+ * thread. Completion callbacks are handed back to the Qt GUI thread with a queued signal, so the panels never block
+ * on the network.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_DATABASE_WORKER_H_
+#define RAIL_PICK_AND_PLACE_DATABASE_WORKER_H_
+
+// ROS
+#include <graspdb/graspdb.h>
+
+// Qt
+#include <QObject>
+
+// Boost
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+// C++ Standard Library
+#include <deque>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class DatabaseWorker
+ * \brief A shared background thread for the grasp database requests of the RViz panels.
+ *
+ * Every panel in the process shares one worker (and one connection) through getInstance. Requests are run in the
+ * order they are posted. The work of a request runs on the worker thread and must only touch the client and its own
+ * data; the completion callback then runs on the GUI thread, where it can update widgets. Requests are tagged with
+ * their owner so a panel can cancel them before it is destroyed.
+ */
+class DatabaseWorker : public QObject
+{
+
+// this class uses Qt slots and is a subclass of QObject, so it needs the Q_OBJECT macro
+Q_OBJECT
+
+public:
+  /*!
+   * \typedef Work
+   * \brief The work of a request, run on the worker thread with the database connection.
+   */
+  typedef boost::function<void(graspdb::Client &)> Work;
+
+  /*!
+   * \typedef Done
+   * \brief The completion callback of a request, run on the GUI thread.
+   */
+  typedef boost::function<void()> Done;
+
+  /*!
+   * \brief Shared worker accessor.
+   *
+   * Get the worker shared by every panel, creating it on first use. The worker is destroyed with its last owner. This
+   * function must be called from the GUI thread.
+   *
+   * \return The shared worker.
+   */
+  static boost::shared_ptr<DatabaseWorker> getInstance();
+
+  /*!
+   * \brief Cleans up a DatabaseWorker.
+   *
+   * Stops the worker thread after its current request (any queued requests are dropped) and closes the connection.
+   */
+  virtual ~DatabaseWorker();
+
+  /*!
+   * \brief Post a request.
+   *
+   * Queue the given work for the worker thread. Once it finishes (even if it threw an exception), the given
+   * completion callback is run on the GUI thread.
+   *
+   * \param owner The owner of the request (used to cancel it).
+   * \param work The work to run with the database connection.
+   * \param done The completion callback (may be empty).
+   */
+  void post(const void *owner, const Work &work, const Done &done = Done());
+
+  /*!
+   * \brief Cancel the requests of an owner.
+   *
+   * Drop the queued requests and pending completion callbacks of the given owner, waiting for its running request
+   * (if any) to finish first. No callback of the owner is run afterwards. This function must be called from the GUI
+   * thread.
+   *
+   * \param owner The owner to cancel the requests of.
+   */
+  void cancel(const void *owner);
+
+// used to hand finished requests to the GUI thread
+  Q_SIGNALS:
+
+  /*!
+   * \brief Signal that a request finished.
+   *
+   * Emitted by the worker thread after a request with a completion callback finishes.
+   */
+  void requestFinished();
+
+// used as UI callbacks
+private
+  Q_SLOTS:
+
+  /*!
+   * \brief Run the completion callbacks.
+   *
+   * Runs the completion callbacks of every finished request on the GUI thread.
+   */
+  void runFinished();
+
+private:
+  /*!
+   * \struct Request
+   * \brief A single queued request.
+   */
+  struct Request
+  {
+    /*! The owner of the request. */
+    const void *owner;
+    /*! The work of the request. */
+    Work work;
+    /*! The completion callback of the request. */
+    Done done;
+  };
+
+  /*!
+   * \brief Creates a new DatabaseWorker.
+   *
+   * Reads the grasp database parameters and starts the worker thread, which connects before running any request.
+   */
+  DatabaseWorker();
+
+  /*!
+   * \brief The worker thread loop.
+   *
+   * Connects to the grasp database and runs queued requests until the worker is destroyed.
+   */
+  void run();
+
+  /*!
+   * \brief Remove the requests of an owner.
+   *
+   * Removes every request of the given owner from the given queue.
+   *
+   * \param requests The queue to remove the requests from.
+   * \param owner The owner of the requests to remove.
+   */
+  static void removeRequests(std::deque<Request> &requests, const void *owner);
+
+  /*! The grasp database connection (only used on the worker thread). */
+  graspdb::Client *graspdb_;
+  /*! The worker thread. */
+  boost::thread *thread_;
+  /*! The queued and finished requests. */
+  std::deque<Request> queued_, finished_;
+  /*! The owner of the running request (NULL if idle). */
+  const void *running_owner_;
+  /*! If the worker thread should keep running. */
+  bool running_;
+  /*! The mutex for the queues and flags. */
+  boost::mutex mutex_;
+  /*! Signaled when a request is queued or finishes. */
+  boost::condition_variable condition_;
+};
+
+}
+}
+
+#endif
@@ -11,6 +11,9 @@
 #ifndef RAIL_PICK_AND_PLACE_METRIC_TRAINING_PANEL_H_
 #define RAIL_PICK_AND_PLACE_METRIC_TRAINING_PANEL_H_
 
+// RAIL Pick and Place Tools
+#include "DatabaseWorker.h"
+
 // ROS
 #include <actionlib/client/simple_action_client.h>
 #include <actionlib/server/simple_action_server.h>
@@ -21,6 +24,7 @@
 #include <rviz/panel.h>
 
 // Boost
+#include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 
 // Qt
@@ -28,6 +32,10 @@
 #include <QLabel>
 #include <QPushButton>
 
+// C++ Standard Library
+#include <string>
+#include <vector>
+
 namespace rail
 {
 namespace pick_and_place
@@ -110,8 +118,17 @@ private:
    */
   void feedbackCallback(const rail_pick_and_place_msgs::TrainMetricsFeedbackConstPtr &feedback);
 
-  /*! The grasp database connection. */
-  graspdb::Client *graspdb_;
+  /*!
+   * \brief Callback for when the object names are loaded.
+   *
+   * Replaces the object list with the given sorted object names.
+   *
+   * \param names The loaded object names.
+   */
+  void objectNamesLoaded(const boost::shared_ptr<std::vector<std::string> > &names);
+
+  /*! The shared worker running the grasp database requests. */
+  boost::shared_ptr<DatabaseWorker> database_;
   /*! If the user has responded yet and their response. */
   bool responded_, yes_;
 
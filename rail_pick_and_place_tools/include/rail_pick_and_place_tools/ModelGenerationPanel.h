@@ -12,6 +12,9 @@
 #ifndef RAIL_PICK_AND_PLACE_MODEL_GENERATION_PANEL_H_
 #define RAIL_PICK_AND_PLACE_MODEL_GENERATION_PANEL_H_
 
+// RAIL Pick and Place Tools
+#include "DatabaseWorker.h"
+
 // ROS
 #include <actionlib/client/simple_action_client.h>
 #include <graspdb/graspdb.h>
@@ -28,6 +31,13 @@
 #include <QPushButton>
 #include <QSpinBox>
 
+// Boost
+#include <boost/shared_ptr.hpp>
+
+// C++ Standard Library
+#include <string>
+#include <vector>
+
 namespace rail
 {
 namespace pick_and_place
@@ -38,6 +48,8 @@ namespace pick_and_place
  * \brief RViz plugin for model generation.
  *
  * The model generation panel allows for model generation requests to be made using a selection of grasps and models.
+ * Every database request runs on the shared database worker. The grasp and model list is filled with summaries loaded
+ * in pages, so large objects never block the GUI thread; point clouds are only loaded when an item is previewed.
  */
 class ModelGenerationPanel : public rviz::Panel
 {
@@ -46,6 +58,9 @@ class ModelGenerationPanel : public rviz::Panel
 Q_OBJECT
 
 public:
+  /*! The number of summaries loaded per database query when populating the list. */
+  static const size_t SUMMARY_PAGE_SIZE = 100;
+
   /*!
    * \brief Create a new ModelGenerationPanel.
    *
@@ -101,8 +116,47 @@ private:
    */
   void feedbackCallback(const rail_pick_and_place_msgs::GenerateModelsFeedbackConstPtr &feedback);
 
-  /*! The grasp database connection. */
-  graspdb::Client *graspdb_;
+  /*!
+   * \brief Callback for when the object names are loaded.
+   *
+   * Replaces the object list with the given sorted and unique object names.
+   *
+   * \param names The loaded object names.
+   */
+  void objectNamesLoaded(const boost::shared_ptr<std::vector<std::string> > &names);
+
+  /*!
+   * \brief Request a page of summaries.
+   *
+   * Posts a request for the next page of SUMMARY_PAGE_SIZE summaries of the given object for the current list
+   * population.
+   *
+   * \param object_name The name of the object to load the summaries of.
+   * \param models If grasp model summaries should be loaded (otherwise grasp demonstration summaries).
+   * \param after_id The ID of the last summary of the previous page (0 for the first page).
+   */
+  void requestSummaryPage(const std::string &object_name, const bool models, const uint32_t after_id);
+
+  /*!
+   * \brief Callback for when a page of summaries is loaded.
+   *
+   * Adds the summaries to the list and requests the next page (grasp demonstrations are listed before models). Pages
+   * of an older list population are ignored.
+   *
+   * \param generation The list population the page was requested for.
+   * \param object_name The name of the object the summaries belong to.
+   * \param models If the page holds grasp model summaries.
+   * \param summaries The loaded summaries.
+   */
+  void summaryPageLoaded(const uint32_t generation, const std::string &object_name, const bool models,
+      const boost::shared_ptr<std::vector<graspdb::Summary> > &summaries);
+
+  /*! The shared worker running the grasp database requests. */
+  boost::shared_ptr<DatabaseWorker> database_;
+  /*! The current list population (incremented every time the list is repopulated). */
+  uint32_t summary_generation_;
+  /*! If the grasp demonstration and object model headers were added to the current list. */
+  bool demonstrations_label_added_, models_label_added_;
 
   /*! The public ROS node handle. */
   ros::NodeHandle node_;
@@ -122,7 +176,8 @@ private:
   /*! The maximum model size spinner. */
   QSpinBox *model_size_spin_box_;
   /*! The various buttons used in the interface. */
-  QPushButton *refresh_button_, *select_all_button_, *deselect_all_button_, *generate_models_button_, *delete_button_;
+  QPushButton *refresh_button_, *select_all_button_, *deselect_all_button_, *generate_models_button_, *delete_button_,
+      *cancel_button_;
 
 // used as UI callbacks
 private
@@ -136,9 +191,17 @@ private
   void executeGenerateModels();
 
   /*!
-   * \brief Remove the currently selected individual grasp or object model.
+   * \brief Cancel the current model generation.
+   *
+   * Cancels the current generate models goal. Models merged before the cancellation are still stored.
+   */
+  void cancelGenerateModels();
+
+  /*!
+   * \brief Remove the currently selected grasps and object models.
    *
-   * Makes a call to the graspdb to delete the selected model or grasp (if any). A confirmation dialog is given.
+   * Deletes every selected model and grasp (if any) with a single batched request per table. A confirmation dialog
+   * is given.
    */
   void deleteModel();
 
@@ -159,7 +222,7 @@ private
   /*!
    * \brief Populates the model list.
    *
-   * Populates the models list with the given object's grasps and models.
+   * Clears the models list and starts loading the summaries of the given object's grasps and models in the background.
    */
   void populateModelsList(const QString &text);
 
@@ -0,0 +1,188 @@
+/*!
+ * \file DatabaseWorker.cpp
+ * \brief A shared background thread for the grasp database requests of the RViz panels.
+ *
+ * The database worker owns a single grasp database connection and runs every request of the panels on its own
+ * thread. Completion callbacks are handed back to the Qt GUI thread with a queued signal, so the panels never block
+ * on the network.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Pick and Place Tools
+#include "rail_pick_and_place_tools/DatabaseWorker.h"
+
+// ROS
+#include <ros/ros.h>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/weak_ptr.hpp>
+
+// C++ Standard Library
+#include <exception>
+#include <string>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+boost::shared_ptr<DatabaseWorker> DatabaseWorker::getInstance()
+{
+  // only the panels keep the worker alive
+  static boost::weak_ptr<DatabaseWorker> instance;
+  boost::shared_ptr<DatabaseWorker> worker = instance.lock();
+  if (!worker)
+  {
+    worker.reset(new DatabaseWorker());
+    instance = worker;
+  }
+  return worker;
+}
+
+DatabaseWorker::DatabaseWorker()
+{
+  // set defaults
+  int port = graspdb::Client::DEFAULT_PORT;
+  string host("127.0.0.1");
+  string user("ros");
+  string password("");
+  string db("graspdb");
+
+  // grab any parameters we need
+  ros::NodeHandle node;
+  node.getParam("/graspdb/host", host);
+  node.getParam("/graspdb/port", port);
+  node.getParam("/graspdb/user", user);
+  node.getParam("/graspdb/password", password);
+  node.getParam("/graspdb/db", db);
+
+  graspdb_ = new graspdb::Client(host, port, user, password, db);
+  running_owner_ = NULL;
+  running_ = true;
+
+  // completion callbacks always run on the GUI thread
+  QObject::connect(this, SIGNAL(requestFinished()), this, SLOT(runFinished()), Qt::QueuedConnection);
+  thread_ = new boost::thread(boost::bind(&DatabaseWorker::run, this));
+}
+
+DatabaseWorker::~DatabaseWorker()
+{
+  // stop after the current request
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    running_ = false;
+  }
+  condition_.notify_all();
+  thread_->join();
+  delete thread_;
+
+  // cleanup
+  graspdb_->disconnect();
+  delete graspdb_;
+}
+
+void DatabaseWorker::post(const void *owner, const Work &work, const Done &done)
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    queued_.push_back(Request());
+    queued_.back().owner = owner;
+    queued_.back().work = work;
+    queued_.back().done = done;
+  }
+  condition_.notify_all();
+}
+
+void DatabaseWorker::cancel(const void *owner)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  // the work of a running request can not be interrupted
+  while (running_owner_ == owner)
+  {
+    condition_.wait(lock);
+  }
+  removeRequests(queued_, owner);
+  removeRequests(finished_, owner);
+}
+
+void DatabaseWorker::runFinished()
+{
+  // take every finished request so callbacks can post new requests
+  deque<Request> finished;
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    finished.swap(finished_);
+  }
+  for (size_t i = 0; i < finished.size(); i++)
+  {
+    finished[i].done();
+  }
+}
+
+void DatabaseWorker::run()
+{
+  // connect on the worker thread so the GUI never waits for the database
+  if (!graspdb_->connect())
+  {
+    ROS_WARN("Could not connect to grasp database.");
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  while (true)
+  {
+    while (running_ && queued_.empty())
+    {
+      condition_.wait(lock);
+    }
+    if (!running_)
+    {
+      return;
+    }
+
+    Request request = queued_.front();
+    queued_.pop_front();
+    running_owner_ = request.owner;
+    lock.unlock();
+
+    // a failed request still completes so the panel can recover
+    if (graspdb_->connected())
+    {
+      try
+      {
+        request.work(*graspdb_);
+      } catch (const exception &e)
+      {
+        ROS_ERROR("Grasp database request failed: %s", e.what());
+      }
+    }
+
+    lock.lock();
+    running_owner_ = NULL;
+    const bool notify = !request.done.empty();
+    if (notify)
+    {
+      finished_.push_back(request);
+    }
+    condition_.notify_all();
+    if (notify)
+    {
+      lock.unlock();
+      Q_EMIT this->requestFinished();
+      lock.lock();
+    }
+  }
+}
+
+void DatabaseWorker::removeRequests(deque<Request> &requests, const void *owner)
+{
+  deque<Request> kept;
+  for (size_t i = 0; i < requests.size(); i++)
+  {
+    if (requests[i].owner != owner)
+    {
+      kept.push_back(requests[i]);
+    }
+  }
+  requests.swap(kept);
+}
@@ -17,9 +17,28 @@
 // Qt
 #include <QBoxLayout>
 
+// Boost
+#include <boost/bind.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
+/*!
+ * Load the unique object names of every grasp demonstration (run on the database worker).
+ *
+ * \param client The grasp database connection.
+ * \param names The vector to fill with the sorted object names.
+ */
+static void loadObjectNames(graspdb::Client &client, const boost::shared_ptr<vector<string> > &names)
+{
+  client.getUniqueGraspDemonstrationObjectNames(*names);
+  // sort the names
+  sort(names->begin(), names->end());
+}
+
 MetricTrainingPanel::MetricTrainingPanel(QWidget *parent)
     : rviz::Panel(parent), train_metrics_ac_("/metric_trainer/train_metrics", true),
       as_(node_, "/metric_trainer/get_yes_no_feedback", boost::bind(&MetricTrainingPanel::getYesNoFeedbackCallback,
@@ -27,28 +46,8 @@ MetricTrainingPanel::MetricTrainingPanel(QWidget *parent)
 {
   responded_ = false;
 
-  // set defaults
-  int port = graspdb::Client::DEFAULT_PORT;
-  string host("127.0.0.1");
-  string user("ros");
-  string password("");
-  string db("graspdb");
-
-  // grab any parameters we need
-  node_.getParam("/graspdb/host", host);
-  node_.getParam("/graspdb/port", port);
-  node_.getParam("/graspdb/user", user);
-  node_.getParam("/graspdb/password", password);
-  node_.getParam("/graspdb/db", db);
-
-  // connect to the grasp database
-  graspdb_ = new graspdb::Client(host, port, user, password, db);
-  bool okay = graspdb_->connect();
-
-  if (!okay)
-  {
-    ROS_WARN("Could not connect to grasp database.");
-  }
+  // every panel shares one database connection on a background thread
+  database_ = DatabaseWorker::getInstance();
 
   as_.start();
 
@@ -111,8 +110,8 @@ MetricTrainingPanel::~MetricTrainingPanel()
 {
   // cleanup
   as_.shutdown();
-  graspdb_->disconnect();
-  delete graspdb_;
+  // no callbacks may run once the panel is gone
+  database_->cancel(this);
 }
 
 void MetricTrainingPanel::getYesNoFeedbackCallback(const rail_pick_and_place_msgs::GetYesNoFeedbackGoalConstPtr &goal)
@@ -166,20 +165,22 @@ void MetricTrainingPanel::setNoFeedback()
 
 void MetricTrainingPanel::refresh()
 {
-  // disable the button as we work
+  // disable the button as we work (re-enabled once the names are loaded)
   refresh_button_->setEnabled(false);
 
+  boost::shared_ptr<vector<string> > names(new vector<string>);
+  database_->post(this, boost::bind(&loadObjectNames, _1, names),
+                  boost::bind(&MetricTrainingPanel::objectNamesLoaded, this, names));
+}
+
+void MetricTrainingPanel::objectNamesLoaded(const boost::shared_ptr<vector<string> > &names)
+{
   // clear the current objects
   object_list_->clear();
-  // load from both the demonstration and model lists
-  vector<string> object_names;
-  graspdb_->getUniqueGraspDemonstrationObjectNames(object_names);
-  // sort the names
-  sort(object_names.begin(), object_names.end());
   // add each item name
-  for (size_t i = 0; i < object_names.size(); i++)
+  for (size_t i = 0; i < names->size(); i++)
   {
-    object_list_->addItem(object_names[i].c_str());
+    object_list_->addItem(names->at(i).c_str());
   }
 
   // re-enable the button
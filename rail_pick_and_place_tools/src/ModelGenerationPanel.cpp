@@ -19,36 +19,82 @@
 #include <QGridLayout>
 #include <QMessageBox>
 
+// Boost
+#include <boost/bind.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
+/*!
+ * Load the unique object names of every grasp demonstration and model (run on the database worker).
+ *
+ * \param client The grasp database connection.
+ * \param names The vector to fill with the sorted and unique object names.
+ */
+static void loadObjectNames(graspdb::Client &client, const boost::shared_ptr<vector<string> > &names)
+{
+  // load from both the demonstration and model lists
+  vector<string> model_names;
+  client.getUniqueGraspDemonstrationObjectNames(*names);
+  client.getUniqueGraspModelObjectNames(model_names);
+  // combine the lists
+  names->insert(names->end(), model_names.begin(), model_names.end());
+  // sort the names
+  sort(names->begin(), names->end());
+  // make the list unique
+  names->erase(unique(names->begin(), names->end()), names->end());
+}
+
+/*!
+ * Load a page of grasp demonstration or model summaries (run on the database worker).
+ *
+ * \param client The grasp database connection.
+ * \param object_name The name of the object to load the summaries of.
+ * \param models If grasp model summaries should be loaded (otherwise grasp demonstration summaries).
+ * \param after_id The ID of the last summary of the previous page.
+ * \param summaries The vector to fill with the summaries.
+ */
+static void loadSummaryPage(graspdb::Client &client, const string &object_name, const bool models,
+    const uint32_t after_id, const boost::shared_ptr<vector<graspdb::Summary> > &summaries)
+{
+  if (models)
+  {
+    client.loadGraspModelSummariesByObjectName(object_name, after_id, ModelGenerationPanel::SUMMARY_PAGE_SIZE,
+                                               *summaries);
+  } else
+  {
+    client.loadGraspDemonstrationSummariesByObjectName(object_name, after_id,
+                                                       ModelGenerationPanel::SUMMARY_PAGE_SIZE, *summaries);
+  }
+}
+
+/*!
+ * Delete grasp demonstrations and models with one batched statement each (run on the database worker).
+ *
+ * \param client The grasp database connection.
+ * \param demonstration_ids The IDs of the grasp demonstrations to delete.
+ * \param model_ids The IDs of the grasp models to delete.
+ */
+static void deleteEntries(graspdb::Client &client, const vector<uint32_t> &demonstration_ids,
+    const vector<uint32_t> &model_ids)
+{
+  client.deleteGraspDemonstrations(demonstration_ids);
+  client.deleteGraspModels(model_ids);
+}
+
 ModelGenerationPanel::ModelGenerationPanel(QWidget *parent)
     : rviz::Panel(parent), generate_models_ac_("/model_generator/generate_models", true),
       retrieve_grasp_ac_("/rail_grasp_retriever/retrieve_grasp", true),
       retrieve_grasp_model_ac_("/rail_grasp_model_retriever/retrieve_grasp_model", true)
 {
-  // set defaults
-  int port = graspdb::Client::DEFAULT_PORT;
-  string host("127.0.0.1");
-  string user("ros");
-  string password("");
-  string db("graspdb");
-
-  // grab any parameters we need
-  node_.getParam("/graspdb/host", host);
-  node_.getParam("/graspdb/port", port);
-  node_.getParam("/graspdb/user", user);
-  node_.getParam("/graspdb/password", password);
-  node_.getParam("/graspdb/db", db);
-
-  // connect to the grasp database
-  graspdb_ = new graspdb::Client(host, port, user, password, db);
-  bool okay = graspdb_->connect();
-
-  if (!okay)
-  {
-    ROS_WARN("Could not connect to grasp database.");
-  }
+  // every panel shares one database connection on a background thread
+  database_ = DatabaseWorker::getInstance();
+  summary_generation_ = 0;
+  demonstrations_label_added_ = false;
+  models_label_added_ = false;
 
   // list of current objects
   QHBoxLayout *objects_layout = new QHBoxLayout();
@@ -74,6 +120,7 @@ ModelGenerationPanel::ModelGenerationPanel(QWidget *parent)
 
   // grasp demonstration and model lists
   models_list_ = new QListWidget();
+  models_list_->setSelectionMode(QAbstractItemView::ExtendedSelection);
 
   // model generation options
   QHBoxLayout *generation_layout = new QHBoxLayout();
@@ -86,9 +133,13 @@ ModelGenerationPanel::ModelGenerationPanel(QWidget *parent)
   model_size_spin_box_->setValue(6);
   // model generation button
   generate_models_button_ = new QPushButton("Generate Models");
+  // model generation cancel button
+  cancel_button_ = new QPushButton("Cancel");
+  cancel_button_->setEnabled(false);
   generation_layout->addWidget(model_size_label);
   generation_layout->addWidget(model_size_spin_box_);
   generation_layout->addWidget(generate_models_button_);
+  generation_layout->addWidget(cancel_button_);
 
   // action client feedback
   model_generation_status_ = new QLabel("Ready to generate models.");
@@ -112,6 +163,7 @@ ModelGenerationPanel::ModelGenerationPanel(QWidget *parent)
   QObject::connect(delete_button_, SIGNAL(clicked()), this, SLOT(deleteModel()));
   QObject::connect(models_list_, SIGNAL(itemSelectionChanged()), this, SLOT(modelSelectionChanged()));
   QObject::connect(generate_models_button_, SIGNAL(clicked()), this, SLOT(executeGenerateModels()));
+  QObject::connect(cancel_button_, SIGNAL(clicked()), this, SLOT(cancelGenerateModels()));
 
   // update with the initial state
   this->refresh();
@@ -122,33 +174,28 @@ ModelGenerationPanel::ModelGenerationPanel(QWidget *parent)
 
 ModelGenerationPanel::~ModelGenerationPanel()
 {
-  // cleanup
-  graspdb_->disconnect();
-  delete graspdb_;
+  // no callbacks may run once the panel is gone
+  database_->cancel(this);
 }
 
 void ModelGenerationPanel::refresh()
 {
-  // disable the button as we work
+  // disable the button as we work (re-enabled once the names are loaded)
   refresh_button_->setEnabled(false);
 
+  boost::shared_ptr<vector<string> > names(new vector<string>);
+  database_->post(this, boost::bind(&loadObjectNames, _1, names),
+                  boost::bind(&ModelGenerationPanel::objectNamesLoaded, this, names));
+}
+
+void ModelGenerationPanel::objectNamesLoaded(const boost::shared_ptr<vector<string> > &names)
+{
   // clear the current objects
   object_list_->clear();
-  // load from both the demonstration and model lists
-  vector<string> object_names;
-  vector<string> model_names;
-  graspdb_->getUniqueGraspDemonstrationObjectNames(object_names);
-  graspdb_->getUniqueGraspModelObjectNames(model_names);
-  // combine the lists
-  object_names.insert(object_names.end(), model_names.begin(), model_names.end());
-  // sort the names
-  sort(object_names.begin(), object_names.end());
-  // make the lise unique
-  object_names.erase(unique(object_names.begin(), object_names.end()), object_names.end());
   // add each item name
-  for (size_t i = 0; i < object_names.size(); i++)
+  for (size_t i = 0; i < names->size(); i++)
   {
-    object_list_->addItem(object_names[i].c_str());
+    object_list_->addItem(names->at(i).c_str());
   }
 
   // re-enable the button
@@ -193,8 +240,20 @@ void ModelGenerationPanel::deselectAll()
 
 void ModelGenerationPanel::modelSelectionChanged()
 {
+  // count the selected grasps and models (the labels can not be selected)
+  const QList<QListWidgetItem *> selected = models_list_->selectedItems();
+  int num_selected = 0;
+  for (int i = 0; i < selected.size(); i++)
+  {
+    if (selected[i]->flags() & Qt::ItemIsUserCheckable)
+    {
+      num_selected++;
+    }
+  }
+
   // check if there is an item selected
-  if (models_list_->currentItem() != NULL && models_list_->currentItem()->flags() & Qt::ItemIsUserCheckable)
+  if (models_list_->currentItem() != NULL && models_list_->currentItem()->flags() & Qt::ItemIsUserCheckable
+      && num_selected > 0)
   {
     // grab the current item
     string selected_item = models_list_->currentItem()->text().toStdString();
@@ -202,11 +261,18 @@ void ModelGenerationPanel::modelSelectionChanged()
     int id = atoi(selected_item.substr(selected_item.find(' ')).c_str());
 
     // enable the delete button
-    string delete_text = "Delete " + selected_item;
-    delete_button_->setText(delete_text.c_str());
+    stringstream delete_text;
+    if (num_selected > 1)
+    {
+      delete_text << "Delete " << num_selected << " Items";
+    } else
+    {
+      delete_text << "Delete " << selected_item;
+    }
+    delete_button_->setText(delete_text.str().c_str());
     delete_button_->setEnabled(true);
 
-    // make calls to visualize the model or grasp
+    // make calls to visualize the model or grasp (the retrievers load the point cloud)
     if (selected_item[0] == 'G' && retrieve_grasp_ac_.isServerConnected())
     {
       rail_pick_and_place_msgs::RetrieveGraspDemonstrationGoal goal;
@@ -228,28 +294,50 @@ void ModelGenerationPanel::modelSelectionChanged()
 
 void ModelGenerationPanel::deleteModel()
 {
-  if (models_list_->currentItem() != NULL)
+  // gather the selected grasps and models
+  const QList<QListWidgetItem *> selected = models_list_->selectedItems();
+  vector<QListWidgetItem *> items;
+  vector<uint32_t> demonstration_ids, model_ids;
+  for (int i = 0; i < selected.size(); i++)
   {
-    // grab the current item
-    string selected_item = models_list_->currentItem()->text().toStdString();
-    // extract the ID
-    int id = atoi(selected_item.substr(selected_item.find(' ')).c_str());
-
-    // confirmation dialog
-    string delete_text = "Are you sure you want to delete " + selected_item + "?";
-    QMessageBox::StandardButton confirm = QMessageBox::question(this, "Delete?", delete_text.c_str(),
-        QMessageBox::Yes | QMessageBox::No);
-    if (confirm == QMessageBox::Yes)
+    if (selected[i]->flags() & Qt::ItemIsUserCheckable)
     {
+      // extract the ID
+      string selected_item = selected[i]->text().toStdString();
+      int id = atoi(selected_item.substr(selected_item.find(' ')).c_str());
       // check for a grasp or a model
       if (selected_item[0] == 'G')
       {
-        graspdb_->deleteGraspDemonstration(id);
+        demonstration_ids.push_back(id);
       } else
       {
-        graspdb_->deleteGraspModel(id);
+        model_ids.push_back(id);
+      }
+      items.push_back(selected[i]);
+    }
+  }
+
+  if (!items.empty())
+  {
+    // confirmation dialog
+    stringstream delete_text;
+    if (items.size() > 1)
+    {
+      delete_text << "Are you sure you want to delete " << items.size() << " items?";
+    } else
+    {
+      delete_text << "Are you sure you want to delete " << items[0]->text().toStdString() << "?";
+    }
+    QMessageBox::StandardButton confirm = QMessageBox::question(this, "Delete?", delete_text.str().c_str(),
+        QMessageBox::Yes | QMessageBox::No);
+    if (confirm == QMessageBox::Yes)
+    {
+      // a single batched delete per table in the background
+      database_->post(this, boost::bind(&deleteEntries, _1, demonstration_ids, model_ids));
+      for (size_t i = 0; i < items.size(); i++)
+      {
+        delete items[i];
       }
-      delete models_list_->currentItem();
     }
   }
 }
@@ -259,51 +347,86 @@ void ModelGenerationPanel::populateModelsList(const QString &text)
   // check if an object exists
   if (object_list_->count() > 0)
   {
-    // clear the current list
+    // clear the current list and ignore any pages still loading for the previous object
     models_list_->clear();
+    summary_generation_++;
+    demonstrations_label_added_ = false;
+    models_label_added_ = false;
 
-    // load grasps/models
-    vector<graspdb::GraspDemonstration> demonstrations;
-    vector<graspdb::GraspModel> models;
-    graspdb_->loadGraspDemonstrationsByObjectName(text.toStdString(), demonstrations);
-    graspdb_->loadGraspModelsByObjectName(text.toStdString(), models);
+    // load grasp/model summaries only (no point cloud data is needed for the list)
+    this->requestSummaryPage(text.toStdString(), false, 0);
+  }
+}
+
+void ModelGenerationPanel::requestSummaryPage(const string &object_name, const bool models, const uint32_t after_id)
+{
+  boost::shared_ptr<vector<graspdb::Summary> > summaries(new vector<graspdb::Summary>);
+  database_->post(this, boost::bind(&loadSummaryPage, _1, object_name, models, after_id, summaries),
+                  boost::bind(&ModelGenerationPanel::summaryPageLoaded, this, summary_generation_, object_name, models,
+                              summaries));
+}
+
+void ModelGenerationPanel::summaryPageLoaded(const uint32_t generation, const string &object_name, const bool models,
+    const boost::shared_ptr<vector<graspdb::Summary> > &summaries)
+{
+  // check if the list was repopulated since the request
+  if (generation != summary_generation_)
+  {
+    return;
+  }
 
-    // first add grasp demonstrations
-    if (demonstrations.size() > 0)
+  if (!models)
+  {
+    // header
+    if (!demonstrations_label_added_ && !summaries->empty())
     {
-      // header
       QListWidgetItem *grasps_label = new QListWidgetItem("--Grasp Demonstrations--", models_list_);
       grasps_label->setTextAlignment(Qt::AlignCenter);
       // makes it so the user can't select this label
       grasps_label->setFlags(Qt::ItemIsEnabled);
-      // add each demonstration
-      for (size_t i = 0; i < demonstrations.size(); i++)
-      {
-        stringstream ss;
-        ss << "Grasp " << demonstrations[i].getID();
-        QListWidgetItem *item = new QListWidgetItem(ss.str().c_str(), models_list_);
-        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
-        item->setCheckState(Qt::Unchecked);
-      }
+      demonstrations_label_added_ = true;
     }
-
-    if (models.size() > 0)
+    // add each demonstration
+    for (size_t i = 0; i < summaries->size(); i++)
+    {
+      stringstream ss;
+      ss << "Grasp " << summaries->at(i).getID();
+      QListWidgetItem *item = new QListWidgetItem(ss.str().c_str(), models_list_);
+      item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+      item->setCheckState(Qt::Unchecked);
+    }
+  } else
+  {
+    if (!models_label_added_ && !summaries->empty())
     {
       QListWidgetItem *models_label = new QListWidgetItem("--Object Models--", models_list_);
       models_label->setTextAlignment(Qt::AlignCenter);
       // makes it so the user can't select this label
       models_label->setFlags(Qt::ItemIsEnabled);
-      // add each model
-      for (size_t i = 0; i < models.size(); i++)
-      {
-        stringstream ss;
-        ss << "Model " << models[i].getID();
-        QListWidgetItem *item = new QListWidgetItem(ss.str().c_str(), models_list_);
-        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
-        item->setCheckState(Qt::Unchecked);
-      }
+      models_label_added_ = true;
+    }
+    // add each model
+    for (size_t i = 0; i < summaries->size(); i++)
+    {
+      stringstream ss;
+      ss << "Model " << summaries->at(i).getID();
+      QListWidgetItem *item = new QListWidgetItem(ss.str().c_str(), models_list_);
+      stringstream tip;
+      tip << summaries->at(i).getNumGrasps() << " grasps";
+      item->setToolTip(tip.str().c_str());
+      item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+      item->setCheckState(Qt::Unchecked);
     }
   }
+
+  // a full page may be followed by more (keyset paging continues after the last ID)
+  if (summaries->size() == SUMMARY_PAGE_SIZE)
+  {
+    this->requestSummaryPage(object_name, models, summaries->back().getID());
+  } else if (!models)
+  {
+    this->requestSummaryPage(object_name, true, 0);
+  }
 }
 
 void ModelGenerationPanel::executeGenerateModels()
@@ -353,15 +476,24 @@ void ModelGenerationPanel::executeGenerateModels()
       generate_models_ac_.sendGoal(goal, boost::bind(&ModelGenerationPanel::doneCallback, this, _1, _2),
           actionlib::SimpleActionClient<rail_pick_and_place_msgs::GenerateModelsAction>::SimpleActiveCallback(),
           boost::bind(&ModelGenerationPanel::feedbackCallback, this, _1));
+      cancel_button_->setEnabled(true);
     }
   }
 }
 
+void ModelGenerationPanel::cancelGenerateModels()
+{
+  // the models merged so far are returned in the result
+  cancel_button_->setEnabled(false);
+  generate_models_ac_.cancelGoal();
+  model_generation_status_->setText("Canceling model generation...");
+}
+
 void ModelGenerationPanel::doneCallback(const actionlib::SimpleClientGoalState &state,
     const rail_pick_and_place_msgs::GenerateModelsResultConstPtr &result)
 {
-  // check if the action was successful
-  if (state == actionlib::SimpleClientGoalState::SUCCEEDED)
+  // check if the action was successful (a preempted goal still stores the models merged so far)
+  if (state == actionlib::SimpleClientGoalState::SUCCEEDED || state == actionlib::SimpleClientGoalState::PREEMPTED)
   {
     // check how models were generated
     if (result->new_model_ids.size() > 0)
@@ -387,7 +519,14 @@ void ModelGenerationPanel::doneCallback(const actionlib::SimpleClientGoalState &
         item->setCheckState(Qt::Unchecked);
       }
       ss << "].";
+      if (state == actionlib::SimpleClientGoalState::PREEMPTED)
+      {
+        ss << " Model generation was canceled.";
+      }
       model_generation_status_->setText(ss.str().c_str());
+    } else if (state == actionlib::SimpleClientGoalState::PREEMPTED)
+    {
+      model_generation_status_->setText("Model generation was canceled.");
     } else
     {
       model_generation_status_->setText("No valid models generated.");
@@ -400,12 +539,25 @@ void ModelGenerationPanel::doneCallback(const actionlib::SimpleClientGoalState &
 
   // re-enable the button
   generate_models_button_->setEnabled(true);
+  cancel_button_->setEnabled(false);
 }
 
 void ModelGenerationPanel::feedbackCallback(const rail_pick_and_place_msgs::GenerateModelsFeedbackConstPtr &feedback)
 {
-  // simply set the status to the current message
-  model_generation_status_->setText(feedback->message.c_str());
+  // show the current message with the registration progress once it starts
+  stringstream ss;
+  ss << feedback->message;
+  if (feedback->pairs_total > 0)
+  {
+    ss << "\n" << feedback->pairs_checked << " of " << feedback->pairs_total << " pairs checked, " << feedback->merges
+        << " merge(s)";
+    if (feedback->eta >= 0)
+    {
+      ss << ", about " << (int) (feedback->eta + 0.5) << " s left";
+    }
+    ss << ".";
+  }
+  model_generation_status_->setText(ss.str().c_str());
 }
 
 void ModelGenerationPanel::save(rviz::Config config) const
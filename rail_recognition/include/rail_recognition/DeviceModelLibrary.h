@@ -0,0 +1,199 @@
+/*!
+ * \file DeviceModelLibrary.h
+ * \brief A grasp model library kept resident in GPU memory for batched registration metrics.
+ *
+ * The device model library uploads the point clouds of every candidate model into a single GPU octree once, so the
+ * overlap and distance metrics of many registered candidates can be computed with one search per metric.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_DEVICE_MODEL_LIBRARY_H_
+#define RAIL_PICK_AND_PLACE_DEVICE_MODEL_LIBRARY_H_
+
+// RAIL Recognition
+#include "PCLGraspModel.h"
+#include "PointCloudMetrics.h"
+
+// PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// Boost
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+// C++ Standard Library
+#include <utility>
+#include <vector>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class DeviceModelLibrary
+ * \brief A grasp model library kept resident in GPU memory for batched registration metrics.
+ *
+ * Every model is shifted to its own slot of a cubic grid centered at the origin and all models are stored in a single
+ * octree. Query points are shifted into the slot of the model they were registered to, so one batched search answers
+ * the queries of many (model, aligned point cloud) pairs at once without matches leaking between models. The slot
+ * spacing follows from the largest model radius and MODEL_MARGIN rather than a fixed distance, so the shifted
+ * coordinates stay small (a library of 10000 models of 15 cm spans about 11 m) and keep their precision. Aligned
+ * points within MODEL_MARGIN of the bounding sphere of their model always find their own model in the batched search;
+ * the rare points further out (poor registrations) are searched against their own model directly. All distances are
+ * computed in the unshifted model coordinates.
+ *
+ * The GPU backend is only compiled when the RAIL_RECOGNITION_USE_GPU CMake option is enabled and the PCL gpu_octree
+ * module is found. Otherwise the same batched searches run on the CPU with a single KD tree, so results match across
+ * builds. The color error only averages the first MAX_NEIGHBORS neighbors of each point (the overlap and distance
+ * error are exact).
+ */
+class DeviceModelLibrary : private boost::noncopyable
+{
+public:
+  /*! The margin in meters around the bounding sphere of each model in which aligned points use the batched search. */
+  static const double MODEL_MARGIN = 0.1;
+  /*! The maximum number of neighbors returned for each point in the overlap metric search. */
+  static const int MAX_NEIGHBORS = 128;
+  /*! The maximum number of query points in a single batched search. */
+  static const size_t MAX_BATCH_POINTS = 262144;
+
+  /*!
+   * \typedef Registration
+   * \brief A registered pair given by the index of the model and the aligned point cloud.
+   */
+  typedef std::pair<size_t, pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr> Registration;
+
+  /*!
+   * \brief Backend accessor.
+   *
+   * Check if the library was compiled with the GPU backend.
+   *
+   * \return True if searches run on the GPU.
+   */
+  static bool isGPUEnabled();
+
+  /*!
+   * \brief Creates a new DeviceModelLibrary.
+   *
+   * Shift and upload the point clouds of the given models and build the search index.
+   *
+   * \param models The models to store.
+   */
+  DeviceModelLibrary(const std::vector<PCLGraspModel> &models);
+
+  /*!
+   * \brief Cleans up a DeviceModelLibrary.
+   *
+   * Releases the device memory.
+   */
+  virtual ~DeviceModelLibrary();
+
+  /*!
+   * \brief Model count accessor.
+   *
+   * Get the number of models in the library.
+   *
+   * \return The number of models in the library.
+   */
+  size_t size() const;
+
+  /*!
+   * \brief Check if the library holds the given models.
+   *
+   * Check if the library was built from the given models (the same IDs and point counts in the same order).
+   *
+   * \param models The models to compare against.
+   * \return True if the library holds the given models.
+   */
+  bool matches(const std::vector<PCLGraspModel> &models) const;
+
+  /*!
+   * \brief Calculate the registration metrics of a batch of registered pairs.
+   *
+   * Calculate the overlap, color error, and distance error of every registered pair with batched searches. The
+   * metrics are the same as the KD tree versions in point_cloud_metrics (the distance error is the sum of squared
+   * nearest distances). This method is thread safe.
+   *
+   * \param registrations The registered pairs (model index, aligned point cloud) to measure.
+   * \param metrics The metrics to fill for each registered pair.
+   * \param metric_overlap_search_radius The search radius to consider a point to be overlapping (defaults to constant).
+   */
+  void calculateRegistrationMetrics(const std::vector<Registration> &registrations,
+      std::vector<point_cloud_metrics::RegistrationMetrics> &metrics,
+      const double metric_overlap_search_radius = point_cloud_metrics::DEFAULT_METRIC_OVERLAP_SEARCH_RADIUS) const;
+
+private:
+  /*!
+   * \struct Backend
+   * \brief The search index of the active backend (defined with the backend).
+   */
+  struct Backend;
+
+  /*!
+   * \brief Calculate the metrics of a single batch.
+   *
+   * Calculate the metrics of the registered pairs in the given range, which must hold at most MAX_BATCH_POINTS points
+   * (or a single pair). The mutex must be held.
+   *
+   * \param registrations The registered pairs.
+   * \param begin The index of the first pair in the batch.
+   * \param end The index after the last pair in the batch.
+   * \param metrics The metrics to fill for each registered pair.
+   * \param metric_overlap_search_radius The search radius to consider a point to be overlapping.
+   */
+  void calculateBatch(const std::vector<Registration> &registrations, const size_t begin, const size_t end,
+      std::vector<point_cloud_metrics::RegistrationMetrics> &metrics, const double metric_overlap_search_radius) const;
+
+  /*!
+   * \brief Get the offset of a slot.
+   *
+   * Get the offset that shifts the points of a model into the given slot of the grid.
+   *
+   * \param slot The index of the slot (the same as the index of the model).
+   * \param x The x offset to set.
+   * \param y The y offset to set.
+   * \param z The z offset to set.
+   */
+  void getSlotOffset(const size_t slot, double &x, double &y, double &z) const;
+
+  /*!
+   * \brief Search a single model directly.
+   *
+   * Find the neighbors within the radius (at most MAX_NEIGHBORS) and the nearest point of a single model for a point
+   * that is too far from the model for the batched search.
+   *
+   * \param point The unshifted query point.
+   * \param model The index of the model to search.
+   * \param radius The search radius.
+   * \param neighbors The array of at least MAX_NEIGHBORS indices to fill with the neighbors.
+   * \param num_neighbors Set to the number of neighbors found.
+   * \param nearest Set to the index of the nearest point.
+   */
+  void searchModel(const pcl::PointXYZRGB &point, const size_t model, const double radius, int *neighbors,
+      int &num_neighbors, int &nearest) const;
+
+  /*! The unshifted points of every model, stored contiguously in model order. */
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr points_;
+  /*! The ID and point count of each model. */
+  std::vector<std::pair<uint32_t, size_t> > models_;
+  /*! The index of the first point of each model. */
+  std::vector<size_t> begins_;
+  /*! The largest distance of a model point from the origin and the distance between neighboring slots. */
+  double model_radius_, spacing_;
+  /*! The number of slots along each axis of the grid. */
+  size_t grid_size_;
+  /*! The search index of the active backend. */
+  boost::scoped_ptr<Backend> backend_;
+  /*! Mutex for the search index and buffers. */
+  mutable boost::mutex mutex_;
+};
+
+}
+}
+
+#endif
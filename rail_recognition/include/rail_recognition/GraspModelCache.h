@@ -0,0 +1,198 @@
+/*!
+ * \file GraspModelCache.h
+ * \brief A resident, incrementally refreshed cache of PCL grasp models.
+ *
+ * The grasp model cache loads and converts all grasp models from the grasp database once. Subsequent refreshes use a
+ * cheap state query to detect changes and only load or drop the grasp models that were added or removed.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_GRASP_MODEL_CACHE_H_
+#define RAIL_PICK_AND_PLACE_GRASP_MODEL_CACHE_H_
+
+// RAIL Recognition
+#include "ModelSnapshot.h"
+#include "PCLGraspModel.h"
+
+// ROS
+#include <graspdb/graspdb.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+// C++ Standard Library
+#include <string>
+#include <vector>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class GraspModelCache
+ * \brief A resident, incrementally refreshed cache of PCL grasp models.
+ *
+ * The grasp model cache loads and converts all grasp models from the grasp database once. Subsequent refreshes use a
+ * cheap state query to detect changes and only load or drop the grasp models that were added or removed. Models are
+ * kept sorted by ID so the candidate order is deterministic. The models are held in an immutable, reference counted
+ * library that is replaced (never modified) when the database changes, so any number of threads can keep using a
+ * library while another thread refreshes the cache. Copies of the unchanged models share their point clouds, so a
+ * refresh only converts the new models. Each library comes with an index of its models by upper case object name, so
+ * name filtered lookups only touch the matching models.
+ */
+class GraspModelCache
+{
+public:
+  /*! A shared, immutable library of grasp models sorted by ID. */
+  typedef boost::shared_ptr<const std::vector<PCLGraspModel> > ModelLibraryConstPtr;
+  /*! The models of a library grouped by upper case object name (each list sorted by ID). */
+  typedef boost::unordered_map<std::string, std::vector<PCLGraspModel> > NameIndex;
+  /*! A shared, immutable name index of a library. */
+  typedef boost::shared_ptr<const NameIndex> NameIndexConstPtr;
+
+  /*!
+   * \brief Creates a new GraspModelCache.
+   *
+   * Creates a new empty GraspModelCache that uses the given grasp database connection. The cache does not take
+   * ownership of the connection. No models are loaded until refresh is called.
+   *
+   * \param graspdb The grasp database connection to load models from.
+   */
+  GraspModelCache(const graspdb::Client *graspdb);
+
+  /*!
+   * \brief Synchronize the cache with the grasp database.
+   *
+   * Checks the state of the grasp models table. If it has changed since the last refresh, any models that no longer
+   * exist (or have a different created timestamp) are dropped and any new models are loaded and converted into a new
+   * library. Libraries given out before the refresh are left unchanged. If any new model can not be loaded, the models
+   * that were loaded are still cached but the table state is not stored, so the next refresh retries the missing
+   * models. This method is thread safe.
+   *
+   * \return True if the contents of the cache changed.
+   */
+  bool refresh();
+
+  /*!
+   * \brief Restore the cache from a snapshot.
+   *
+   * Replace the cached models and table state with the contents of the given snapshot. The next refresh compares the
+   * snapshot state and each model ID and created timestamp against the grasp database, so a stale snapshot only
+   * costs loading the models that changed. The cache is left unchanged if the snapshot can not be loaded.
+   *
+   * \param snapshot The snapshot to restore from.
+   * \return True if the snapshot was restored.
+   */
+  bool loadSnapshot(const ModelSnapshot &snapshot);
+
+  /*!
+   * \brief Save the cache to a snapshot.
+   *
+   * Write the cached models and the table state of the last refresh to the given snapshot. Nothing is written if the
+   * cache has never been synchronized or restored.
+   *
+   * \param snapshot The snapshot to save to.
+   * \return True if the snapshot was written.
+   */
+  bool saveSnapshot(const ModelSnapshot &snapshot) const;
+
+  /*!
+   * \brief Model library accessor.
+   *
+   * Get the current library of cached grasp models. The library never changes and stays valid for as long as the
+   * pointer is held, even if the cache is refreshed in the meantime. This method is thread safe.
+   *
+   * \return The current library of cached grasp models.
+   */
+  ModelLibraryConstPtr getModelLibrary() const;
+
+  /*!
+   * \brief Model library and name index accessor.
+   *
+   * Get the current library of cached grasp models and its name index as a consistent pair. Both stay valid for as
+   * long as the pointers are held. This method is thread safe.
+   *
+   * \param models The pointer to set to the current library of cached grasp models.
+   * \param name_index The pointer to set to the name index of the library.
+   */
+  void getModelLibrary(ModelLibraryConstPtr &models, NameIndexConstPtr &name_index) const;
+
+  /*!
+   * \brief Model library lookup.
+   *
+   * Find the model with the given ID in the given model library.
+   *
+   * \param models The model library to search.
+   * \param id The ID of the grasp model to find.
+   * \return A pointer to the grasp model (valid while the library is held), or NULL if no model has the given ID.
+   */
+  static const PCLGraspModel *findModel(const ModelLibraryConstPtr &models, const uint32_t id);
+
+  /*!
+   * \brief Name index lookup.
+   *
+   * Find the models with the given object name (case insensitive) in the given name index.
+   *
+   * \param name_index The name index to search.
+   * \param object_name The object name of the grasp models to find.
+   * \return A pointer to the matching models sorted by ID (valid while the index is held), or NULL if none match.
+   */
+  static const std::vector<PCLGraspModel> *findModelsByObjectName(const NameIndexConstPtr &name_index,
+      const std::string &object_name);
+
+  /*!
+   * \brief Cached models by object name accessor.
+   *
+   * Copy all of the cached grasp models with the given object name (case insensitive) into the given vector. Only the
+   * matching models are touched.
+   *
+   * \param object_name The object name of the grasp models to get.
+   * \param models The vector to fill with the matching grasp models.
+   * \return True if at least one model was found.
+   */
+  bool getModelsByObjectName(const std::string &object_name, std::vector<PCLGraspModel> &models) const;
+
+  /*!
+   * \brief Cache size accessor.
+   *
+   * Get the number of cached grasp models.
+   *
+   * \return The number of cached grasp models.
+   */
+  size_t size() const;
+
+private:
+  /*!
+   * \brief Model library mutator.
+   *
+   * Replace the current library of cached grasp models and build its name index. This method is thread safe.
+   *
+   * \param models The new library of cached grasp models.
+   */
+  void setModelLibrary(const ModelLibraryConstPtr &models);
+
+  /*! The grasp database connection. */
+  const graspdb::Client *graspdb_;
+  /*! If the cache has been synchronized at least once. */
+  bool initialized_;
+  /*! The grasp models table state at the last refresh. */
+  uint32_t max_id_, count_;
+  /*! Mutex held during a refresh (guards the database connection and table state). */
+  mutable boost::mutex refresh_mutex_;
+  /*! Mutex for the current library. */
+  mutable boost::mutex models_mutex_;
+  /*! The current library of cached models sorted by ID. */
+  ModelLibraryConstPtr models_;
+  /*! The name index of the current library. */
+  NameIndexConstPtr name_index_;
+};
+
+}
+}
+
+#endif
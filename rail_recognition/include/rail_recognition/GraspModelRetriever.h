@@ -13,8 +13,11 @@
 #ifndef RAIL_PICK_AND_PLACE_GRASP_MODEL_RETRIEVER_H_
 #define RAIL_PICK_AND_PLACE_GRASP_MODEL_RETRIEVER_H_
 
+// RAIL Recognition
+#include "GraspModelCache.h"
+
 // ROS
-#include <actionlib/server/simple_action_server.h>
+#include <actionlib/server/action_server.h>
 #include <graspdb/graspdb.h>
 #include <rail_pick_and_place_msgs/RetrieveGraspModelAction.h>
 #include <ros/ros.h>
@@ -30,15 +33,20 @@ namespace pick_and_place
  *
  * The grasp model retriever allows for loading stored models from the grasp database training set. An action server is
  * started as the main entry point to grasp retrieval. A latched topic is used to publish the resulting point cloud and
- * pose array.
+ * pose array. Goals are queued and served concurrently by a set of goal threads, so a slow database refresh does not
+ * hold up lookups that can be answered from the cache. Every goal holds the shared model library it looked the model
+ * up in, so a concurrent refresh never invalidates it.
  */
 class GraspModelRetriever
 {
 public:
+  /*! The default number of retrieval goals served concurrently. */
+  static const int DEFAULT_NUM_GOAL_THREADS = 4;
+
   /*!
    * \brief Create a GraspModelRetriever and associated ROS information.
    *
-   * Creates a ROS node handle, creates a client to the grasp database, and starts the action server.
+   * Creates a ROS node handle, creates a client to the grasp database, and starts the goal threads and action server.
    */
   GraspModelRetriever();
 
@@ -59,24 +67,35 @@ public:
   bool okay() const;
 
 private:
+  /*! The retrieve grasp model action server goal handle. */
+  typedef actionlib::ActionServer<rail_pick_and_place_msgs::RetrieveGraspModelAction>::GoalHandle GoalHandle;
+  /*! The queue of retrieve grasp model goals. */
+  typedef graspdb::GoalQueue<GoalHandle, rail_pick_and_place_msgs::RetrieveGraspModelResult> GoalQueue;
+
   /*!
-   * \brief Callback for the retrieve grasp model action server.
+   * \brief Retrieve the grasp model of a goal.
    *
-   * The retrieve grasp model action will attempt to load a stored grasp model from the grasp database.
+   * The retrieve grasp model action will attempt to load a stored grasp model from the grasp database. The goal must
+   * be accepted.
    *
-   * \param goal The goal object specifying the parameters.
+   * \param goal_handle The handle of the goal specifying the parameters.
    */
-  void retrieveGraspModel(const rail_pick_and_place_msgs::RetrieveGraspModelGoalConstPtr &goal);
+  void retrieveGraspModel(GoalHandle &goal_handle);
 
   /*! The okay check flag. */
   bool okay_;
   /*! The grasp database connection. */
   graspdb::Client *graspdb_;
+  /*! The resident grasp model cache. */
+  GraspModelCache *model_cache_;
+
+  /*! The goals waiting for a goal thread. */
+  GoalQueue goal_queue_;
 
   /*! The public and private ROS node handles. */
   ros::NodeHandle node_, private_node_;
   /*! The main action server. */
-  actionlib::SimpleActionServer<rail_pick_and_place_msgs::RetrieveGraspModelAction> as_;
+  actionlib::ActionServer<rail_pick_and_place_msgs::RetrieveGraspModelAction> as_;
   /*! The latched publishers for retrieved data. */
   ros::Publisher point_cloud_pub_, poses_pub_;
 };
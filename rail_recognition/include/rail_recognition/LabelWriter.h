@@ -0,0 +1,100 @@
+/*!
+ * \file LabelWriter.h
+ * \brief A background writer for labelled training data.
+ *
+ * The label writer appends lines of labelled training data to a file from a background thread so operators are
+ * never blocked by file output.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_LABEL_WRITER_H_
+#define RAIL_PICK_AND_PLACE_LABEL_WRITER_H_
+
+// Boost
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+// C++ Standard Library
+#include <deque>
+#include <string>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class LabelWriter
+ * \brief A background writer for labelled training data.
+ *
+ * The label writer appends queued lines to a file from a background thread. Every line queued at once is written and
+ * flushed together, so a session that is interrupted only loses the lines that were still queued.
+ */
+class LabelWriter : private boost::noncopyable
+{
+public:
+  /*!
+   * \brief Create a LabelWriter.
+   *
+   * Creates a LabelWriter and starts the writer thread. The file is opened in append mode for each write.
+   *
+   * \param file_name The file to append lines to.
+   */
+  LabelWriter(const std::string &file_name);
+
+  /*!
+   * \brief Cleans up a LabelWriter.
+   *
+   * Finishes writing every queued line and stops the writer thread.
+   */
+  virtual ~LabelWriter();
+
+  /*!
+   * \brief Queue a line to be written.
+   *
+   * Queue the given line (without a trailing newline) to be appended by the writer thread. This never blocks on file
+   * output.
+   *
+   * \param line The line to append.
+   */
+  void write(const std::string &line);
+
+  /*!
+   * \brief Wait for the queue to be written.
+   *
+   * Block until every line queued so far has been written and flushed.
+   */
+  void flush();
+
+private:
+  /*!
+   * \brief The main writer thread loop.
+   *
+   * Writes queued lines until the writer is shut down and the queue is empty.
+   */
+  void writerLoop();
+
+  /*! The file to append lines to. */
+  std::string file_name_;
+  /*! The queued lines. */
+  std::deque<std::string> queue_;
+  /*! The number of lines currently being written by the writer thread. */
+  size_t writing_;
+  /*! Mutex for the queue. */
+  boost::mutex mutex_;
+  /*! Signals for a non-empty queue and for written lines. */
+  boost::condition_variable not_empty_condition_, written_condition_;
+  /*! If the writer thread should exit once the queue is empty. */
+  bool shutdown_;
+  /*! The writer thread. */
+  boost::thread thread_;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*!
+ * \file LatencyPublisher.h
+ * \brief Periodic publishing of latency histograms as diagnostics.
+ *
+ * The latency publisher periodically summarizes a latency recorder and publishes each stage on the diagnostics topic.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_LATENCY_PUBLISHER_H_
+#define RAIL_PICK_AND_PLACE_LATENCY_PUBLISHER_H_
+
+// ROS
+#include <graspdb/graspdb.h>
+#include <ros/ros.h>
+
+// C++ Standard Library
+#include <string>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class LatencyPublisher
+ * \brief Periodic publishing of latency histograms as diagnostics.
+ *
+ * The latency publisher summarizes the given latency recorder on a wall clock timer and publishes one status for each
+ * stage with samples on the /diagnostics topic. The count, mean, 50th, 90th, and 99th percentiles, and maximum (in
+ * milliseconds) are published as key-value pairs. The recorder is reset after each summary, so every message covers a
+ * single period.
+ */
+class LatencyPublisher
+{
+public:
+  /*! The default period in seconds between diagnostics messages. */
+  static const double DEFAULT_DIAGNOSTICS_PERIOD = 5.0;
+
+  /*!
+   * \brief Create a LatencyPublisher and associated ROS information.
+   *
+   * Creates the diagnostics publisher and starts the timer. A period of 0 or less disables publishing.
+   *
+   * \param node The node handle used to advertise the diagnostics topic.
+   * \param name The name prefix of each status (e.g., the node name).
+   * \param recorder The latency recorder to summarize (must outlive this publisher).
+   * \param period The period in seconds between diagnostics messages.
+   */
+  LatencyPublisher(ros::NodeHandle &node, const std::string &name, graspdb::LatencyRecorder &recorder,
+      const double period = DEFAULT_DIAGNOSTICS_PERIOD);
+
+  /*!
+   * \brief Cleans up a LatencyPublisher.
+   *
+   * Stops the timer.
+   */
+  virtual ~LatencyPublisher();
+
+private:
+  /*!
+   * \brief Timer callback.
+   *
+   * Summarize and reset the recorder and publish the statistics of each stage.
+   *
+   * \param event The timer event.
+   */
+  void publishCallback(const ros::WallTimerEvent &event);
+
+  /*! The name prefix of each status. */
+  std::string name_;
+  /*! The latency recorder to summarize. */
+  graspdb::LatencyRecorder &recorder_;
+  /*! The diagnostics publisher. */
+  ros::Publisher diagnostics_pub_;
+  /*! The publishing timer. */
+  ros::WallTimer timer_;
+};
+
+}
+}
+
+#endif
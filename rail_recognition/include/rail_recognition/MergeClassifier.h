@@ -0,0 +1,165 @@
+/*!
+ * \file MergeClassifier.h
+ * \brief A compiled decision tree ensemble for classifying point cloud merges.
+ *
+ * The merge classifier loads a trained decision tree (or an ensemble of trees) over the registration metrics and
+ * compiles it into flat arrays that are evaluated without data dependent branches.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_MERGE_CLASSIFIER_H_
+#define RAIL_PICK_AND_PLACE_MERGE_CLASSIFIER_H_
+
+// RAIL Recognition
+#include "PointCloudMetrics.h"
+
+// C++ Standard Library
+#include <string>
+#include <vector>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class MergeClassifier
+ * \brief A compiled decision tree ensemble for classifying point cloud merges.
+ *
+ * Trees are loaded from a text file with one statement per line ('#' starts a comment):
+ *
+ *   tree                                               starts a new tree
+ *   node <feature> <threshold> <low child> <high child>  a split (high if the feature is above the threshold)
+ *   leaf <value>                                       a leaf
+ *   threshold <value>                                  the decision threshold (defaults to 0.5)
+ *
+ * Features are overlap, color_error, or distance_error. Children are indices of nodes in the same tree and must come
+ * after their parent; the first node of a tree is its root. A merge is valid if the mean leaf value of all trees is
+ * above the decision threshold. Every tree is walked for a fixed number of steps with leaves looping back to
+ * themselves, so the evaluation is the same sequence of table lookups for every pair. The default classifier is the
+ * trained two-threshold tree of point_cloud_metrics::classifyMerge.
+ */
+class MergeClassifier
+{
+public:
+  /*!
+   * \enum Feature
+   * \brief The registration metrics a split can test.
+   */
+  enum Feature
+  {
+    OVERLAP = 0, COLOR_ERROR = 1, DISTANCE_ERROR = 2, NUM_FEATURES = 3
+  };
+
+  /*! The default decision threshold on the mean leaf value. */
+  static const double DEFAULT_DECISION_THRESHOLD = 0.5;
+
+  /*!
+   * \brief Creates a new MergeClassifier.
+   *
+   * Creates a new MergeClassifier with the default trained tree.
+   */
+  MergeClassifier();
+
+  /*!
+   * \brief Load a classifier.
+   *
+   * Load and compile the trees in the given file. The current classifier is only replaced if the entire file is valid.
+   *
+   * \param file_name The file to load the trees from.
+   * \return True if the file was loaded successfully.
+   */
+  bool load(const std::string &file_name);
+
+  /*!
+   * \brief Classify a merge.
+   *
+   * Classify a merge from its precomputed registration metrics.
+   *
+   * \param metrics The registration metrics of the merge.
+   * \return If the metrics meet the criteria for a valid merge.
+   */
+  bool classify(const point_cloud_metrics::RegistrationMetrics &metrics) const;
+
+  /*!
+   * \brief Feature usage accessor.
+   *
+   * Check if any split of the classifier tests the given feature, so metrics that are never used can be skipped.
+   *
+   * \param feature The feature to check.
+   * \return If any split tests the feature.
+   */
+  bool usesFeature(const Feature feature) const;
+
+  /*!
+   * \brief Tree count accessor.
+   *
+   * Get the number of trees in the classifier.
+   *
+   * \return The number of trees in the classifier.
+   */
+  size_t getNumTrees() const;
+
+  /*!
+   * \brief Signature accessor.
+   *
+   * Get a signature of the compiled classifier. Any change to the trees or the decision threshold changes the
+   * signature.
+   *
+   * \return The classifier signature (without whitespace).
+   */
+  const std::string &getSignature() const;
+
+private:
+  /*!
+   * \struct Node
+   * \brief A single parsed node of a tree.
+   */
+  struct Node
+  {
+    /*! If the node is a leaf. */
+    bool leaf;
+    /*! The feature tested by a split. */
+    int feature;
+    /*! The threshold of a split or the value of a leaf. */
+    double value;
+    /*! The low and high children of a split (relative to the start of the tree). */
+    size_t low, high;
+  };
+
+  /*!
+   * \brief Compile the classifier.
+   *
+   * Compile the given parsed trees into the flat evaluation arrays and update the signature.
+   *
+   * \param trees The parsed nodes of each tree (already validated).
+   * \param threshold The decision threshold on the mean leaf value.
+   */
+  void compile(const std::vector<std::vector<Node> > &trees, const double threshold);
+
+  /*! The feature tested by each node (0 for leaves). */
+  std::vector<int> features_;
+  /*! The split threshold of each node (infinite for leaves). */
+  std::vector<double> thresholds_;
+  /*! The low and high successors of each node (leaves are their own successors). */
+  std::vector<size_t> next_;
+  /*! The value of each node (0 for splits). */
+  std::vector<double> values_;
+  /*! The root node of each tree. */
+  std::vector<size_t> roots_;
+  /*! The number of steps needed to reach a leaf in the deepest tree. */
+  size_t depth_;
+  /*! The decision threshold on the sum of the leaf values (the mean threshold times the number of trees). */
+  double sum_threshold_;
+  /*! If any split tests each feature. */
+  bool uses_feature_[NUM_FEATURES];
+  /*! The classifier signature. */
+  std::string signature_;
+};
+
+}
+}
+
+#endif
@@ -13,6 +13,10 @@
 #ifndef RAIL_PICK_AND_PLACE_METRIC_TRAINER_H_
 #define RAIL_PICK_AND_PLACE_METRIC_TRAINER_H_
 
+// RAIL Recognition
+#include "LabelWriter.h"
+#include "ThreadPool.h"
+
 // ROS
 #include <actionlib/client/simple_action_client.h>
 #include <actionlib/server/simple_action_server.h>
@@ -21,6 +25,19 @@
 #include <rail_pick_and_place_msgs/TrainMetricsAction.h>
 #include <ros/ros.h>
 
+// PCL
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+// Boost
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+// C++ Standard Library
+#include <deque>
+#include <utility>
+#include <vector>
+
 namespace rail
 {
 namespace pick_and_place
@@ -31,11 +48,20 @@ namespace pick_and_place
  * \brief The metric trainer node object.
  *
  * The metric trainer allows for generating data sets for training registration metric decision trees. An action server
- * is used to provide the object name and files are dumped to "registration_metrics.txt".
+ * is used to provide the object name and files are dumped to "registration_metrics.txt". Registrations and metrics for
+ * the upcoming pairs are computed on the worker threads while the operator labels the current pair, and labels are
+ * written in the background, so a labelling session is limited only by the operator. An automatic mode registers
+ * every pair of every grasp demonstration in parallel, labels each pair by object name equality, and appends the
+ * results to a CSV file without an operator.
  */
 class MetricTrainer
 {
 public:
+  /*! The default number of pairs registered ahead of the pair being labelled. */
+  static const int DEFAULT_PREFETCH_PAIRS = 4;
+  /*! The number of pairs registered between progress updates (and held in memory at once) in automatic mode. */
+  static const size_t AUTOMATIC_BATCH_SIZE = 256;
+
   /*!
    * \brief Creates a new MetricTrainer.
    *
@@ -60,6 +86,40 @@ public:
   bool okay() const;
 
 private:
+  /*!
+   * \struct RegisteredPair
+   * \brief A registered pair of point clouds and its metrics, ready to be labelled.
+   */
+  struct RegisteredPair
+  {
+    /*! The indices of the two point clouds. */
+    size_t first, second;
+    /*! The base point cloud (the larger of the two). */
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr base_pc;
+    /*! The other point cloud aligned to the base point cloud. */
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr aligned_pc;
+    /*! The overlap, distance error, and color error metrics. */
+    double m_o, m_d_err, m_c_err;
+  };
+
+  /*!
+   * \struct RegistrationQueue
+   * \brief The bounded queue of registered pairs between the registration thread and the labelling thread.
+   */
+  struct RegistrationQueue
+  {
+    /*! Mutex for the queue. */
+    boost::mutex mutex;
+    /*! Signals for a changed queue. */
+    boost::condition_variable condition;
+    /*! The registered pairs in labelling order. */
+    std::deque<RegisteredPair> ready;
+    /*! The number of registered pairs to keep ahead of the labelling thread. */
+    size_t capacity;
+    /*! If the labelling thread stopped early. */
+    bool cancelled;
+  };
+
   /*!
    * \brief The train metrics action server callback.
    *
@@ -71,10 +131,80 @@ private:
    */
   void trainMetricsCallback(const rail_pick_and_place_msgs::TrainMetricsGoalConstPtr &goal);
 
+  /*!
+   * \brief Label pairs through the operator.
+   *
+   * Register every pair of grasp demonstrations with the object name from the goal and ask the operator to label
+   * each, appending the metrics and labels to "registration_metrics.txt".
+   *
+   * \param goal The goal specifying the object name.
+   */
+  void trainMetricsInteractive(const rail_pick_and_place_msgs::TrainMetricsGoalConstPtr &goal);
+
+  /*!
+   * \brief Label pairs automatically.
+   *
+   * Register every pair of grasp demonstrations in the database in parallel, label each pair as a match if both have
+   * the same object name, and append the IDs, object names, metrics, and labels to the CSV file from the goal.
+   *
+   * \param goal The goal specifying the output file.
+   */
+  void trainMetricsAutomatic(const rail_pick_and_place_msgs::TrainMetricsGoalConstPtr &goal);
+
+  /*!
+   * \brief Convert a streamed grasp demonstration.
+   *
+   * Convert the point cloud of the given grasp demonstration, filter it, move it to the origin, and append it to the
+   * given list along with the ID and object name of the grasp demonstration.
+   *
+   * \param demonstration The streamed grasp demonstration.
+   * \param point_clouds The list of converted point clouds to append to.
+   * \param summaries The list of grasp demonstration summaries to append to.
+   * \return True so every grasp demonstration is streamed.
+   */
+  bool addDemonstrationPointCloud(graspdb::GraspDemonstration &demonstration,
+      std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &point_clouds,
+      std::vector<graspdb::Summary> &summaries) const;
+
+  /*!
+   * \brief The registration thread loop.
+   *
+   * Register the pairs in order, a batch at a time on the worker threads, keeping at most the queue capacity of
+   * registered pairs ahead of the labelling thread.
+   *
+   * \param point_clouds The filtered point clouds.
+   * \param pairs The pairs of point cloud indices to register.
+   * \param queue The queue to push registered pairs to.
+   */
+  void registrationLoop(const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &point_clouds,
+      const std::vector<std::pair<size_t, size_t> > &pairs, RegistrationQueue &queue) const;
+
+  /*!
+   * \brief Register a single pair.
+   *
+   * Perform ICP on the pair and calculate every metric. The larger point cloud is used as the base point cloud.
+   *
+   * \param index The index of the pair within the batch.
+   * \param thread The index of the thread running the task.
+   * \param first The index of the first pair of the batch.
+   * \param point_clouds The filtered point clouds.
+   * \param pairs The pairs of point cloud indices to register.
+   * \param registered The registered pairs of the batch to fill.
+   */
+  void registerPairTask(const size_t index, const size_t thread, const size_t first,
+      const std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &point_clouds,
+      const std::vector<std::pair<size_t, size_t> > &pairs, std::vector<RegisteredPair> &registered) const;
+
   /*! The okay check flag. */
   bool okay_;
   /*! The grasp database connection. */
   graspdb::Client *graspdb_;
+  /*! The thread pool used to filter point clouds and register pairs. */
+  ThreadPool *thread_pool_;
+  /*! The number of pairs registered ahead of the pair being labelled. */
+  int prefetch_pairs_;
+  /*! The background writer of the labelled metrics. */
+  LabelWriter *label_writer_;
 
   /*! The public and private ROS node handles. */
   ros::NodeHandle node_, private_node_;
@@ -14,7 +14,12 @@
 #define RAIL_PICK_AND_PLACE_MODEL_GENERATOR_H_
 
 // RAIL Recognition
+#include "LatencyPublisher.h"
+#include "MergeClassifier.h"
 #include "PCLGraspModel.h"
+#include "PointCloudMetrics.h"
+#include "RegistrationCache.h"
+#include "ThreadPool.h"
 
 // ROS
 #include <actionlib/server/simple_action_server.h>
@@ -26,6 +31,15 @@
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+// Boost
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+// C++ Standard Library
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace rail
 {
 namespace pick_and_place
@@ -36,13 +50,20 @@ namespace pick_and_place
  * \brief The grasp model generator node object.
  *
  * The grasp model generator allows for generating graspdb models based on registration criteria. An action server is
- * used to provide the model/grasp demonstration IDs to use during registration.
+ * used to provide the model/grasp demonstration IDs to use during registration. Progress feedback is throttled to the
+ * feedback rate. A preempted goal stops registering new pairs and stores the models merged so far.
  */
 class ModelGenerator
 {
 public:
   /*! If a topic should be created to display debug information such as model point clouds. */
   static const bool DEFAULT_DEBUG = false;
+  /*! The default seed for the random edge ordering. */
+  static const int DEFAULT_RANDOM_SEED = 0;
+  /*! The default maximum number of points in a merged model (0 for no limit). */
+  static const int DEFAULT_MAX_MODEL_POINTS = 0;
+  /*! The default maximum rate in Hz to publish progress feedback at (0 to publish every update). */
+  static const double DEFAULT_FEEDBACK_RATE = 2.0;
 
   /*!
    * \brief Create a ModelGenerator and associated ROS information.
@@ -77,36 +98,210 @@ private:
    */
   void generateModelsCallback(const rail_pick_and_place_msgs::GenerateModelsGoalConstPtr &goal);
 
+  /*!
+   * \brief Preemption callback.
+   *
+   * Flag the current goal as preempted so registration stops after the pairs already in progress.
+   */
+  void preemptCallback();
+
+  /*!
+   * \brief Check if the current goal was preempted.
+   *
+   * Check if the current goal was preempted or ROS is shutting down. This function is thread safe.
+   *
+   * \return True if no more pairs should be registered.
+   */
+  bool isPreempted() const;
+
+  /*!
+   * \brief Reset the progress feedback.
+   *
+   * Clear the progress counters and start the elapsed time for a new goal.
+   */
+  void resetProgress();
+
+  /*!
+   * \brief Set the number of pairs still to register.
+   *
+   * Set the total number of pairs to the pairs checked so far plus the given number of remaining pairs. The ETA is
+   * measured from the first call after the progress is reset.
+   *
+   * \param pairs_remaining The number of pairs still to register.
+   */
+  void setPairsRemaining(const size_t pairs_remaining);
+
+  /*!
+   * \brief Update the progress feedback.
+   *
+   * Add to the progress counters and publish the feedback with the given message, unless feedback was published more
+   * recently than the feedback rate allows. This function is thread safe.
+   *
+   * \param message The current state message.
+   * \param pairs_checked The number of pairs checked since the last update.
+   * \param merges The number of merged models made since the last update.
+   * \param force If the feedback should be published regardless of the feedback rate.
+   */
+  void updateProgress(const std::string &message, const size_t pairs_checked = 0, const size_t merges = 0,
+      const bool force = false);
+
   /*!
    * \brief Model generation function.
    *
-   * Attempt to search for valid registration pairs for the given models up to the max model size. Valid models are
-   * saved to the database and a list of IDs is stored in the given vector.
+   * Attempt to search for valid registration pairs for the given models up to the max model size using the given
+   * strategy. Valid models are saved to the database and a list of IDs is stored in the given vector. Registration
+   * results are taken from the registration cache when possible, keyed by the given sources of the models.
    *
    * \param grasp_models The array of grasp models to attempt to generate models for.
+   * \param sources The unique source of each grasp model (e.g., its database ID and created time) for the cache.
    * \param max_model_size The maximum number of grasps allowed per model.
+   * \param strategy The model generation strategy from the GenerateModels goal.
    * \param new_model_ids The vector to fill with the new grasp model IDs.
    */
-  void generateAndStoreModels(std::vector<PCLGraspModel> &grasp_models, const int max_model_size,
-      std::vector<uint32_t> &new_model_ids);
+  void generateAndStoreModels(std::vector<PCLGraspModel> &grasp_models, const std::vector<std::string> &sources,
+      const int max_model_size, const uint8_t strategy, std::vector<uint32_t> &new_model_ids);
+
+  /*!
+   * \brief Greedy model merging.
+   *
+   * Repeatedly register random pairs of models and merge any match, adding the merged model back into the graph.
+   * Candidate pairs are checked in waves of up to one pair per thread. The pairs of a wave never share a model, so
+   * every match in a wave can be merged. The order pairs are checked in is random but seeded, so runs with the same
+   * input and seed are reproducible. The given vector is left with the remaining models. If the goal is preempted,
+   * the matches of the current wave are still merged and no further waves are checked.
+   *
+   * \param grasp_models The grasp models to merge (prepared and with unique IDs).
+   * \param sources The unique source of each grasp model.
+   * \param max_model_size The maximum number of grasps allowed per model.
+   */
+  void mergeModelsGreedy(std::vector<PCLGraspModel> &grasp_models, const std::vector<std::string> &sources,
+      const int max_model_size);
+
+  /*!
+   * \brief Clustering model merging.
+   *
+   * Register every pair of models once (in parallel), then agglomerate the matches from best to worst overlap into
+   * clusters without exceeding the max model size. Each cluster is merged in a single step by chaining the pairwise
+   * transforms along the matches that joined it into the frame of its largest member. The given vector is left with
+   * the unmerged models followed by the merged models. If the goal is preempted, only the pairs registered before
+   * the preemption are clustered.
+   *
+   * \param grasp_models The grasp models to merge (prepared and with unique IDs).
+   * \param sources The unique source of each grasp model.
+   * \param max_model_size The maximum number of grasps allowed per model.
+   */
+  void clusterModels(std::vector<PCLGraspModel> &grasp_models, const std::vector<std::string> &sources,
+      const int max_model_size);
 
   /*!
    * \brief Check the point cloud registration for the two models.
    *
    * Attempt to merge the two models into a single model. If the model passes the criteria, the result model is
-   * filled with the corresponding model.
+   * filled with the corresponding model. If the registration cache holds a result for the given key, ICP is skipped
+   * and the cached result is used; otherwise the new result is added to the cache.
    *
    * \param base The base model to compare to.
    * \param target The target model to compare against the base model.
+   * \param key The registration cache key of the pair.
    * \param new_model_ids The resuliting model (if valid)
    * \return True if the registration meets the criteria.
    */
-  bool registrationCheck(const PCLGraspModel &base, const PCLGraspModel &target, PCLGraspModel &result) const;
+  bool registrationCheck(const PCLGraspModel &base, const PCLGraspModel &target, const std::string &key,
+      PCLGraspModel &result) const;
+
+  /*!
+   * \brief Register a pair of models.
+   *
+   * Register the target model to the base model with ICP and classify the merge from the metrics computed after
+   * registration, or use the cached result for the given key. New results are added to the registration cache.
+   *
+   * \param base The base model.
+   * \param target The target model to register to the base model.
+   * \param key The registration cache key of the pair.
+   * \param entry The registration result to fill.
+   * \param aligned_pc The point cloud to fill with the aligned target for a match (may be NULL).
+   * \return True if the registration was classified as a valid merge.
+   */
+  bool registerPair(const PCLGraspModel &base, const PCLGraspModel &target, const std::string &key,
+      RegistrationCache::Entry &entry, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &aligned_pc) const;
+
+  /*!
+   * \brief Register a single pair of the similarity matrix.
+   *
+   * Register the given pair of models and store the result at the index of the pair. Nothing is registered once the
+   * goal is preempted (the entry is left as no merge).
+   *
+   * \param index The index of the pair.
+   * \param pairs The (base, target) model index pairs.
+   * \param grasp_models The grasp models.
+   * \param sources The unique source of each grasp model.
+   * \param entries The registration results to fill.
+   */
+  void similarityTask(const size_t index, const std::vector<std::pair<size_t, size_t> > &pairs,
+      const std::vector<PCLGraspModel> &grasp_models, const std::vector<std::string> &sources,
+      std::vector<RegistrationCache::Entry> &entries);
+
+  /*!
+   * \brief Publish a model for debugging.
+   *
+   * Publish the grasp poses and point cloud of the model if debug mode is enabled.
+   *
+   * \param model The model to publish.
+   */
+  void publishDebug(const PCLGraspModel &model) const;
+
+  /*!
+   * \brief Check a single pair of a registration wave.
+   *
+   * Run the registration check for the given pair of the wave and store the result at the index of the pair. Nothing
+   * is registered once the goal is preempted (the pair is left unmatched).
+   *
+   * \param index The index of the pair in the wave.
+   * \param wave The (base, target) model ID pairs of the wave.
+   * \param models The current models by ID.
+   * \param sources The sources of the current models by ID.
+   * \param results The merged models to fill.
+   * \param matched The flags to fill with if each pair passed the registration check.
+   */
+  void registrationTask(const size_t index, const std::vector<std::pair<uint32_t, uint32_t> > &wave,
+      const boost::unordered_map<uint32_t, PCLGraspModel> &models,
+      const boost::unordered_map<uint32_t, std::string> &sources, std::vector<PCLGraspModel> &results,
+      std::vector<char> &matched) const;
 
   /*! The debug flag. */
   bool debug_, okay_;
+  /*! The seed for the random edge ordering. */
+  int random_seed_;
+  /*! The maximum number of points in a merged model (0 for no limit). */
+  int max_model_points_;
+  /*! The maximum rate in Hz to publish progress feedback at. */
+  double feedback_rate_;
+  /*! If the current goal was preempted. */
+  bool preempted_;
+  /*! The progress of the current goal. */
+  rail_pick_and_place_msgs::GenerateModelsFeedback progress_;
+  /*! The start of the current goal, its first registration, and the last published feedback. */
+  ros::WallTime progress_start_, registration_start_, last_feedback_;
+  /*! The mutex for the progress and preemption flag. */
+  mutable boost::mutex progress_mutex_;
   /*! The grasp database connection. */
   graspdb::Client *graspdb_;
+  /*! The ICP parameters used for registration. */
+  point_cloud_metrics::ICPParameters icp_parameters_;
+  /*! The classifier used to decide if a registered pair is a valid merge. */
+  MergeClassifier merge_classifier_;
+  /*! The thread pool used to filter point clouds. */
+  ThreadPool *thread_pool_;
+  /*! The registration cache (NULL if disabled). */
+  RegistrationCache *registration_cache_;
+  /*! The signature of the filter and registration parameters used in registration cache keys. */
+  std::string registration_signature_;
+  /*! The latency histograms of the database, filtering, and registration stages. */
+  mutable graspdb::LatencyRecorder latency_recorder_;
+  /*! The latency recorder stage indices. */
+  size_t filter_stage_, icp_stage_, overlap_stage_, classify_stage_, redundant_stage_, resample_stage_;
+  /*! The periodic publisher of the latency histograms. */
+  LatencyPublisher *latency_publisher_;
 
   /*! The public and private ROS node handles. */
   ros::NodeHandle node_, private_node_;
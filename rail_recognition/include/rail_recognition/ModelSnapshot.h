@@ -0,0 +1,98 @@
+/*!
+ * \file ModelSnapshot.h
+ * \brief A memory-mappable on-disk snapshot of the PCL grasp model library.
+ *
+ * The model snapshot stores every converted grasp model (PCL point arrays, color statistics, principal extents, color
+ * histograms, and grasps) in a single binary file so nodes can restore their model library at startup without
+ * converting every point cloud again.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_MODEL_SNAPSHOT_H_
+#define RAIL_PICK_AND_PLACE_MODEL_SNAPSHOT_H_
+
+// RAIL Recognition
+#include "PCLGraspModel.h"
+
+// C++ Standard Library
+#include <string>
+#include <vector>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class ModelSnapshot
+ * \brief A memory-mappable on-disk snapshot of the PCL grasp model library.
+ *
+ * The model snapshot stores every converted grasp model in a single binary file along with the state of the grasp
+ * models table (maximum ID and count) it was taken at. Points are stored in the native PCL PointXYZRGB layout so
+ * restoring a model is a single copy out of the mapped file, and the color statistics, principal extents, and color
+ * histograms are stored so nothing is recomputed. Search trees and normals are still built on first use. The file is
+ * specific to the machine architecture; snapshots with a different version, point layout, or byte order are
+ * rejected. Snapshots are written to a temporary file and renamed, so readers never see a partial file.
+ */
+class ModelSnapshot
+{
+public:
+  /*! The version of the snapshot file format. */
+  static const uint32_t VERSION = 2;
+
+  /*!
+   * \brief Creates a new ModelSnapshot.
+   *
+   * Creates a new ModelSnapshot that is stored in the given file. Nothing is read or written until load or save is
+   * called.
+   *
+   * \param file_name The file to store the snapshot in.
+   */
+  ModelSnapshot(const std::string &file_name);
+
+  /*!
+   * \brief File name accessor.
+   *
+   * Get the name of the file the snapshot is stored in.
+   *
+   * \return The name of the file the snapshot is stored in.
+   */
+  const std::string &getFileName() const;
+
+  /*!
+   * \brief Save a snapshot.
+   *
+   * Write the given models and the grasp models table state they were loaded at to the snapshot file, replacing any
+   * previous snapshot.
+   *
+   * \param models The models to store.
+   * \param max_id The maximum grasp model ID in the database when the models were loaded.
+   * \param count The number of grasp models in the database when the models were loaded.
+   * \return True if the snapshot was written successfully.
+   */
+  bool save(const std::vector<PCLGraspModel> &models, const uint32_t max_id, const uint32_t count) const;
+
+  /*!
+   * \brief Load a snapshot.
+   *
+   * Map the snapshot file and restore every model in it. The given vector and state are only modified if the entire
+   * snapshot is valid.
+   *
+   * \param models The vector to fill with the restored models (in the order they were saved).
+   * \param max_id The maximum grasp model ID in the database when the snapshot was taken.
+   * \param count The number of grasp models in the database when the snapshot was taken.
+   * \return True if the snapshot exists and was restored successfully.
+   */
+  bool load(std::vector<PCLGraspModel> &models, uint32_t &max_id, uint32_t &count) const;
+
+private:
+  /*! The file to store the snapshot in. */
+  std::string file_name_;
+};
+
+}
+}
+
+#endif
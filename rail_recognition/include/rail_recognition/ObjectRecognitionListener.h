@@ -13,11 +13,22 @@
 #ifndef RAIL_PICK_AND_PLACE_OBJECT_RECOGNITION_LISTENER_H_
 #define RAIL_PICK_AND_PLACE_OBJECT_RECOGNITION_LISTENER_H_
 
+// RAIL Recognition
+#include "GraspModelCache.h"
+#include "LatencyPublisher.h"
+#include "ObjectTracker.h"
+#include "PointCloudRecognizer.h"
+
 // ROS
 #include <graspdb/graspdb.h>
 #include <rail_manipulation_msgs/SegmentedObjectList.h>
 #include <ros/ros.h>
 
+// Boost
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 namespace rail
 {
 namespace pick_and_place
@@ -28,20 +39,32 @@ namespace pick_and_place
  * \brief The object recognition listener node object.
  *
  * The object recognition listener will listen to a specified SegmentedObjectsArray topic and attempt to recognize
- * all segmented objects. The new list are republished on a separate topic.
+ * all segmented objects. The new list are republished on a separate topic. Recognition runs on a dedicated worker
+ * thread that always takes the newest list; work on a list that is superseded before it finishes is cancelled. A list
+ * that finishes is always published, and after max_cancelled_lists cancelled lists in a row the next list is allowed to
+ * finish, so results keep coming even when lists arrive faster than they can be recognized.
  */
 class ObjectRecognitionListener
 {
 public:
   /*! If a topic should be created to display debug information such as pose arrays. */
   static const bool DEFAULT_DEBUG = false;
+  /*! If recognition results should be carried forward to matching objects in the next frame. */
+  static const bool DEFAULT_TRACK_OBJECTS = true;
+  /*! The default number of lists in a row that can be cancelled before one is allowed to finish. */
+  static const int DEFAULT_MAX_CANCELLED_LISTS = 2;
 
   /*!
    * \brief Creates a new ObjectRecognitionListener.
    *
-   * Creates a new ObjectRecognitionListener with the associated topics.
+   * Creates a new ObjectRecognitionListener with the associated topics. The node handles allow the listener to run
+   * inside a nodelet.
+   *
+   * \param node The public node handle to use (defaults to the global namespace).
+   * \param private_node The private node handle to use for parameters and advertised topics (defaults to "~").
    */
-  ObjectRecognitionListener();
+  ObjectRecognitionListener(const ros::NodeHandle &node = ros::NodeHandle(),
+      const ros::NodeHandle &private_node = ros::NodeHandle("~"));
 
   /*!
    * \brief Cleans up a ObjectRecognitionListener.
@@ -63,28 +86,55 @@ private:
   /*!
    * \brief The segmented objects callback.
    *
-   * Take the current list of segmented objects and attempt to recognize each one. The new list is republished on the
-   * recognized objects topic.
+   * Hand the current list of segmented objects to the recognition worker, replacing any list it has not started yet.
    *
    * \param objects The current list of segmented objects.
    */
   void segmentedObjectsCallback(const rail_manipulation_msgs::SegmentedObjectList::ConstPtr &objects);
 
   /*!
-   * \brief Check if the two point clouds are the same.
+   * \brief The main recognition worker loop.
+   *
+   * Waits for the newest list of segmented objects and recognizes it until the listener is shut down.
+   */
+  void recognitionLoop();
+
+  /*!
+   * \brief Recognize a list of segmented objects.
    *
-   * Checks if the data in the two point clouds are the same.
+   * Take the list of segmented objects and attempt to recognize each one. The new list is republished on the
+   * recognized objects topic unless a newer list arrives first.
    *
-   * \param pc1 The first point cloud.
-   * \param pc2 The second point cloud.
-   * \return Returns true if the data in pc1 is equal to the data in pc2.
+   * \param objects The list of segmented objects.
    */
-  bool comparePointClouds(const sensor_msgs::PointCloud2 &pc1, const sensor_msgs::PointCloud2 &pc2) const;
+  void recognizeObjects(const rail_manipulation_msgs::SegmentedObjectList::ConstPtr &objects);
 
-  /*! The debug and okay check flags. */
-  bool debug_, okay_;
+  /*!
+   * \brief Check if the current recognition should be cancelled.
+   *
+   * Check if a newer list of segmented objects is waiting or the listener is shutting down. A newer list does not
+   * cancel the current one once max_cancelled_lists lists in a row were cancelled.
+   *
+   * \return True if the current recognition should be cancelled.
+   */
+  bool isSuperseded();
+
+  /*! The debug, tracking, and okay check flags. */
+  bool debug_, track_objects_, okay_;
   /*! The grasp database connection. */
   graspdb::Client *graspdb_;
+  /*! The resident grasp model cache. */
+  GraspModelCache *model_cache_;
+  /*! The point cloud recognizer. */
+  PointCloudRecognizer *recognizer_;
+  /*! The tracker for objects recognized in the previous frame. */
+  ObjectTracker tracker_;
+  /*! The latency histograms of the database, tracking, and recognition stages. */
+  graspdb::LatencyRecorder latency_recorder_;
+  /*! The latency recorder stage indices for tracking and each full list. */
+  size_t track_stage_, list_stage_;
+  /*! The periodic publisher of the latency histograms. */
+  LatencyPublisher *latency_publisher_;
 
   /*! The public and private ROS node handles. */
   ros::NodeHandle node_, private_node_;
@@ -92,8 +142,23 @@ private:
   ros::Subscriber segmented_objects_sub_;
   /*! The recognized objects and debug publishers. */
   ros::Publisher recognized_objects_pub_, debug_pub_;
-  /*! The most recent segmented objects. */
-  rail_manipulation_msgs::SegmentedObjectList object_list_;
+  /*! The most recently published objects (never modified after publishing so it can be shared within a process). */
+  rail_manipulation_msgs::SegmentedObjectList::ConstPtr object_list_;
+
+  /*! The newest list of segmented objects waiting to be recognized (NULL if none). */
+  rail_manipulation_msgs::SegmentedObjectList::ConstPtr pending_objects_;
+  /*! If the recognition worker should exit. */
+  bool shutdown_;
+  /*! Mutex for the pending objects and the shutdown flag. */
+  boost::mutex pending_mutex_;
+  /*! Signals a new pending list or a shutdown. */
+  boost::condition_variable pending_condition_;
+  /*! The recognition worker thread. */
+  boost::thread worker_;
+  /*! The number of lists in a row that can be cancelled before one is allowed to finish (less than 0 for no limit). */
+  int max_cancelled_lists_;
+  /*! The number of lists cancelled in a row (only modified by the worker thread between lists). */
+  int cancelled_lists_;
 };
 
 }
@@ -12,11 +12,23 @@
 #ifndef RAIL_PICK_AND_PLACE_OBJECT_RECOGNIZER_H_
 #define RAIL_PICK_AND_PLACE_OBJECT_RECOGNIZER_H_
 
+// RAIL Recognition
+#include "GraspModelCache.h"
+#include "LatencyPublisher.h"
+#include "PointCloudRecognizer.h"
+
 // ROS
-#include <actionlib/server/simple_action_server.h>
+#include <actionlib/server/action_server.h>
 #include <graspdb/graspdb.h>
 #include <rail_manipulation_msgs/RecognizeObjectAction.h>
 #include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+
+// Boost
+#include <boost/thread/mutex.hpp>
+
+// C++ Standard Library
+#include <vector>
 
 namespace rail
 {
@@ -27,17 +39,31 @@ namespace pick_and_place
  * \class ObjectRecognizer
  * \brief The object recognizer node object.
  *
- * The object recognizer sets up an action server that allows the recognition of a single segmented object.
+ * The object recognizer sets up an action server that allows the recognition of a single segmented object. The best
+ * ranked candidates of the last unfiltered recognition are kept, so asking again for the same object with a name
+ * filter is answered without registering the candidates again. Goals are queued and served concurrently by a set of
+ * goal threads. Every goal reads the same shared, immutable model library, so memory use does not grow with the
+ * number of goals in flight; a goal that starts after the database changes simply uses the new library.
  */
 class ObjectRecognizer
 {
 public:
+  /*! The default number of ranked candidates kept from the last recognition. */
+  static const int DEFAULT_NUM_RANKED_RESULTS = 5;
+  /*! The default number of recognition goals served concurrently. */
+  static const int DEFAULT_NUM_GOAL_THREADS = 4;
+
   /*!
    * \brief Creates a new ObjectRecognizer.
    *
-   * Creates a new ObjectRecognizer with the associated action server.
+   * Creates a new ObjectRecognizer with the associated action server. The node handles allow the recognizer to run
+   * inside a nodelet.
+   *
+   * \param node The public node handle to use (defaults to the global namespace).
+   * \param private_node The private node handle to use for parameters and advertised servers (defaults to "~").
    */
-  ObjectRecognizer();
+  ObjectRecognizer(const ros::NodeHandle &node = ros::NodeHandle(),
+      const ros::NodeHandle &private_node = ros::NodeHandle("~"));
 
   /*!
    * \brief Cleans up a ObjectRecognizer.
@@ -56,24 +82,63 @@ public:
   bool okay() const;
 
 private:
+  /*! The recognize object action server goal handle. */
+  typedef actionlib::ActionServer<rail_manipulation_msgs::RecognizeObjectAction>::GoalHandle GoalHandle;
+  /*! The queue of recognize object goals. */
+  typedef graspdb::GoalQueue<GoalHandle, rail_manipulation_msgs::RecognizeObjectResult> GoalQueue;
+
   /*!
-   * \brief The recognize object action server callback.
+   * \brief Recognize the object of a goal.
    *
-   * Attempts to recognize the object given in the goal and return it in the result.
+   * Attempts to recognize the object given in the goal and return it in the result. The goal must be accepted.
    *
-   * \param goal The goal specifying the segmented object to recognize.
+   * \param goal_handle The handle of the goal specifying the segmented object to recognize.
    */
-  void recognizeObjectCallback(const rail_manipulation_msgs::RecognizeObjectGoalConstPtr &goal);
+  void recognizeObject(GoalHandle &goal_handle);
+
+  /*!
+   * \brief Check if the ranked candidates belong to the given point cloud.
+   *
+   * Checks if the ranked candidates were computed against the given model library for a point cloud with the same
+   * header and data. The ranked mutex must be held.
+   *
+   * \param pc The point cloud to check.
+   * \param library The model library the candidates must index into.
+   * \return True if the ranked candidates belong to the given point cloud.
+   */
+  bool isRankedPointCloud(const sensor_msgs::PointCloud2 &pc,
+      const GraspModelCache::ModelLibraryConstPtr &library) const;
 
   /*! The okay check flag. */
   bool okay_;
+  /*! The number of ranked candidates kept from the last recognition. */
+  int num_ranked_results_;
+  /*! Mutex for the ranked candidates. */
+  boost::mutex ranked_mutex_;
+  /*! The point cloud of the object the ranked candidates were computed for. */
+  sensor_msgs::PointCloud2 ranked_point_cloud_;
+  /*! The model library the ranked candidates index into (NULL if there are no ranked candidates). */
+  GraspModelCache::ModelLibraryConstPtr ranked_library_;
+  /*! The ranked candidates of the last unfiltered recognition (indices into the ranked model library). */
+  std::vector<PointCloudRecognizer::RankedCandidate> ranked_;
   /*! The grasp database connection. */
   graspdb::Client *graspdb_;
+  /*! The resident grasp model cache. */
+  GraspModelCache *model_cache_;
+  /*! The point cloud recognizer. */
+  PointCloudRecognizer *recognizer_;
+  /*! The latency histograms of the database and recognition stages. */
+  graspdb::LatencyRecorder latency_recorder_;
+  /*! The periodic publisher of the latency histograms. */
+  LatencyPublisher *latency_publisher_;
+
+  /*! The goals waiting for a goal thread. */
+  GoalQueue goal_queue_;
 
   /*! The public and private ROS node handles. */
   ros::NodeHandle node_, private_node_;
   /*! The main recognition action server. */
-  actionlib::SimpleActionServer<rail_manipulation_msgs::RecognizeObjectAction> as_;
+  actionlib::ActionServer<rail_manipulation_msgs::RecognizeObjectAction> as_;
 };
 
 }
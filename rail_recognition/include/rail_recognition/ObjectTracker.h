@@ -0,0 +1,254 @@
+/*!
+ * \file ObjectTracker.h
+ * \brief Frame to frame tracking of recognized segmented objects.
+ *
+ * The object tracker matches newly segmented objects to the objects recognized in the previous frame and carries the
+ * recognition results forward so only new or significantly changed objects need to be recognized again.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_OBJECT_TRACKER_H_
+#define RAIL_PICK_AND_PLACE_OBJECT_TRACKER_H_
+
+// ROS
+#include <rail_manipulation_msgs/SegmentedObject.h>
+#include <rail_manipulation_msgs/SegmentedObjectList.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf2/LinearMath/Vector3.h>
+
+// Boost
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+// C++ Standard Library
+#include <string>
+#include <vector>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class ObjectTracker
+ * \brief Frame to frame tracking of recognized segmented objects.
+ *
+ * The object tracker matches newly segmented objects to the objects recognized in the previous frame. A new object
+ * matches a previous object if both are in the same frame and their centroid distance, point count, axis aligned
+ * bounding box overlap, and average color are all within tolerance. Matched objects receive the previous recognition
+ * results with their grasps translated by the change in centroid. Previous objects are stored in a spatial hash on
+ * their centroid so each lookup only checks nearby objects. The tracker is not thread safe.
+ */
+class ObjectTracker
+{
+public:
+  /*! The default maximum distance in meters between the centroids of matching objects. */
+  static const double DEFAULT_MAX_CENTROID_DISTANCE = 0.02;
+  /*! The default maximum relative change in the number of points between matching objects. */
+  static const double DEFAULT_MAX_POINT_COUNT_CHANGE = 0.2;
+  /*! The default minimum intersection over union of the bounding boxes of matching objects. */
+  static const double DEFAULT_MIN_BOUNDING_BOX_OVERLAP = 0.5;
+  /*! The default maximum distance between the average RGB colors (0 to 255) of matching objects. */
+  static const double DEFAULT_MAX_COLOR_DISTANCE = 30.0;
+
+  /*!
+   * \brief Creates a new ObjectTracker.
+   *
+   * Creates a new ObjectTracker with the default tolerances and no previous objects.
+   */
+  ObjectTracker();
+
+  /*!
+   * \brief Maximum centroid distance accessor.
+   *
+   * Get the maximum distance in meters between the centroids of matching objects.
+   *
+   * \return The maximum distance in meters between the centroids of matching objects.
+   */
+  double getMaxCentroidDistance() const;
+
+  /*!
+   * \brief Maximum centroid distance mutator.
+   *
+   * Set the maximum distance in meters between the centroids of matching objects. This also sets the cell size of
+   * the spatial hash used for lookups and clears any previous objects.
+   *
+   * \param max_centroid_distance The maximum distance in meters between the centroids of matching objects.
+   */
+  void setMaxCentroidDistance(const double max_centroid_distance);
+
+  /*!
+   * \brief Maximum point count change accessor.
+   *
+   * Get the maximum relative change in the number of points between matching objects.
+   *
+   * \return The maximum relative change in the number of points between matching objects.
+   */
+  double getMaxPointCountChange() const;
+
+  /*!
+   * \brief Maximum point count change mutator.
+   *
+   * Set the maximum relative change in the number of points between matching objects.
+   *
+   * \param max_point_count_change The maximum relative change in the number of points between matching objects.
+   */
+  void setMaxPointCountChange(const double max_point_count_change);
+
+  /*!
+   * \brief Minimum bounding box overlap accessor.
+   *
+   * Get the minimum intersection over union of the bounding boxes of matching objects.
+   *
+   * \return The minimum intersection over union of the bounding boxes of matching objects.
+   */
+  double getMinBoundingBoxOverlap() const;
+
+  /*!
+   * \brief Minimum bounding box overlap mutator.
+   *
+   * Set the minimum intersection over union of the bounding boxes of matching objects.
+   *
+   * \param min_bounding_box_overlap The minimum intersection over union of the bounding boxes of matching objects.
+   */
+  void setMinBoundingBoxOverlap(const double min_bounding_box_overlap);
+
+  /*!
+   * \brief Maximum color distance accessor.
+   *
+   * Get the maximum distance between the average RGB colors (0 to 255) of matching objects.
+   *
+   * \return The maximum distance between the average RGB colors of matching objects.
+   */
+  double getMaxColorDistance() const;
+
+  /*!
+   * \brief Maximum color distance mutator.
+   *
+   * Set the maximum distance between the average RGB colors (0 to 255) of matching objects. The color check is
+   * skipped for point clouds without an RGB field.
+   *
+   * \param max_color_distance The maximum distance between the average RGB colors of matching objects.
+   */
+  void setMaxColorDistance(const double max_color_distance);
+
+  /*!
+   * \brief Carry forward previous recognition results.
+   *
+   * Match each unrecognized object in the list to a recognized object from the previous frame. Matched objects are
+   * marked as recognized and given the previous name, model ID, confidence, orientation, and grasps (translated by
+   * the change in centroid). Each previous object is matched at most once.
+   *
+   * \param objects The list of newly segmented objects to update.
+   * \return The number of objects that were matched.
+   */
+  size_t track(rail_manipulation_msgs::SegmentedObjectList &objects);
+
+  /*!
+   * \brief Store the objects of the current frame.
+   *
+   * Replace the previous objects with the recognized objects in the given list. This should be called with the final
+   * list after recognition so the next frame can be tracked against it.
+   *
+   * \param objects The list of objects from the current frame.
+   */
+  void update(const rail_manipulation_msgs::SegmentedObjectList &objects);
+
+  /*!
+   * \brief Clear the previous objects.
+   *
+   * Clear the previous objects so the next frame is recognized from scratch.
+   */
+  void clear();
+
+private:
+  /*!
+   * \struct Signature
+   * \brief The summary statistics of a segmented object point cloud used for matching.
+   */
+  struct Signature
+  {
+    /*! The frame of the point cloud. */
+    std::string frame_id;
+    /*! The centroid and bounding box corners of the point cloud. */
+    tf2::Vector3 centroid, min, max;
+    /*! The number of valid points in the point cloud. */
+    size_t num_points;
+    /*! The average RGB color of the point cloud. */
+    double r, g, b;
+    /*! If the point cloud has color information. */
+    bool has_color;
+  };
+
+  /*!
+   * \struct Track
+   * \brief A recognized object from the previous frame.
+   */
+  struct Track
+  {
+    /*! The signature of the point cloud of the object. */
+    Signature signature;
+    /*! The recognized object with its point cloud removed. */
+    rail_manipulation_msgs::SegmentedObject object;
+  };
+
+  /*!
+   * \brief Compute the signature of a point cloud.
+   *
+   * Compute the centroid, bounding box, number of valid points, and average color of the given point cloud in a
+   * single pass. Points with non-finite coordinates are skipped.
+   *
+   * \param pc The point cloud to compute the signature of.
+   * \param signature The signature to fill.
+   */
+  static void computeSignature(const sensor_msgs::PointCloud2 &pc, Signature &signature);
+
+  /*!
+   * \brief Compute the overlap of two bounding boxes.
+   *
+   * Compute the intersection over union of the axis aligned bounding boxes of the two signatures.
+   *
+   * \param s1 The first signature.
+   * \param s2 The second signature.
+   * \return The intersection over union of the two bounding boxes in [0, 1].
+   */
+  static double computeBoundingBoxOverlap(const Signature &s1, const Signature &s2);
+
+  /*!
+   * \brief Check if two signatures match.
+   *
+   * Check if the two signatures are in the same frame and within all tolerances.
+   *
+   * \param s1 The first signature.
+   * \param s2 The second signature.
+   * \return True if the two signatures match.
+   */
+  bool matches(const Signature &s1, const Signature &s2) const;
+
+  /*!
+   * \brief Compute the spatial hash cell of a point.
+   *
+   * Compute the key of the spatial hash cell containing the given point offset by the given number of cells.
+   *
+   * \param point The point to hash.
+   * \param dx The offset in cells along the x-axis.
+   * \param dy The offset in cells along the y-axis.
+   * \param dz The offset in cells along the z-axis.
+   * \return The key of the spatial hash cell.
+   */
+  uint64_t computeCell(const tf2::Vector3 &point, const int dx = 0, const int dy = 0, const int dz = 0) const;
+
+  /*! The matching tolerances. */
+  double max_centroid_distance_, max_point_count_change_, min_bounding_box_overlap_, max_color_distance_;
+  /*! The recognized objects from the previous frame. */
+  std::vector<Track> tracks_;
+  /*! The spatial hash of the indices of the previous objects by their centroid cell. */
+  boost::unordered_map<uint64_t, std::vector<size_t> > cells_;
+};
+
+}
+}
+
+#endif
@@ -4,7 +4,9 @@
  *
  * The PCLGraspModel is simply a wrapper around the graspdb GrapsModel with a PCL point cloud. A flag can also be set
  * to mark the grasp model as an original (as apposed to newly generated during model generation). All accessors to
- * the ROS point cloud message are disabled.
+ * the ROS point cloud message are disabled. A search tree and normals for the point cloud are built on first use and
+ * reused for every registration against the model. The derived statistics are stored with the model as versioned
+ * features so they are not recomputed when the model is loaded again.
  *
  * \author Russell Toris, WPI - rctoris@wpi.edu
  * \date April 8, 2015
@@ -13,12 +15,24 @@
 #ifndef RAIL_PICK_AND_PLACE_PCL_GRASP_MODEL_H_
 #define RAIL_PICK_AND_PLACE_PCL_GRASP_MODEL_H_
 
+// RAIL Recognition
+#include "PointCloudMetrics.h"
+
 // ROS
+#include <geometry_msgs/Point.h>
 #include <graspdb/GraspModel.h>
 
 // PCL
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
+#include <pcl/search/kdtree.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+// C++ Standard Library
+#include <vector>
 
 namespace rail
 {
@@ -31,21 +45,75 @@ namespace pick_and_place
  *
  * The PCLGraspModel is simply a wrapper around the graspdb GrapsModel with a PCL point cloud. A flag can also be set
  * to mark the grasp model as an original (as apposed to newly generated during model generation). All accessors to
- * the ROS point cloud message are disabled.
+ * the ROS point cloud message are disabled. A search tree and normals for the point cloud are built on first use and
+ * reused for every registration against the model. Copies of a model share the point cloud and the search index.
+ *
+ * The centroid, average colors, principal extents, and color histogram are written to the graspdb features of the
+ * model by toGraspModel and read back when a grasp model is converted, so they are only computed once (at model
+ * generation). Features with a different version, byte order, histogram size, or point count are ignored and the
+ * values are recomputed from the point cloud. Search trees and normals are not stored.
  */
 class PCLGraspModel : public graspdb::GraspModel
 {
 public:
+  /*! The radius to search within for neighbors when estimating normals. */
+  static const double NORMAL_SEARCH_RADIUS = 0.01;
+  /*! The version of the stored features format. */
+  static const uint32_t FEATURES_VERSION = 1;
+
   /*!
    * \brief Creates a new PCLGraspModel.
    *
    * Creates a new ObjectRecognizer from the graspdb grasp model object. The point cloud is converted during
-   * construction. The original flag defaults to false.
+   * construction and the point cloud message is not kept. Valid stored features are used instead of recomputing the
+   * statistics. The original flag defaults to false.
    *
    * \param grasp_model The graspdb GraspModel to create a PCLGraspModel from (defaults to an empty GraspModel).
    */
   PCLGraspModel(const graspdb::GraspModel &grasp_model = graspdb::GraspModel());
 
+  /*!
+   * \brief Creates a new PCLGraspModel.
+   *
+   * Creates a new PCLGraspModel from an already converted point cloud and its precomputed statistics (e.g., when
+   * restoring a model snapshot). Nothing is recomputed and the point cloud of the given grasp model is ignored. The
+   * original flag defaults to false.
+   *
+   * \param grasp_model The graspdb GraspModel holding the ID, object name, grasps, and created time.
+   * \param pc The converted PCL point cloud (shared, not copied).
+   * \param centroid The centroid of the point cloud.
+   * \param avg_r The average red value of the point cloud.
+   * \param avg_g The average green value of the point cloud.
+   * \param avg_b The average blue value of the point cloud.
+   * \param extents The principal extents of the point cloud.
+   * \param color_histogram The color histogram of the point cloud.
+   */
+  PCLGraspModel(const graspdb::GraspModel &grasp_model, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
+      const geometry_msgs::Point &centroid, const double avg_r, const double avg_g, const double avg_b,
+      const Eigen::Vector3f &extents, const point_cloud_metrics::ColorHistogram &color_histogram);
+
+  /*!
+   * \brief Take over a graspdb GraspModel.
+   *
+   * Replace the values of this PCLGraspModel with the given grasp model. The object name and grasps are swapped
+   * rather than copied, and the point cloud message of the given grasp model is released as soon as it has been
+   * converted, so only one copy of the point cloud exists at a time. Valid stored features are used instead of
+   * recomputing the statistics. The given grasp model is left empty. The original flag is not modified.
+   *
+   * \param grasp_model The graspdb GraspModel to take over.
+   */
+  void consume(graspdb::GraspModel &grasp_model);
+
+  /*!
+   * \brief Swap the values of two PCLGraspModel objects.
+   *
+   * Swap every value of this PCLGraspModel with the given PCLGraspModel without copying the grasps or point clouds.
+   * This is used to move models within containers.
+   *
+   * \param other The PCLGraspModel to swap values with.
+   */
+  void swap(PCLGraspModel &other);
+
   /*!
    * \brief Original flag accessor.
    *
@@ -129,22 +197,124 @@ public:
    */
   double getAverageBlue() const;
 
+  /*!
+   * \brief Point cloud centroid accessor.
+   *
+   * Get the centroid of the PCL point cloud.
+   *
+   * \return The centroid of the PCL point cloud.
+   */
+  const geometry_msgs::Point &getCentroid() const;
+
+  /*!
+   * \brief Principal extents accessor.
+   *
+   * Get the extents of the PCL point cloud along its principal axes (largest first). This is used as a cheap shape
+   * descriptor to prune candidates before registration.
+   *
+   * \return The principal extents of the PCL point cloud.
+   */
+  const Eigen::Vector3f &getPrincipalExtents() const;
+
+  /*!
+   * \brief Color histogram accessor.
+   *
+   * Get the HSV color histogram of the PCL point cloud. This is used to prune candidates with different colors
+   * before registration.
+   *
+   * \return The color histogram of the PCL point cloud.
+   */
+  const point_cloud_metrics::ColorHistogram &getColorHistogram() const;
+
+  /*!
+   * \brief Search tree accessor.
+   *
+   * Get the search tree for the PCL point cloud. The search tree is built on the first call and reused afterwards.
+   * This method is thread safe.
+   *
+   * \return The search tree for the PCL point cloud.
+   */
+  pcl::search::KdTree<pcl::PointXYZRGB>::Ptr getSearchTree() const;
+
+  /*!
+   * \brief Normals accessor.
+   *
+   * Get the estimated normals of the PCL point cloud. The normals are estimated on the first call and reused
+   * afterwards. This method is thread safe.
+   *
+   * \return The estimated normals of the PCL point cloud.
+   */
+  pcl::PointCloud<pcl::Normal>::ConstPtr getNormals() const;
+
+  /*!
+   * \brief Reset the search index.
+   *
+   * Drop the cached search tree and normals and recompute the centroid, average colors, principal extents, and color
+   * histogram. This must be called after the PCL point cloud is modified in place.
+   */
+  void resetSearchIndex();
+
   /*!
    * \brief Creates a graspdb GraspModel from this PCL grasp model.
    *
-   * Creates and returns a new graspdb GraspModel from this PCL grasp model.
+   * Creates and returns a new graspdb GraspModel from this PCL grasp model, including the features of the point
+   * cloud.
    *
    * \return The new graspdb GraspModel.
    */
   graspdb::GraspModel toGraspModel() const;
 
 private:
+  /*!
+   * \brief Encode the features.
+   *
+   * Encode the centroid, average colors, principal extents, and color histogram of the point cloud into a versioned
+   * features blob.
+   *
+   * \param features The features blob to fill.
+   */
+  void encodeFeatures(std::vector<uint8_t> &features) const;
+
+  /*!
+   * \brief Decode the features.
+   *
+   * Restore the centroid, average colors, principal extents, and color histogram from a features blob and invalidate
+   * any old search structures. Nothing is modified if the blob is not valid for the current point cloud.
+   *
+   * \param features The features blob to decode.
+   * \return True if the features were valid and restored.
+   */
+  bool decodeFeatures(const std::vector<uint8_t> &features);
+
   /*! The original model flag. */
   bool original_;
   /*! The internal shared pointer to the PCL point cloud. */
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr pc_;
   /*! Color information for the point cloud */
   double avg_r_, avg_g_, avg_b_;
+  /*! The centroid of the point cloud. */
+  geometry_msgs::Point centroid_;
+  /*! The principal extents of the point cloud. */
+  Eigen::Vector3f extents_;
+  /*! The color histogram of the point cloud. */
+  point_cloud_metrics::ColorHistogram color_histogram_;
+
+  /*!
+   * \struct SearchIndex
+   * \brief The lazily built search structures for the point cloud.
+   */
+  struct SearchIndex
+  {
+    /*! Mutex for building the search structures. */
+    boost::mutex mutex;
+    /*! The search tree (NULL until built). */
+    pcl::search::KdTree<pcl::PointXYZRGB>::Ptr search_tree;
+    /*! The estimated normals (NULL until built). */
+    pcl::PointCloud<pcl::Normal>::Ptr normals;
+  };
+
+  /*! The shared search index. */
+  boost::shared_ptr<SearchIndex> index_;
 };
 
 }
@@ -12,15 +12,20 @@
 #ifndef RAIL_PICK_AND_PLACE_POINT_CLOUD_METRICS_H_
 #define RAIL_PICK_AND_PLACE_POINT_CLOUD_METRICS_H_
 
+// RAIL Recognition
+#include "ThreadPool.h"
+
 // ROS
 #include <geometry_msgs/Point.h>
 #include <graspdb/Grasp.h>
+#include <ros/node_handle.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <tf2/LinearMath/Transform.h>
 
 // PCL
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
+#include <pcl/search/kdtree.h>
 
 // C++ Standard Library
 #include <vector>
@@ -40,22 +45,185 @@ static const double DEFAULT_FILTER_REDUNDANT_SEARCH_RADIUS = 0.00075;
 static const int DEFAULT_FILTER_OUTLIER_MIN_NUM_NEIGHBORS = 6;
 /*! The radius to search within for neighbors during the overlap metric search. */
 static const double DEFAULT_METRIC_OVERLAP_SEARCH_RADIUS = 0.005;
+/*! The maximum number of voxel grid passes used to fit a point cloud into a point budget. */
+static const int POINT_BUDGET_MAX_PASSES = 8;
+/*! The maximum number of source points used to score each principal axis hypothesis. */
+static const int PRINCIPAL_AXIS_HYPOTHESIS_SAMPLES = 256;
+/*! The number of hue bins of the chromatic part of a color histogram (each split by saturation and value). */
+static const int COLOR_HISTOGRAM_HUE_BINS = 12;
+/*! The number of value bins of the achromatic part of a color histogram. */
+static const int COLOR_HISTOGRAM_GRAY_BINS = 16;
+/*! The total number of bins of a color histogram. */
+static const int COLOR_HISTOGRAM_BINS = COLOR_HISTOGRAM_HUE_BINS * 4 + COLOR_HISTOGRAM_GRAY_BINS;
+/*! The minimum saturation and value (in [0, 1]) of a chromatic point in a color histogram. */
+static const double COLOR_HISTOGRAM_MIN_CHROMA = 0.2;
+/*! The minimum overlap of a valid merge for the default merge classifier (found via decision tree training). */
+static const double DEFAULT_MERGE_MIN_OVERLAP = 0.471303;
+/*! The maximum color error of a valid merge for the default merge classifier (found via decision tree training). */
+static const double DEFAULT_MERGE_MAX_COLOR_ERROR = 97.0674;
+
+/*!
+ * \struct ICPParameters
+ * \brief Configuration for the multi-resolution ICP pipeline.
+ *
+ * ICP first aligns voxel downsampled copies of the point clouds for each voxel size (coarse to fine), using the result
+ * of each level as the initial guess for the next. A final pass always runs on the full resolution point clouds. The
+ * termination criteria are used for every level. With principal axis initialization the source is first matched to
+ * the target by their principal axes; the sign ambiguity of the axes gives four seeded rotations, which are scored
+ * with the identity on a sample of source points, and ICP starts from the best one. The defaults match the PCL
+ * defaults with no downsampling and no initialization.
+ */
+struct ICPParameters
+{
+  /*! The voxel sizes of each coarse level, from coarse to fine (empty for a single full resolution pass). */
+  std::vector<double> voxel_sizes;
+  /*! The maximum number of ICP iterations per level. */
+  int max_iterations;
+  /*! The maximum distance between corresponding points. */
+  double max_correspondence_distance;
+  /*! The minimum change in the transformation required to continue. */
+  double transformation_epsilon;
+  /*! The minimum change in the mean squared error required to continue. */
+  double euclidean_fitness_epsilon;
+  /*! If ICP starts from the best principal axis hypothesis instead of the identity. */
+  bool principal_axis_initialization;
+
+  /*!
+   * \brief Creates a new ICPParameters.
+   *
+   * Creates a new ICPParameters with a single full resolution pass and the PCL default termination criteria.
+   */
+  ICPParameters();
+};
+
+/*!
+ * \struct PointCloudStatistics
+ * \brief The centroid and color statistics of a point cloud.
+ */
+struct PointCloudStatistics
+{
+  /*! The centroid of the finite points. */
+  geometry_msgs::Point centroid;
+  /*! The average color values. */
+  double avg_r, avg_g, avg_b;
+  /*! The color value standard deviations. */
+  double std_dev_r, std_dev_g, std_dev_b;
+
+  /*!
+   * \brief Creates a new PointCloudStatistics.
+   *
+   * Creates a new PointCloudStatistics with all values set to 0.
+   */
+  PointCloudStatistics();
+};
+
+/*!
+ * \struct ColorHistogram
+ * \brief A compact HSV color histogram of a point cloud.
+ *
+ * Chromatic points are binned by hue (COLOR_HISTOGRAM_HUE_BINS bins), then by low or high saturation and value.
+ * Points with a low saturation or value have no reliable hue, so they are binned by value alone. Each bin holds the
+ * fraction of points in it, so histograms of point clouds of any size can be compared.
+ */
+struct ColorHistogram
+{
+  /*! The fraction of points in each bin. */
+  float bins[COLOR_HISTOGRAM_BINS];
+
+  /*!
+   * \brief Creates a new ColorHistogram.
+   *
+   * Creates a new ColorHistogram with all bins set to 0.
+   */
+  ColorHistogram();
+};
+
+/*!
+ * \struct RegistrationMetrics
+ * \brief The metrics of a registered pair of point clouds.
+ *
+ * The metrics are computed once after registration and handed to the merge classifier, so no metric is computed
+ * twice for the same pair.
+ */
+struct RegistrationMetrics
+{
+  /*! The overlap and color error metrics. */
+  double overlap, color_error;
+  /*! The distance error metric. */
+  double distance_error;
+
+  /*!
+   * \brief Creates a new RegistrationMetrics.
+   *
+   * Creates a new RegistrationMetrics with all values set to 0.
+   */
+  RegistrationMetrics();
+};
+
+/*!
+ * \struct ColorDistanceScratch
+ * \brief Reusable scratch buffers for the neighbor color distance kernel.
+ *
+ * The neighbor colors are gathered into separate arrays (structure of arrays) so the distance loop can be vectorized.
+ * The buffers only grow, so reusing a scratch object avoids allocations in the metric loops.
+ */
+struct ColorDistanceScratch
+{
+  /*! The gathered neighbor color values. */
+  std::vector<int> r, g, b;
+  /*! The per neighbor color distances. */
+  std::vector<double> distances;
+};
+
+/*!
+ * \struct MetricWorkspace
+ * \brief Reusable buffers for the registration metrics.
+ *
+ * A workspace holds the search result buffers, the color distance scratch buffers, and a temporary aligned point
+ * cloud. Every buffer only grows, so passing the same workspace to repeated metric calculations avoids allocations
+ * after the first call. A workspace must only be used by one thread at a time.
+ */
+struct MetricWorkspace
+{
+  /*! The search result indices. */
+  std::vector<int> indices;
+  /*! The search result squared distances. */
+  std::vector<float> distances;
+  /*! The color distance scratch buffers. */
+  ColorDistanceScratch color_scratch;
+  /*! A temporary point cloud for alignment results (created by the first user). */
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr aligned;
+};
+
+/*!
+ * \brief Load the ICP parameters from ROS.
+ *
+ * Load any of the icp_voxel_sizes, icp_max_iterations, icp_max_correspondence_distance, icp_transformation_epsilon,
+ * and icp_euclidean_fitness_epsilon parameters that are set on the given node handle. Unset values are left as is.
+ *
+ * \param node The node handle to read the parameters from.
+ * \param parameters The ICP parameters to update.
+ */
+void loadICPParameters(const ros::NodeHandle &node, ICPParameters &parameters);
 
 /*!
  * \brief Convert a ROS point cloud message to a PCL point cloud.
  *
- * Converts the given ROS point cloud message to a PCL point cloud.
+ * Converts the given ROS point cloud message to a PCL point cloud with a single copy of the data. Messages in the PCL
+ * PointXYZRGB layout are copied in one pass and other little endian messages with FLOAT32 x, y, and z fields (and an
+ * optional rgb or rgba field) are copied field by field. Anything else uses the generic PCL conversion.
  *
  * \param in The input ROS point cloud message.
  * \param out The PCL point cloud to create.
  */
-void rosPointCloud2ToPCLPointCloud(const sensor_msgs::PointCloud2 in,
+void rosPointCloud2ToPCLPointCloud(const sensor_msgs::PointCloud2 &in,
     const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &out);
 
 /*!
  * \brief Convert a PCL point cloud to a ROS point cloud message.
  *
- * Converts the given PCL point cloud to a ROS point cloud message.
+ * Converts the given PCL point cloud to a ROS point cloud message with a single copy of the points. The message has
+ * the same fields and layout as the generic PCL conversion.
  *
  * \param in The input PCL point cloud message.
  * \param out The ROS point cloud message to create.
@@ -77,17 +245,53 @@ void filterPointCloudOutliers(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
     const double filter_outlier_search_radius = DEFAULT_FILTER_OUTLIER_SEARCH_RADIUS,
     const double filter_outlier_min_num_neighbors = DEFAULT_FILTER_OUTLIER_MIN_NUM_NEIGHBORS);
 
+/*!
+ * \brief Filter point cloud outliers in parallel.
+ *
+ * Filter outliers in the point cloud using the given thread pool. The point range is split across the threads, each
+ * point is marked as kept or removed, and the kept points are extracted in order afterwards. The result is identical
+ * to the serial version. This must not be called from inside a task of the same thread pool.
+ *
+ * \param thread_pool The thread pool to search with.
+ * \param pc The point cloud to remove outlier points from.
+ * \param filter_outlier_search_radius The search radius to be considered as an outlier point (defaults to constant).
+ * \param filter_outlier_min_num_neighbors The minimum neighbors to be consider as an outlier (defaults to constant).
+ */
+void filterPointCloudOutliers(ThreadPool &thread_pool, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
+    const double filter_outlier_search_radius = DEFAULT_FILTER_OUTLIER_SEARCH_RADIUS,
+    const double filter_outlier_min_num_neighbors = DEFAULT_FILTER_OUTLIER_MIN_NUM_NEIGHBORS);
+
 /*!
  * \brief Filter redundant points from the point cloud.
  *
- * Filter redundant points from the point cloud effectively downsampling it.
+ * Filter redundant points from the point cloud effectively downsampling it. Points are visited in order and each
+ * point that is kept marks every other point within the search radius as redundant. The kept points are then
+ * extracted in a single pass, so no two remaining points are within the search radius of each other.
  *
  * \param pc The point cloud to remove redundant points from.
  * \param filter_redundant_search_radius The search radius to be considered as a redundant point (defaults to constant).
+ * \return The number of points that were removed.
  */
-void filterRedundantPoints(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
+size_t filterRedundantPoints(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
     const double filter_redundant_search_radius = DEFAULT_FILTER_REDUNDANT_SEARCH_RADIUS);
 
+/*!
+ * \brief Limit the number of points in the point cloud.
+ *
+ * Resample the point cloud with a voxel grid so it holds at most the given number of points. Sampled surfaces hold a
+ * number of points proportional to the inverse square of the leaf size, so the leaf size starts from that estimate
+ * and grows until the budget is met (at most POINT_BUDGET_MAX_PASSES passes over the original points). Each voxel
+ * keeps the average position and color of its points, so dense regions are thinned the most. If the budget is still
+ * exceeded, evenly spaced points are kept. Point clouds within the budget are not modified.
+ *
+ * \param pc The point cloud to resample.
+ * \param max_points The maximum number of points (0 for no limit).
+ * \param min_leaf_size The smallest voxel size to try (defaults to the redundant point search radius).
+ * \return The number of points that were removed.
+ */
+size_t limitPointCloudSize(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc, const size_t max_points,
+    const double min_leaf_size = DEFAULT_FILTER_REDUNDANT_SEARCH_RADIUS);
+
 /*!
  * \brief Compute the centroid of the given point cloud.
  *
@@ -98,6 +302,17 @@ void filterRedundantPoints(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
  */
 geometry_msgs::Point computeCentroid(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc);
 
+/*!
+ * \brief Compute the principal extents of the given point cloud.
+ *
+ * Compute the extent of the point cloud along each of its principal axes, sorted from largest to smallest. This is a
+ * cheap, rotation invariant shape descriptor used to prune candidates before registration.
+ *
+ * \param pc The point cloud to compute the principal extents of.
+ * \return The principal extents of the point cloud (all zero for an empty point cloud).
+ */
+Eigen::Vector3f calculatePrincipalExtents(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc);
+
 /*!
  * \brief Transform the point cloud to be centered about the origin.
  *
@@ -152,6 +367,37 @@ void transformToOrigin(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
 double calculateRegistrationMetricDistanceError(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &base,
     const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target);
 
+/*!
+ * \brief Point cloud distance error metric calculator.
+ *
+ * Calculate the total distance between each point in target to the closest point in base using a prebuilt search tree
+ * over the base point cloud.
+ *
+ * \param base_search_tree The search tree over the base point cloud.
+ * \param target The target point cloud..
+ * \return The total distance between each point in target to the closest point in base.
+ */
+double calculateRegistrationMetricDistanceError(const pcl::search::KdTree<pcl::PointXYZRGB> &base_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target);
+
+/*!
+ * \brief Bounded point cloud distance error metric calculator.
+ *
+ * Calculate the total distance between each point in target to the closest point in base using a prebuilt search tree
+ * over the base point cloud. The search stops as soon as the partial sum exceeds the given bound, since the remaining
+ * points can only increase it. The result is identical to the unbounded version whenever true is returned.
+ *
+ * \param base_search_tree The search tree over the base point cloud.
+ * \param target The target point cloud.
+ * \param max_distance_error The bound on the total distance.
+ * \param workspace The reusable buffers to search with.
+ * \param distance_error The total distance (or the partial sum that exceeded the bound).
+ * \return True if the total distance is within the bound.
+ */
+bool calculateBoundedRegistrationMetricDistanceError(const pcl::search::KdTree<pcl::PointXYZRGB> &base_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target, const double max_distance_error,
+    MetricWorkspace &workspace, double &distance_error);
+
 /*!
  * \brief Point cloud overlap metric calculator.
  *
@@ -169,6 +415,94 @@ void calculateRegistrationMetricOverlap(const pcl::PointCloud<pcl::PointXYZRGB>:
     const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target, double &overlap, double &color_error,
     const double metric_overlap_search_radius = DEFAULT_METRIC_OVERLAP_SEARCH_RADIUS);
 
+/*!
+ * \brief Point cloud overlap metric calculator.
+ *
+ * Calculate the overlap metric for the given point clouds using a prebuilt search tree over the base point cloud. See
+ * the point cloud version for details on the metrics.
+ *
+ * \param base_search_tree The search tree over the base point cloud.
+ * \param target The target point cloud.
+ * \param overlap The overlap metric score.
+ * \param color_error The color error metric score.
+ * \param metric_overlap_search_radius The search radius to consider a point to be overlapping (defaults to constant).
+ */
+void calculateRegistrationMetricOverlap(const pcl::search::KdTree<pcl::PointXYZRGB> &base_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target, double &overlap, double &color_error,
+    const double metric_overlap_search_radius = DEFAULT_METRIC_OVERLAP_SEARCH_RADIUS);
+
+/*!
+ * \brief Bounded point cloud overlap metric calculator.
+ *
+ * Calculate the overlap metric for the given point clouds using a prebuilt search tree over the base point cloud. The
+ * search stops as soon as the remaining points can no longer lift the overlap to the given minimum. The results are
+ * identical to the unbounded version whenever true is returned.
+ *
+ * \param base_search_tree The search tree over the base point cloud.
+ * \param target The target point cloud.
+ * \param min_overlap The minimum overlap required.
+ * \param workspace The reusable buffers to search with.
+ * \param overlap The overlap metric score (or the best overlap still possible when stopped early).
+ * \param color_error The color error metric score (infinity when stopped early).
+ * \param metric_overlap_search_radius The search radius to consider a point to be overlapping (defaults to constant).
+ * \return True if the overlap can meet the minimum and the metrics were fully calculated.
+ */
+bool calculateBoundedRegistrationMetricOverlap(const pcl::search::KdTree<pcl::PointXYZRGB> &base_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target, const double min_overlap, MetricWorkspace &workspace,
+    double &overlap, double &color_error,
+    const double metric_overlap_search_radius = DEFAULT_METRIC_OVERLAP_SEARCH_RADIUS);
+
+/*!
+ * \brief Fused centroid and color statistics calculator.
+ *
+ * Calculate the centroid, average color values, and color value standard deviations of the point cloud in a single
+ * pass. Colors are accumulated as exact integer sums of the packed RGB values. Non-finite points are skipped for the
+ * centroid of non-dense point clouds. All values are 0 for an empty point cloud.
+ *
+ * \param pc The point cloud.
+ * \param statistics The statistics to fill.
+ */
+void calculatePointCloudStatistics(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc,
+    PointCloudStatistics &statistics);
+
+/*!
+ * \brief Color histogram calculator.
+ *
+ * Calculate the HSV color histogram of the point cloud. All bins are 0 for an empty point cloud.
+ *
+ * \param pc The point cloud.
+ * \param histogram The histogram to fill.
+ */
+void calculateColorHistogram(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc, ColorHistogram &histogram);
+
+/*!
+ * \brief Color histogram distance calculator.
+ *
+ * Calculate the total variation distance (half the L1 distance) between two color histograms. The distance is 0 for
+ * identical histograms and 1 for histograms with no bins in common. The loop has no branches so it is vectorized.
+ *
+ * \param a The first histogram.
+ * \param b The second histogram.
+ * \return The distance between the histograms in [0, 1].
+ */
+float calculateColorHistogramDistance(const ColorHistogram &a, const ColorHistogram &b);
+
+/*!
+ * \brief Average neighbor color distance calculator.
+ *
+ * Calculate the average Euclidean RGB distance between the given point and the given neighbors in the point cloud.
+ * Neighbor colors are gathered into the scratch buffers and the distances are computed in a vectorizable loop. The
+ * distances are summed in neighbor order, so the result is bit-identical to the scalar calculation.
+ *
+ * \param point The point to compare against.
+ * \param pc The point cloud the neighbor indices refer to.
+ * \param indices The indices of the neighbors.
+ * \param scratch The scratch buffers to use.
+ * \return The average RGB distance to the neighbors (0 if there are no neighbors).
+ */
+double calculateAvgColorDistance(const pcl::PointXYZRGB &point, const pcl::PointCloud<pcl::PointXYZRGB> &pc,
+    const std::vector<int> &indices, ColorDistanceScratch &scratch);
+
 /*!
  * \brief Average color value calculator.
  *
@@ -192,7 +526,7 @@ void calculateAvgColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc, d
  * \param std_dev_g A reference to the standard deviation in the green value to store.
  * \param std_dev_b A reference to the standard deviation in the blue value to store.
  */
-double calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc, double &std_dev_r,
+void calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc, double &std_dev_r,
     double &std_dev_g, double &std_dev_b);
 
 /*!
@@ -208,7 +542,7 @@ double calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &
  * \param avg_g The average green color.
  * \param avg_b The average blue color.
  */
-double calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc, double &std_dev_r,
+void calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc, double &std_dev_r,
     double &std_dev_g, double &std_dev_b, const double avg_r, const double avg_g, const double avg_b);
 
 /*!
@@ -224,6 +558,17 @@ double calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &
 bool classifyMerge(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &base,
     const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target);
 
+/*!
+ * \brief Classify the point cloud merge.
+ *
+ * Classify a merge from its precomputed registration metrics using the default trained thresholds. Only the overlap
+ * and color error are used.
+ *
+ * \param metrics The registration metrics of the merge.
+ * \return If the metrics meet the criteria for a valid merge.
+ */
+bool classifyMerge(const RegistrationMetrics &metrics);
+
 /*!
  * \brief Perform ICP on the given point clouds.
  *
@@ -232,10 +577,67 @@ bool classifyMerge(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &base,
  * \param target The target point cloud.
  * \param source The source point cloud (to transform to the target).
  * \param result The transformed source point cloud.
+ * \param parameters The resolution levels and termination criteria to use (defaults to a single PCL default pass).
  * \return The transform used to move source to target.
  */
 tf2::Transform performICP(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target,
-    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &source, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &result);
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &source, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &result,
+    const ICPParameters &parameters = ICPParameters());
+
+/*!
+ * \brief Perform ICP on the given point clouds.
+ *
+ * Perform ICP on the given point clouds using a prebuilt search tree over the target point cloud and store the
+ * resulting transformed point cloud in the result pointer. The search tree is not modified and can be shared between
+ * threads (with older versions of PCL that always rebuild the tree, a local tree is used instead).
+ *
+ * \param target_search_tree The search tree over the target point cloud.
+ * \param source The source point cloud (to transform to the target).
+ * \param result The transformed source point cloud.
+ * \param parameters The resolution levels and termination criteria to use (defaults to a single PCL default pass).
+ * \return The transform used to move source to target.
+ */
+tf2::Transform performICP(const pcl::search::KdTree<pcl::PointXYZRGB>::Ptr &target_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &source, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &result,
+    const ICPParameters &parameters = ICPParameters());
+
+/*!
+ * \brief Principal axes calculator.
+ *
+ * Calculate the principal axes of the point cloud as the columns of a rotation matrix, ordered from the largest to the
+ * smallest variance and made right-handed.
+ *
+ * \param pc The point cloud (with at least one point).
+ * \param axes The principal axes to fill.
+ * \param centroid The centroid to fill.
+ */
+void calculatePrincipalAxes(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc, Eigen::Matrix3f &axes,
+    Eigen::Vector3f &centroid);
+
+/*!
+ * \brief Select an initial alignment from principal axis hypotheses.
+ *
+ * Create the identity and the four rotations that match the principal axes of the source to those of the target
+ * (every right-handed choice of axis signs), each moving the source centroid to the target centroid. Each hypothesis
+ * is scored by the mean squared nearest distance of up to PRINCIPAL_AXIS_HYPOTHESIS_SAMPLES evenly spaced source
+ * points and the best is returned (ties keep the identity).
+ *
+ * \param target_search_tree The search tree over the target point cloud.
+ * \param source The source point cloud.
+ * \return The best initial transform of the source.
+ */
+Eigen::Matrix4f selectPrincipalAxisAlignment(const pcl::search::KdTree<pcl::PointXYZRGB> &target_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &source);
+
+/*!
+ * \brief Convert an ICP transformation matrix to a TF2 transform.
+ *
+ * Convert the given homogeneous transformation matrix from ICP to a TF2 transform.
+ *
+ * \param transform The homogeneous transformation matrix.
+ * \return The TF2 transform.
+ */
+tf2::Transform icpToTF2Transform(const Eigen::Matrix4f &transform);
 }
 }
 }
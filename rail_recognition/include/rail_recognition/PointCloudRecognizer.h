@@ -14,19 +14,34 @@
 #define RAIL_PICK_AND_PLACE_POINT_CLOUD_RECOGNIZER_H_
 
 // RAIL Recognition
+#include "DeviceModelLibrary.h"
 #include "PCLGraspModel.h"
+#include "PointCloudMetrics.h"
+#include "ThreadPool.h"
 
 // ROS
 #include <graspdb/graspdb.h>
 #include <sensor_msgs/PointCloud.h>
 #include <ros/ros.h>
 #include <rail_manipulation_msgs/SegmentedObject.h>
+#include <rail_manipulation_msgs/SegmentedObjectList.h>
 #include <tf2/LinearMath/Transform.h>
 
 // PCL
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+// Boost
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility.hpp>
+
+// C++ Standard Library
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace rail
 {
 namespace pick_and_place
@@ -48,13 +63,158 @@ public:
   static const double SCORE_CONFIDENCE_THRESHOLD = 0.8;
   /*! The threshold for the overlap metric to be considered a valid match. */
   static const double OVERLAP_THRESHOLD = 0.75;
+  /*! The default maximum color histogram distance of a registered candidate (1 disables the histogram check). */
+  static const double DEFAULT_MAX_COLOR_HISTOGRAM_DISTANCE = 1.0;
+
+  /*!
+   * \struct RankedCandidate
+   * \brief A candidate model that matched a segmented object with its registration result.
+   */
+  struct RankedCandidate
+  {
+    /*! The index of the candidate in the list of candidates. */
+    size_t index;
+    /*! The weighted registration score (a measure of error). */
+    double score;
+    /*! The transform between the candidate model and the segmented object. */
+    tf2::Transform tf_icp;
+  };
 
   /*!
    * \brief Creates a new PointCloudRecognizer.
    *
-   * Creates a new PointCloudRecognizer.
+   * Creates a new PointCloudRecognizer. Candidates are scored on a pool of the given number of threads. A value of 1
+   * scores every candidate serially and a value less than 1 uses the number of hardware threads.
+   *
+   * \param num_threads The number of threads used to score candidates (defaults to 1).
+   */
+  PointCloudRecognizer(const int num_threads = 1);
+
+  /*!
+   * \brief Number of threads accessor.
+   *
+   * Get the number of threads used to score candidates.
+   *
+   * \return The number of threads used to score candidates.
+   */
+  int getNumThreads() const;
+
+  /*!
+   * \brief Maximum ICP candidates accessor.
+   *
+   * Get the maximum number of candidates registered with ICP for each object. Candidates that pass the color check are
+   * ranked by the distance between their principal extents and those of the object and only the closest are
+   * registered. A value less than 1 means every candidate that passes the color check is registered.
+   *
+   * \return The maximum number of candidates registered with ICP for each object.
+   */
+  int getMaxICPCandidates() const;
+
+  /*!
+   * \brief Maximum ICP candidates mutator.
+   *
+   * Set the maximum number of candidates registered with ICP for each object. A value less than 1 disables pruning.
+   *
+   * \param max_icp_candidates The maximum number of candidates registered with ICP for each object.
+   */
+  void setMaxICPCandidates(const int max_icp_candidates);
+
+  /*!
+   * \brief Maximum grasps accessor.
+   *
+   * Get the maximum number of grasps given to a recognized object. Grasps are ranked by success rate (ties broken by
+   * model order) and only the best are kept. A value less than 1 means every grasp is kept.
+   *
+   * \return The maximum number of grasps given to a recognized object.
+   */
+  int getMaxGrasps() const;
+
+  /*!
+   * \brief Maximum grasps mutator.
+   *
+   * Set the maximum number of grasps given to a recognized object. A value less than 1 keeps every grasp.
+   *
+   * \param max_grasps The maximum number of grasps given to a recognized object.
+   */
+  void setMaxGrasps(const int max_grasps);
+
+  /*!
+   * \brief Maximum color histogram distance accessor.
+   *
+   * Get the maximum distance between the color histograms of an object and a candidate for the candidate to be
+   * registered (defaults to DEFAULT_MAX_COLOR_HISTOGRAM_DISTANCE). Distances are in [0, 1], so a value of 1 or more
+   * disables the histogram check, which is off by default.
+   *
+   * \return The maximum color histogram distance.
+   */
+  double getMaxColorHistogramDistance() const;
+
+  /*!
+   * \brief Maximum color histogram distance mutator.
+   *
+   * Set the maximum distance between the color histograms of an object and a candidate for the candidate to be
+   * registered. A value below 1 enables the histogram check; it should be tuned against the model library in use.
+   *
+   * \param max_color_histogram_distance The maximum color histogram distance.
+   */
+  void setMaxColorHistogramDistance(const double max_color_histogram_distance);
+
+  /*!
+   * \brief Bounded scoring flag accessor.
+   *
+   * Get if bounded scoring is enabled (defaults to true). In bounded mode the metric passes stop as soon as a candidate
+   * can no longer reach the overlap threshold or beat the best score found so far for the object (shared across
+   * threads). Bounded scoring never changes the recognition result.
+   *
+   * \return True if bounded scoring is enabled.
+   */
+  bool isBoundedScoring() const;
+
+  /*!
+   * \brief Bounded scoring flag mutator.
+   *
+   * Set if bounded scoring is enabled.
+   *
+   * \param bounded_scoring If bounded scoring should be enabled.
+   */
+  void setBoundedScoring(const bool bounded_scoring);
+
+  /*!
+   * \brief ICP parameters accessor.
+   *
+   * Get the resolution levels and termination criteria used for registration.
+   *
+   * \return The ICP parameters used for registration.
+   */
+  const point_cloud_metrics::ICPParameters &getICPParameters() const;
+
+  /*!
+   * \brief ICP parameters mutator.
+   *
+   * Set the resolution levels and termination criteria used for registration.
+   *
+   * \param icp_parameters The ICP parameters used for registration.
+   */
+  void setICPParameters(const point_cloud_metrics::ICPParameters &icp_parameters);
+
+  /*!
+   * \brief Latency recorder accessor.
+   *
+   * Get the latency recorder used to time each recognition stage.
+   *
+   * \return The latency recorder (or NULL if timing is disabled).
+   */
+  graspdb::LatencyRecorder *getLatencyRecorder() const;
+
+  /*!
+   * \brief Latency recorder mutator.
+   *
+   * Set the latency recorder used to time the conversion, filtering, ICP, each metric, and grasp ranking of every
+   * recognition call. The recorder is not owned by this recognizer and must outlive it.
+   *
+   * \param latency_recorder The latency recorder (or NULL to disable timing).
    */
-  PointCloudRecognizer();
+  void setLatencyRecorder(graspdb::LatencyRecorder *latency_recorder);
 
   /*!
    * \brief The main recognition function.
@@ -62,7 +222,8 @@ public:
    * Attempt to recognize the given object against the list of candidates. The object is compared to each candidate
    * and registration metrics are calculated. The weighted score is checked and the model with the lowest error score
    * is picked as the object. If this score meets the threshold, the segmented object is updated with the correct
-   * grasps and object information.
+   * grasps and object information. Candidates are scored in parallel and reduced in candidate order, so the result is
+   * identical to scoring each candidate serially.
    *
    * \param object The segmented object to recognize and update if recognition is successful.
    * \param candidates The list of candidate models for this object.
@@ -71,34 +232,324 @@ public:
   bool recognizeObject(rail_manipulation_msgs::SegmentedObject &object,
       const std::vector<PCLGraspModel> &candidates) const;
 
+  /*!
+   * \brief The ranked recognition function.
+   *
+   * Attempt to recognize the given object exactly as recognizeObject would, and also return up to the given number of
+   * best candidates that meet the confidence threshold from the same sweep. Candidates are ordered by score (ties
+   * broken by candidate order), so the first ranked candidate is always the one applied to the object. Bounded scoring
+   * is limited by the worst of the best scores found so far, so the ranking is the same as with unbounded scoring.
+   *
+   * \param object The segmented object to recognize and update if recognition is successful.
+   * \param candidates The list of candidate models for this object.
+   * \param max_results The maximum number of ranked candidates to return.
+   * \param ranked The list of ranked candidates to fill.
+   * \return True if the segmented object was recognized and updated accordingly.
+   */
+  bool recognizeObject(rail_manipulation_msgs::SegmentedObject &object,
+      const std::vector<PCLGraspModel> &candidates, const size_t max_results,
+      std::vector<RankedCandidate> &ranked) const;
+
+  /*!
+   * \brief The batch recognition function.
+   *
+   * Attempt to recognize every object in the given list that is not already recognized. All objects are pre-processed
+   * up front and every (object, candidate) pair is scored as a single batch of independent tasks. Each object is
+   * then updated exactly as recognizeObject would. If a cancellation check is given, it is polled before each
+   * candidate is scored; once it returns true the remaining candidates are skipped and no object is updated. A batch
+   * that finishes before the check returns true is applied as usual. Concurrent calls are safe and each batch uses its
+   * own workspaces, but with more than one thread the scoring tasks of every batch share the same thread pool and run
+   * one batch at a time; only pre-processing, candidate selection and applying the results overlap.
+   *
+   * \param objects The list of segmented objects to recognize and update.
+   * \param candidates The list of candidate models for these objects.
+   * \param cancelled The optional cancellation check (must be thread safe).
+   * \param was_cancelled Set to true if any candidate was skipped and nothing was updated (may be NULL).
+   * \return The number of objects that were recognized and updated.
+   */
+  size_t recognizeObjects(rail_manipulation_msgs::SegmentedObjectList &objects,
+      const std::vector<PCLGraspModel> &candidates,
+      const boost::function<bool()> &cancelled = boost::function<bool()>(), bool *was_cancelled = NULL) const;
+
+  /*!
+   * \brief Update the segmented object with a recognition result.
+   *
+   * Fill in the recognition information of the segmented object and compute its grasps from the matched model. The
+   * orientation of the object is the rotation from the model to the object. Grasps with a zero success rate after at
+   * least one attempt are dropped and the rest are ordered from the highest success rate to the lowest. This can be
+   * used to apply a ranked candidate other than the best one.
+   *
+   * \param object The segmented object to update.
+   * \param model The matched model.
+   * \param score The registration score of the match.
+   * \param tf_icp The transform between the matched model and the segmented object.
+   */
+  void applyRecognition(rail_manipulation_msgs::SegmentedObject &object, const PCLGraspModel &model,
+      const double score, const tf2::Transform &tf_icp) const;
+
 private:
+  /*!
+   * \struct PreparedObject
+   * \brief A segmented object that has been pre-processed for registration.
+   */
+  struct PreparedObject
+  {
+    /*! The filtered point cloud shifted to the origin. */
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr point_cloud;
+    /*! The average colors of the point cloud. */
+    double avg_r, avg_g, avg_b;
+    /*! The standard deviation of the colors of the point cloud. */
+    double std_dev_r, std_dev_g, std_dev_b;
+    /*! The principal extents of the point cloud. */
+    Eigen::Vector3f extents;
+    /*! The color histogram of the point cloud. */
+    point_cloud_metrics::ColorHistogram color_histogram;
+  };
+
+  /*!
+   * \struct ScoreBounds
+   * \brief The best score found so far for each object, shared across threads.
+   */
+  struct ScoreBounds
+  {
+    /*! Mutex for the bounds. */
+    boost::mutex mutex;
+    /*! The score a new candidate must not exceed for each object. */
+    std::vector<double> values;
+    /*! The number of best scores that must be found before the bound of an object is tightened. */
+    size_t max_results;
+    /*! The best scores found so far for each object in ascending order (at most max_results each). */
+    std::vector<std::vector<double> > best;
+    /*! The optional cancellation check for the batch; remaining pairs are skipped once it returns true. */
+    boost::function<bool()> cancelled;
+  };
+
+  /*!
+   * \struct ScoringWorkspaces
+   * \brief The metric workspaces used by a single batch, one for each thread.
+   */
+  struct ScoringWorkspaces
+  {
+    /*! The metric workspace for each thread. */
+    std::vector<point_cloud_metrics::MetricWorkspace> workspaces;
+    /*! The candidates of the last batch kept in device memory (only used with the GPU backend). */
+    boost::shared_ptr<DeviceModelLibrary> device_library;
+  };
+
+  /*!
+   * \struct WorkspacePool
+   * \brief The workspace sets reused across recognition calls.
+   *
+   * Every batch in flight checks out its own set, so concurrent calls never share scratch buffers. A new set is only
+   * created when every existing set is in use, so the pool grows to the largest number of concurrent batches.
+   */
+  struct WorkspacePool
+  {
+    /*! Mutex for the list of available sets. */
+    boost::mutex mutex;
+    /*! The sets not currently used by a batch. */
+    std::vector<boost::shared_ptr<ScoringWorkspaces> > available;
+    /*! The number of workspaces in each set. */
+    size_t num_workspaces;
+  };
+
+  /*!
+   * \class ScopedWorkspaces
+   * \brief Checks out a workspace set for the lifetime of a batch.
+   */
+  class ScopedWorkspaces : private boost::noncopyable
+  {
+  public:
+    /*!
+     * \brief Check out a workspace set.
+     *
+     * Take an available set from the pool or create a new one if every set is in use.
+     *
+     * \param pool The pool to check the set out of.
+     */
+    ScopedWorkspaces(WorkspacePool &pool);
+
+    /*!
+     * \brief Return the workspace set.
+     *
+     * Return the set to the pool so the next batch can reuse it.
+     */
+    ~ScopedWorkspaces();
+
+    /*!
+     * \brief Workspace set accessor.
+     *
+     * Get the checked out workspace set.
+     *
+     * \return The checked out workspace set.
+     */
+    ScoringWorkspaces &get() const;
+
+  private:
+    /*! The pool the set belongs to. */
+    WorkspacePool &pool_;
+    /*! The checked out set. */
+    boost::shared_ptr<ScoringWorkspaces> workspaces_;
+  };
+
+  /*!
+   * \brief Recognize a set of valid objects.
+   *
+   * Pre-process and score every object against every candidate, then update each object with its best match if it
+   * meets the confidence threshold. Objects must have a non-empty point cloud. Nothing is updated if the batch is
+   * cancelled.
+   *
+   * \param objects The segmented objects to recognize and update.
+   * \param candidates The list of candidate models.
+   * \param cancelled The optional cancellation check polled before each candidate is scored.
+   * \param max_results The maximum number of ranked candidates to keep for each object.
+   * \param ranked The list of ranked candidates to fill for each object (or NULL if only the best is needed).
+   * \param was_cancelled Set to true if the batch was cancelled (may be NULL).
+   * \return The number of objects that were recognized and updated.
+   */
+  size_t recognize(const std::vector<rail_manipulation_msgs::SegmentedObject *> &objects,
+      const std::vector<PCLGraspModel> &candidates, const boost::function<bool()> &cancelled,
+      const size_t max_results, std::vector<std::vector<RankedCandidate> > *ranked,
+      bool *was_cancelled = NULL) const;
+
+  /*!
+   * \brief Pre-process a segmented object for registration.
+   *
+   * Convert the point cloud of the segmented object, calculate its color statistics, filter outliers, and shift it to
+   * the origin. The result is stored at the index of the object.
+   *
+   * \param index The index of the object to pre-process.
+   * \param objects The segmented objects.
+   * \param filter_pool The thread pool used to filter outliers in parallel (or NULL to filter serially).
+   * \param prepared The list of pre-processed objects to fill.
+   */
+  void prepareObjectTask(const size_t index, const std::vector<rail_manipulation_msgs::SegmentedObject *> &objects,
+      ThreadPool *filter_pool, std::vector<PreparedObject> &prepared) const;
+
+  /*!
+   * \brief Select the candidates to register with an object.
+   *
+   * Check each candidate against the average color and color histogram of the object. If a maximum number of ICP
+   * candidates is set, the remaining candidates are ranked by the distance between their principal extents and those
+   * of the object and only the closest are kept. The selected candidate indices are appended in ascending order.
+   *
+   * \param candidates The list of candidate models.
+   * \param object The pre-processed object.
+   * \param selected The list of selected candidate indices to append to.
+   */
+  void selectCandidates(const std::vector<PCLGraspModel> &candidates, const PreparedObject &object,
+      std::vector<size_t> &selected) const;
+
+  /*!
+   * \brief Score a single (object, candidate) pair.
+   *
+   * Score the registration of the given pair. The score and transform are stored at the slot for the pair (ordered by
+   * object first, then by candidate). The metric workspace of the current thread is used for all temporary buffers.
+   *
+   * \param index The index of the pair to score.
+   * \param thread The index of the thread running the task.
+   * \param pairs The list of (object, candidate) index pairs.
+   * \param candidates The list of candidate models.
+   * \param objects The pre-processed objects.
+   * \param bounds The best score found so far for each object (only used in bounded mode).
+   * \param workspaces The workspace set checked out by the batch.
+   * \param scores The list of scores to fill.
+   * \param icp_tfs The list of transforms to fill.
+   */
+  void scoreTask(const size_t index, const size_t thread, const std::vector<std::pair<size_t, size_t> > &pairs,
+      const std::vector<PCLGraspModel> &candidates, const std::vector<PreparedObject> &objects, ScoreBounds &bounds,
+      ScoringWorkspaces &workspaces, std::vector<double> &scores, std::vector<tf2::Transform> &icp_tfs) const;
+
+  /*!
+   * \brief Score every (object, candidate) pair with the device model library.
+   *
+   * Register every pair with ICP in parallel, then compute the metrics of every registered pair with batched searches
+   * against the candidates kept in device memory by the workspace set. The library is only rebuilt when the candidates
+   * change. Bounded scoring does not apply since every metric of the batch is computed at once.
+   *
+   * \param pairs The list of (object, candidate) index pairs.
+   * \param candidates The list of candidate models.
+   * \param objects The pre-processed objects.
+   * \param cancelled The optional cancellation check polled before each pair is registered.
+   * \param workspaces The workspace set checked out by the batch.
+   * \param scores The list of scores to fill.
+   * \param icp_tfs The list of transforms to fill.
+   */
+  void scoreOnDevice(const std::vector<std::pair<size_t, size_t> > &pairs,
+      const std::vector<PCLGraspModel> &candidates, const std::vector<PreparedObject> &objects,
+      const boost::function<bool()> &cancelled, ScoringWorkspaces &workspaces, std::vector<double> &scores,
+      std::vector<tf2::Transform> &icp_tfs) const;
+
+  /*!
+   * \brief Register a single (object, candidate) pair.
+   *
+   * Register the object to the candidate with ICP. The aligned point cloud is stored at the index of the pair and the
+   * transform at the slot for the pair.
+   *
+   * \param index The index of the pair to register.
+   * \param pairs The list of (object, candidate) index pairs.
+   * \param candidates The list of candidate models.
+   * \param objects The pre-processed objects.
+   * \param cancelled The optional cancellation check; the pair is skipped once it returns true.
+   * \param aligned The list of aligned point clouds to fill.
+   * \param icp_tfs The list of transforms to fill.
+   */
+  void registerTask(const size_t index, const std::vector<std::pair<size_t, size_t> > &pairs,
+      const std::vector<PCLGraspModel> &candidates, const std::vector<PreparedObject> &objects,
+      const boost::function<bool()> &cancelled,
+      std::vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &aligned, std::vector<tf2::Transform> &icp_tfs) const;
+
   /*!
    * \brief Score the point cloud registration for the two point clouds.
    *
    * Perform registration from the object to the candidate and return the resulting weighted registration score (a
    * measure of error). The tf_icp transform is filled with the transform used to shift the object to the candidate.
-   * A score of infinity (meaning a very poor match) is possible.
+   * A score of infinity (meaning a very poor match) is possible. The search tree of the candidate is reused for ICP
+   * and both metrics. In bounded mode, scoring stops early and infinity is returned as soon as the score is known to be
+   * greater than the given bound. The aligned point cloud and all search buffers are taken from the given workspace.
    *
-   * \param candidate The candidate point cloud.
+   * \param candidate The candidate model.
    * \param object The point cloud of the object in question.
+   * \param bound The score the registration must not exceed (only used in bounded mode).
+   * \param workspace The metric workspace to use.
    * \param tf_icp The transform from object to candidate used after ICP.
    * \return The score representing the weighted success of the registration (a measure of error).
    */
-  double scoreRegistration(pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr candidate,
-      pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr object, tf2::Transform &tf_icp) const;
+  double scoreRegistration(const PCLGraspModel &candidate, pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr object,
+      const double bound, point_cloud_metrics::MetricWorkspace &workspace, tf2::Transform &tf_icp) const;
 
   /*!
-   * \brief Compute the grasps for the recognized object.
+   * \brief Compute the ranked grasps for the recognized object.
    *
-   * Compute the grasps to the recognized object based on the grasps from the model.
+   * Rank the usable grasps from the model by success rate, keep at most the maximum number of grasps, and transform
+   * only the kept grasp poses to the recognized object.
    *
    * \param tf_icp The transform between the candidate model and the segmented object.
    * \param centroid The centroid of the object point cloud.
    * \param candidate_grasps The candidate grasps from the model.
-   * \param grasps The transformed grasps with respect to the recognized object.
+   * \param frame_id The frame of the object point cloud.
+   * \param grasps The ranked and transformed grasp poses with respect to the recognized object.
    */
   void computeGraspList(const tf2::Transform &tf_icp, const geometry_msgs::Point &centroid,
-      const std::vector<graspdb::Grasp> &candidate_grasps, std::vector<graspdb::Grasp> &grasps) const;
+      const std::vector<graspdb::Grasp> &candidate_grasps, const std::string &frame_id,
+      std::vector<geometry_msgs::PoseStamped> &grasps) const;
+
+  /*! The maximum number of candidates registered with ICP for each object and grasps given to each object. */
+  int max_icp_candidates_, max_grasps_;
+  /*! The maximum color histogram distance of a registered candidate. */
+  double max_color_histogram_distance_;
+  /*! If bounded scoring is enabled. */
+  bool bounded_scoring_;
+  /*! The ICP parameters used for registration. */
+  point_cloud_metrics::ICPParameters icp_parameters_;
+  /*! The thread pool used to score candidates. */
+  boost::shared_ptr<ThreadPool> thread_pool_;
+  /*! The workspace sets checked out by each batch in flight. */
+  boost::shared_ptr<WorkspacePool> workspace_pool_;
+  /*! The optional latency recorder (not owned). */
+  graspdb::LatencyRecorder *latency_recorder_;
+  /*! The latency recorder stage indices. */
+  size_t recognize_stage_, convert_stage_, filter_stage_, icp_stage_, overlap_stage_, distance_stage_, grasps_stage_;
 };
 
 }
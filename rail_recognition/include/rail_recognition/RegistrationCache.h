@@ -0,0 +1,146 @@
+/*!
+ * \file RegistrationCache.h
+ * \brief A persistent cache of pairwise registration results.
+ *
+ * The registration cache stores the ICP transform, overlap, color error, and merge decision for each registered pair
+ * of point clouds in an append-only file so later model generation runs can skip pairs that were already registered.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_REGISTRATION_CACHE_H_
+#define RAIL_PICK_AND_PLACE_REGISTRATION_CACHE_H_
+
+// ROS
+#include <tf2/LinearMath/Transform.h>
+
+// Boost
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+// C++ Standard Library
+#include <string>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class RegistrationCache
+ * \brief A persistent cache of pairwise registration results.
+ *
+ * The registration cache stores the ICP transform, overlap, color error, and merge decision for each registered pair
+ * of point clouds in an append-only file so later model generation runs can skip pairs that were already registered.
+ * Entries are keyed by the source of both point clouds and a signature of the parameters used to filter and register
+ * them, so changing any of those parameters never returns a stale result. All methods are thread safe.
+ */
+class RegistrationCache
+{
+public:
+  /*!
+   * \struct Entry
+   * \brief A single cached registration result.
+   */
+  struct Entry
+  {
+    /*! The ICP transform from the target to the base point cloud. */
+    tf2::Transform tf_icp;
+    /*! The overlap and color error metrics after registration. */
+    double overlap, color_error;
+    /*! If the registration was classified as a valid merge. */
+    bool merge;
+
+    /*!
+     * \brief Create a new Entry.
+     *
+     * Creates a new Entry with an identity transform, zero metrics, and no merge.
+     */
+    Entry();
+  };
+
+  /*!
+   * \brief Creates a new RegistrationCache.
+   *
+   * Creates a new RegistrationCache that is stored in the given file. Any entries already in the file are loaded.
+   *
+   * \param file_name The file to store the cache in.
+   */
+  RegistrationCache(const std::string &file_name);
+
+  /*!
+   * \brief File name accessor.
+   *
+   * Get the name of the file the cache is stored in.
+   *
+   * \return The name of the file the cache is stored in.
+   */
+  const std::string &getFileName() const;
+
+  /*!
+   * \brief Size accessor.
+   *
+   * Get the number of cached entries.
+   *
+   * \return The number of cached entries.
+   */
+  size_t size() const;
+
+  /*!
+   * \brief Find a cached registration result.
+   *
+   * Find the cached result with the given key.
+   *
+   * \param key The key of the result (see createKey).
+   * \param entry The entry to fill if the result is found.
+   * \return True if the result was found.
+   */
+  bool find(const std::string &key, Entry &entry) const;
+
+  /*!
+   * \brief Store a registration result.
+   *
+   * Store the result with the given key and append it to the cache file.
+   *
+   * \param key The key of the result (see createKey).
+   * \param entry The result to store.
+   * \return True if the result was also written to the cache file.
+   */
+  bool insert(const std::string &key, const Entry &entry);
+
+  /*!
+   * \brief Create a cache key.
+   *
+   * Create the key for registering the target point cloud to the base point cloud. Sources and the signature must not
+   * contain whitespace.
+   *
+   * \param base_source The source of the base point cloud.
+   * \param target_source The source of the target point cloud.
+   * \param signature The signature of the filter and registration parameters.
+   * \return The cache key.
+   */
+  static std::string createKey(const std::string &base_source, const std::string &target_source,
+      const std::string &signature);
+
+private:
+  /*!
+   * \brief Load the cache file.
+   *
+   * Load every entry in the cache file. Later entries replace earlier entries with the same key and malformed lines
+   * are skipped.
+   */
+  void load();
+
+  /*! The file the cache is stored in. */
+  std::string file_name_;
+  /*! Mutex for the entries and the file. */
+  mutable boost::mutex mutex_;
+  /*! The cached entries by key. */
+  boost::unordered_map<std::string, Entry> entries_;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*!
+ * \file ThreadPool.h
+ * \brief A fixed size pool of worker threads for data parallel tasks.
+ *
+ * The thread pool keeps a set of worker threads alive and uses them to run a number of independent, indexed tasks.
+ * The calling thread also works on the tasks and blocks until every task has finished.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+#ifndef RAIL_PICK_AND_PLACE_THREAD_POOL_H_
+#define RAIL_PICK_AND_PLACE_THREAD_POOL_H_
+
+// Boost
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/utility.hpp>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class ThreadPool
+ * \brief A fixed size pool of worker threads for data parallel tasks.
+ *
+ * The thread pool keeps a set of worker threads alive and uses them to run a number of independent, indexed tasks.
+ * The calling thread also works on the tasks and blocks until every task has finished. Tasks are handed out in index
+ * order; callers that need a deterministic result should store per-task results and reduce them in index order.
+ */
+class ThreadPool : private boost::noncopyable
+{
+public:
+  /*!
+   * \brief Creates a new ThreadPool.
+   *
+   * Creates a new ThreadPool with the given total number of threads (including the calling thread). A value of 1
+   * runs every task serially in the calling thread. A value less than 1 uses the number of hardware threads.
+   *
+   * \param num_threads The total number of threads to use (defaults to 1).
+   */
+  ThreadPool(const int num_threads = 1);
+
+  /*!
+   * \brief Cleans up a ThreadPool.
+   *
+   * Stops and joins all worker threads.
+   */
+  virtual ~ThreadPool();
+
+  /*!
+   * \brief Number of threads accessor.
+   *
+   * Get the total number of threads used to run tasks (including the calling thread).
+   *
+   * \return The total number of threads used to run tasks.
+   */
+  int getNumThreads() const;
+
+  /*!
+   * \brief Run a set of indexed tasks.
+   *
+   * Run the given task once for each index in [0, num_tasks) across all threads and block until every task has
+   * finished. Tasks must be independent of each other and must not throw. Each task is also given the index of the
+   * thread running it, in [0, getNumThreads()), so tasks can reuse per-thread scratch data. Bound functions that only
+   * take the task index can ignore the thread index. Tasks must not call run on the same thread pool.
+   *
+   * \param num_tasks The number of tasks to run.
+   * \param task The task to run with the index of the current task and the index of the current thread.
+   */
+  void run(const size_t num_tasks, const boost::function<void(size_t, size_t)> &task);
+
+private:
+  /*!
+   * \brief The main worker thread loop.
+   *
+   * Waits for new work and runs tasks until the pool is shut down.
+   *
+   * \param thread_index The index of this worker thread.
+   */
+  void workerLoop(const size_t thread_index);
+
+  /*!
+   * \brief Run tasks until none are left.
+   *
+   * Claims and runs tasks from the current batch until every task has been claimed.
+   *
+   * \param thread_index The index of the thread running the tasks.
+   */
+  void runTasks(const size_t thread_index);
+
+  /*! The total number of threads used to run tasks. */
+  int num_threads_;
+  /*! The worker threads. */
+  boost::thread_group workers_;
+  /*! Mutex for serializing calls to run. */
+  boost::mutex run_mutex_;
+  /*! Mutex for the current batch state. */
+  boost::mutex mutex_;
+  /*! Signals for new work and finished work. */
+  boost::condition_variable work_condition_, done_condition_;
+  /*! The current task (only valid during a call to run). */
+  const boost::function<void(size_t, size_t)> *task_;
+  /*! The size of the current batch, the next task to claim, and the number of tasks still running. */
+  size_t num_tasks_, next_task_, running_tasks_;
+  /*! Incremented for each new batch so workers can detect new work. */
+  unsigned long generation_;
+  /*! If the workers should exit. */
+  bool shutdown_;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*!
+ * \file object_recognition_listener_nodelet.cpp
+ * \brief The object recognition listener nodelet.
+ *
+ * Runs the object recognition listener inside a nodelet manager so segmented objects are shared by pointer with no
+ * serialization or copy.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/ObjectRecognitionListener.h"
+
+// ROS
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class ObjectRecognitionListenerNodelet
+ * \brief The object recognition listener nodelet.
+ *
+ * Runs the object recognition listener inside a nodelet manager so segmented objects are shared by pointer with no
+ * serialization or copy.
+ */
+class ObjectRecognitionListenerNodelet : public nodelet::Nodelet
+{
+private:
+  /*!
+   * \brief Initialize the nodelet.
+   *
+   * Creates the ObjectRecognitionListener with the node handles of this nodelet.
+   */
+  virtual void onInit()
+  {
+    listener_.reset(new ObjectRecognitionListener(this->getNodeHandle(), this->getPrivateNodeHandle()));
+    if (!listener_->okay())
+    {
+      NODELET_ERROR("ObjectRecognitionListener could not be initialized.");
+    }
+  }
+
+  /*! The object recognition listener. */
+  boost::shared_ptr<ObjectRecognitionListener> listener_;
+};
+
+}
+}
+
+PLUGINLIB_EXPORT_CLASS(rail::pick_and_place::ObjectRecognitionListenerNodelet, nodelet::Nodelet)
@@ -0,0 +1,58 @@
+/*!
+ * \file object_recognizer_nodelet.cpp
+ * \brief The object recognizer nodelet.
+ *
+ * Runs the object recognizer inside a nodelet manager so recognition requests are shared by pointer with no
+ * serialization or copy.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/ObjectRecognizer.h"
+
+// ROS
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+// Boost
+#include <boost/shared_ptr.hpp>
+
+namespace rail
+{
+namespace pick_and_place
+{
+
+/*!
+ * \class ObjectRecognizerNodelet
+ * \brief The object recognizer nodelet.
+ *
+ * Runs the object recognizer inside a nodelet manager so recognition requests are shared by pointer with no
+ * serialization or copy.
+ */
+class ObjectRecognizerNodelet : public nodelet::Nodelet
+{
+private:
+  /*!
+   * \brief Initialize the nodelet.
+   *
+   * Creates the ObjectRecognizer with the node handles of this nodelet.
+   */
+  virtual void onInit()
+  {
+    recognizer_.reset(new ObjectRecognizer(this->getNodeHandle(), this->getPrivateNodeHandle()));
+    if (!recognizer_->okay())
+    {
+      NODELET_ERROR("ObjectRecognizer could not be initialized.");
+    }
+  }
+
+  /*! The object recognizer. */
+  boost::shared_ptr<ObjectRecognizer> recognizer_;
+};
+
+}
+}
+
+PLUGINLIB_EXPORT_CLASS(rail::pick_and_place::ObjectRecognizerNodelet, nodelet::Nodelet)
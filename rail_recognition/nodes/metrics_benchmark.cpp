@@ -0,0 +1,714 @@
+/*!
+ * \file metrics_benchmark.cpp
+ * \brief A benchmark for the point cloud metric kernels.
+ *
+ * The metrics benchmark times the neighbor color distance kernel used by the overlap metric against the original
+ * scalar calculation and counts the heap allocations made by the registration metrics with and without a reused
+ * metric workspace. It then runs every point cloud metrics kernel and reports the time and heap allocations per point
+ * and, where the hardware counters are available, the cache misses per point, including the direct point cloud
+ * conversions against the generic PCL conversions. Recorded point clouds can be given as PCD files on the command
+ * line; synthetic point clouds of 1k, 10k, and 100k points are used if none are given.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/PointCloudMetrics.h"
+#include "rail_recognition/ThreadPool.h"
+
+// ROS
+#include <pcl_conversions/pcl_conversions.h>
+#include <ros/ros.h>
+
+// PCL
+#include <pcl/io/pcd_io.h>
+#include <pcl/search/kdtree.h>
+
+// Boost
+#include <boost/random.hpp>
+
+// Linux
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// C++ Standard Library
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+/*! The number of timed repetitions of each kernel. */
+static const int NUM_REPETITIONS = 20;
+/*! The number of points in the synthetic point cloud. */
+static const int NUM_SYNTHETIC_POINTS = 10000;
+/*! The sizes of the synthetic point clouds used for the kernel suite. */
+static const int KERNEL_SUITE_SIZES[] = {1000, 10000, 100000};
+/*! The number of points processed by each kernel across all repetitions (at least one repetition is run). */
+static const size_t KERNEL_POINT_BUDGET = 200000;
+
+/*! The number of heap allocations made so far (updated atomically since some kernels use a thread pool). */
+static unsigned long num_allocations = 0;
+/*! The file descriptor of the hardware cache miss counter (or -1 if it is not available). */
+static int cache_miss_fd = -1;
+
+/*!
+ * Counting replacement for the global allocation function.
+ *
+ * \param size The number of bytes to allocate.
+ * \return The allocated memory.
+ */
+void *operator new(size_t size) throw(std::bad_alloc)
+{
+  __sync_fetch_and_add(&num_allocations, 1);
+  void *memory = malloc(size == 0 ? 1 : size);
+  if (memory == NULL)
+  {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+/*!
+ * Matching replacement for the global deallocation function.
+ *
+ * \param memory The memory to free.
+ */
+void operator delete(void *memory) throw()
+{
+  free(memory);
+}
+
+/*!
+ * The original scalar neighbor color distance calculation.
+ *
+ * \param point The point to compare against.
+ * \param pc The point cloud the neighbor indices refer to.
+ * \param indices The indices of the neighbors.
+ * \return The average RGB distance to the neighbors.
+ */
+static double scalarAvgColorDistance(const pcl::PointXYZRGB &point, const pcl::PointCloud<pcl::PointXYZRGB> &pc,
+    const vector<int> &indices)
+{
+  double rgb_distance = 0;
+  for (size_t j = 0; j < indices.size(); j++)
+  {
+    const pcl::PointXYZRGB &neighbor = pc.at(indices[j]);
+    rgb_distance += sqrt(pow(point.r - neighbor.r, 2) + pow(point.g - neighbor.g, 2) + pow(point.b - neighbor.b, 2));
+  }
+  return rgb_distance / indices.size();
+}
+
+/*!
+ * Create a synthetic point cloud with random positions and random colors. The cube is 10cm wide for the default
+ * number of points and is scaled so every size has the same point density.
+ *
+ * \param pc The point cloud to fill.
+ * \param num_points The number of points to create.
+ */
+static void createSyntheticPointCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc, const int num_points)
+{
+  boost::mt19937 generator(0);
+  boost::uniform_real<float> position(0.0f, 0.1f * (float) pow((double) num_points / NUM_SYNTHETIC_POINTS, 1.0 / 3.0));
+  boost::uniform_int<int> color(0, 255);
+  for (int i = 0; i < num_points; i++)
+  {
+    pcl::PointXYZRGB point;
+    point.x = position(generator);
+    point.y = position(generator);
+    point.z = position(generator);
+    point.r = color(generator);
+    point.g = color(generator);
+    point.b = color(generator);
+    pc->push_back(point);
+  }
+}
+
+/*!
+ * Count the heap allocations made by the registration metrics on the given point cloud against itself, once with a new
+ * metric workspace for each call and once with a single reused workspace.
+ *
+ * \param search_tree The search tree over the point cloud.
+ * \param pc The point cloud to use.
+ */
+static void countAllocations(const pcl::search::KdTree<pcl::PointXYZRGB> &search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc)
+{
+  double overlap, color_error, distance_error;
+  const double infinity = numeric_limits<double>::infinity();
+
+  // a new workspace for every call
+  unsigned long start = num_allocations;
+  for (int r = 0; r < NUM_REPETITIONS; r++)
+  {
+    point_cloud_metrics::MetricWorkspace workspace;
+    point_cloud_metrics::calculateBoundedRegistrationMetricOverlap(search_tree, pc, 0, workspace, overlap,
+                                                                   color_error);
+    point_cloud_metrics::calculateBoundedRegistrationMetricDistanceError(search_tree, pc, infinity, workspace,
+                                                                         distance_error);
+  }
+  double fresh = (double) (num_allocations - start) / NUM_REPETITIONS;
+
+  // a single workspace for every call (warmed up by the first call)
+  point_cloud_metrics::MetricWorkspace workspace;
+  point_cloud_metrics::calculateBoundedRegistrationMetricOverlap(search_tree, pc, 0, workspace, overlap, color_error);
+  point_cloud_metrics::calculateBoundedRegistrationMetricDistanceError(search_tree, pc, infinity, workspace,
+                                                                       distance_error);
+  start = num_allocations;
+  for (int r = 0; r < NUM_REPETITIONS; r++)
+  {
+    point_cloud_metrics::calculateBoundedRegistrationMetricOverlap(search_tree, pc, 0, workspace, overlap,
+                                                                   color_error);
+    point_cloud_metrics::calculateBoundedRegistrationMetricDistanceError(search_tree, pc, infinity, workspace,
+                                                                         distance_error);
+  }
+  double reused = (double) (num_allocations - start) / NUM_REPETITIONS;
+
+  ROS_INFO("  allocations per metric pass: new workspace: %.1f  reused workspace: %.1f", fresh, reused);
+}
+
+/*!
+ * Benchmark the color distance kernels on the given point cloud against itself.
+ *
+ * \param name The name of the point cloud used in the output.
+ * \param pc The point cloud to use.
+ * \return True if both kernels produced bit-identical results.
+ */
+static bool benchmark(const string &name, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc)
+{
+  // find the neighbors of each point once (not timed)
+  pcl::search::KdTree<pcl::PointXYZRGB> search_tree;
+  search_tree.setInputCloud(pc);
+  vector<vector<int> > neighbors(pc->size());
+  size_t total_neighbors = 0;
+  for (size_t i = 0; i < pc->size(); i++)
+  {
+    vector<float> distances;
+    search_tree.radiusSearch(pc->at(i), point_cloud_metrics::DEFAULT_METRIC_OVERLAP_SEARCH_RADIUS, neighbors[i],
+                             distances);
+    total_neighbors += neighbors[i].size();
+  }
+
+  // time the original calculation
+  double scalar_error = 0;
+  ros::WallTime start = ros::WallTime::now();
+  for (int r = 0; r < NUM_REPETITIONS; r++)
+  {
+    scalar_error = 0;
+    for (size_t i = 0; i < pc->size(); i++)
+    {
+      if (!neighbors[i].empty())
+      {
+        scalar_error += scalarAvgColorDistance(pc->at(i), *pc, neighbors[i]);
+      }
+    }
+  }
+  double scalar_time = (ros::WallTime::now() - start).toSec();
+
+  // time the kernel
+  double kernel_error = 0;
+  point_cloud_metrics::ColorDistanceScratch scratch;
+  start = ros::WallTime::now();
+  for (int r = 0; r < NUM_REPETITIONS; r++)
+  {
+    kernel_error = 0;
+    for (size_t i = 0; i < pc->size(); i++)
+    {
+      if (!neighbors[i].empty())
+      {
+        kernel_error += point_cloud_metrics::calculateAvgColorDistance(pc->at(i), *pc, neighbors[i], scratch);
+      }
+    }
+  }
+  double kernel_time = (ros::WallTime::now() - start).toSec();
+
+  bool identical = (scalar_error == kernel_error);
+  ROS_INFO("%s: %lu points, %lu neighbors", name.c_str(), pc->size(), total_neighbors);
+  ROS_INFO("  scalar: %.3f ms  kernel: %.3f ms  speedup: %.2fx  identical: %s",
+           1000.0 * scalar_time / NUM_REPETITIONS, 1000.0 * kernel_time / NUM_REPETITIONS,
+           scalar_time / kernel_time, identical ? "yes" : "NO");
+  countAllocations(search_tree, pc);
+  return identical;
+}
+
+/*!
+ * Create a packed point cloud message with x, y, z, and rgb fields and no padding.
+ *
+ * \param pc The point cloud to convert.
+ * \param msg The packed point cloud message to fill.
+ */
+static void createPackedPointCloud2(const pcl::PointCloud<pcl::PointXYZRGB> &pc, sensor_msgs::PointCloud2 &msg)
+{
+  const char *names[] = {"x", "y", "z", "rgb"};
+  msg.fields.resize(4);
+  for (size_t i = 0; i < msg.fields.size(); i++)
+  {
+    msg.fields[i].name = names[i];
+    msg.fields[i].offset = i * sizeof(float);
+    msg.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+    msg.fields[i].count = 1;
+  }
+  msg.header.frame_id = pc.header.frame_id;
+  msg.width = pc.size();
+  msg.height = 1;
+  msg.is_bigendian = false;
+  msg.is_dense = pc.is_dense;
+  msg.point_step = msg.fields.size() * sizeof(float);
+  msg.row_step = msg.point_step * msg.width;
+  msg.data.resize(msg.row_step);
+  for (size_t i = 0; i < pc.size(); i++)
+  {
+    uint8_t *point = &msg.data[i * msg.point_step];
+    memcpy(point, &pc.points[i].x, 3 * sizeof(float));
+    memcpy(point + 3 * sizeof(float), &pc.points[i].rgba, sizeof(uint32_t));
+  }
+}
+
+/*!
+ * Open the hardware cache miss counter for this process. The counter stays unavailable if the kernel or the hardware
+ * does not support it (e.g., in a virtual machine or with a restrictive perf_event_paranoid setting).
+ */
+static void openCacheMissCounter()
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // count all threads created after this point as well
+  attr.inherit = 1;
+  cache_miss_fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+/*!
+ * \class KernelTimer
+ * \brief Accumulates the time, heap allocations, and cache misses of the timed sections of a kernel.
+ */
+class KernelTimer
+{
+public:
+  /*!
+   * Creates a new KernelTimer with nothing recorded.
+   */
+  KernelTimer() : elapsed_(0), allocations_(0), cache_misses_(0), calls_(0)
+  {
+  }
+
+  /*!
+   * Start a timed section.
+   */
+  void start()
+  {
+#ifdef __linux__
+    if (cache_miss_fd >= 0)
+    {
+      ioctl(cache_miss_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(cache_miss_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    allocations_start_ = num_allocations;
+    start_ = ros::WallTime::now();
+  }
+
+  /*!
+   * Stop the current timed section.
+   */
+  void stop()
+  {
+    elapsed_ += (ros::WallTime::now() - start_).toSec();
+    allocations_ += num_allocations - allocations_start_;
+#ifdef __linux__
+    if (cache_miss_fd >= 0)
+    {
+      ioctl(cache_miss_fd, PERF_EVENT_IOC_DISABLE, 0);
+      long long count = 0;
+      if (read(cache_miss_fd, &count, sizeof(count)) == sizeof(count))
+      {
+        cache_misses_ += count;
+      }
+    }
+#endif
+    calls_++;
+  }
+
+  /*!
+   * Log the time, allocations, and cache misses per point of every timed section.
+   *
+   * \param name The name of the kernel.
+   * \param num_points The number of points processed by each timed section.
+   */
+  void report(const string &name, const size_t num_points) const
+  {
+    const double points = (double) max(num_points, (size_t) 1) * max(calls_, 1);
+    char cache[32];
+    if (cache_miss_fd >= 0)
+    {
+      snprintf(cache, sizeof(cache), "%.3f", cache_misses_ / points);
+    } else
+    {
+      snprintf(cache, sizeof(cache), "n/a");
+    }
+    ROS_INFO("  %-44s %10.1f ns/point  %8.4f allocations/point  %8s cache misses/point", name.c_str(),
+             1e9 * elapsed_ / points, allocations_ / points, cache);
+  }
+
+private:
+  /*! The total time of every timed section in seconds. */
+  double elapsed_;
+  /*! The total allocations and cache misses of every timed section. */
+  double allocations_, cache_misses_;
+  /*! The number of timed sections. */
+  int calls_;
+  /*! The start of the current timed section. */
+  ros::WallTime start_;
+  /*! The allocation count at the start of the current timed section. */
+  unsigned long allocations_start_;
+};
+
+/*!
+ * Run every point cloud metrics kernel on the given point cloud. Kernels that modify the point cloud are given a new
+ * copy for each repetition, which is not timed. The registration kernels compare the point cloud against a copy that
+ * is rotated by 2 degrees and shifted by 5mm. The direct conversions are also compared against the generic PCL
+ * conversions, for both a message in the PCL layout and a packed message.
+ *
+ * \param name The name of the point cloud used in the output.
+ * \param pc The point cloud to use.
+ * \param thread_pool The thread pool used for the parallel kernels.
+ * \return True if the direct conversions produced the same points as the generic conversions.
+ */
+static bool runKernelSuite(const string &name, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
+    ThreadPool &thread_pool)
+{
+  const size_t n = pc->size();
+  const int repetitions = (int) max(KERNEL_POINT_BUDGET / n, (size_t) 1);
+  ROS_INFO("%s: %lu points, %d repetitions per kernel", name.c_str(), n, repetitions);
+
+  // conversions against the generic PCL conversions through PCLPointCloud2
+  sensor_msgs::PointCloud2 msg;
+  point_cloud_metrics::pclPointCloudToROSPointCloud2(pc, msg);
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      sensor_msgs::PointCloud2 out;
+      timer.start();
+      pcl::PCLPointCloud2 converter;
+      pcl::toPCLPointCloud2(*pc, converter);
+      pcl_conversions::fromPCL(converter, out);
+      timer.stop();
+    }
+    timer.report("pclPointCloudToROSPointCloud2 (PCLPointCloud2)", n);
+  }
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      sensor_msgs::PointCloud2 out;
+      timer.start();
+      point_cloud_metrics::pclPointCloudToROSPointCloud2(pc, out);
+      timer.stop();
+    }
+    timer.report("pclPointCloudToROSPointCloud2", n);
+  }
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr out(new pcl::PointCloud<pcl::PointXYZRGB>);
+      timer.start();
+      pcl::PCLPointCloud2 converter;
+      pcl_conversions::toPCL(msg, converter);
+      pcl::fromPCLPointCloud2(converter, *out);
+      timer.stop();
+    }
+    timer.report("rosPointCloud2ToPCLPointCloud (PCLPointCloud2)", n);
+  }
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr out(new pcl::PointCloud<pcl::PointXYZRGB>);
+      timer.start();
+      point_cloud_metrics::rosPointCloud2ToPCLPointCloud(msg, out);
+      timer.stop();
+    }
+    timer.report("rosPointCloud2ToPCLPointCloud", n);
+  }
+  sensor_msgs::PointCloud2 packed;
+  createPackedPointCloud2(*pc, packed);
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr out(new pcl::PointCloud<pcl::PointXYZRGB>);
+      timer.start();
+      pcl::PCLPointCloud2 converter;
+      pcl_conversions::toPCL(packed, converter);
+      pcl::fromPCLPointCloud2(converter, *out);
+      timer.stop();
+    }
+    timer.report("rosPointCloud2ToPCLPointCloud packed (PCLPointCloud2)", n);
+  }
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr out(new pcl::PointCloud<pcl::PointXYZRGB>);
+      timer.start();
+      point_cloud_metrics::rosPointCloud2ToPCLPointCloud(packed, out);
+      timer.stop();
+    }
+    timer.report("rosPointCloud2ToPCLPointCloud packed", n);
+  }
+
+  // the direct conversions must match the generic ones
+  bool identical = true;
+  {
+    pcl::PCLPointCloud2 converter;
+    sensor_msgs::PointCloud2 expected;
+    pcl::toPCLPointCloud2(*pc, converter);
+    pcl_conversions::fromPCL(converter, expected);
+    identical &= (expected.fields.size() == msg.fields.size() && expected.point_step == msg.point_step
+                  && expected.row_step == msg.row_step && expected.data == msg.data);
+    const sensor_msgs::PointCloud2 *inputs[] = {&msg, &packed};
+    for (int i = 0; i < 2; i++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr direct(new pcl::PointCloud<pcl::PointXYZRGB>);
+      pcl::PointCloud<pcl::PointXYZRGB> generic;
+      point_cloud_metrics::rosPointCloud2ToPCLPointCloud(*inputs[i], direct);
+      pcl_conversions::toPCL(*inputs[i], converter);
+      pcl::fromPCLPointCloud2(converter, generic);
+      identical &= (direct->size() == generic.size());
+      for (size_t j = 0; identical && j < generic.size(); j++)
+      {
+        const pcl::PointXYZRGB &a = direct->points[j], &b = generic.points[j];
+        identical &= (a.x == b.x && a.y == b.y && a.z == b.z && a.rgba == b.rgba);
+      }
+    }
+  }
+  ROS_INFO("  direct conversions identical: %s", identical ? "yes" : "NO");
+
+  // read only statistics
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      timer.start();
+      point_cloud_metrics::computeCentroid(pc);
+      timer.stop();
+    }
+    timer.report("computeCentroid", n);
+  }
+  {
+    KernelTimer timer;
+    point_cloud_metrics::PointCloudStatistics statistics;
+    for (int r = 0; r < repetitions; r++)
+    {
+      timer.start();
+      point_cloud_metrics::calculatePointCloudStatistics(pc, statistics);
+      timer.stop();
+    }
+    timer.report("calculatePointCloudStatistics", n);
+  }
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      timer.start();
+      point_cloud_metrics::calculatePrincipalExtents(pc);
+      timer.stop();
+    }
+    timer.report("calculatePrincipalExtents", n);
+  }
+
+  // filters
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr copy(new pcl::PointCloud<pcl::PointXYZRGB>(*pc));
+      timer.start();
+      point_cloud_metrics::filterPointCloudOutliers(copy);
+      timer.stop();
+    }
+    timer.report("filterPointCloudOutliers", n);
+  }
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr copy(new pcl::PointCloud<pcl::PointXYZRGB>(*pc));
+      timer.start();
+      point_cloud_metrics::filterPointCloudOutliers(thread_pool, copy);
+      timer.stop();
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "filterPointCloudOutliers (%d threads)", thread_pool.getNumThreads());
+    timer.report(label, n);
+  }
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr copy(new pcl::PointCloud<pcl::PointXYZRGB>(*pc));
+      timer.start();
+      point_cloud_metrics::filterRedundantPoints(copy);
+      timer.stop();
+    }
+    timer.report("filterRedundantPoints", n);
+  }
+
+  // a slightly moved copy to register against the original
+  const double angle = 2.0 * M_PI / 180.0;
+  const float c = (float) cos(angle), s = (float) sin(angle);
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr moved(new pcl::PointCloud<pcl::PointXYZRGB>(*pc));
+  for (size_t i = 0; i < moved->size(); i++)
+  {
+    pcl::PointXYZRGB &point = moved->at(i);
+    const float x = point.x, y = point.y;
+    point.x = c * x - s * y + 0.005f;
+    point.y = s * x + c * y;
+  }
+  pcl::search::KdTree<pcl::PointXYZRGB>::Ptr search_tree(new pcl::search::KdTree<pcl::PointXYZRGB>);
+  {
+    KernelTimer timer;
+    timer.start();
+    search_tree->setInputCloud(pc);
+    timer.stop();
+    timer.report("KdTree::setInputCloud", n);
+  }
+
+  // registration metrics
+  double overlap, color_error, distance_error;
+  const double infinity = numeric_limits<double>::infinity();
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      timer.start();
+      point_cloud_metrics::calculateRegistrationMetricOverlap(*search_tree, moved, overlap, color_error);
+      timer.stop();
+    }
+    timer.report("calculateRegistrationMetricOverlap", n);
+  }
+  {
+    KernelTimer timer;
+    point_cloud_metrics::MetricWorkspace workspace;
+    for (int r = 0; r < repetitions; r++)
+    {
+      timer.start();
+      point_cloud_metrics::calculateBoundedRegistrationMetricOverlap(*search_tree, moved, 0, workspace, overlap,
+                                                                     color_error);
+      timer.stop();
+    }
+    timer.report("calculateBoundedRegistrationMetricOverlap", n);
+  }
+  {
+    KernelTimer timer;
+    for (int r = 0; r < repetitions; r++)
+    {
+      timer.start();
+      point_cloud_metrics::calculateRegistrationMetricDistanceError(*search_tree, moved);
+      timer.stop();
+    }
+    timer.report("calculateRegistrationMetricDistanceError", n);
+  }
+  {
+    KernelTimer timer;
+    point_cloud_metrics::MetricWorkspace workspace;
+    for (int r = 0; r < repetitions; r++)
+    {
+      timer.start();
+      point_cloud_metrics::calculateBoundedRegistrationMetricDistanceError(*search_tree, moved, infinity, workspace,
+                                                                           distance_error);
+      timer.stop();
+    }
+    timer.report("calculateBoundedRegistrationMetricDistanceError", n);
+  }
+
+  // registration
+  {
+    KernelTimer timer;
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr aligned(new pcl::PointCloud<pcl::PointXYZRGB>);
+    for (int r = 0; r < repetitions; r++)
+    {
+      timer.start();
+      point_cloud_metrics::performICP(search_tree, moved, aligned);
+      timer.stop();
+    }
+    timer.report("performICP", n);
+  }
+  return identical;
+}
+
+/*!
+ * Runs the metrics benchmark.
+ *
+ * \param argc argument count.
+ * \param argv the PCD files to benchmark (a synthetic point cloud is used if none are given).
+ * \return EXIT_SUCCESS if every benchmark produced identical results or EXIT_FAILURE otherwise.
+ */
+int main(int argc, char **argv)
+{
+  openCacheMissCounter();
+  ThreadPool thread_pool(0);
+
+  bool success = true;
+  if (argc < 2)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr pc(new pcl::PointCloud<pcl::PointXYZRGB>);
+    createSyntheticPointCloud(pc, NUM_SYNTHETIC_POINTS);
+    success = benchmark("synthetic", pc);
+
+    // the kernel suite at each size
+    const size_t num_sizes = sizeof(KERNEL_SUITE_SIZES) / sizeof(KERNEL_SUITE_SIZES[0]);
+    for (size_t i = 0; i < num_sizes; i++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr synthetic(new pcl::PointCloud<pcl::PointXYZRGB>);
+      createSyntheticPointCloud(synthetic, KERNEL_SUITE_SIZES[i]);
+      char name[32];
+      snprintf(name, sizeof(name), "synthetic %d", KERNEL_SUITE_SIZES[i]);
+      success &= runKernelSuite(name, synthetic, thread_pool);
+    }
+  } else
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      pcl::PointCloud<pcl::PointXYZRGB>::Ptr pc(new pcl::PointCloud<pcl::PointXYZRGB>);
+      if (pcl::io::loadPCDFile(argv[i], *pc) < 0 || pc->empty())
+      {
+        ROS_WARN("Could not load point cloud from %s.", argv[i]);
+        success = false;
+      } else
+      {
+        success &= benchmark(argv[i], pc);
+        success &= runKernelSuite(argv[i], pc, thread_pool);
+      }
+    }
+  }
+
+#ifdef __linux__
+  if (cache_miss_fd >= 0)
+  {
+    close(cache_miss_fd);
+  }
+#endif
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,552 @@
+/*!
+ * \file recognition_benchmark.cpp
+ * \brief An offline benchmark for segmented object recognition.
+ *
+ * The recognition benchmark replays recorded SegmentedObjectList messages from a bag file through the point cloud
+ * recognizer. It reports per-stage latency percentiles from a serial replay of the recognition steps, end-to-end
+ * latency percentiles and throughput of the recognizer itself, and accuracy against the object names recorded in the
+ * bag. Models are loaded from the grasp database or from a bag file snapshot of GraspModel messages.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/PCLGraspModel.h"
+#include "rail_recognition/PointCloudMetrics.h"
+#include "rail_recognition/PointCloudRecognizer.h"
+
+// ROS
+#include <graspdb/graspdb.h>
+#include <rail_manipulation_msgs/SegmentedObjectList.h>
+#include <rail_pick_and_place_msgs/GraspModel.h>
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+
+// Boost
+#include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+/*! The default topic of the recorded segmented objects. */
+static const string DEFAULT_TOPIC = "/segmentation/segmented_objects";
+/*! The topic used for grasp models in a model snapshot. */
+static const string MODELS_TOPIC = "grasp_models";
+
+/*!
+ * \struct Options
+ * \brief The command line options of the benchmark.
+ */
+struct Options
+{
+  /*! The bag files of recorded objects, a model snapshot to load, a model snapshot to save, and the object topic. */
+  string objects_bag, models_bag, save_models_bag, topic;
+  /*! The grasp database connection information. */
+  string host, user, password, db;
+  /*! The grasp database port. */
+  int port;
+  /*! The recognizer settings. */
+  int num_threads, max_icp_candidates, max_grasps;
+  /*! The maximum color histogram distance of a registered candidate. */
+  double max_color_histogram_distance;
+  /*! If bounded scoring is enabled. */
+  bool bounded_scoring;
+  /*! The number of times each list is replayed. */
+  int repetitions;
+};
+
+/*!
+ * \struct StageTimes
+ * \brief The latency samples of each recognition stage in milliseconds (one sample per object).
+ */
+struct StageTimes
+{
+  /*! The samples for each stage. */
+  vector<double> conversion, filter, color_gate, icp, metrics, grasp_ranking;
+};
+
+/*!
+ * Get the elapsed time since the given start in milliseconds.
+ *
+ * \param start The start time.
+ * \return The elapsed time in milliseconds.
+ */
+static double elapsedMilliseconds(const ros::WallTime &start)
+{
+  return 1000.0 * (ros::WallTime::now() - start).toSec();
+}
+
+/*!
+ * Log the mean and nearest rank percentiles of the given samples.
+ *
+ * \param name The name of the samples.
+ * \param samples The samples in milliseconds (sorted in place).
+ */
+static void reportPercentiles(const string &name, vector<double> &samples)
+{
+  if (samples.empty())
+  {
+    ROS_INFO("  %-16s no samples", name.c_str());
+    return;
+  }
+
+  sort(samples.begin(), samples.end());
+  double sum = 0;
+  for (size_t i = 0; i < samples.size(); i++)
+  {
+    sum += samples[i];
+  }
+
+  const size_t n = samples.size();
+  ROS_INFO("  %-16s mean: %8.3f  p50: %8.3f  p90: %8.3f  p99: %8.3f  max: %8.3f ms (%lu samples)", name.c_str(),
+           sum / n, samples[(n - 1) / 2], samples[(size_t) (0.9 * (n - 1))], samples[(size_t) (0.99 * (n - 1))],
+           samples[n - 1], n);
+}
+
+/*!
+ * Print the usage of the benchmark.
+ */
+static void printUsage()
+{
+  ROS_INFO("Usage: recognition_benchmark <objects.bag> [options]");
+  ROS_INFO("  --topic <topic>              topic of the recorded SegmentedObjectList messages");
+  ROS_INFO("  --models <models.bag>        load the models from a snapshot instead of the grasp database");
+  ROS_INFO("  --save-models <models.bag>   save the loaded models to a snapshot");
+  ROS_INFO("  --host, --port, --user, --password, --db  grasp database connection information");
+  ROS_INFO("  --num-threads <n>, --max-icp-candidates <n>, --max-grasps <n>, --bounded-scoring <0|1>");
+  ROS_INFO("  --max-color-histogram-distance <d>  color histogram gate (1 to disable)");
+  ROS_INFO("  --repetitions <n>            number of times each list is replayed");
+}
+
+/*!
+ * Parse the command line options.
+ *
+ * \param argc argument count.
+ * \param argv argument vector.
+ * \param options The options to fill.
+ * \return True if the options were valid.
+ */
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+  options.topic = DEFAULT_TOPIC;
+  options.host = "127.0.0.1";
+  options.port = graspdb::Client::DEFAULT_PORT;
+  options.user = "ros";
+  options.db = "graspdb";
+  options.num_threads = 1;
+  options.max_icp_candidates = 0;
+  options.max_grasps = 0;
+  options.max_color_histogram_distance = PointCloudRecognizer::DEFAULT_MAX_COLOR_HISTOGRAM_DISTANCE;
+  options.bounded_scoring = true;
+  options.repetitions = 1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const string arg(argv[i]);
+    if (arg.size() < 2 || arg.substr(0, 2) != "--")
+    {
+      if (!options.objects_bag.empty())
+      {
+        return false;
+      }
+      options.objects_bag = arg;
+      continue;
+    }
+
+    // every option takes a value
+    if (i + 1 >= argc)
+    {
+      return false;
+    }
+    const string value(argv[++i]);
+    if (arg == "--topic")
+    {
+      options.topic = value;
+    } else if (arg == "--models")
+    {
+      options.models_bag = value;
+    } else if (arg == "--save-models")
+    {
+      options.save_models_bag = value;
+    } else if (arg == "--host")
+    {
+      options.host = value;
+    } else if (arg == "--port")
+    {
+      options.port = atoi(value.c_str());
+    } else if (arg == "--user")
+    {
+      options.user = value;
+    } else if (arg == "--password")
+    {
+      options.password = value;
+    } else if (arg == "--db")
+    {
+      options.db = value;
+    } else if (arg == "--num-threads")
+    {
+      options.num_threads = atoi(value.c_str());
+    } else if (arg == "--max-icp-candidates")
+    {
+      options.max_icp_candidates = atoi(value.c_str());
+    } else if (arg == "--max-grasps")
+    {
+      options.max_grasps = atoi(value.c_str());
+    } else if (arg == "--max-color-histogram-distance")
+    {
+      options.max_color_histogram_distance = atof(value.c_str());
+    } else if (arg == "--bounded-scoring")
+    {
+      options.bounded_scoring = (atoi(value.c_str()) != 0);
+    } else if (arg == "--repetitions")
+    {
+      options.repetitions = max(atoi(value.c_str()), 1);
+    } else
+    {
+      return false;
+    }
+  }
+
+  return !options.objects_bag.empty();
+}
+
+/*!
+ * Load the grasp models from a snapshot or the grasp database.
+ *
+ * \param options The benchmark options.
+ * \param models The models to fill.
+ * \return True if the models were loaded.
+ */
+static bool loadModels(const Options &options, vector<graspdb::GraspModel> &models)
+{
+  if (!options.models_bag.empty())
+  {
+    rosbag::Bag bag;
+    try
+    {
+      bag.open(options.models_bag, rosbag::bagmode::Read);
+      rosbag::View view(bag, rosbag::TopicQuery(MODELS_TOPIC));
+      BOOST_FOREACH(const rosbag::MessageInstance &m, view)
+      {
+        rail_pick_and_place_msgs::GraspModel::ConstPtr gm = m.instantiate<rail_pick_and_place_msgs::GraspModel>();
+        if (gm)
+        {
+          models.push_back(graspdb::GraspModel(*gm));
+        }
+      }
+    } catch (rosbag::BagException &e)
+    {
+      ROS_ERROR("Could not read the model snapshot %s: %s", options.models_bag.c_str(), e.what());
+      return false;
+    }
+    return true;
+  }
+
+  graspdb::Client graspdb(options.host, options.port, options.user, options.password, options.db);
+  if (!graspdb.connect())
+  {
+    ROS_ERROR("Could not connect to the grasp database.");
+    return false;
+  }
+  bool success = graspdb.loadGraspModels(models);
+  graspdb.disconnect();
+  return success;
+}
+
+/*!
+ * Save the grasp models to a snapshot.
+ *
+ * \param file_name The bag file to write.
+ * \param models The models to save.
+ * \return True if the snapshot was written.
+ */
+static bool saveModels(const string &file_name, const vector<graspdb::GraspModel> &models)
+{
+  try
+  {
+    rosbag::Bag bag(file_name, rosbag::bagmode::Write);
+    const ros::Time stamp = ros::Time(ros::WallTime::now().toSec());
+    for (size_t i = 0; i < models.size(); i++)
+    {
+      bag.write(MODELS_TOPIC, stamp, models[i].toROSGraspModelMessage());
+    }
+    bag.close();
+  } catch (rosbag::BagException &e)
+  {
+    ROS_ERROR("Could not write the model snapshot %s: %s", file_name.c_str(), e.what());
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * Replay the recognition steps for a single object serially and time each stage. Every candidate that passes the
+ * color gate is registered and scored without bounds, so this is the unpruned cost of each stage.
+ *
+ * \param recognizer The recognizer used to rank grasps.
+ * \param object The object to recognize.
+ * \param candidates The candidate models.
+ * \param icp_parameters The ICP parameters.
+ * \param workspace The metric workspace to use.
+ * \param times The stage times to add to.
+ */
+static void timeStages(const PointCloudRecognizer &recognizer, const rail_manipulation_msgs::SegmentedObject &object,
+    const vector<PCLGraspModel> &candidates, const point_cloud_metrics::ICPParameters &icp_parameters,
+    point_cloud_metrics::MetricWorkspace &workspace, StageTimes &times)
+{
+  // conversion
+  ros::WallTime start = ros::WallTime::now();
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr pc(new pcl::PointCloud<pcl::PointXYZRGB>);
+  point_cloud_metrics::rosPointCloud2ToPCLPointCloud(object.point_cloud, pc);
+  times.conversion.push_back(elapsedMilliseconds(start));
+
+  // color statistics are part of the color gate
+  start = ros::WallTime::now();
+  point_cloud_metrics::PointCloudStatistics statistics;
+  point_cloud_metrics::calculatePointCloudStatistics(pc, statistics);
+  double color_gate = elapsedMilliseconds(start);
+
+  // outlier filter and the shift to the origin
+  start = ros::WallTime::now();
+  point_cloud_metrics::filterPointCloudOutliers(pc);
+  point_cloud_metrics::transformToOrigin(pc, object.centroid);
+  point_cloud_metrics::calculatePrincipalExtents(pc);
+  times.filter.push_back(elapsedMilliseconds(start));
+
+  // color gate
+  start = ros::WallTime::now();
+  point_cloud_metrics::ColorHistogram color_histogram;
+  point_cloud_metrics::calculateColorHistogram(pc, color_histogram);
+  const double max_color_histogram_distance = recognizer.getMaxColorHistogramDistance();
+  vector<size_t> selected;
+  for (size_t i = 0; i < candidates.size(); i++)
+  {
+    const PCLGraspModel &candidate = candidates[i];
+    if (!candidate.getPCLPointCloud()->empty()
+        && fabs(statistics.avg_r - candidate.getAverageRed()) <= statistics.std_dev_r / 1.5
+        && fabs(statistics.avg_g - candidate.getAverageGreen()) <= statistics.std_dev_g / 1.5
+        && fabs(statistics.avg_b - candidate.getAverageBlue()) <= statistics.std_dev_b / 1.5
+        && (max_color_histogram_distance >= 1.0
+            || point_cloud_metrics::calculateColorHistogramDistance(color_histogram, candidate.getColorHistogram())
+                <= max_color_histogram_distance))
+    {
+      selected.push_back(i);
+    }
+  }
+  times.color_gate.push_back(color_gate + elapsedMilliseconds(start));
+
+  // registration and metrics for each remaining candidate
+  double icp = 0, metrics = 0;
+  double best_score = numeric_limits<double>::infinity();
+  size_t best_index = 0;
+  tf2::Transform best_tf;
+  if (!workspace.aligned)
+  {
+    workspace.aligned.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+  }
+  for (size_t i = 0; i < selected.size(); i++)
+  {
+    const PCLGraspModel &candidate = candidates[selected[i]];
+    const pcl::search::KdTree<pcl::PointXYZRGB>::Ptr search_tree = candidate.getSearchTree();
+
+    start = ros::WallTime::now();
+    tf2::Transform tf_icp = point_cloud_metrics::performICP(search_tree, pc, workspace.aligned, icp_parameters);
+    icp += elapsedMilliseconds(start);
+
+    start = ros::WallTime::now();
+    double overlap, color_error, distance_error;
+    point_cloud_metrics::calculateBoundedRegistrationMetricOverlap(*search_tree, workspace.aligned, 0, workspace,
+                                                                   overlap, color_error);
+    point_cloud_metrics::calculateBoundedRegistrationMetricDistanceError(*search_tree, workspace.aligned,
+                                                                         numeric_limits<double>::infinity(), workspace,
+                                                                         distance_error);
+    metrics += elapsedMilliseconds(start);
+
+    if (overlap >= PointCloudRecognizer::OVERLAP_THRESHOLD)
+    {
+      const double score = PointCloudRecognizer::ALPHA * (3.0 * distance_error)
+          + (1.0 - PointCloudRecognizer::ALPHA) * (color_error / 100.0);
+      if (score < best_score)
+      {
+        best_score = score;
+        best_index = selected[i];
+        best_tf = tf_icp;
+      }
+    }
+  }
+  times.icp.push_back(icp);
+  times.metrics.push_back(metrics);
+
+  // grasp ranking for the match
+  if (best_score <= PointCloudRecognizer::SCORE_CONFIDENCE_THRESHOLD)
+  {
+    rail_manipulation_msgs::SegmentedObject result = object;
+    start = ros::WallTime::now();
+    recognizer.applyRecognition(result, candidates[best_index], best_score, best_tf);
+    times.grasp_ranking.push_back(elapsedMilliseconds(start));
+  }
+}
+
+/*!
+ * Runs the recognition benchmark.
+ *
+ * \param argc argument count.
+ * \param argv the bag file of recorded objects followed by any options.
+ * \return EXIT_SUCCESS if the benchmark ran or EXIT_FAILURE otherwise.
+ */
+int main(int argc, char **argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options))
+  {
+    printUsage();
+    return EXIT_FAILURE;
+  }
+
+  // load and convert the models
+  vector<graspdb::GraspModel> models;
+  if (!loadModels(options, models))
+  {
+    return EXIT_FAILURE;
+  }
+  if (!options.save_models_bag.empty() && !saveModels(options.save_models_bag, models))
+  {
+    return EXIT_FAILURE;
+  }
+  ros::WallTime start = ros::WallTime::now();
+  vector<PCLGraspModel> candidates;
+  candidates.reserve(models.size());
+  for (size_t i = 0; i < models.size(); i++)
+  {
+    candidates.push_back(PCLGraspModel(models[i]));
+  }
+  ROS_INFO("Loaded %lu models in %.3f ms.", candidates.size(), elapsedMilliseconds(start));
+  if (candidates.empty())
+  {
+    ROS_ERROR("No models to recognize against.");
+    return EXIT_FAILURE;
+  }
+
+  // load the recorded lists
+  vector<rail_manipulation_msgs::SegmentedObjectList> lists;
+  try
+  {
+    rosbag::Bag bag(options.objects_bag, rosbag::bagmode::Read);
+    rosbag::View view(bag, rosbag::TopicQuery(options.topic));
+    BOOST_FOREACH(const rosbag::MessageInstance &m, view)
+    {
+      rail_manipulation_msgs::SegmentedObjectList::ConstPtr list =
+          m.instantiate<rail_manipulation_msgs::SegmentedObjectList>();
+      if (list)
+      {
+        lists.push_back(*list);
+      }
+    }
+  } catch (rosbag::BagException &e)
+  {
+    ROS_ERROR("Could not read %s: %s", options.objects_bag.c_str(), e.what());
+    return EXIT_FAILURE;
+  }
+  ROS_INFO("Loaded %lu segmented object lists from %s.", lists.size(), options.topic.c_str());
+
+  PointCloudRecognizer recognizer(options.num_threads);
+  recognizer.setMaxICPCandidates(options.max_icp_candidates);
+  recognizer.setMaxGrasps(options.max_grasps);
+  recognizer.setMaxColorHistogramDistance(options.max_color_histogram_distance);
+  recognizer.setBoundedScoring(options.bounded_scoring);
+  point_cloud_metrics::ICPParameters icp_parameters;
+
+  // serial replay of each stage
+  StageTimes times;
+  point_cloud_metrics::MetricWorkspace workspace;
+  for (size_t i = 0; i < lists.size(); i++)
+  {
+    for (size_t j = 0; j < lists[i].objects.size(); j++)
+    {
+      if (!lists[i].objects[j].point_cloud.data.empty())
+      {
+        timeStages(recognizer, lists[i].objects[j], candidates, icp_parameters, workspace, times);
+      }
+    }
+  }
+
+  // end-to-end recognition
+  vector<double> latencies;
+  size_t num_objects = 0, num_labeled = 0, num_correct = 0, num_wrong = 0, num_missed = 0;
+  double total = 0;
+  for (int r = 0; r < options.repetitions; r++)
+  {
+    for (size_t i = 0; i < lists.size(); i++)
+    {
+      // recorded lists may already be recognized
+      rail_manipulation_msgs::SegmentedObjectList list = lists[i];
+      for (size_t j = 0; j < list.objects.size(); j++)
+      {
+        list.objects[j].recognized = false;
+      }
+
+      start = ros::WallTime::now();
+      recognizer.recognizeObjects(list, candidates);
+      const double latency = elapsedMilliseconds(start);
+      latencies.push_back(latency);
+      total += latency;
+      num_objects += list.objects.size();
+
+      // recorded names are used as labels
+      for (size_t j = 0; r == 0 && j < list.objects.size(); j++)
+      {
+        const string &label = lists[i].objects[j].name;
+        if (!label.empty())
+        {
+          num_labeled++;
+          if (!list.objects[j].recognized)
+          {
+            num_missed++;
+          } else if (boost::iequals(list.objects[j].name, label))
+          {
+            num_correct++;
+          } else
+          {
+            num_wrong++;
+          }
+        }
+      }
+    }
+  }
+
+  ROS_INFO("Stage latency (serial, unpruned):");
+  reportPercentiles("conversion", times.conversion);
+  reportPercentiles("outlier filter", times.filter);
+  reportPercentiles("color gate", times.color_gate);
+  reportPercentiles("ICP", times.icp);
+  reportPercentiles("metrics", times.metrics);
+  reportPercentiles("grasp ranking", times.grasp_ranking);
+  ROS_INFO("End-to-end latency per list (%d thread(s)):", recognizer.getNumThreads());
+  reportPercentiles("recognizeObjects", latencies);
+  if (total > 0)
+  {
+    ROS_INFO("Throughput: %.2f lists/s  %.2f objects/s", 1000.0 * latencies.size() / total,
+             1000.0 * num_objects / total);
+  }
+  if (num_labeled > 0)
+  {
+    ROS_INFO("Accuracy: %.1f%% (%lu correct, %lu wrong, %lu not recognized of %lu labeled objects)",
+             100.0 * num_correct / num_labeled, num_correct, num_wrong, num_missed, num_labeled);
+  } else
+  {
+    ROS_INFO("Accuracy: no labeled objects (object names in the bag are used as labels).");
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,361 @@
+/*!
+ * \file DeviceModelLibrary.cpp
+ * \brief A grasp model library kept resident in GPU memory for batched registration metrics.
+ *
+ * The device model library uploads the point clouds of every candidate model into a single GPU octree once, so the
+ * overlap and distance metrics of many registered candidates can be computed with one search per metric.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/DeviceModelLibrary.h"
+
+// PCL
+#ifdef RAIL_RECOGNITION_USE_GPU
+#include <pcl/gpu/containers/device_array.h>
+#include <pcl/gpu/octree/octree.hpp>
+#else
+#include <pcl/search/kdtree.h>
+#endif
+
+// C++ Standard Library
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+#ifdef RAIL_RECOGNITION_USE_GPU
+
+struct DeviceModelLibrary::Backend
+{
+  /*! The shifted model points in device memory. */
+  pcl::gpu::Octree::PointCloud cloud;
+  /*! The octree over the device points. */
+  pcl::gpu::Octree octree;
+  /*! The query points in device memory (reused between batches). */
+  pcl::gpu::Octree::Queries queries;
+};
+
+#else
+
+struct DeviceModelLibrary::Backend
+{
+  /*! The shifted model points. */
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr points;
+  /*! The KD tree over the shifted model points. */
+  pcl::search::KdTree<pcl::PointXYZRGB> search_tree;
+};
+
+#endif
+
+bool DeviceModelLibrary::isGPUEnabled()
+{
+#ifdef RAIL_RECOGNITION_USE_GPU
+  return true;
+#else
+  return false;
+#endif
+}
+
+DeviceModelLibrary::DeviceModelLibrary(const vector<PCLGraspModel> &models)
+    : points_(new pcl::PointCloud<pcl::PointXYZRGB>), backend_(new Backend)
+{
+  // store every model contiguously in its own coordinates
+  size_t total = 0;
+  for (size_t i = 0; i < models.size(); i++)
+  {
+    total += models[i].getPCLPointCloud()->size();
+  }
+  points_->reserve(total);
+  models_.reserve(models.size());
+  begins_.reserve(models.size());
+  model_radius_ = 0;
+  for (size_t i = 0; i < models.size(); i++)
+  {
+    const pcl::PointCloud<pcl::PointXYZRGB> &pc = *models[i].getPCLPointCloud();
+    begins_.push_back(points_->size());
+    for (size_t j = 0; j < pc.size(); j++)
+    {
+      model_radius_ = max(model_radius_, (double) pc[j].getVector3fMap().norm());
+      points_->push_back(pc[j]);
+    }
+    models_.push_back(make_pair(models[i].getID(), pc.size()));
+  }
+
+  // slots must be far enough apart that points near a model never find another model first
+  spacing_ = 4.0 * model_radius_ + 2.0 * MODEL_MARGIN;
+  grid_size_ = 1;
+  while (grid_size_ * grid_size_ * grid_size_ < models.size())
+  {
+    grid_size_++;
+  }
+
+  // shift each model into its own slot
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr shifted(new pcl::PointCloud<pcl::PointXYZRGB>);
+  shifted->reserve(total);
+  for (size_t i = 0; i < models_.size(); i++)
+  {
+    double x, y, z;
+    this->getSlotOffset(i, x, y, z);
+    for (size_t j = begins_[i]; j < begins_[i] + models_[i].second; j++)
+    {
+      pcl::PointXYZRGB point = points_->points[j];
+      point.x = (float) (point.x + x);
+      point.y = (float) (point.y + y);
+      point.z = (float) (point.z + z);
+      shifted->push_back(point);
+    }
+  }
+
+#ifdef RAIL_RECOGNITION_USE_GPU
+  // upload the positions once, the colors stay on the host
+  vector<pcl::PointXYZ> positions(shifted->size());
+  for (size_t i = 0; i < shifted->size(); i++)
+  {
+    positions[i].x = shifted->points[i].x;
+    positions[i].y = shifted->points[i].y;
+    positions[i].z = shifted->points[i].z;
+  }
+  if (!positions.empty())
+  {
+    backend_->cloud.upload(positions);
+    backend_->octree.setCloud(backend_->cloud);
+    backend_->octree.build();
+  }
+#else
+  backend_->points = shifted;
+  if (!shifted->empty())
+  {
+    backend_->search_tree.setInputCloud(shifted);
+  }
+#endif
+}
+
+DeviceModelLibrary::~DeviceModelLibrary()
+{
+  // the device memory is released with the backend
+}
+
+size_t DeviceModelLibrary::size() const
+{
+  return models_.size();
+}
+
+bool DeviceModelLibrary::matches(const vector<PCLGraspModel> &models) const
+{
+  if (models.size() != models_.size())
+  {
+    return false;
+  }
+  for (size_t i = 0; i < models.size(); i++)
+  {
+    if (models[i].getID() != models_[i].first || models[i].getPCLPointCloud()->size() != models_[i].second)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void DeviceModelLibrary::calculateRegistrationMetrics(const vector<Registration> &registrations,
+    vector<point_cloud_metrics::RegistrationMetrics> &metrics, const double metric_overlap_search_radius) const
+{
+  metrics.assign(registrations.size(), point_cloud_metrics::RegistrationMetrics());
+  if (points_->empty())
+  {
+    // nothing can overlap
+    for (size_t i = 0; i < metrics.size(); i++)
+    {
+      metrics[i].color_error = numeric_limits<double>::infinity();
+      metrics[i].distance_error = numeric_limits<double>::infinity();
+    }
+    return;
+  }
+
+  // split into batches of at most the maximum number of points (a larger point cloud is its own batch)
+  boost::mutex::scoped_lock lock(mutex_);
+  size_t begin = 0;
+  while (begin < registrations.size())
+  {
+    size_t end = begin + 1;
+    size_t num_points = registrations[begin].second->size();
+    while (end < registrations.size() && num_points + registrations[end].second->size() <= MAX_BATCH_POINTS)
+    {
+      num_points += registrations[end].second->size();
+      end++;
+    }
+    this->calculateBatch(registrations, begin, end, metrics, metric_overlap_search_radius);
+    begin = end;
+  }
+}
+
+void DeviceModelLibrary::calculateBatch(const vector<Registration> &registrations, const size_t begin,
+    const size_t end, vector<point_cloud_metrics::RegistrationMetrics> &metrics,
+    const double metric_overlap_search_radius) const
+{
+  // shift every query point into the slot of its model (points too far from their model are searched directly)
+  const double slot_limit = min(model_radius_ + MODEL_MARGIN,
+                                3.0 * model_radius_ + 2.0 * MODEL_MARGIN - metric_overlap_search_radius);
+  pcl::PointCloud<pcl::PointXYZRGB> queries;
+  vector<size_t> outliers;
+  for (size_t i = begin; i < end; i++)
+  {
+    const pcl::PointCloud<pcl::PointXYZRGB> &pc = *registrations[i].second;
+    double x, y, z;
+    this->getSlotOffset(registrations[i].first, x, y, z);
+    for (size_t j = 0; j < pc.size(); j++)
+    {
+      if (pc[j].getVector3fMap().norm() >= slot_limit)
+      {
+        outliers.push_back(queries.size());
+      }
+      pcl::PointXYZRGB point = pc[j];
+      point.x = (float) (point.x + x);
+      point.y = (float) (point.y + y);
+      point.z = (float) (point.z + z);
+      queries.push_back(point);
+    }
+  }
+
+  // the neighbors of query i are neighbors[i * MAX_NEIGHBORS, i * MAX_NEIGHBORS + num_neighbors[i])
+  vector<int> neighbors, num_neighbors, nearest;
+#ifdef RAIL_RECOGNITION_USE_GPU
+  {
+    vector<pcl::PointXYZ> positions(queries.size());
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+      positions[i].x = queries[i].x;
+      positions[i].y = queries[i].y;
+      positions[i].z = queries[i].z;
+    }
+    backend_->queries.upload(positions);
+
+    // one launch for every radius search and one for every nearest search
+    pcl::gpu::NeighborIndices radius_results(positions.size(), MAX_NEIGHBORS);
+    backend_->octree.radiusSearch(backend_->queries, (float) metric_overlap_search_radius, MAX_NEIGHBORS,
+                                  radius_results);
+    radius_results.data.download(neighbors);
+    radius_results.sizes.download(num_neighbors);
+    pcl::gpu::NeighborIndices nearest_results(positions.size(), 1);
+    backend_->octree.nearestKSearchBatch(backend_->queries, 1, nearest_results);
+    nearest_results.data.download(nearest);
+  }
+#else
+  {
+    neighbors.resize(queries.size() * MAX_NEIGHBORS);
+    num_neighbors.resize(queries.size());
+    nearest.resize(queries.size());
+    vector<int> indices;
+    vector<float> distances;
+    for (size_t i = 0; i < queries.size(); i++)
+    {
+      num_neighbors[i] = backend_->search_tree.radiusSearch(queries[i], metric_overlap_search_radius, indices,
+                                                            distances, MAX_NEIGHBORS);
+      copy(indices.begin(), indices.begin() + num_neighbors[i], neighbors.begin() + i * MAX_NEIGHBORS);
+      backend_->search_tree.nearestKSearch(queries[i], 1, indices, distances);
+      nearest[i] = indices[0];
+    }
+  }
+#endif
+
+  // replace the results of the points that may have matched another model
+  size_t next_outlier = 0;
+  size_t query = 0;
+  for (size_t i = begin; i < end && next_outlier < outliers.size(); i++)
+  {
+    const pcl::PointCloud<pcl::PointXYZRGB> &pc = *registrations[i].second;
+    for (size_t j = 0; j < pc.size(); j++, query++)
+    {
+      if (next_outlier < outliers.size() && outliers[next_outlier] == query)
+      {
+        this->searchModel(pc[j], registrations[i].first, metric_overlap_search_radius,
+                          &neighbors[query * MAX_NEIGHBORS], num_neighbors[query], nearest[query]);
+        next_outlier++;
+      }
+    }
+  }
+
+  // reduce each registered pair on the host in the unshifted coordinates
+  point_cloud_metrics::ColorDistanceScratch scratch;
+  vector<int> indices;
+  query = 0;
+  for (size_t i = begin; i < end; i++)
+  {
+    const pcl::PointCloud<pcl::PointXYZRGB> &pc = *registrations[i].second;
+    const size_t n = pc.size();
+    if (models_[registrations[i].first].second == 0)
+    {
+      // an empty model never overlaps
+      metrics[i].color_error = numeric_limits<double>::infinity();
+      metrics[i].distance_error = numeric_limits<double>::infinity();
+      query += n;
+      continue;
+    }
+    double score = 0;
+    double error = 0;
+    double distance_error = 0;
+    for (size_t j = 0; j < n; j++, query++)
+    {
+      const pcl::PointXYZRGB &point = pc[j];
+      if (num_neighbors[query] > 0)
+      {
+        score++;
+        const int *first = &neighbors[query * MAX_NEIGHBORS];
+        indices.assign(first, first + num_neighbors[query]);
+        error += point_cloud_metrics::calculateAvgColorDistance(point, *points_, indices, scratch);
+      }
+      const pcl::PointXYZRGB &closest = points_->points[nearest[query]];
+      const double dx = point.x - closest.x;
+      const double dy = point.y - closest.y;
+      const double dz = point.z - closest.z;
+      distance_error += dx * dx + dy * dy + dz * dz;
+    }
+
+    // normalize the errors the same as the KD tree metrics
+    metrics[i].overlap = score / (double) n;
+    metrics[i].color_error = error / score;
+    metrics[i].distance_error = distance_error;
+  }
+}
+
+void DeviceModelLibrary::getSlotOffset(const size_t slot, double &x, double &y, double &z) const
+{
+  // the grid is centered at the origin to keep the shifted coordinates as small as possible
+  const double center = 0.5 * (double) (grid_size_ - 1);
+  x = ((double) (slot % grid_size_) - center) * spacing_;
+  y = ((double) ((slot / grid_size_) % grid_size_) - center) * spacing_;
+  z = ((double) (slot / (grid_size_ * grid_size_)) - center) * spacing_;
+}
+
+void DeviceModelLibrary::searchModel(const pcl::PointXYZRGB &point, const size_t model, const double radius,
+    int *neighbors, int &num_neighbors, int &nearest) const
+{
+  const double radius_squared = radius * radius;
+  double nearest_squared = numeric_limits<double>::infinity();
+  num_neighbors = 0;
+  // an empty model keeps the batched result (its metrics are never reduced)
+  if (models_[model].second == 0)
+  {
+    return;
+  }
+  for (size_t i = begins_[model]; i < begins_[model] + models_[model].second; i++)
+  {
+    const pcl::PointXYZRGB &candidate = points_->points[i];
+    const double dx = point.x - candidate.x;
+    const double dy = point.y - candidate.y;
+    const double dz = point.z - candidate.z;
+    const double d = dx * dx + dy * dy + dz * dz;
+    if (d <= radius_squared && num_neighbors < MAX_NEIGHBORS)
+    {
+      neighbors[num_neighbors++] = (int) i;
+    }
+    if (d < nearest_squared)
+    {
+      nearest_squared = d;
+      nearest = (int) i;
+    }
+  }
+}
@@ -0,0 +1,252 @@
+/*!
+ * \file GraspModelCache.cpp
+ * \brief A resident, incrementally refreshed cache of PCL grasp models.
+ *
+ * The grasp model cache loads and converts all grasp models from the grasp database once. Subsequent refreshes use a
+ * cheap state query to detect changes and only load or drop the grasp models that were added or removed.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/GraspModelCache.h"
+
+// ROS
+#include <ros/ros.h>
+
+// Boost
+#include <boost/algorithm/string.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+#include <map>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+/*!
+ * Comparison function used to keep the cached models sorted by ID.
+ *
+ * \param model The cached model.
+ * \param id The ID to compare against.
+ * \return True if the ID of the model is less than the given ID.
+ */
+static bool modelIDLessThan(const PCLGraspModel &model, const uint32_t id)
+{
+  return model.getID() < id;
+}
+
+GraspModelCache::GraspModelCache(const graspdb::Client *graspdb)
+    : graspdb_(graspdb), models_(new vector<PCLGraspModel>), name_index_(new NameIndex)
+{
+  initialized_ = false;
+  max_id_ = 0;
+  count_ = 0;
+}
+
+bool GraspModelCache::refresh()
+{
+  // only a single refresh can use the database connection at a time
+  boost::mutex::scoped_lock lock(refresh_mutex_);
+
+  // cheap check to see if anything changed
+  uint32_t max_id, count;
+  if (!graspdb_->getGraspModelsState(max_id, count))
+  {
+    ROS_WARN("Could not load the grasp model state from the database.");
+    return false;
+  } else if (initialized_ && max_id == max_id_ && count == count_)
+  {
+    return false;
+  }
+
+  // load the ID and created times of everything currently in the database
+  vector<graspdb::Entity> entities;
+  graspdb_->loadGraspModelEntities(entities);
+  map<uint32_t, time_t> current;
+  for (size_t i = 0; i < entities.size(); i++)
+  {
+    current[entities[i].getID()] = entities[i].getCreated();
+  }
+
+  // find the models that are still valid (any that were removed or replaced are dropped)
+  const ModelLibraryConstPtr old_models = this->getModelLibrary();
+  vector<size_t> kept;
+  kept.reserve(old_models->size());
+  for (size_t i = 0; i < old_models->size(); i++)
+  {
+    map<uint32_t, time_t>::iterator it = current.find(old_models->at(i).getID());
+    if (it != current.end() && it->second == old_models->at(i).getCreated())
+    {
+      // already cached, no need to load it again
+      current.erase(it);
+      kept.push_back(i);
+    }
+  }
+  const size_t dropped = old_models->size() - kept.size();
+
+  // load and convert the new models (the map is sorted by ID) in batches, releasing each message once converted
+  vector<PCLGraspModel> loaded_models(current.size());
+  size_t loaded = 0, failed = 0;
+  map<uint32_t, time_t>::const_iterator it = current.begin();
+  while (it != current.end())
+  {
+    vector<uint32_t> ids;
+    for (; it != current.end() && ids.size() < graspdb::Client::DEFAULT_BATCH_SIZE; ++it)
+    {
+      ids.push_back(it->first);
+    }
+    vector<graspdb::GraspModel> models;
+    graspdb_->loadGraspModels(ids, models);
+    size_t next = 0;
+    for (size_t i = 0; i < ids.size(); i++)
+    {
+      if (next < models.size() && models[next].getID() == ids[i])
+      {
+        loaded_models[loaded++].consume(models[next++]);
+      } else
+      {
+        ROS_WARN("Could not load grasp model with ID %d.", ids[i]);
+        failed++;
+      }
+    }
+  }
+
+  // build a new library in ID order (the old one may still be in use, so the kept models are copied)
+  if (loaded > 0 || dropped > 0)
+  {
+    boost::shared_ptr<vector<PCLGraspModel> > models(new vector<PCLGraspModel>(kept.size() + loaded));
+    size_t next_kept = 0, next_loaded = 0;
+    for (size_t i = 0; i < models->size(); i++)
+    {
+      if (next_loaded == loaded || (next_kept < kept.size()
+          && old_models->at(kept[next_kept]).getID() < loaded_models[next_loaded].getID()))
+      {
+        models->at(i) = old_models->at(kept[next_kept++]);
+      } else
+      {
+        models->at(i).swap(loaded_models[next_loaded++]);
+      }
+    }
+    this->setModelLibrary(models);
+  }
+
+  // only store the new state once every model is cached, otherwise the next refresh retries the missing models
+  if (failed == 0)
+  {
+    initialized_ = true;
+    max_id_ = max_id;
+    count_ = count;
+  } else
+  {
+    ROS_WARN("%lu grasp models could not be loaded and will be retried on the next refresh.", failed);
+  }
+
+  ROS_INFO("Grasp model cache refreshed: %lu loaded, %lu dropped, %lu total.", loaded, dropped,
+           kept.size() + loaded);
+  return loaded > 0 || dropped > 0;
+}
+
+bool GraspModelCache::loadSnapshot(const ModelSnapshot &snapshot)
+{
+  boost::shared_ptr<vector<PCLGraspModel> > models(new vector<PCLGraspModel>);
+  uint32_t max_id, count;
+  if (!snapshot.load(*models, max_id, count))
+  {
+    return false;
+  }
+
+  // keep the cache sorted by ID regardless of how the snapshot was written
+  for (size_t i = 1; i < models->size(); i++)
+  {
+    if (models->at(i - 1).getID() >= models->at(i).getID())
+    {
+      ROS_WARN("Ignoring unsorted model snapshot %s.", snapshot.getFileName().c_str());
+      return false;
+    }
+  }
+
+  boost::mutex::scoped_lock lock(refresh_mutex_);
+  this->setModelLibrary(models);
+  initialized_ = true;
+  max_id_ = max_id;
+  count_ = count;
+  ROS_INFO("Restored %lu grasp models from the snapshot %s.", models->size(), snapshot.getFileName().c_str());
+  return true;
+}
+
+bool GraspModelCache::saveSnapshot(const ModelSnapshot &snapshot) const
+{
+  boost::mutex::scoped_lock lock(refresh_mutex_);
+  if (!initialized_)
+  {
+    return false;
+  }
+  return snapshot.save(*this->getModelLibrary(), max_id_, count_);
+}
+
+GraspModelCache::ModelLibraryConstPtr GraspModelCache::getModelLibrary() const
+{
+  boost::mutex::scoped_lock lock(models_mutex_);
+  return models_;
+}
+
+void GraspModelCache::getModelLibrary(ModelLibraryConstPtr &models, NameIndexConstPtr &name_index) const
+{
+  boost::mutex::scoped_lock lock(models_mutex_);
+  models = models_;
+  name_index = name_index_;
+}
+
+const vector<PCLGraspModel> *GraspModelCache::findModelsByObjectName(const NameIndexConstPtr &name_index,
+    const string &object_name)
+{
+  NameIndex::const_iterator it = name_index->find(boost::to_upper_copy(object_name));
+  return (it == name_index->end()) ? NULL : &it->second;
+}
+
+void GraspModelCache::setModelLibrary(const ModelLibraryConstPtr &models)
+{
+  // names are grouped case insensitive to match the database queries (copies share the point clouds)
+  boost::shared_ptr<NameIndex> name_index(new NameIndex);
+  for (size_t i = 0; i < models->size(); i++)
+  {
+    (*name_index)[boost::to_upper_copy(models->at(i).getObjectName())].push_back(models->at(i));
+  }
+
+  boost::mutex::scoped_lock lock(models_mutex_);
+  models_ = models;
+  name_index_ = name_index;
+}
+
+bool GraspModelCache::getModelsByObjectName(const string &object_name, vector<PCLGraspModel> &models) const
+{
+  ModelLibraryConstPtr library;
+  NameIndexConstPtr name_index;
+  this->getModelLibrary(library, name_index);
+  const vector<PCLGraspModel> *matches = GraspModelCache::findModelsByObjectName(name_index, object_name);
+  if (matches == NULL)
+  {
+    return false;
+  }
+  models.insert(models.end(), matches->begin(), matches->end());
+  return true;
+}
+
+const PCLGraspModel *GraspModelCache::findModel(const ModelLibraryConstPtr &models, const uint32_t id)
+{
+  vector<PCLGraspModel>::const_iterator it = lower_bound(models->begin(), models->end(), id, modelIDLessThan);
+  if (it != models->end() && it->getID() == id)
+  {
+    return &(*it);
+  } else
+  {
+    return NULL;
+  }
+}
+
+size_t GraspModelCache::size() const
+{
+  return this->getModelLibrary()->size();
+}
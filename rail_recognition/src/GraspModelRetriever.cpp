@@ -20,10 +20,14 @@ using namespace std;
 using namespace rail::pick_and_place;
 
 GraspModelRetriever::GraspModelRetriever()
-    : private_node_("~"),
-      as_(private_node_, "retrieve_grasp_model", boost::bind(&GraspModelRetriever::retrieveGraspModel, this, _1), false)
+    : goal_queue_(boost::bind(&GraspModelRetriever::retrieveGraspModel, this, _1), "Grasp model retriever shut down.",
+                  "Goal cancelled before retrieval."),
+      private_node_("~"),
+      as_(private_node_, "retrieve_grasp_model", boost::bind(&GoalQueue::goalCallback, &goal_queue_, _1),
+          boost::bind(&GoalQueue::cancelCallback, &goal_queue_, _1), false)
 {
   // set defaults
+  int num_goal_threads = DEFAULT_NUM_GOAL_THREADS;
   int port = graspdb::Client::DEFAULT_PORT;
   string host("127.0.0.1");
   string user("ros");
@@ -31,6 +35,7 @@ GraspModelRetriever::GraspModelRetriever()
   string db("graspdb");
 
   // grab any parameters we need
+  private_node_.getParam("num_goal_threads", num_goal_threads);
   node_.getParam("/graspdb/host", host);
   node_.getParam("/graspdb/port", port);
   node_.getParam("/graspdb/user", user);
@@ -41,11 +46,20 @@ GraspModelRetriever::GraspModelRetriever()
   graspdb_ = new graspdb::Client(host, port, user, password, db);
   okay_ = graspdb_->connect();
 
+  // load the initial set of grasp models
+  model_cache_ = new GraspModelCache(graspdb_);
+  if (okay_)
+  {
+    model_cache_->refresh();
+  }
+
   // set up the latched publishers we need
   point_cloud_pub_ = private_node_.advertise<sensor_msgs::PointCloud2>("point_cloud", 1, true);
   poses_pub_ = private_node_.advertise<geometry_msgs::PoseArray>("poses", 1, true);
 
-  // start the action server
+  // start the goal threads and the action server
+  goal_queue_.start(num_goal_threads);
+  ROS_INFO("Serving up to %d goal(s) at once.", goal_queue_.getNumThreads());
   as_.start();
 
   if (okay_)
@@ -56,8 +70,11 @@ GraspModelRetriever::GraspModelRetriever()
 
 GraspModelRetriever::~GraspModelRetriever()
 {
+  // stop the goal threads (running goals are finished first)
+  goal_queue_.shutdown();
+
   // cleanup
-  as_.shutdown();
+  delete model_cache_;
   graspdb_->disconnect();
   delete graspdb_;
 }
@@ -67,28 +84,32 @@ bool GraspModelRetriever::okay() const
   return okay_;
 }
 
-void GraspModelRetriever::retrieveGraspModel(const rail_pick_and_place_msgs::RetrieveGraspModelGoalConstPtr &goal)
+void GraspModelRetriever::retrieveGraspModel(GoalHandle &goal_handle)
 {
+  const rail_pick_and_place_msgs::RetrieveGraspModelGoalConstPtr goal = goal_handle.getGoal();
   rail_pick_and_place_msgs::RetrieveGraspModelFeedback feedback;
   rail_pick_and_place_msgs::RetrieveGraspModelResult result;
 
-  // attempt to load the grasp model from the database
+  // attempt to load the grasp model from the cache (refreshes from other goals are serialized by the cache)
   feedback.message = "Requesting grasp model from database...";
-  as_.publishFeedback(feedback);
-  graspdb::GraspModel gm;
-  if (!graspdb_->loadGraspModel(goal->id, gm))
+  goal_handle.publishFeedback(feedback);
+  model_cache_->refresh();
+  // hold on to the library so the model stays valid for the whole goal
+  const GraspModelCache::ModelLibraryConstPtr library = model_cache_->getModelLibrary();
+  const PCLGraspModel *cached = GraspModelCache::findModel(library, goal->id);
+  if (cached == NULL)
   {
     result.success = false;
-    as_.setSucceeded(result, "Could not load grasp model from database.");
+    goal_handle.setSucceeded(result, "Could not load grasp model from database.");
     return;
   } else
   {
     // store inside of the result
-    result.grasp_model = gm.toROSGraspModelMessage();
+    result.grasp_model = cached->toGraspModel().toROSGraspModelMessage();
 
     // publish the data
     feedback.message = "Publishing to latched topics...";
-    as_.publishFeedback(feedback);
+    goal_handle.publishFeedback(feedback);
     // send the resulting point cloud message from the goal
     point_cloud_pub_.publish(result.grasp_model.point_cloud);
     // create and send a PoseArray
@@ -102,6 +123,6 @@ void GraspModelRetriever::retrieveGraspModel(const rail_pick_and_place_msgs::Ret
 
     // success
     result.success = true;
-    as_.setSucceeded(result, "Success!");
+    goal_handle.setSucceeded(result, "Success!");
   }
 }
@@ -0,0 +1,102 @@
+/*!
+ * \file LabelWriter.cpp
+ * \brief A background writer for labelled training data.
+ *
+ * The label writer appends lines of labelled training data to a file from a background thread so operators are
+ * never blocked by file output.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/LabelWriter.h"
+
+// ROS
+#include <ros/ros.h>
+
+// Boost
+#include <boost/bind.hpp>
+
+// C++ Standard Library
+#include <fstream>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+LabelWriter::LabelWriter(const string &file_name) : file_name_(file_name)
+{
+  writing_ = 0;
+  shutdown_ = false;
+  thread_ = boost::thread(boost::bind(&LabelWriter::writerLoop, this));
+}
+
+LabelWriter::~LabelWriter()
+{
+  // let the writer finish the queue
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    shutdown_ = true;
+  }
+  not_empty_condition_.notify_all();
+  thread_.join();
+}
+
+void LabelWriter::write(const string &line)
+{
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    queue_.push_back(line);
+  }
+  not_empty_condition_.notify_one();
+}
+
+void LabelWriter::flush()
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  while (!queue_.empty() || writing_ > 0)
+  {
+    written_condition_.wait(lock);
+  }
+}
+
+void LabelWriter::writerLoop()
+{
+  while (true)
+  {
+    // take everything that is queued
+    deque<string> lines;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!shutdown_ && queue_.empty())
+      {
+        not_empty_condition_.wait(lock);
+      }
+      if (queue_.empty())
+      {
+        // shut down with nothing left to write
+        return;
+      }
+      lines.swap(queue_);
+      writing_ = lines.size();
+    }
+
+    // append and flush the lines together
+    ofstream output_file(file_name_.c_str(), ios::out | ios::app);
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+      output_file << lines[i] << '\n';
+    }
+    output_file.close();
+    if (output_file.fail())
+    {
+      ROS_ERROR("Could not write %lu label(s) to %s.", lines.size(), file_name_.c_str());
+    }
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      writing_ = 0;
+    }
+    written_condition_.notify_all();
+  }
+}
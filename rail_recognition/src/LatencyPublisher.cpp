@@ -0,0 +1,92 @@
+/*!
+ * \file LatencyPublisher.cpp
+ * \brief Periodic publishing of latency histograms as diagnostics.
+ *
+ * The latency publisher periodically summarizes a latency recorder and publishes each stage on the diagnostics topic.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/LatencyPublisher.h"
+
+// ROS
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+// Boost
+#include <boost/lexical_cast.hpp>
+
+// C++ Standard Library
+#include <sstream>
+#include <vector>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+/*!
+ * Create a key-value pair for a diagnostics status.
+ *
+ * \param key The key.
+ * \param value The value.
+ * \return The key-value pair.
+ */
+template<typename T>
+static diagnostic_msgs::KeyValue createKeyValue(const string &key, const T &value)
+{
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = boost::lexical_cast<string>(value);
+  return kv;
+}
+
+LatencyPublisher::LatencyPublisher(ros::NodeHandle &node, const string &name, graspdb::LatencyRecorder &recorder,
+    const double period)
+    : name_(name), recorder_(recorder)
+{
+  if (period > 0)
+  {
+    diagnostics_pub_ = node.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+    timer_ = node.createWallTimer(ros::WallDuration(period), &LatencyPublisher::publishCallback, this);
+  }
+}
+
+LatencyPublisher::~LatencyPublisher()
+{
+  // cleanup
+  timer_.stop();
+}
+
+void LatencyPublisher::publishCallback(const ros::WallTimerEvent &event)
+{
+  // each message covers a single period
+  vector<graspdb::LatencyRecorder::Statistics> statistics;
+  recorder_.getStatistics(statistics, true);
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  for (size_t i = 0; i < statistics.size(); i++)
+  {
+    const graspdb::LatencyRecorder::Statistics &s = statistics[i];
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = name_ + ": " + s.name;
+    status.hardware_id = name_;
+    stringstream ss;
+    ss << s.count << " sample(s), p99 " << s.p99 << " ms";
+    status.message = ss.str();
+    status.values.push_back(createKeyValue("count", s.count));
+    status.values.push_back(createKeyValue("mean_ms", s.mean));
+    status.values.push_back(createKeyValue("p50_ms", s.p50));
+    status.values.push_back(createKeyValue("p90_ms", s.p90));
+    status.values.push_back(createKeyValue("p99_ms", s.p99));
+    status.values.push_back(createKeyValue("max_ms", s.max));
+    diagnostics.status.push_back(status);
+  }
+
+  // idle periods are skipped
+  if (!diagnostics.status.empty())
+  {
+    diagnostics_pub_.publish(diagnostics);
+  }
+}
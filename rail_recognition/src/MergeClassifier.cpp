@@ -0,0 +1,311 @@
+/*!
+ * \file MergeClassifier.cpp
+ * \brief A compiled decision tree ensemble for classifying point cloud merges.
+ *
+ * The merge classifier loads a trained decision tree (or an ensemble of trees) over the registration metrics and
+ * compiles it into flat arrays that are evaluated without data dependent branches.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/MergeClassifier.h"
+
+// ROS
+#include <ros/ros.h>
+
+// Boost
+#include <boost/cstdint.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+/*!
+ * Parse a feature name.
+ *
+ * \param name The name of the feature.
+ * \param feature The feature to set.
+ * \return True if the name is a valid feature.
+ */
+static bool parseFeature(const string &name, int &feature)
+{
+  if (name == "overlap")
+  {
+    feature = MergeClassifier::OVERLAP;
+  } else if (name == "color_error")
+  {
+    feature = MergeClassifier::COLOR_ERROR;
+  } else if (name == "distance_error")
+  {
+    feature = MergeClassifier::DISTANCE_ERROR;
+  } else
+  {
+    return false;
+  }
+  return true;
+}
+
+/*!
+ * Parse a double value (strtod also handles infinite values).
+ *
+ * \param token The token to parse.
+ * \param value The value to set.
+ * \return True if the entire token is a valid double.
+ */
+static bool parseDouble(const string &token, double &value)
+{
+  char *end;
+  value = strtod(token.c_str(), &end);
+  return !token.empty() && *end == '\0';
+}
+
+/*!
+ * Hash a string with 64-bit FNV-1a (stable across runs and platforms).
+ *
+ * \param str The string to hash.
+ * \return The hash as a hexadecimal string.
+ */
+static string hashString(const string &str)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < str.size(); i++)
+  {
+    hash ^= (uint64_t) (unsigned char) str[i];
+    hash *= 1099511628211ULL;
+  }
+  stringstream ss;
+  ss << hex << hash;
+  return ss.str();
+}
+
+MergeClassifier::MergeClassifier()
+{
+  // the trained two-threshold tree (overlap above the minimum and color error at most the maximum)
+  vector<vector<Node> > trees(1, vector<Node>(5));
+  vector<Node> &tree = trees[0];
+  tree[0].leaf = false;
+  tree[0].feature = OVERLAP;
+  tree[0].value = point_cloud_metrics::DEFAULT_MERGE_MIN_OVERLAP;
+  tree[0].low = 1;
+  tree[0].high = 2;
+  tree[1].leaf = true;
+  tree[1].value = 0;
+  tree[2].leaf = false;
+  tree[2].feature = COLOR_ERROR;
+  tree[2].value = point_cloud_metrics::DEFAULT_MERGE_MAX_COLOR_ERROR;
+  tree[2].low = 3;
+  tree[2].high = 4;
+  tree[3].leaf = true;
+  tree[3].value = 1;
+  tree[4].leaf = true;
+  tree[4].value = 0;
+  this->compile(trees, DEFAULT_DECISION_THRESHOLD);
+}
+
+bool MergeClassifier::load(const string &file_name)
+{
+  ifstream file(file_name.c_str());
+  if (!file.is_open())
+  {
+    ROS_ERROR("Could not open the merge classifier %s.", file_name.c_str());
+    return false;
+  }
+
+  vector<vector<Node> > trees;
+  double threshold = DEFAULT_DECISION_THRESHOLD;
+  string line;
+  size_t line_number = 0;
+  while (getline(file, line))
+  {
+    line_number++;
+    // strip comments
+    size_t comment = line.find('#');
+    if (comment != string::npos)
+    {
+      line.erase(comment);
+    }
+
+    istringstream ss(line);
+    string statement;
+    if (!(ss >> statement))
+    {
+      continue;
+    }
+
+    bool valid;
+    string token, extra;
+    if (statement == "tree")
+    {
+      trees.push_back(vector<Node>());
+      valid = !(ss >> extra);
+    } else if (statement == "threshold")
+    {
+      valid = (ss >> token) && parseDouble(token, threshold) && !(ss >> extra);
+    } else if (!trees.empty() && (statement == "leaf" || statement == "node"))
+    {
+      Node node;
+      node.leaf = (statement == "leaf");
+      node.feature = OVERLAP;
+      node.low = 0;
+      node.high = 0;
+      if (node.leaf)
+      {
+        valid = (ss >> token) && parseDouble(token, node.value);
+      } else
+      {
+        string feature;
+        long low = 0, high = 0;
+        valid = (ss >> feature >> token >> low >> high) && parseFeature(feature, node.feature)
+            && parseDouble(token, node.value);
+        // children must come after their parent, which also rules out cycles
+        long index = (long) trees.back().size();
+        valid = valid && low > index && high > index;
+        node.low = (size_t) low;
+        node.high = (size_t) high;
+      }
+      valid = valid && !(ss >> extra);
+      trees.back().push_back(node);
+    } else
+    {
+      valid = false;
+    }
+
+    if (!valid)
+    {
+      ROS_ERROR("Malformed line %lu in the merge classifier %s.", line_number, file_name.c_str());
+      return false;
+    }
+  }
+
+  // every child must exist within its tree
+  if (trees.empty())
+  {
+    ROS_ERROR("The merge classifier %s contains no trees.", file_name.c_str());
+    return false;
+  }
+  for (size_t i = 0; i < trees.size(); i++)
+  {
+    bool valid = !trees[i].empty();
+    for (size_t j = 0; valid && j < trees[i].size(); j++)
+    {
+      valid = trees[i][j].leaf || (trees[i][j].low < trees[i].size() && trees[i][j].high < trees[i].size());
+    }
+    if (!valid)
+    {
+      ROS_ERROR("Tree %lu of the merge classifier %s is empty or references a missing node.", i, file_name.c_str());
+      return false;
+    }
+  }
+
+  this->compile(trees, threshold);
+  return true;
+}
+
+void MergeClassifier::compile(const vector<vector<Node> > &trees, const double threshold)
+{
+  features_.clear();
+  thresholds_.clear();
+  next_.clear();
+  values_.clear();
+  roots_.clear();
+  depth_ = 0;
+  sum_threshold_ = threshold * (double) trees.size();
+  for (int i = 0; i < NUM_FEATURES; i++)
+  {
+    uses_feature_[i] = false;
+  }
+
+  // the description of every node is hashed for the signature
+  stringstream description;
+  description.precision(17);
+  description << threshold;
+  for (size_t i = 0; i < trees.size(); i++)
+  {
+    const vector<Node> &tree = trees[i];
+    const size_t offset = features_.size();
+    roots_.push_back(offset);
+    description << ";tree";
+
+    // children come after their parents, so the depth of each node is known once its children are visited
+    vector<size_t> depths(tree.size(), 0);
+    for (size_t j = tree.size(); j > 0; j--)
+    {
+      const Node &node = tree[j - 1];
+      if (!node.leaf)
+      {
+        depths[j - 1] = 1 + max(depths[node.low], depths[node.high]);
+      }
+    }
+    depth_ = max(depth_, depths[0]);
+
+    for (size_t j = 0; j < tree.size(); j++)
+    {
+      const Node &node = tree[j];
+      if (node.leaf)
+      {
+        // leaves never pass their threshold and loop back to themselves
+        features_.push_back(OVERLAP);
+        thresholds_.push_back(numeric_limits<double>::infinity());
+        next_.push_back(offset + j);
+        next_.push_back(offset + j);
+        values_.push_back(node.value);
+        description << ";l" << node.value;
+      } else
+      {
+        features_.push_back(node.feature);
+        thresholds_.push_back(node.value);
+        next_.push_back(offset + node.low);
+        next_.push_back(offset + node.high);
+        values_.push_back(0);
+        uses_feature_[node.feature] = true;
+        description << ";n" << node.feature << "," << node.value << "," << node.low << "," << node.high;
+      }
+    }
+  }
+
+  stringstream ss;
+  ss << trees.size() << "x" << depth_ << ":" << hashString(description.str());
+  signature_ = ss.str();
+}
+
+bool MergeClassifier::classify(const point_cloud_metrics::RegistrationMetrics &metrics) const
+{
+  const double values[NUM_FEATURES] = {metrics.overlap, metrics.color_error, metrics.distance_error};
+
+  // every tree takes the same number of steps, so the comparison results only select table entries
+  double sum = 0;
+  for (size_t i = 0; i < roots_.size(); i++)
+  {
+    size_t node = roots_[i];
+    for (size_t step = 0; step < depth_; step++)
+    {
+      // NaN metrics never pass a threshold
+      node = next_[2 * node + (size_t) (values[features_[node]] > thresholds_[node])];
+    }
+    sum += values_[node];
+  }
+  return sum > sum_threshold_;
+}
+
+bool MergeClassifier::usesFeature(const Feature feature) const
+{
+  return feature >= 0 && feature < NUM_FEATURES && uses_feature_[feature];
+}
+
+size_t MergeClassifier::getNumTrees() const
+{
+  return roots_.size();
+}
+
+const string &MergeClassifier::getSignature() const
+{
+  return signature_;
+}
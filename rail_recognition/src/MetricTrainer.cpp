@@ -17,6 +17,15 @@
 // ROS
 #include <pcl_ros/point_cloud.h>
 
+// Boost
+#include <boost/algorithm/string.hpp>
+#include <boost/thread/thread.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
@@ -26,6 +35,8 @@ MetricTrainer::MetricTrainer()
                                                       this, _1), false)
 {
   // set defaults
+  prefetch_pairs_ = DEFAULT_PREFETCH_PAIRS;
+  int num_threads = 1;
   int port = graspdb::Client::DEFAULT_PORT;
   string host("127.0.0.1");
   string user("ros");
@@ -33,6 +44,8 @@ MetricTrainer::MetricTrainer()
   string db("graspdb");
 
   // grab any parameters we need
+  private_node_.getParam("num_threads", num_threads);
+  private_node_.getParam("prefetch_pairs", prefetch_pairs_);
   node_.getParam("/graspdb/host", host);
   node_.getParam("/graspdb/port", port);
   node_.getParam("/graspdb/user", user);
@@ -43,6 +56,11 @@ MetricTrainer::MetricTrainer()
   graspdb_ = new graspdb::Client(host, port, user, password, db);
   okay_ = graspdb_->connect();
 
+  // create the worker threads
+  thread_pool_ = new ThreadPool(num_threads);
+  ROS_INFO("Filtering point clouds with %d thread(s).", thread_pool_->getNumThreads());
+  label_writer_ = new LabelWriter("registration_metrics.txt");
+
   // setup the point cloud publishers
   base_pc_pub_ = private_node_.advertise<pcl::PointCloud<pcl::PointXYZRGB> >("base_pc", 1, true);
   aligned_pc_pub_ = private_node_.advertise<pcl::PointCloud<pcl::PointXYZRGB> >("aligned_pc", 1, true);
@@ -58,6 +76,8 @@ MetricTrainer::~MetricTrainer()
 {
   // cleanup
   as_.shutdown();
+  delete label_writer_;
+  delete thread_pool_;
   graspdb_->disconnect();
   delete graspdb_;
 }
@@ -67,102 +87,278 @@ bool MetricTrainer::okay() const
   return okay_;
 }
 
+bool MetricTrainer::addDemonstrationPointCloud(graspdb::GraspDemonstration &demonstration,
+    vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &point_clouds, vector<graspdb::Summary> &summaries) const
+{
+  // convert from a ROS message
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr pc(new pcl::PointCloud<pcl::PointXYZRGB>);
+  point_cloud_metrics::rosPointCloud2ToPCLPointCloud(demonstration.getPointCloud(), pc);
+  // filter and move to the origin
+  point_cloud_metrics::filterPointCloudOutliers(*thread_pool_, pc);
+  point_cloud_metrics::transformToOrigin(pc);
+  point_clouds.push_back(pc);
+  summaries.push_back(graspdb::Summary(demonstration.getID(), demonstration.getObjectName(), 1,
+                                       demonstration.getCreated()));
+  return true;
+}
+
+void MetricTrainer::registrationLoop(const vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &point_clouds,
+    const vector<pair<size_t, size_t> > &pairs, RegistrationQueue &queue) const
+{
+  size_t next = 0;
+  while (next < pairs.size())
+  {
+    // wait for the labelling thread to fall behind the capacity
+    {
+      boost::mutex::scoped_lock lock(queue.mutex);
+      while (!queue.cancelled && queue.ready.size() >= queue.capacity)
+      {
+        queue.condition.wait(lock);
+      }
+      if (queue.cancelled)
+      {
+        return;
+      }
+    }
+
+    // register the next batch in parallel
+    const size_t batch_size = min(queue.capacity, pairs.size() - next);
+    vector<RegisteredPair> registered(batch_size);
+    thread_pool_->run(batch_size, boost::bind(&MetricTrainer::registerPairTask, this, _1, _2, next,
+                                              boost::cref(point_clouds), boost::cref(pairs),
+                                              boost::ref(registered)));
+    next += batch_size;
+
+    {
+      boost::mutex::scoped_lock lock(queue.mutex);
+      queue.ready.insert(queue.ready.end(), registered.begin(), registered.end());
+    }
+    queue.condition.notify_all();
+  }
+}
+
+void MetricTrainer::registerPairTask(const size_t index, const size_t thread, const size_t first,
+    const vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &point_clouds, const vector<pair<size_t, size_t> > &pairs,
+    vector<RegisteredPair> &registered) const
+{
+  const pair<size_t, size_t> &p = pairs[first + index];
+  RegisteredPair &result = registered[index];
+  result.first = p.first;
+  result.second = p.second;
+
+  // set the larger point cloud as the base point cloud
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr target_pc;
+  if (point_clouds[p.first]->size() > point_clouds[p.second]->size())
+  {
+    result.base_pc = point_clouds[p.first];
+    target_pc = point_clouds[p.second];
+  } else
+  {
+    result.base_pc = point_clouds[p.second];
+    target_pc = point_clouds[p.first];
+  }
+
+  // perform ICP on the point clouds and calculate all metrics
+  result.aligned_pc.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+  point_cloud_metrics::performICP(result.base_pc, target_pc, result.aligned_pc);
+  point_cloud_metrics::calculateRegistrationMetricOverlap(result.base_pc, result.aligned_pc, result.m_o,
+                                                          result.m_c_err);
+  result.m_d_err = point_cloud_metrics::calculateRegistrationMetricDistanceError(result.base_pc, result.aligned_pc);
+}
+
 void MetricTrainer::trainMetricsCallback(const rail_pick_and_place_msgs::TrainMetricsGoalConstPtr &goal)
 {
-  ROS_INFO("Gathering metrics for %s. Check RViz to see the matches.", goal->object_name.c_str());
+  if (goal->mode == rail_pick_and_place_msgs::TrainMetricsGoal::AUTOMATIC)
+  {
+    this->trainMetricsAutomatic(goal);
+  } else
+  {
+    this->trainMetricsInteractive(goal);
+  }
+}
+
+void MetricTrainer::trainMetricsAutomatic(const rail_pick_and_place_msgs::TrainMetricsGoalConstPtr &goal)
+{
+  const string output_file = goal->output_file.empty() ? "registration_metrics.csv" : goal->output_file;
+  ROS_INFO("Automatically labelling every pair of grasp demonstrations into %s.", output_file.c_str());
 
-  // default to false
   rail_pick_and_place_msgs::TrainMetricsFeedback feedback;
   rail_pick_and_place_msgs::TrainMetricsResult result;
   result.success = false;
+  result.num_pairs = 0;
 
-  // get all of the grasp demonstrations for the given object name
+  // stream every grasp demonstration (without images), converting each as it arrives
   feedback.message = "Loading grasp demonstrations...";
   as_.publishFeedback(feedback);
-  vector<graspdb::GraspDemonstration> demonstrations;
-  graspdb_->loadGraspDemonstrationsByObjectName(goal->object_name, demonstrations);
+  vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> point_clouds;
+  vector<graspdb::Summary> summaries;
+  graspdb_->forEachGraspDemonstration(boost::bind(&MetricTrainer::addDemonstrationPointCloud, this, _1,
+                                                  boost::ref(point_clouds), boost::ref(summaries)),
+                                      graspdb::Client::DEFAULT_BATCH_SIZE, false);
+  if (point_clouds.size() < 2)
+  {
+    string message = "Less than 2 grasp demonstrations found, ignoring request.";
+    ROS_WARN("%s", message.c_str());
+    as_.setSucceeded(result, message);
+    return;
+  }
 
-  // try merging every combination of grasps and gather metrics for each
-  if (demonstrations.size() >= 2)
+  // list every pair across every object
+  vector<pair<size_t, size_t> > pairs;
+  for (size_t i = 0; i < point_clouds.size() - 1; i++)
   {
-    // convert to PCL point clouds and filter them
-    feedback.message = "Converting to PCL point clouds...";
+    for (size_t j = i + 1; j < point_clouds.size(); j++)
+    {
+      pairs.push_back(make_pair(i, j));
+    }
+  }
+
+  // write a header for new files
+  LabelWriter writer(output_file);
+  if (!ifstream(output_file.c_str()).good())
+  {
+    writer.write("first_id,second_id,first_object_name,second_object_name,overlap,distance_error,color_error,label");
+  }
+
+  // register a batch at a time in parallel so only one batch of aligned point clouds is held at once
+  for (size_t first = 0; first < pairs.size(); first += AUTOMATIC_BATCH_SIZE)
+  {
+    if (as_.isPreemptRequested() || !ros::ok())
+    {
+      writer.flush();
+      as_.setPreempted(result, "Labelling stopped early.");
+      return;
+    }
+
+    const size_t batch_size = min((size_t) AUTOMATIC_BATCH_SIZE, pairs.size() - first);
+    stringstream ss;
+    ss << "Registering pairs " << first << " to " << first + batch_size << " of " << pairs.size() << "...";
+    feedback.message = ss.str();
     as_.publishFeedback(feedback);
-    vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> point_clouds;
-    for (size_t i = 0; i < demonstrations.size(); i++)
+
+    vector<RegisteredPair> registered(batch_size);
+    thread_pool_->run(batch_size, boost::bind(&MetricTrainer::registerPairTask, this, _1, _2, first,
+                                              boost::cref(point_clouds), boost::cref(pairs),
+                                              boost::ref(registered)));
+
+    // the same object name (case insensitive, as stored) is a positive match
+    for (size_t i = 0; i < registered.size(); i++)
     {
-      // create the PCL point cloud
-      point_clouds.push_back(pcl::PointCloud<pcl::PointXYZRGB>::Ptr(new pcl::PointCloud<pcl::PointXYZRGB>));
-      // convert from a ROS message
-      point_cloud_metrics::rosPointCloud2ToPCLPointCloud(demonstrations[i].getPointCloud(), point_clouds[i]);
-      // filter and move to the origin
-      point_cloud_metrics::filterPointCloudOutliers(point_clouds[i]);
-      point_cloud_metrics::transformToOrigin(point_clouds[i]);
+      const graspdb::Summary &a = summaries[registered[i].first];
+      const graspdb::Summary &b = summaries[registered[i].second];
+      const bool match = boost::iequals(a.getObjectName(), b.getObjectName());
+      ss.str("");
+      ss << a.getID() << "," << b.getID() << "," << a.getObjectName() << "," << b.getObjectName() << ","
+          << registered[i].m_o << "," << registered[i].m_d_err << "," << registered[i].m_c_err << ","
+          << (match ? "y" : "n");
+      writer.write(ss.str());
     }
+    result.num_pairs += registered.size();
+  }
 
-    // create the output file
-    ofstream output_file;
-    output_file.open("registration_metrics.txt", ios::out | ios::app);
+  // make sure every label is in the file before finishing
+  writer.flush();
+  result.success = true;
+  as_.setSucceeded(result);
+}
 
-    // check all pairs
+void MetricTrainer::trainMetricsInteractive(const rail_pick_and_place_msgs::TrainMetricsGoalConstPtr &goal)
+{
+  ROS_INFO("Gathering metrics for %s. Check RViz to see the matches.", goal->object_name.c_str());
+
+  // default to false
+  rail_pick_and_place_msgs::TrainMetricsFeedback feedback;
+  rail_pick_and_place_msgs::TrainMetricsResult result;
+  result.success = false;
+  result.num_pairs = 0;
+
+  // stream the grasp demonstrations for the given object name (without images), converting each as it arrives
+  feedback.message = "Loading grasp demonstrations...";
+  as_.publishFeedback(feedback);
+  vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> point_clouds;
+  vector<graspdb::Summary> summaries;
+  graspdb_->forEachGraspDemonstrationByObjectName(goal->object_name,
+                                                  boost::bind(&MetricTrainer::addDemonstrationPointCloud, this, _1,
+                                                              boost::ref(point_clouds), boost::ref(summaries)),
+                                                  graspdb::Client::DEFAULT_BATCH_SIZE, false);
+
+  // try merging every combination of grasps and gather metrics for each
+  if (point_clouds.size() >= 2)
+  {
+    // list every pair, then register them in the background while the operator labels
+    vector<pair<size_t, size_t> > pairs;
     for (size_t i = 0; i < point_clouds.size() - 1; i++)
     {
       for (size_t j = i + 1; j < point_clouds.size(); j++)
       {
-        stringstream ss;
-        ss << i << " and " << j;
-        string i_j_str = ss.str();
-        feedback.message = "Merging point clouds " + i_j_str + "...";
-        as_.publishFeedback(feedback);
+        pairs.push_back(make_pair(i, j));
+      }
+    }
+    RegistrationQueue queue;
+    queue.capacity = (size_t) max(prefetch_pairs_, 1);
+    queue.cancelled = false;
+    boost::thread registration_thread(boost::bind(&MetricTrainer::registrationLoop, this, boost::cref(point_clouds),
+                                                  boost::cref(pairs), boost::ref(queue)));
 
-        pcl::PointCloud<pcl::PointXYZRGB>::Ptr base_pc;
-        pcl::PointCloud<pcl::PointXYZRGB>::Ptr target_pc;
+    bool preempted = false;
+    for (size_t k = 0; k < pairs.size(); k++)
+    {
+      // stop registering ahead if the session is over
+      if (as_.isPreemptRequested() || !ros::ok())
+      {
+        boost::mutex::scoped_lock lock(queue.mutex);
+        queue.cancelled = true;
+        preempted = true;
+        queue.condition.notify_all();
+        break;
+      }
 
-        // set the larger point cloud as the base point cloud
-        if (point_clouds[i]->size() > point_clouds[j]->size())
-        {
-          base_pc = point_clouds[i];
-          target_pc = point_clouds[j];
-        }
-        else
+      stringstream ss;
+      ss << pairs[k].first << " and " << pairs[k].second;
+      string i_j_str = ss.str();
+      feedback.message = "Merging point clouds " + i_j_str + "...";
+      as_.publishFeedback(feedback);
+
+      // take the next registered pair (usually already waiting)
+      RegisteredPair registered;
+      {
+        boost::mutex::scoped_lock lock(queue.mutex);
+        while (queue.ready.empty())
         {
-          base_pc = point_clouds[j];
-          target_pc = point_clouds[i];
+          queue.condition.wait(lock);
         }
-
-        // perform ICP on the point clouds
-        pcl::PointCloud<pcl::PointXYZRGB>::Ptr aligned_pc(new pcl::PointCloud<pcl::PointXYZRGB>);
-        point_cloud_metrics::performICP(base_pc, target_pc, aligned_pc);
-
-        // publish result for human verification
-        base_pc_pub_.publish(base_pc);
-        aligned_pc_pub_.publish(aligned_pc);
-
-        // wait for input denoting positive or negative registration
-        feedback.message = "Getting metrics for point clouds " + i_j_str + "...";
-        as_.publishFeedback(feedback);
-        // send the request
-        rail_pick_and_place_msgs::GetYesNoFeedbackGoal goal;
-        get_yes_and_no_feedback_ac_.sendGoal(goal);
-
-        // calculate all metrics
-        double m_o, m_c_err;
-        point_cloud_metrics::calculateRegistrationMetricOverlap(base_pc, aligned_pc, m_o, m_c_err);
-        double m_d_err = point_cloud_metrics::calculateRegistrationMetricDistanceError(base_pc, aligned_pc);
-
-        // wait for a response
-        feedback.message = "Waiting for feedback on point clouds " + i_j_str + "...";
-        as_.publishFeedback(feedback);
-        get_yes_and_no_feedback_ac_.waitForResult();
-        string input = (get_yes_and_no_feedback_ac_.getResult()->yes) ? "y" : "n";
-
-        // write the data to the file
-        output_file << m_o << "," << m_d_err << "," << m_c_err << "," << input << endl;
+        registered = queue.ready.front();
+        queue.ready.pop_front();
       }
+      queue.condition.notify_all();
+
+      // publish result for human verification
+      base_pc_pub_.publish(registered.base_pc);
+      aligned_pc_pub_.publish(registered.aligned_pc);
+
+      // wait for input denoting positive or negative registration
+      feedback.message = "Waiting for feedback on point clouds " + i_j_str + "...";
+      as_.publishFeedback(feedback);
+      rail_pick_and_place_msgs::GetYesNoFeedbackGoal goal;
+      get_yes_and_no_feedback_ac_.sendGoal(goal);
+      get_yes_and_no_feedback_ac_.waitForResult();
+      string input = (get_yes_and_no_feedback_ac_.getResult()->yes) ? "y" : "n";
+
+      // queue the data for the file
+      result.num_pairs++;
+      ss.str("");
+      ss << registered.m_o << "," << registered.m_d_err << "," << registered.m_c_err << "," << input;
+      label_writer_->write(ss.str());
     }
+    registration_thread.join();
 
-    // save the file and finish
-    output_file.close();
+    // make sure every label is in the file before finishing
+    label_writer_->flush();
+    if (preempted)
+    {
+      as_.setPreempted(result, "Labelling stopped early.");
+      return;
+    }
     result.success = true;
     as_.setSucceeded(result);
   } else
@@ -18,33 +18,189 @@
 #include <geometry_msgs/PoseArray.h>
 #include <pcl_ros/point_cloud.h>
 
+// PCL
+#include <pcl/common/transforms.h>
+
+// Boost
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random.hpp>
+#include <boost/unordered_set.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+#include <map>
+#include <sstream>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
+/*!
+ * Find the cluster a model belongs to (with path halving).
+ *
+ * \param clusters The parent of each model in the cluster forest.
+ * \param model The index of the model.
+ * \return The index of the root model of the cluster.
+ */
+static size_t findCluster(vector<size_t> &clusters, size_t model)
+{
+  while (clusters[model] != model)
+  {
+    clusters[model] = clusters[clusters[model]];
+    model = clusters[model];
+  }
+  return model;
+}
+
+/*!
+ * Create the registration cache source of a database entity. The cache outlives the database, so the created
+ * timestamp is included with the ID; a row that reuses the ID of a deleted row (e.g., after the database is recreated)
+ * never matches the cached results of the old row.
+ *
+ * \param type The type of the entity.
+ * \param entity The database entity.
+ * \return The registration cache source (without whitespace).
+ */
+static string createSource(const string &type, const graspdb::Entity &entity)
+{
+  return type + ":" + boost::lexical_cast<string>(entity.getID()) + "@"
+      + boost::lexical_cast<string>((long long) entity.getCreated());
+}
+
+/*!
+ * Create the signature of the filter and registration parameters used by the model generator. Any change to these
+ * parameters or to the model point cap changes the registration results, so the signature (including the cap) is part
+ * of every registration cache key.
+ *
+ * \param icp_parameters The ICP parameters used for registration.
+ * \param merge_classifier The classifier used to decide merges.
+ * \param max_model_points The maximum number of points kept in a merged model.
+ * \return The parameter signature (without whitespace).
+ */
+static string createRegistrationSignature(const point_cloud_metrics::ICPParameters &icp_parameters,
+    const MergeClassifier &merge_classifier, const int max_model_points)
+{
+  stringstream ss;
+  ss.precision(17);
+  ss << "outlier:" << point_cloud_metrics::DEFAULT_FILTER_OUTLIER_SEARCH_RADIUS << ","
+      << point_cloud_metrics::DEFAULT_FILTER_OUTLIER_MIN_NUM_NEIGHBORS << ";redundant:"
+      << point_cloud_metrics::DEFAULT_FILTER_REDUNDANT_SEARCH_RADIUS << ";icp:";
+  for (size_t i = 0; i < icp_parameters.voxel_sizes.size(); i++)
+  {
+    ss << icp_parameters.voxel_sizes[i] << ",";
+  }
+  ss << icp_parameters.max_iterations << "," << icp_parameters.max_correspondence_distance << ","
+      << icp_parameters.transformation_epsilon << "," << icp_parameters.euclidean_fitness_epsilon << ","
+      << (icp_parameters.principal_axis_initialization ? 1 : 0) << ";merge:"
+      << merge_classifier.getSignature() << ";budget:" << max_model_points;
+  return ss.str();
+}
+
+/*!
+ * Convert a TF2 transform to the matrix form used by PCL.
+ *
+ * \param transform The TF2 transform.
+ * \return The matrix form of the transform.
+ */
+static Eigen::Matrix4f tf2TransformToMatrix(const tf2::Transform &transform)
+{
+  Eigen::Matrix4f matrix = Eigen::Matrix4f::Identity();
+  const tf2::Matrix3x3 &rotation = transform.getBasis();
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      matrix(i, j) = rotation[i][j];
+    }
+    matrix(i, 3) = transform.getOrigin()[i];
+  }
+  return matrix;
+}
+
 ModelGenerator::ModelGenerator()
     : private_node_("~"),
       as_(private_node_, "generate_models", boost::bind(&ModelGenerator::generateModelsCallback, this, _1), false)
 {
   // set defaults
   debug_ = DEFAULT_DEBUG;
+  random_seed_ = DEFAULT_RANDOM_SEED;
+  max_model_points_ = DEFAULT_MAX_MODEL_POINTS;
+  feedback_rate_ = DEFAULT_FEEDBACK_RATE;
+  preempted_ = false;
+  int num_threads = 1;
+  // relative to the ROS home directory (empty to disable)
+  string registration_cache("registration_cache.txt");
+  // empty to use the default trained classifier
+  string merge_classifier;
   int port = graspdb::Client::DEFAULT_PORT;
   string host("127.0.0.1");
   string user("ros");
   string password("");
   string db("graspdb");
+  int binary_encoding = graspdb::Client::ENCODING_RAW;
+  double diagnostics_period = LatencyPublisher::DEFAULT_DIAGNOSTICS_PERIOD;
 
   // grab any parameters we need
   private_node_.getParam("debug", debug_);
+  private_node_.getParam("num_threads", num_threads);
+  private_node_.getParam("random_seed", random_seed_);
+  private_node_.getParam("max_model_points", max_model_points_);
+  private_node_.getParam("feedback_rate", feedback_rate_);
+  private_node_.getParam("registration_cache", registration_cache);
+  private_node_.getParam("merge_classifier", merge_classifier);
+  private_node_.getParam("diagnostics_period", diagnostics_period);
+  point_cloud_metrics::loadICPParameters(private_node_, icp_parameters_);
   node_.getParam("/graspdb/host", host);
   node_.getParam("/graspdb/port", port);
   node_.getParam("/graspdb/user", user);
   node_.getParam("/graspdb/password", password);
   node_.getParam("/graspdb/db", db);
+  node_.getParam("/graspdb/binary_encoding", binary_encoding);
 
   // connect to the grasp database
   graspdb_ = new graspdb::Client(host, port, user, password, db);
+  graspdb_->setBinaryEncoding(binary_encoding);
+  graspdb_->setLatencyRecorder(&latency_recorder_);
   okay_ = graspdb_->connect();
 
+  // create the worker threads
+  thread_pool_ = new ThreadPool(num_threads);
+  ROS_INFO("Registering models with %d thread(s).", thread_pool_->getNumThreads());
+
+  // load the merge classifier (the default is kept if the file is invalid)
+  if (!merge_classifier.empty())
+  {
+    if (merge_classifier_.load(merge_classifier))
+    {
+      ROS_INFO("Loaded a merge classifier with %lu tree(s) from %s.", merge_classifier_.getNumTrees(),
+               merge_classifier.c_str());
+    } else
+    {
+      ROS_WARN("Using the default merge classifier.");
+    }
+  }
+
+  // load any previous registration results
+  registration_signature_ = createRegistrationSignature(icp_parameters_, merge_classifier_, max_model_points_);
+  if (registration_cache.empty())
+  {
+    registration_cache_ = NULL;
+  } else
+  {
+    registration_cache_ = new RegistrationCache(registration_cache);
+    ROS_INFO("Loaded %lu cached registration results from %s.", registration_cache_->size(),
+             registration_cache.c_str());
+  }
+
+  // periodically publish the stage latencies
+  filter_stage_ = latency_recorder_.addStage("generator.filter");
+  icp_stage_ = latency_recorder_.addStage("generator.icp");
+  overlap_stage_ = latency_recorder_.addStage("generator.overlap_metric");
+  classify_stage_ = latency_recorder_.addStage("generator.classify_merge");
+  redundant_stage_ = latency_recorder_.addStage("generator.filter_redundant");
+  resample_stage_ = latency_recorder_.addStage("generator.resample");
+  latency_publisher_ = new LatencyPublisher(node_, "model_generator", latency_recorder_, diagnostics_period);
+
   // setup a debug publisher if we need it
   if (debug_)
   {
@@ -57,6 +213,8 @@ ModelGenerator::ModelGenerator()
     ROS_INFO("Model Generator Successfully Initialized");
   }
 
+  // preemption is checked between registrations
+  as_.registerPreemptCallback(boost::bind(&ModelGenerator::preemptCallback, this));
   as_.start();
 }
 
@@ -64,6 +222,12 @@ ModelGenerator::~ModelGenerator()
 {
   // cleanup
   as_.shutdown();
+  delete latency_publisher_;
+  delete thread_pool_;
+  if (registration_cache_ != NULL)
+  {
+    delete registration_cache_;
+  }
   graspdb_->disconnect();
   delete graspdb_;
 }
@@ -73,90 +237,240 @@ bool ModelGenerator::okay() const
   return okay_;
 }
 
+void ModelGenerator::preemptCallback()
+{
+  boost::mutex::scoped_lock lock(progress_mutex_);
+  preempted_ = true;
+}
+
+bool ModelGenerator::isPreempted() const
+{
+  boost::mutex::scoped_lock lock(progress_mutex_);
+  return preempted_ || !ros::ok();
+}
+
+void ModelGenerator::resetProgress()
+{
+  boost::mutex::scoped_lock lock(progress_mutex_);
+  progress_ = rail_pick_and_place_msgs::GenerateModelsFeedback();
+  progress_.eta = -1;
+  progress_start_ = ros::WallTime::now();
+  registration_start_ = ros::WallTime();
+  last_feedback_ = ros::WallTime();
+}
+
+void ModelGenerator::setPairsRemaining(const size_t pairs_remaining)
+{
+  boost::mutex::scoped_lock lock(progress_mutex_);
+  progress_.pairs_total = progress_.pairs_checked + pairs_remaining;
+  if (registration_start_.isZero())
+  {
+    registration_start_ = ros::WallTime::now();
+  }
+}
+
+void ModelGenerator::updateProgress(const string &message, const size_t pairs_checked, const size_t merges,
+                                    const bool force)
+{
+  boost::mutex::scoped_lock lock(progress_mutex_);
+  progress_.pairs_checked += pairs_checked;
+  progress_.merges += merges;
+
+  // throttle to the feedback rate
+  const ros::WallTime now = ros::WallTime::now();
+  if (!force && feedback_rate_ > 0 && !last_feedback_.isZero() && (now - last_feedback_).toSec() < 1.0 / feedback_rate_)
+  {
+    return;
+  }
+  last_feedback_ = now;
+
+  // estimate the time left from the average time per pair so far
+  progress_.message = message;
+  progress_.elapsed = (now - progress_start_).toSec();
+  if (progress_.pairs_checked > 0 && !registration_start_.isZero())
+  {
+    const double per_pair = (now - registration_start_).toSec() / (double) progress_.pairs_checked;
+    const size_t left = (progress_.pairs_total > progress_.pairs_checked)
+        ? progress_.pairs_total - progress_.pairs_checked : 0;
+    progress_.eta = per_pair * (double) left;
+  } else
+  {
+    progress_.eta = -1;
+  }
+  as_.publishFeedback(progress_);
+}
+
 
 void ModelGenerator::generateModelsCallback(const rail_pick_and_place_msgs::GenerateModelsGoalConstPtr &goal)
 {
   ROS_INFO("Model generation request received.");
 
   rail_pick_and_place_msgs::GenerateModelsResult result;
-  rail_pick_and_place_msgs::GenerateModelsFeedback feedback;
-
-  // load each grasp demonstration
-  feedback.message = "Loading grasp demonstrations...";
-  as_.publishFeedback(feedback);
-  vector<PCLGraspModel> grasp_models;
+  {
+    boost::mutex::scoped_lock lock(progress_mutex_);
+    preempted_ = false;
+  }
+  this->resetProgress();
+
+  // load every grasp demonstration in a single query (the images are not needed)
+  this->updateProgress("Loading grasp demonstrations...", 0, 0, true);
+  vector<PCLGraspModel> grasp_models(goal->grasp_demonstration_ids.size() + goal->grasp_model_ids.size());
+  vector<string> sources;
+  size_t loaded = 0;
+  vector<graspdb::GraspDemonstration> demonstrations;
+  graspdb_->loadGraspDemonstrations(goal->grasp_demonstration_ids, demonstrations, false);
+  size_t next = 0;
   for (size_t i = 0; i < goal->grasp_demonstration_ids.size(); i++)
   {
-    graspdb::GraspDemonstration demonstration;
-    if (graspdb_->loadGraspDemonstration(goal->grasp_demonstration_ids[i], demonstration))
+    // the demonstrations are in the order of the IDs with missing IDs skipped
+    if (next < demonstrations.size() && demonstrations[next].getID() == goal->grasp_demonstration_ids[i])
     {
+      graspdb::GraspDemonstration &demonstration = demonstrations[next++];
+
       // translate the demonstration into a grasp model
       graspdb::GraspModel model;
-      model.setPointCloud(demonstration.getPointCloud());
       model.setObjectName(demonstration.getObjectName());
       graspdb::Grasp grasp;
       grasp.setGraspPose(demonstration.getGraspPose());
       grasp.setEefFrameID(demonstration.getEefFrameID());
       model.addGrasp(grasp);
 
-      // convert to a PCL version of the grasp model
-      PCLGraspModel pcl_grasp_model(model);
-      grasp_models.push_back(pcl_grasp_model);
+      // convert to a PCL version of the grasp model (straight from the demonstration to avoid copying the message)
+      PCLGraspModel &pcl_grasp_model = grasp_models[loaded++];
+      pcl_grasp_model.consume(model);
+      pcl_grasp_model.setPointCloud(demonstration.getPointCloud());
+      sources.push_back(createSource("demonstration", demonstration));
+      // release the message once converted
+      demonstration.setPointCloud(sensor_msgs::PointCloud2());
     } else
     {
       ROS_WARN("Could not load grasp demonstration with ID %d.", goal->grasp_demonstration_ids[i]);
     }
   }
 
-  // load each existing model
-  feedback.message = "Loading grasp models...";
-  as_.publishFeedback(feedback);
+  // load every existing model (and their grasps) in a single transaction
+  this->updateProgress("Loading grasp models...", 0, 0, true);
+  vector<graspdb::GraspModel> models;
+  graspdb_->loadGraspModels(goal->grasp_model_ids, models);
+  next = 0;
   for (size_t i = 0; i < goal->grasp_model_ids.size(); i++)
   {
-    graspdb::GraspModel model;
-    if (graspdb_->loadGraspModel(goal->grasp_model_ids[i], model))
+    if (next < models.size() && models[next].getID() == goal->grasp_model_ids[i])
     {
-      // convert to a PCL version of the grasp model
-      PCLGraspModel pcl_grasp_model(model);
-      grasp_models.push_back(pcl_grasp_model);
+      // convert to a PCL version of the grasp model, releasing the message once converted
+      graspdb::GraspModel &model = models[next++];
+      sources.push_back(createSource("model", model));
+      grasp_models[loaded++].consume(model);
     } else
     {
       ROS_WARN("Could not load grasp model with ID %d.", goal->grasp_model_ids[i]);
     }
   }
 
+  grasp_models.erase(grasp_models.begin() + loaded, grasp_models.end());
+
   // generate and store the models
-  feedback.message = "Registering models...";
-  as_.publishFeedback(feedback);
-  this->generateAndStoreModels(grasp_models, goal->max_model_size, result.new_model_ids);
+  this->updateProgress("Registering models...", 0, 0, true);
+  this->generateAndStoreModels(grasp_models, sources, goal->max_model_size, goal->strategy, result.new_model_ids);
 
-  // finished
-  as_.setSucceeded(result, "Success!");
+  // finished (the models merged before any preemption are already stored)
+  if (this->isPreempted())
+  {
+    stringstream ss;
+    ss << "Preempted after storing " << result.new_model_ids.size() << " model(s).";
+    ROS_INFO("%s", ss.str().c_str());
+    as_.setPreempted(result, ss.str());
+  } else
+  {
+    as_.setSucceeded(result, "Success!");
+  }
 }
 
-void ModelGenerator::generateAndStoreModels(vector<PCLGraspModel> &grasp_models, const int max_model_size,
+void ModelGenerator::generateAndStoreModels(vector<PCLGraspModel> &grasp_models, const vector<string> &sources,
+                                            const int max_model_size, const uint8_t strategy,
                                             vector<uint32_t> &new_model_ids)
 {
-  rail_pick_and_place_msgs::GenerateModelsFeedback feedback;
-
   // filter each point cloud, move to the origin, set unique IDs, and ensure they are flagged as original
-  feedback.message = "Filtinering point clouds...";
-  as_.publishFeedback(feedback);
+  this->updateProgress("Filtering point clouds...", 0, 0, true);
   uint32_t id_counter = 0;
   for (size_t i = 0; i < grasp_models.size(); i++)
   {
     // filter the resulting PC
-    point_cloud_metrics::filterPointCloudOutliers(grasp_models[i].getPCLPointCloud());
-    point_cloud_metrics::transformToOrigin(grasp_models[i].getPCLPointCloud(), grasp_models[i].getGrasps());
+    {
+      graspdb::LatencyRecorder::ScopedTimer timer(&latency_recorder_, filter_stage_);
+      point_cloud_metrics::filterPointCloudOutliers(*thread_pool_, grasp_models[i].getPCLPointCloud());
+      point_cloud_metrics::transformToOrigin(grasp_models[i].getPCLPointCloud(), grasp_models[i].getGrasps());
+    }
+    grasp_models[i].resetSearchIndex();
     // set a unique ID
     grasp_models[i].setID(id_counter++);
     // flag as an original model
     grasp_models[i].setOriginal(true);
   }
 
+  // merge the models
+  this->updateProgress("Searching graph for valid registrations...", 0, 0, true);
+  ROS_INFO("Searching graph for valid registrations...");
+  if (strategy == rail_pick_and_place_msgs::GenerateModelsGoal::CLUSTERING)
+  {
+    this->clusterModels(grasp_models, sources, max_model_size);
+  } else
+  {
+    this->mergeModelsGreedy(grasp_models, sources, max_model_size);
+  }
+
+  // remove any original (unmerged) models and save the rest
+  this->updateProgress("Saving new models...", 0, 0, true);
+  vector<graspdb::GraspModel> new_models;
+  new_models.reserve(grasp_models.size());
+  size_t kept = 0;
+  for (int i = ((int) grasp_models.size()) - 1; i >= 0; i--)
+  {
+    if (!grasp_models[i].isOriginal())
+    {
+      // swap the converted model in rather than copying its point cloud message
+      graspdb::GraspModel new_model = grasp_models[i].toGraspModel();
+      new_models.push_back(graspdb::GraspModel());
+      new_models.back().swap(new_model);
+      grasp_models[kept++].swap(grasp_models[i]);
+    }
+  }
+  grasp_models.erase(grasp_models.begin() + kept, grasp_models.end());
+
+  // store every new model in a single transaction
+  if (new_models.empty())
+  {
+    return;
+  } else if (graspdb_->addGraspModels(new_models))
+  {
+    for (size_t i = 0; i < new_models.size(); i++)
+    {
+      ROS_INFO("Added new model to the database with ID %d.", new_models[i].getID());
+      new_model_ids.push_back(new_models[i].getID());
+    }
+  } else
+  {
+    ROS_WARN("Error inserting %lu models into database.", new_models.size());
+  }
+}
+
+void ModelGenerator::mergeModelsGreedy(vector<PCLGraspModel> &grasp_models, const vector<string> &sources,
+                                       const int max_model_size)
+{
+  // index the models and their sources by ID
+  uint32_t id_counter = 0;
+  boost::unordered_map<uint32_t, PCLGraspModel> models;
+  boost::unordered_map<uint32_t, string> model_sources;
+  for (size_t i = 0; i < grasp_models.size(); i++)
+  {
+    models.insert(make_pair(grasp_models[i].getID(), grasp_models[i]));
+    model_sources[grasp_models[i].getID()] = sources[i];
+    id_counter = max(id_counter, grasp_models[i].getID() + 1);
+  }
+
   // create the initial pairings between all vertices
   vector<pair<uint32_t, uint32_t> > edges;
-  for (size_t i = 0; i < grasp_models.size() - 1; i++)
+  for (size_t i = 0; i + 1 < grasp_models.size(); i++)
   {
     for (size_t j = i + 1; j < grasp_models.size(); j++)
     {
@@ -175,147 +489,177 @@ void ModelGenerator::generateAndStoreModels(vector<PCLGraspModel> &grasp_models,
     }
   }
 
-  // attempt to pair models
-  feedback.message = "Searching graph for valid registrations...";
-  as_.publishFeedback(feedback);
-  ROS_INFO("%s", feedback.message.c_str());
-  while (!edges.empty())
+  // seeded so runs are reproducible
+  boost::mt19937 generator(random_seed_);
+  boost::random_number_generator<boost::mt19937> random(generator);
+  const size_t wave_size = thread_pool_->getNumThreads();
+
+  // attempt to pair models until every edge is checked or the goal is preempted
+  while (!edges.empty() && !this->isPreempted())
   {
-    // randomly select the element to increase variability
-    int rand_index = rand() % edges.size();
-    pair<uint32_t, uint32_t> edge = edges[rand_index];
-    edges.erase(edges.begin() + rand_index);
+    this->setPairsRemaining(edges.size());
 
-    // search for the base and target models
-    size_t base_index, target_index;
-    for (size_t i = 0; i < grasp_models.size(); i++)
+    // randomly order the remaining edges to increase variability
+    random_shuffle(edges.begin(), edges.end(), random);
+
+    // pick a wave of edges that do not share any models
+    vector<pair<uint32_t, uint32_t> > wave;
+    vector<pair<uint32_t, uint32_t> > remaining;
+    boost::unordered_set<uint32_t> busy;
+    for (size_t i = 0; i < edges.size(); i++)
     {
-      if (grasp_models[i].getID() == edge.first)
+      const pair<uint32_t, uint32_t> &edge = edges[i];
+      if (wave.size() >= wave_size || busy.count(edge.first) > 0 || busy.count(edge.second) > 0)
+      {
+        remaining.push_back(edge);
+        continue;
+      }
+
+      // check if the maximum size would be allowed
+      const PCLGraspModel &base = models.find(edge.first)->second;
+      const PCLGraspModel &target = models.find(edge.second)->second;
+      if (base.getNumGrasps() + target.getNumGrasps() > max_model_size)
       {
-        base_index = i;
-      } else if (grasp_models[i].getID() == edge.second)
+        stringstream ss;
+        ss << "Skipping pair " << base.getID() << "-" << target.getID()
+            << " as a merge would exceed the maximum model size.";
+        this->updateProgress(ss.str());
+        ROS_WARN("%s", ss.str().c_str());
+      } else
       {
-        target_index = i;
+        wave.push_back(edge);
+        busy.insert(edge.first);
+        busy.insert(edge.second);
       }
     }
+    edges.swap(remaining);
 
-    // keep track of the base and the target models
-    PCLGraspModel &base = grasp_models[base_index];
-    PCLGraspModel &target = grasp_models[target_index];
-
-    // used in feedback messages
-    stringstream ss;
-    ss << base.getID() << "-" << target.getID();
-    string pair_str = ss.str();
-
-    feedback.message = "Checking pair " + pair_str + "...";
-    as_.publishFeedback(feedback);
-
-    // check if the maximum size would be allowed
-    if (base.getNumGrasps() + target.getNumGrasps() > max_model_size)
+    // check every pair of the wave at once (each result needs its own point cloud)
+    vector<PCLGraspModel> results;
+    results.reserve(wave.size());
+    for (size_t i = 0; i < wave.size(); i++)
     {
-      feedback.message = "Skipping pair " + pair_str + "as a merge would exceed the maximum model size.";
-      as_.publishFeedback(feedback);
-      ROS_WARN("%s", feedback.message.c_str());
-    } else
+      results.push_back(PCLGraspModel());
+    }
+    vector<char> matched(wave.size(), false);
+    thread_pool_->run(wave.size(), boost::bind(&ModelGenerator::registrationTask, this, _1, boost::cref(wave),
+                                               boost::cref(models), boost::cref(model_sources), boost::ref(results),
+                                               boost::ref(matched)));
+
+    // merge every match (the pairs are disjoint, so none of them conflict)
+    boost::unordered_set<uint32_t> merged;
+    vector<size_t> new_results;
+    for (size_t i = 0; i < wave.size(); i++)
     {
-      // check if the registration passes
-      PCLGraspModel result;
-      if (this->registrationCheck(base, target, result))
+      stringstream ss;
+      ss << wave[i].first << "-" << wave[i].second;
+      string pair_str = ss.str();
+      if (!matched[i])
       {
-        feedback.message = "Registration match found for pair " + pair_str + ".";
-        as_.publishFeedback(feedback);
-        ROS_INFO("%s", feedback.message.c_str());
-
-        // remove any edges containing these nodes
-        for (int i = (int) edges.size() - 1; i >= 0; i--)
+        // pairs skipped after a preemption were never checked
+        if (!this->isPreempted())
         {
-          if (edges[i].first == base.getID() || edges[i].second == base.getID() || edges[i].first == target.getID()
-              || edges[i].second == target.getID())
-          {
-            edges.erase(edges.begin() + i);
-          }
-        }
-
-        // remove both models from the global list
-        for (int i = (int) grasp_models.size() - 1; i >= 0; i--)
-        {
-          if (grasp_models[i].getID() == base.getID() || grasp_models[i].getID() == target.getID())
-          {
-            grasp_models.erase(grasp_models.begin() + i);
-          }
-        }
-
-        // set a unique ID
-        result.setID(id_counter++);
-
-        // add a new edges with this new model
-        for (size_t i = 0; i < grasp_models.size(); i++)
-        {
-          pair<uint32_t, uint32_t> edge(result.getID(), grasp_models[i].getID());
-          edges.push_back(edge);
+          this->updateProgress("Checked pair " + pair_str + ".", 1);
         }
+        continue;
+      }
 
-        // add the new model
-        grasp_models.push_back(result);
+      ss.str("");
+      ss << "Registration match found for pair " << pair_str << " (" << results[i].getPCLPointCloud()->size()
+          << " points).";
+      this->updateProgress(ss.str(), 1, 1);
+      ROS_INFO("%s", ss.str().c_str());
+
+      // remove both models from the global list
+      models.erase(wave[i].first);
+      models.erase(wave[i].second);
+      merged.insert(wave[i].first);
+      merged.insert(wave[i].second);
+
+      // set a unique ID and record how it was made
+      results[i].setID(id_counter++);
+      model_sources[results[i].getID()] = "(" + model_sources[wave[i].first] + "," + model_sources[wave[i].second]
+          + ")";
+      model_sources.erase(wave[i].first);
+      model_sources.erase(wave[i].second);
+      new_results.push_back(i);
+    }
 
-        // check if we are running debug
-        if (debug_)
+    // remove any edges containing the merged models
+    if (!merged.empty())
+    {
+      remaining.clear();
+      for (size_t i = 0; i < edges.size(); i++)
+      {
+        if (merged.count(edges[i].first) == 0 && merged.count(edges[i].second) == 0)
         {
-          // generate the pose array
-          geometry_msgs::PoseArray poses;
-          for (size_t i = 0; i < result.getNumGrasps(); i++)
-          {
-            const graspdb::Pose &pose = result.getGrasp(i).getGraspPose();
-            poses.header.frame_id = pose.getRobotFixedFrameID();
-            poses.poses.push_back(pose.toROSPoseMessage());
-          }
-          // publish the poses and the resulting merged point cloud
-          debug_poses_pub_.publish(poses);
-          debug_pc_pub_.publish(*result.getPCLPointCloud());
+          remaining.push_back(edges[i]);
         }
       }
+      edges.swap(remaining);
     }
-  }
 
-  // remove any original (unmerged) models and save the rest
-  feedback.message = "Saving new models...";
-  as_.publishFeedback(feedback);
-  for (int i = ((int) grasp_models.size()) - 1; i >= 0; i--)
-  {
-    if (grasp_models[i].isOriginal())
-    {
-      grasp_models.erase(grasp_models.begin() + i);
-    } else
+    // add the new models and new edges with each of them
+    for (size_t i = 0; i < new_results.size(); i++)
     {
-      // attempt to store it
-      graspdb::GraspModel new_model = grasp_models[i].toGraspModel();
-      if (graspdb_->addGraspModel(new_model))
+      const PCLGraspModel &result = results[new_results[i]];
+      for (boost::unordered_map<uint32_t, PCLGraspModel>::const_iterator it = models.begin(); it != models.end();
+           ++it)
       {
-        ROS_INFO("Added new model to the database with ID %d.", new_model.getID());
-        new_model_ids.push_back(new_model.getID());
-      }
-      else
-      {
-        ROS_WARN("Error inserting model into database.");
+        edges.push_back(make_pair(result.getID(), it->first));
       }
+      models.insert(make_pair(result.getID(), result));
+
+      this->publishDebug(result);
     }
   }
+
+  // keep the remaining models in ID order
+  vector<uint32_t> ids;
+  for (boost::unordered_map<uint32_t, PCLGraspModel>::const_iterator it = models.begin(); it != models.end(); ++it)
+  {
+    ids.push_back(it->first);
+  }
+  sort(ids.begin(), ids.end());
+  vector<PCLGraspModel> remaining_models(ids.size());
+  for (size_t i = 0; i < ids.size(); i++)
+  {
+    remaining_models[i].swap(models.find(ids[i])->second);
+  }
+  grasp_models.swap(remaining_models);
 }
 
-bool ModelGenerator::registrationCheck(const PCLGraspModel &base, const PCLGraspModel &target,
+void ModelGenerator::registrationTask(const size_t index, const vector<pair<uint32_t, uint32_t> > &wave,
+    const boost::unordered_map<uint32_t, PCLGraspModel> &models,
+    const boost::unordered_map<uint32_t, string> &sources, vector<PCLGraspModel> &results,
+    vector<char> &matched) const
+{
+  if (this->isPreempted())
+  {
+    return;
+  }
+
+  const PCLGraspModel &base = models.find(wave[index].first)->second;
+  const PCLGraspModel &target = models.find(wave[index].second)->second;
+  const string key = RegistrationCache::createKey(sources.find(wave[index].first)->second,
+                                                  sources.find(wave[index].second)->second, registration_signature_);
+  matched[index] = this->registrationCheck(base, target, key, results[index]);
+}
+
+bool ModelGenerator::registrationCheck(const PCLGraspModel &base, const PCLGraspModel &target, const string &key,
                                        PCLGraspModel &result) const
 {
   const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &base_pc = base.getPCLPointCloud();
-  const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &target_pc = target.getPCLPointCloud();
   const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &result_pc = result.getPCLPointCloud();
 
-  // perform ICP on the point clouds
+  // register the pair (or use the cached result)
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr aligned_pc(new pcl::PointCloud<pcl::PointXYZRGB>);
-  tf2::Transform tf_icp = point_cloud_metrics::performICP(base_pc, target_pc, aligned_pc);
+  RegistrationCache::Entry entry;
+  this->registerPair(base, target, key, entry, aligned_pc);
+  const tf2::Transform &tf_icp = entry.tf_icp;
 
   // check if the match is valid
-  if (point_cloud_metrics::classifyMerge(base_pc, aligned_pc))
+  if (entry.merge)
   {
     // transform each target grasp
     for (size_t i = 0; i < target.getNumGrasps(); i++)
@@ -347,9 +691,22 @@ bool ModelGenerator::registrationCheck(const PCLGraspModel &base, const PCLGrasp
     // merge the two point clouds
     *result_pc = *base_pc + *aligned_pc;
 
-    point_cloud_metrics::filterRedundantPoints(result_pc);
+    size_t removed;
+    {
+      graspdb::LatencyRecorder::ScopedTimer timer(&latency_recorder_, redundant_stage_);
+      removed = point_cloud_metrics::filterRedundantPoints(result_pc);
+    }
+    ROS_DEBUG("Removed %lu redundant points from the merged model.", removed);
+    // keep the merged model within the point budget
+    if (max_model_points_ > 0)
+    {
+      graspdb::LatencyRecorder::ScopedTimer timer(&latency_recorder_, resample_stage_);
+      removed = point_cloud_metrics::limitPointCloudSize(result_pc, (size_t) max_model_points_);
+      ROS_DEBUG("Resampled away %lu points to fit the merged model within its point budget.", removed);
+    }
     // move to the origin
     point_cloud_metrics::transformToOrigin(result_pc, result.getGrasps());
+    result.resetSearchIndex();
 
     // set the final model parameters
     result.setObjectName(base.getObjectName());
@@ -359,3 +716,284 @@ bool ModelGenerator::registrationCheck(const PCLGraspModel &base, const PCLGrasp
     return false;
   }
 }
+
+bool ModelGenerator::registerPair(const PCLGraspModel &base, const PCLGraspModel &target, const string &key,
+                                  RegistrationCache::Entry &entry,
+                                  const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &aligned_pc) const
+{
+  const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &base_pc = base.getPCLPointCloud();
+  const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &target_pc = target.getPCLPointCloud();
+
+  if (registration_cache_ != NULL && registration_cache_->find(key, entry))
+  {
+    // the aligned point cloud is the target moved by the cached transform
+    if (entry.merge && aligned_pc)
+    {
+      pcl::transformPointCloud(*target_pc, *aligned_pc, tf2TransformToMatrix(entry.tf_icp));
+    }
+  } else
+  {
+    // perform ICP on the point clouds
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr icp_pc = aligned_pc ? aligned_pc
+        : pcl::PointCloud<pcl::PointXYZRGB>::Ptr(new pcl::PointCloud<pcl::PointXYZRGB>);
+    {
+      graspdb::LatencyRecorder::ScopedTimer timer(&latency_recorder_, icp_stage_);
+      entry.tf_icp = point_cloud_metrics::performICP(base_pc, target_pc, icp_pc, icp_parameters_);
+    }
+    // each metric is computed once (and only if the classifier uses it)
+    point_cloud_metrics::RegistrationMetrics metrics;
+    {
+      graspdb::LatencyRecorder::ScopedTimer timer(&latency_recorder_, overlap_stage_);
+      const pcl::search::KdTree<pcl::PointXYZRGB>::Ptr search_tree = base.getSearchTree();
+      point_cloud_metrics::calculateRegistrationMetricOverlap(*search_tree, icp_pc, metrics.overlap,
+                                                              metrics.color_error);
+      if (merge_classifier_.usesFeature(MergeClassifier::DISTANCE_ERROR))
+      {
+        metrics.distance_error = point_cloud_metrics::calculateRegistrationMetricDistanceError(*search_tree, icp_pc);
+      }
+    }
+    entry.overlap = metrics.overlap;
+    entry.color_error = metrics.color_error;
+    {
+      graspdb::LatencyRecorder::ScopedTimer timer(&latency_recorder_, classify_stage_);
+      entry.merge = merge_classifier_.classify(metrics);
+    }
+    if (registration_cache_ != NULL)
+    {
+      registration_cache_->insert(key, entry);
+    }
+  }
+  return entry.merge;
+}
+
+void ModelGenerator::clusterModels(vector<PCLGraspModel> &grasp_models, const vector<string> &sources,
+                                   const int max_model_size)
+{
+  // register every pair once (use the larger as the base)
+  vector<pair<size_t, size_t> > pairs;
+  for (size_t i = 0; i + 1 < grasp_models.size(); i++)
+  {
+    for (size_t j = i + 1; j < grasp_models.size(); j++)
+    {
+      if (grasp_models[i].getPCLPointCloud()->size() > grasp_models[j].getPCLPointCloud()->size())
+      {
+        pairs.push_back(make_pair(i, j));
+      } else
+      {
+        pairs.push_back(make_pair(j, i));
+      }
+    }
+  }
+  vector<RegistrationCache::Entry> entries(pairs.size());
+  this->setPairsRemaining(pairs.size());
+  thread_pool_->run(pairs.size(), boost::bind(&ModelGenerator::similarityTask, this, _1, boost::cref(pairs),
+                                              boost::cref(grasp_models), boost::cref(sources),
+                                              boost::ref(entries)));
+
+  // rank the matches by overlap, then by color error (ties broken by pair order)
+  vector<pair<pair<double, double>, size_t> > matches;
+  for (size_t i = 0; i < entries.size(); i++)
+  {
+    if (entries[i].merge)
+    {
+      matches.push_back(make_pair(make_pair(-entries[i].overlap, entries[i].color_error), i));
+    }
+  }
+  sort(matches.begin(), matches.end());
+  stringstream ss;
+  ss << matches.size() << " of " << pairs.size() << " pairs matched.";
+  if (this->isPreempted())
+  {
+    ss << " Preempted, clustering the pairs registered so far.";
+  }
+  this->updateProgress(ss.str(), 0, 0, true);
+  ROS_INFO("%s", ss.str().c_str());
+
+  // agglomerate the best matches first without exceeding the maximum model size
+  vector<size_t> clusters(grasp_models.size());
+  vector<size_t> cluster_sizes(grasp_models.size());
+  for (size_t i = 0; i < grasp_models.size(); i++)
+  {
+    clusters[i] = i;
+    cluster_sizes[i] = grasp_models[i].getNumGrasps();
+  }
+  vector<vector<size_t> > tree_edges(grasp_models.size());
+  for (size_t i = 0; i < matches.size(); i++)
+  {
+    const size_t edge = matches[i].second;
+    const size_t a = findCluster(clusters, pairs[edge].first);
+    const size_t b = findCluster(clusters, pairs[edge].second);
+    if (a != b && cluster_sizes[a] + cluster_sizes[b] <= (size_t) max_model_size)
+    {
+      clusters[b] = a;
+      cluster_sizes[a] += cluster_sizes[b];
+      // the accepted matches form a spanning tree of each cluster
+      tree_edges[pairs[edge].first].push_back(edge);
+      tree_edges[pairs[edge].second].push_back(edge);
+    }
+  }
+
+  // gather the members of each cluster in model order
+  vector<vector<size_t> > members(grasp_models.size());
+  for (size_t i = 0; i < grasp_models.size(); i++)
+  {
+    members[findCluster(clusters, i)].push_back(i);
+  }
+
+  // build each merged model from all of its members at once
+  vector<PCLGraspModel> results;
+  results.reserve(members.size());
+  uint32_t id_counter = grasp_models.size();
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    if (members[i].size() < 2)
+    {
+      continue;
+    }
+
+    // use the largest point cloud as the reference frame
+    size_t root = members[i][0];
+    for (size_t j = 1; j < members[i].size(); j++)
+    {
+      if (grasp_models[members[i][j]].getPCLPointCloud()->size() > grasp_models[root].getPCLPointCloud()->size())
+      {
+        root = members[i][j];
+      }
+    }
+
+    // walk the spanning tree from the root, chaining the pairwise transforms to the root frame
+    map<size_t, tf2::Transform> to_root;
+    to_root[root] = tf2::Transform::getIdentity();
+    vector<size_t> order(1, root);
+    for (size_t j = 0; j < order.size(); j++)
+    {
+      const size_t current = order[j];
+      for (size_t k = 0; k < tree_edges[current].size(); k++)
+      {
+        const size_t edge = tree_edges[current][k];
+        const bool is_base = (pairs[edge].first == current);
+        const size_t next = is_base ? pairs[edge].second : pairs[edge].first;
+        if (to_root.find(next) == to_root.end())
+        {
+          // the registration transform moves the second model of the pair onto the first
+          const tf2::Transform &tf_icp = entries[edge].tf_icp;
+          to_root[next] = to_root[current] * (is_base ? tf_icp : tf_icp.inverse());
+          order.push_back(next);
+        }
+      }
+    }
+
+    // move every member into the root frame
+    PCLGraspModel result;
+    const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &result_pc = result.getPCLPointCloud();
+    for (size_t j = 0; j < order.size(); j++)
+    {
+      const PCLGraspModel &member = grasp_models[order[j]];
+      const tf2::Transform &tf_member = to_root[order[j]];
+      pcl::PointCloud<pcl::PointXYZRGB> aligned_pc;
+      pcl::transformPointCloud(*member.getPCLPointCloud(), aligned_pc, tf2TransformToMatrix(tf_member));
+      *result_pc += aligned_pc;
+      for (size_t k = 0; k < member.getNumGrasps(); k++)
+      {
+        const graspdb::Grasp &old_grasp = member.getGrasp(k);
+        const graspdb::Pose &old_grasp_pose = old_grasp.getGraspPose();
+        graspdb::Pose new_pose(old_grasp_pose.getRobotFixedFrameID(), tf_member * old_grasp_pose.toTF2Transform());
+        graspdb::Grasp new_grasp(new_pose, graspdb::GraspModel::UNSET_ID, old_grasp.getEefFrameID(),
+                                 old_grasp.getSuccesses(), old_grasp.getAttempts());
+        result.addGrasp(new_grasp);
+      }
+    }
+
+    size_t removed;
+    {
+      graspdb::LatencyRecorder::ScopedTimer timer(&latency_recorder_, redundant_stage_);
+      removed = point_cloud_metrics::filterRedundantPoints(result_pc);
+    }
+    ROS_DEBUG("Removed %lu redundant points from the merged model.", removed);
+    // keep the merged model within the point budget
+    if (max_model_points_ > 0)
+    {
+      graspdb::LatencyRecorder::ScopedTimer timer(&latency_recorder_, resample_stage_);
+      removed = point_cloud_metrics::limitPointCloudSize(result_pc, (size_t) max_model_points_);
+      ROS_DEBUG("Resampled away %lu points to fit the merged model within its point budget.", removed);
+    }
+    // move to the origin
+    point_cloud_metrics::transformToOrigin(result_pc, result.getGrasps());
+    result.resetSearchIndex();
+
+    // set the final model parameters
+    result.setObjectName(grasp_models[root].getObjectName());
+    result.setID(id_counter++);
+
+    ss.str("");
+    ss << "Merged a cluster of " << order.size() << " models (" << result_pc->size() << " points).";
+    this->updateProgress(ss.str(), 0, 1);
+    ROS_INFO("%s", ss.str().c_str());
+    this->publishDebug(result);
+    results.push_back(PCLGraspModel());
+    results.back().swap(result);
+  }
+
+  // keep the unmerged models followed by the merged models
+  size_t unmerged = 0;
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    if (members[i].size() == 1)
+    {
+      unmerged++;
+    }
+  }
+  vector<PCLGraspModel> remaining(unmerged + results.size());
+  size_t next = 0;
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    if (members[i].size() == 1)
+    {
+      remaining[next++].swap(grasp_models[members[i][0]]);
+    }
+  }
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    remaining[next++].swap(results[i]);
+  }
+  grasp_models.swap(remaining);
+}
+
+void ModelGenerator::similarityTask(const size_t index, const vector<pair<size_t, size_t> > &pairs,
+    const vector<PCLGraspModel> &grasp_models, const vector<string> &sources,
+    vector<RegistrationCache::Entry> &entries)
+{
+  if (this->isPreempted())
+  {
+    return;
+  }
+
+  const size_t base = pairs[index].first;
+  const size_t target = pairs[index].second;
+  const string key = RegistrationCache::createKey(sources[base], sources[target], registration_signature_);
+  this->registerPair(grasp_models[base], grasp_models[target], key, entries[index],
+                     pcl::PointCloud<pcl::PointXYZRGB>::Ptr());
+
+  stringstream ss;
+  ss << "Checked pair " << grasp_models[base].getID() << "-" << grasp_models[target].getID() << ".";
+  this->updateProgress(ss.str(), 1, 0);
+}
+
+void ModelGenerator::publishDebug(const PCLGraspModel &model) const
+{
+  // check if we are running debug
+  if (debug_)
+  {
+    // generate the pose array
+    geometry_msgs::PoseArray poses;
+    for (size_t i = 0; i < model.getNumGrasps(); i++)
+    {
+      const graspdb::Pose &pose = model.getGrasp(i).getGraspPose();
+      poses.header.frame_id = pose.getRobotFixedFrameID();
+      poses.poses.push_back(pose.toROSPoseMessage());
+    }
+    // publish the poses and the resulting merged point cloud
+    debug_poses_pub_.publish(poses);
+    debug_pc_pub_.publish(*model.getPCLPointCloud());
+  }
+}
@@ -0,0 +1,420 @@
+/*!
+ * \file ModelSnapshot.cpp
+ * \brief A memory-mappable on-disk snapshot of the PCL grasp model library.
+ *
+ * The model snapshot stores every converted grasp model (PCL point arrays, color statistics, principal extents, color
+ * histograms, and grasps) in a single binary file so nodes can restore their model library at startup without
+ * converting every point cloud again.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/ModelSnapshot.h"
+
+// ROS
+#include <ros/ros.h>
+
+// Linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// C++ Standard Library
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+/*! The magic bytes at the start of every snapshot file. */
+static const char SNAPSHOT_MAGIC[8] = {'R', 'A', 'I', 'L', 'S', 'N', 'A', 'P'};
+/*! A value used to detect snapshots written with a different byte order. */
+static const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+/*! The alignment of each point array in the snapshot file. */
+static const size_t SNAPSHOT_ALIGNMENT = 16;
+
+/*!
+ * \struct SnapshotReader
+ * \brief A bounds checked cursor over a mapped snapshot file.
+ */
+struct SnapshotReader
+{
+  /*! The mapped file. */
+  const uint8_t *data;
+  /*! The size of the mapped file and the current offset. */
+  size_t size, offset;
+  /*! If every read so far was in bounds. */
+  bool valid;
+};
+
+/*!
+ * Append raw bytes to a snapshot buffer.
+ *
+ * \param buffer The snapshot buffer.
+ * \param data The bytes to append.
+ * \param size The number of bytes to append.
+ */
+static void writeBytes(vector<uint8_t> &buffer, const void *data, const size_t size)
+{
+  const size_t offset = buffer.size();
+  buffer.resize(offset + size);
+  if (size > 0)
+  {
+    memcpy(&buffer[offset], data, size);
+  }
+}
+
+/*!
+ * Append a value to a snapshot buffer in the native layout.
+ *
+ * \param buffer The snapshot buffer.
+ * \param value The value to append.
+ */
+template<typename T>
+static void writeValue(vector<uint8_t> &buffer, const T &value)
+{
+  writeBytes(buffer, &value, sizeof(T));
+}
+
+/*!
+ * Append a length prefixed string to a snapshot buffer.
+ *
+ * \param buffer The snapshot buffer.
+ * \param str The string to append.
+ */
+static void writeString(vector<uint8_t> &buffer, const string &str)
+{
+  writeValue(buffer, (uint32_t) str.size());
+  writeBytes(buffer, str.data(), str.size());
+}
+
+/*!
+ * Pad a snapshot buffer to the point array alignment.
+ *
+ * \param buffer The snapshot buffer.
+ */
+static void writePadding(vector<uint8_t> &buffer)
+{
+  buffer.resize((buffer.size() + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT, 0);
+}
+
+/*!
+ * Read raw bytes from a snapshot. Once a read is out of bounds, every later read fails.
+ *
+ * \param reader The snapshot reader.
+ * \param data The buffer to copy the bytes into.
+ * \param size The number of bytes to read.
+ * \return True if the bytes were in bounds.
+ */
+static bool readBytes(SnapshotReader &reader, void *data, const size_t size)
+{
+  if (!reader.valid || size > reader.size - reader.offset)
+  {
+    reader.valid = false;
+    return false;
+  }
+  if (size > 0)
+  {
+    memcpy(data, reader.data + reader.offset, size);
+  }
+  reader.offset += size;
+  return true;
+}
+
+/*!
+ * Read a value in the native layout from a snapshot.
+ *
+ * \param reader The snapshot reader.
+ * \return The value read (undefined if the read was out of bounds).
+ */
+template<typename T>
+static T readValue(SnapshotReader &reader)
+{
+  T value = T();
+  readBytes(reader, &value, sizeof(T));
+  return value;
+}
+
+/*!
+ * Read a length prefixed string from a snapshot.
+ *
+ * \param reader The snapshot reader.
+ * \return The string read (empty if the read was out of bounds).
+ */
+static string readString(SnapshotReader &reader)
+{
+  const uint32_t size = readValue<uint32_t>(reader);
+  if (!reader.valid || size > reader.size - reader.offset)
+  {
+    reader.valid = false;
+    return string();
+  }
+  string str((const char *) reader.data + reader.offset, size);
+  reader.offset += size;
+  return str;
+}
+
+/*!
+ * Skip to the point array alignment in a snapshot.
+ *
+ * \param reader The snapshot reader.
+ */
+static void readPadding(SnapshotReader &reader)
+{
+  const size_t aligned = (reader.offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+  if (aligned > reader.size)
+  {
+    reader.valid = false;
+  } else
+  {
+    reader.offset = aligned;
+  }
+}
+
+ModelSnapshot::ModelSnapshot(const string &file_name) : file_name_(file_name)
+{
+}
+
+const string &ModelSnapshot::getFileName() const
+{
+  return file_name_;
+}
+
+bool ModelSnapshot::save(const vector<PCLGraspModel> &models, const uint32_t max_id, const uint32_t count) const
+{
+  // header
+  vector<uint8_t> buffer;
+  writeBytes(buffer, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  writeValue(buffer, (uint32_t) VERSION);
+  writeValue(buffer, (uint32_t) sizeof(pcl::PointXYZRGB));
+  writeValue(buffer, SNAPSHOT_BYTE_ORDER);
+  writeValue(buffer, max_id);
+  writeValue(buffer, count);
+  writeValue(buffer, (uint32_t) models.size());
+
+  for (size_t i = 0; i < models.size(); i++)
+  {
+    const PCLGraspModel &model = models[i];
+    writeValue(buffer, model.getID());
+    writeValue(buffer, (int64_t) model.getCreated());
+    writeString(buffer, model.getObjectName());
+
+    // grasps
+    writeValue(buffer, (uint32_t) model.getNumGrasps());
+    for (size_t j = 0; j < model.getNumGrasps(); j++)
+    {
+      const graspdb::Grasp &grasp = model.getGrasp(j);
+      const graspdb::Pose &pose = grasp.getGraspPose();
+      writeValue(buffer, grasp.getID());
+      writeValue(buffer, grasp.getGraspModelID());
+      writeValue(buffer, grasp.getSuccesses());
+      writeValue(buffer, grasp.getAttempts());
+      writeValue(buffer, (int64_t) grasp.getCreated());
+      writeString(buffer, grasp.getEefFrameID());
+      writeString(buffer, pose.getRobotFixedFrameID());
+      writeValue(buffer, pose.getPosition().getX());
+      writeValue(buffer, pose.getPosition().getY());
+      writeValue(buffer, pose.getPosition().getZ());
+      writeValue(buffer, pose.getOrientation().getX());
+      writeValue(buffer, pose.getOrientation().getY());
+      writeValue(buffer, pose.getOrientation().getZ());
+      writeValue(buffer, pose.getOrientation().getW());
+    }
+
+    // precomputed statistics and descriptors
+    const pcl::PointCloud<pcl::PointXYZRGB> &pc = *model.getPCLPointCloud();
+    writeString(buffer, pc.header.frame_id);
+    writeValue(buffer, (uint32_t) pc.width);
+    writeValue(buffer, (uint32_t) pc.height);
+    writeValue(buffer, (uint8_t) pc.is_dense);
+    writeValue(buffer, model.getCentroid().x);
+    writeValue(buffer, model.getCentroid().y);
+    writeValue(buffer, model.getCentroid().z);
+    writeValue(buffer, model.getAverageRed());
+    writeValue(buffer, model.getAverageGreen());
+    writeValue(buffer, model.getAverageBlue());
+    for (int j = 0; j < 3; j++)
+    {
+      writeValue(buffer, model.getPrincipalExtents()[j]);
+    }
+    for (int j = 0; j < point_cloud_metrics::COLOR_HISTOGRAM_BINS; j++)
+    {
+      writeValue(buffer, model.getColorHistogram().bins[j]);
+    }
+
+    // the points in the native PCL layout
+    writeValue(buffer, (uint64_t) pc.size());
+    writePadding(buffer);
+    writeBytes(buffer, pc.points.empty() ? NULL : &pc.points[0], pc.size() * sizeof(pcl::PointXYZRGB));
+  }
+
+  // write to a temporary file so readers never see a partial snapshot
+  const string temp_file_name = file_name_ + ".tmp";
+  {
+    ofstream file(temp_file_name.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!file.is_open())
+    {
+      ROS_WARN("Could not write to the model snapshot %s.", temp_file_name.c_str());
+      return false;
+    }
+    file.write((const char *) &buffer[0], buffer.size());
+    if (!file.good())
+    {
+      ROS_WARN("Could not write to the model snapshot %s.", temp_file_name.c_str());
+      return false;
+    }
+  }
+  if (rename(temp_file_name.c_str(), file_name_.c_str()) != 0)
+  {
+    ROS_WARN("Could not replace the model snapshot %s.", file_name_.c_str());
+    remove(temp_file_name.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ModelSnapshot::load(vector<PCLGraspModel> &models, uint32_t &max_id, uint32_t &count) const
+{
+  // map the whole file
+  const int fd = open(file_name_.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0)
+  {
+    close(fd);
+    return false;
+  }
+  const size_t size = (size_t) file_stat.st_size;
+  void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (mapped == MAP_FAILED)
+  {
+    ROS_WARN("Could not map the model snapshot %s.", file_name_.c_str());
+    return false;
+  }
+
+  SnapshotReader reader;
+  reader.data = (const uint8_t *) mapped;
+  reader.size = size;
+  reader.offset = 0;
+  reader.valid = true;
+
+  // check the header
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+  readBytes(reader, magic, sizeof(magic));
+  const uint32_t version = readValue<uint32_t>(reader);
+  const uint32_t point_size = readValue<uint32_t>(reader);
+  const uint32_t byte_order = readValue<uint32_t>(reader);
+  const uint32_t snapshot_max_id = readValue<uint32_t>(reader);
+  const uint32_t snapshot_count = readValue<uint32_t>(reader);
+  const uint32_t num_models = readValue<uint32_t>(reader);
+  if (!reader.valid || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 || version != VERSION
+      || point_size != sizeof(pcl::PointXYZRGB) || byte_order != SNAPSHOT_BYTE_ORDER)
+  {
+    ROS_WARN("Ignoring incompatible model snapshot %s.", file_name_.c_str());
+    munmap(mapped, size);
+    return false;
+  }
+
+  vector<PCLGraspModel> restored;
+  restored.reserve(num_models);
+  for (uint32_t i = 0; i < num_models && reader.valid; i++)
+  {
+    const uint32_t id = readValue<uint32_t>(reader);
+    const time_t created = (time_t) readValue<int64_t>(reader);
+    const string object_name = readString(reader);
+
+    // grasps
+    const uint32_t num_grasps = readValue<uint32_t>(reader);
+    vector<graspdb::Grasp> grasps;
+    for (uint32_t j = 0; j < num_grasps && reader.valid; j++)
+    {
+      const uint32_t grasp_id = readValue<uint32_t>(reader);
+      const uint32_t grasp_model_id = readValue<uint32_t>(reader);
+      const uint32_t successes = readValue<uint32_t>(reader);
+      const uint32_t attempts = readValue<uint32_t>(reader);
+      const time_t grasp_created = (time_t) readValue<int64_t>(reader);
+      const string eef_frame_id = readString(reader);
+      const string robot_fixed_frame_id = readString(reader);
+      const double x = readValue<double>(reader);
+      const double y = readValue<double>(reader);
+      const double z = readValue<double>(reader);
+      const double qx = readValue<double>(reader);
+      const double qy = readValue<double>(reader);
+      const double qz = readValue<double>(reader);
+      const double qw = readValue<double>(reader);
+      graspdb::Pose pose(robot_fixed_frame_id, graspdb::Position(x, y, z), graspdb::Orientation(qx, qy, qz, qw));
+      grasps.push_back(graspdb::Grasp(grasp_id, grasp_model_id, pose, eef_frame_id, successes, attempts,
+                                      grasp_created));
+    }
+
+    // precomputed statistics and descriptors
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr pc(new pcl::PointCloud<pcl::PointXYZRGB>);
+    pc->header.frame_id = readString(reader);
+    const uint32_t width = readValue<uint32_t>(reader);
+    const uint32_t height = readValue<uint32_t>(reader);
+    const bool is_dense = readValue<uint8_t>(reader) != 0;
+    geometry_msgs::Point centroid;
+    centroid.x = readValue<double>(reader);
+    centroid.y = readValue<double>(reader);
+    centroid.z = readValue<double>(reader);
+    const double avg_r = readValue<double>(reader);
+    const double avg_g = readValue<double>(reader);
+    const double avg_b = readValue<double>(reader);
+    Eigen::Vector3f extents;
+    for (int j = 0; j < 3; j++)
+    {
+      extents[j] = readValue<float>(reader);
+    }
+    point_cloud_metrics::ColorHistogram color_histogram;
+    for (int j = 0; j < point_cloud_metrics::COLOR_HISTOGRAM_BINS; j++)
+    {
+      color_histogram.bins[j] = readValue<float>(reader);
+    }
+
+    // a single copy of the points out of the mapped file
+    const uint64_t num_points = readValue<uint64_t>(reader);
+    readPadding(reader);
+    if (!reader.valid || num_points > (reader.size - reader.offset) / sizeof(pcl::PointXYZRGB))
+    {
+      reader.valid = false;
+      break;
+    }
+    pc->points.resize(num_points);
+    readBytes(reader, pc->points.empty() ? NULL : &pc->points[0], num_points * sizeof(pcl::PointXYZRGB));
+    if ((uint64_t) width * height == num_points)
+    {
+      pc->width = width;
+      pc->height = height;
+    } else
+    {
+      pc->width = num_points;
+      pc->height = 1;
+    }
+    pc->is_dense = is_dense;
+
+    graspdb::GraspModel grasp_model(id, object_name, grasps, sensor_msgs::PointCloud2(), created);
+    restored.push_back(PCLGraspModel(grasp_model, pc, centroid, avg_r, avg_g, avg_b, extents, color_histogram));
+  }
+  munmap(mapped, size);
+
+  if (!reader.valid || reader.offset != reader.size)
+  {
+    ROS_WARN("Ignoring truncated or corrupt model snapshot %s.", file_name_.c_str());
+    return false;
+  }
+
+  // only modify the output once everything is valid
+  models.swap(restored);
+  max_id = snapshot_max_id;
+  count = snapshot_count;
+  return true;
+}
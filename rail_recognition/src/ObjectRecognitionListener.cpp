@@ -12,18 +12,38 @@
 
 // RAIL Recognition
 #include "rail_recognition/ObjectRecognitionListener.h"
-#include "rail_recognition/PointCloudRecognizer.h"
 
 // ROS
 #include <geometry_msgs/PoseArray.h>
 
+// Boost
+#include <boost/bind.hpp>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
-ObjectRecognitionListener::ObjectRecognitionListener() : private_node_("~")
+ObjectRecognitionListener::ObjectRecognitionListener(const ros::NodeHandle &node, const ros::NodeHandle &private_node)
+    : node_(node), private_node_(private_node)
 {
   // set defaults
   debug_ = DEFAULT_DEBUG;
+  shutdown_ = false;
+  track_objects_ = DEFAULT_TRACK_OBJECTS;
+  max_cancelled_lists_ = DEFAULT_MAX_CANCELLED_LISTS;
+  cancelled_lists_ = 0;
+  double max_centroid_distance = ObjectTracker::DEFAULT_MAX_CENTROID_DISTANCE;
+  double max_point_count_change = ObjectTracker::DEFAULT_MAX_POINT_COUNT_CHANGE;
+  double min_bounding_box_overlap = ObjectTracker::DEFAULT_MIN_BOUNDING_BOX_OVERLAP;
+  double max_color_distance = ObjectTracker::DEFAULT_MAX_COLOR_DISTANCE;
+  int num_threads = 1;
+  int max_icp_candidates = 0;
+  int max_grasps = 0;
+  double max_color_histogram_distance = PointCloudRecognizer::DEFAULT_MAX_COLOR_HISTOGRAM_DISTANCE;
+  bool bounded_scoring = true;
+  double diagnostics_period = LatencyPublisher::DEFAULT_DIAGNOSTICS_PERIOD;
+  // relative to the ROS home directory (empty to disable)
+  string model_snapshot("model_snapshot.bin");
+  point_cloud_metrics::ICPParameters icp_parameters;
   string segmented_objects_topic("/segmentation/segmented_objects");
   int port = graspdb::Client::DEFAULT_PORT;
   string host("127.0.0.1");
@@ -34,6 +54,20 @@ ObjectRecognitionListener::ObjectRecognitionListener() : private_node_("~")
   // grab any parameters we need
   private_node_.getParam("debug", debug_);
   private_node_.getParam("segmented_objects_topic", segmented_objects_topic);
+  private_node_.getParam("max_cancelled_lists", max_cancelled_lists_);
+  private_node_.getParam("num_threads", num_threads);
+  private_node_.getParam("max_icp_candidates", max_icp_candidates);
+  private_node_.getParam("max_grasps", max_grasps);
+  private_node_.getParam("max_color_histogram_distance", max_color_histogram_distance);
+  private_node_.getParam("bounded_scoring", bounded_scoring);
+  point_cloud_metrics::loadICPParameters(private_node_, icp_parameters);
+  private_node_.getParam("track_objects", track_objects_);
+  private_node_.getParam("tracker_max_centroid_distance", max_centroid_distance);
+  private_node_.getParam("tracker_max_point_count_change", max_point_count_change);
+  private_node_.getParam("tracker_min_bounding_box_overlap", min_bounding_box_overlap);
+  private_node_.getParam("tracker_max_color_distance", max_color_distance);
+  private_node_.getParam("diagnostics_period", diagnostics_period);
+  private_node_.getParam("model_snapshot", model_snapshot);
   node_.getParam("/graspdb/host", host);
   node_.getParam("/graspdb/port", port);
   node_.getParam("/graspdb/user", user);
@@ -42,14 +76,52 @@ ObjectRecognitionListener::ObjectRecognitionListener() : private_node_("~")
 
   // connect to the grasp database
   graspdb_ = new graspdb::Client(host, port, user, password, db);
+  graspdb_->setLatencyRecorder(&latency_recorder_);
   okay_ = graspdb_->connect();
 
+  // load the initial set of grasp models, starting from the local snapshot if one exists
+  model_cache_ = new GraspModelCache(graspdb_);
+  if (!model_snapshot.empty())
+  {
+    model_cache_->loadSnapshot(ModelSnapshot(model_snapshot));
+  }
+  if (okay_ && model_cache_->refresh() && !model_snapshot.empty())
+  {
+    // only the models that changed were loaded, so keep the snapshot up to date for the next start
+    model_cache_->saveSnapshot(ModelSnapshot(model_snapshot));
+  }
+
+  // create the recognizer and its worker threads
+  recognizer_ = new PointCloudRecognizer(num_threads);
+  recognizer_->setMaxICPCandidates(max_icp_candidates);
+  recognizer_->setMaxGrasps(max_grasps);
+  recognizer_->setMaxColorHistogramDistance(max_color_histogram_distance);
+  recognizer_->setBoundedScoring(bounded_scoring);
+  recognizer_->setICPParameters(icp_parameters);
+  recognizer_->setLatencyRecorder(&latency_recorder_);
+  ROS_INFO("Scoring candidates with %d thread(s).", recognizer_->getNumThreads());
+
+  // setup the frame to frame tracker
+  tracker_.setMaxCentroidDistance(max_centroid_distance);
+  tracker_.setMaxPointCountChange(max_point_count_change);
+  tracker_.setMinBoundingBoxOverlap(min_bounding_box_overlap);
+  tracker_.setMaxColorDistance(max_color_distance);
+
+  // periodically publish the stage latencies
+  track_stage_ = latency_recorder_.addStage("listener.track");
+  list_stage_ = latency_recorder_.addStage("listener.recognize_list");
+  latency_publisher_ = new LatencyPublisher(node_, "object_recognition_listener", latency_recorder_,
+                                            diagnostics_period);
+
   // setup a debug publisher if we need it
   if (debug_)
   {
     debug_pub_ = private_node_.advertise<geometry_msgs::PoseArray>("debug", 1, true);
   }
 
+  // start the worker before any lists can arrive
+  worker_ = boost::thread(&ObjectRecognitionListener::recognitionLoop, this);
+
   segmented_objects_sub_ = node_.subscribe(segmented_objects_topic, 1,
       &ObjectRecognitionListener::segmentedObjectsCallback, this);
   recognized_objects_pub_ = private_node_.advertise<rail_manipulation_msgs::SegmentedObjectList>(
@@ -63,7 +135,19 @@ ObjectRecognitionListener::ObjectRecognitionListener() : private_node_("~")
 
 ObjectRecognitionListener::~ObjectRecognitionListener()
 {
+  // stop taking new lists and cancel any recognition in progress
+  segmented_objects_sub_.shutdown();
+  {
+    boost::mutex::scoped_lock lock(pending_mutex_);
+    shutdown_ = true;
+  }
+  pending_condition_.notify_all();
+  worker_.join();
+
   // cleanup
+  delete latency_publisher_;
+  delete recognizer_;
+  delete model_cache_;
   graspdb_->disconnect();
   delete graspdb_;
 }
@@ -78,72 +162,104 @@ void ObjectRecognitionListener::segmentedObjectsCallback(
 {
   ROS_INFO("Received %li segmented objects.", objects->objects.size());
 
-  // check against the old list to prevent throwing out data
-  vector<rail_manipulation_msgs::SegmentedObject> new_list;
-  for (size_t i = 0; i < objects->objects.size(); i++)
+  // the newest list always wins
   {
-    bool matched = false;
-    // search for a match on the point cloud
-    for (size_t j = 0; j < object_list_.objects.size(); j++)
+    boost::mutex::scoped_lock lock(pending_mutex_);
+    if (pending_objects_)
     {
-      // only do a compare if we previously recognized the object
-      if (object_list_.objects[j].recognized &&
-          this->comparePointClouds(objects->objects[i].point_cloud, object_list_.objects[j].point_cloud))
-      {
-        ROS_INFO("Found a match from previously recognized objects.");
-        matched = true;
-        new_list.push_back(object_list_.objects[j]);
-        break;
-      }
+      ROS_INFO("Dropping a segmented object list that was never started.");
     }
+    pending_objects_ = objects;
+  }
+  pending_condition_.notify_all();
+}
 
-    // check if we didn't match
-    if (!matched)
+void ObjectRecognitionListener::recognitionLoop()
+{
+  while (true)
+  {
+    // wait for the newest list
+    rail_manipulation_msgs::SegmentedObjectList::ConstPtr objects;
     {
-      new_list.push_back(objects->objects[i]);
+      boost::mutex::scoped_lock lock(pending_mutex_);
+      while (!shutdown_ && !pending_objects_)
+      {
+        pending_condition_.wait(lock);
+      }
+      if (shutdown_)
+      {
+        return;
+      }
+      objects = pending_objects_;
+      pending_objects_.reset();
     }
+
+    this->recognizeObjects(objects);
   }
+}
 
-  // store the list
-  object_list_.objects = new_list;
+bool ObjectRecognitionListener::isSuperseded()
+{
+  // once too many lists were cancelled in a row, only a shutdown cancels the current one
+  const bool can_supersede = max_cancelled_lists_ < 0 || cancelled_lists_ < max_cancelled_lists_;
+  boost::mutex::scoped_lock lock(pending_mutex_);
+  return shutdown_ || (can_supersede && pending_objects_.get() != NULL);
+}
+
+void ObjectRecognitionListener::recognizeObjects(const rail_manipulation_msgs::SegmentedObjectList::ConstPtr &objects)
+{
+  const ros::WallTime start = ros::WallTime::now();
+  // build a new list so published messages are never modified
+  rail_manipulation_msgs::SegmentedObjectList::Ptr object_list(
+      new rail_manipulation_msgs::SegmentedObjectList(*objects));
+
+  // carry forward results for objects that have not changed since the last frame
+  if (track_objects_)
+  {
+    graspdb::LatencyRecorder::ScopedTimer timer(&latency_recorder_, track_stage_);
+    size_t matched = tracker_.track(*object_list);
+    ROS_INFO("Matched %lu objects from previously recognized objects.", matched);
+  }
 
   // run recognition
   ROS_INFO("Running recognition...");
-  // populate candidates
-  vector<graspdb::GraspModel> candidates;
-  graspdb_->loadGraspModels(candidates);
-  // convert to PCL grasp models
-  vector<PCLGraspModel> pcl_candidates;
-  for (size_t i = 0; i < candidates.size(); i++)
+  // pick up any changes to the grasp models and hold on to the library for the whole batch
+  model_cache_->refresh();
+  const GraspModelCache::ModelLibraryConstPtr library = model_cache_->getModelLibrary();
+  const vector<PCLGraspModel> &pcl_candidates = *library;
+
+  // recognize everything that is left in a single batch, giving up as soon as a newer list arrives
+  bool cancelled = false;
+  recognizer_->recognizeObjects(*object_list, pcl_candidates,
+                                boost::bind(&ObjectRecognitionListener::isSuperseded, this), &cancelled);
+  if (cancelled)
   {
-    pcl_candidates.push_back(PCLGraspModel(candidates[i]));
+    // a finished batch is published below even if a newer list is already waiting
+    cancelled_lists_++;
+    ROS_INFO("Recognition cancelled for a newer segmented object list.");
+    return;
   }
+  cancelled_lists_ = 0;
+  // only completed lists count towards the list latency
+  latency_recorder_.record(list_stage_, (ros::WallTime::now() - start).toSec());
 
-  // go through the current list
-  PointCloudRecognizer recognizer;
-  for (size_t i = 0; i < object_list_.objects.size(); i++)
+  // republish the new list by pointer so subscribers in the same process share it without a copy
+  object_list_ = object_list;
+  if (track_objects_)
   {
-    // check if it is already recognized
-    rail_manipulation_msgs::SegmentedObject &object = object_list_.objects[i];
-    if (!object.recognized)
-    {
-      // perform recognition
-      recognizer.recognizeObject(object, pcl_candidates);
-    }
+    tracker_.update(*object_list_);
   }
-
-  // republish the new list
   recognized_objects_pub_.publish(object_list_);
   // check for debug publishing
   if (debug_)
   {
     geometry_msgs::PoseArray poses;
-    for (size_t i = 0; i < object_list_.objects.size(); i++)
+    for (size_t i = 0; i < object_list_->objects.size(); i++)
     {
-      for (size_t j = 0; j < object_list_.objects[i].grasps.size(); j++)
+      for (size_t j = 0; j < object_list_->objects[i].grasps.size(); j++)
       {
-        poses.header = object_list_.objects[i].grasps[j].header;
-        poses.poses.push_back(object_list_.objects[i].grasps[j].pose);
+        poses.header = object_list_->objects[i].grasps[j].header;
+        poses.poses.push_back(object_list_->objects[i].grasps[j].pose);
       }
     }
     debug_pub_.publish(poses);
@@ -151,10 +267,3 @@ void ObjectRecognitionListener::segmentedObjectsCallback(
 
   ROS_INFO("New recognized objects published.");
 }
-
-bool ObjectRecognitionListener::comparePointClouds(const sensor_msgs::PointCloud2 &pc1,
-    const sensor_msgs::PointCloud2 &pc2) const
-{
-  // check the size first then compare
-  return (pc1.data.size() == pc2.data.size()) && (pc1.data == pc1.data);
-}
@@ -2,7 +2,8 @@
  * \file ObjectRecognizer.cpp
  * \brief The object recognizer node object.
  *
- * The object recognizer sets up an action server that allows the recognition of a single segmented object.
+ * The object recognizer sets up an action server that allows the recognition of a single segmented object. Goals are
+ * served concurrently against a shared model library.
  *
  * \author David Kent, WPI - rctoris@wpi.edu
  * \author Russell Toris, WPI - rctoris@wpi.edu
@@ -11,16 +12,35 @@
 
 // RAIL Recognition
 #include "rail_recognition/ObjectRecognizer.h"
-#include "rail_recognition/PointCloudRecognizer.h"
+
+// Boost
+#include <boost/algorithm/string.hpp>
+
+// C++ Standard Library
+#include <algorithm>
 
 using namespace std;
 using namespace rail::pick_and_place;
 
-ObjectRecognizer::ObjectRecognizer()
-    : private_node_("~"),
-      as_(private_node_, "recognize_object", boost::bind(&ObjectRecognizer::recognizeObjectCallback, this, _1), false)
+ObjectRecognizer::ObjectRecognizer(const ros::NodeHandle &node, const ros::NodeHandle &private_node)
+    : goal_queue_(boost::bind(&ObjectRecognizer::recognizeObject, this, _1), "Object recognizer shut down.",
+                  "Goal cancelled before recognition."),
+      node_(node), private_node_(private_node),
+      as_(private_node_, "recognize_object", boost::bind(&GoalQueue::goalCallback, &goal_queue_, _1),
+          boost::bind(&GoalQueue::cancelCallback, &goal_queue_, _1), false)
 {
   // set defaults
+  num_ranked_results_ = DEFAULT_NUM_RANKED_RESULTS;
+  int num_goal_threads = DEFAULT_NUM_GOAL_THREADS;
+  int num_threads = 1;
+  int max_icp_candidates = 0;
+  int max_grasps = 0;
+  double max_color_histogram_distance = PointCloudRecognizer::DEFAULT_MAX_COLOR_HISTOGRAM_DISTANCE;
+  bool bounded_scoring = true;
+  double diagnostics_period = LatencyPublisher::DEFAULT_DIAGNOSTICS_PERIOD;
+  // relative to the ROS home directory (empty to disable)
+  string model_snapshot("model_snapshot.bin");
+  point_cloud_metrics::ICPParameters icp_parameters;
   int port = graspdb::Client::DEFAULT_PORT;
   string host("127.0.0.1");
   string user("ros");
@@ -28,6 +48,16 @@ ObjectRecognizer::ObjectRecognizer()
   string db("graspdb");
 
   // grab any parameters we need
+  private_node_.getParam("num_goal_threads", num_goal_threads);
+  private_node_.getParam("num_threads", num_threads);
+  private_node_.getParam("max_icp_candidates", max_icp_candidates);
+  private_node_.getParam("max_grasps", max_grasps);
+  private_node_.getParam("max_color_histogram_distance", max_color_histogram_distance);
+  private_node_.getParam("bounded_scoring", bounded_scoring);
+  private_node_.getParam("num_ranked_results", num_ranked_results_);
+  private_node_.getParam("diagnostics_period", diagnostics_period);
+  private_node_.getParam("model_snapshot", model_snapshot);
+  point_cloud_metrics::loadICPParameters(private_node_, icp_parameters);
   node_.getParam("/graspdb/host", host);
   node_.getParam("/graspdb/port", port);
   node_.getParam("/graspdb/user", user);
@@ -36,9 +66,37 @@ ObjectRecognizer::ObjectRecognizer()
 
   // connect to the grasp database
   graspdb_ = new graspdb::Client(host, port, user, password, db);
+  graspdb_->setLatencyRecorder(&latency_recorder_);
   okay_ = graspdb_->connect();
 
-  // start the action server
+  // load the initial set of grasp models, starting from the local snapshot if one exists
+  model_cache_ = new GraspModelCache(graspdb_);
+  if (!model_snapshot.empty())
+  {
+    model_cache_->loadSnapshot(ModelSnapshot(model_snapshot));
+  }
+  if (okay_ && model_cache_->refresh() && !model_snapshot.empty())
+  {
+    // only the models that changed were loaded, so keep the snapshot up to date for the next start
+    model_cache_->saveSnapshot(ModelSnapshot(model_snapshot));
+  }
+
+  // create the recognizer and its worker threads
+  recognizer_ = new PointCloudRecognizer(num_threads);
+  recognizer_->setMaxICPCandidates(max_icp_candidates);
+  recognizer_->setMaxGrasps(max_grasps);
+  recognizer_->setMaxColorHistogramDistance(max_color_histogram_distance);
+  recognizer_->setBoundedScoring(bounded_scoring);
+  recognizer_->setICPParameters(icp_parameters);
+  recognizer_->setLatencyRecorder(&latency_recorder_);
+  ROS_INFO("Scoring candidates with %d thread(s).", recognizer_->getNumThreads());
+
+  // periodically publish the stage latencies
+  latency_publisher_ = new LatencyPublisher(node_, "object_recognizer", latency_recorder_, diagnostics_period);
+
+  // start the goal threads and the action server
+  goal_queue_.start(num_goal_threads);
+  ROS_INFO("Serving up to %d goal(s) at once.", goal_queue_.getNumThreads());
   as_.start();
 
   if (okay_)
@@ -49,8 +107,13 @@ ObjectRecognizer::ObjectRecognizer()
 
 ObjectRecognizer::~ObjectRecognizer()
 {
+  // stop the goal threads (running goals are finished first)
+  goal_queue_.shutdown();
+
   // cleanup
-  as_.shutdown();
+  delete latency_publisher_;
+  delete recognizer_;
+  delete model_cache_;
   graspdb_->disconnect();
   delete graspdb_;
 }
@@ -60,46 +123,108 @@ bool ObjectRecognizer::okay() const
   return okay_;
 }
 
-void ObjectRecognizer::recognizeObjectCallback(const rail_manipulation_msgs::RecognizeObjectGoalConstPtr &goal)
+void ObjectRecognizer::recognizeObject(GoalHandle &goal_handle)
 {
   ROS_INFO("Recognize Object Request Received.");
+  const rail_manipulation_msgs::RecognizeObjectGoalConstPtr goal = goal_handle.getGoal();
 
   rail_manipulation_msgs::RecognizeObjectFeedback feedback;
   feedback.message = "Loading candidate models...";
-  as_.publishFeedback(feedback);
+  goal_handle.publishFeedback(feedback);
 
-  // populate candidates based on the name if it exists
-  vector<graspdb::GraspModel> candidates;
+  // pick up any changes to the grasp models and hold on to the library for the whole goal
+  model_cache_->refresh();
+  GraspModelCache::ModelLibraryConstPtr library;
+  GraspModelCache::NameIndexConstPtr name_index;
+  model_cache_->getModelLibrary(library, name_index);
+
+  // copy the information to the result
+  rail_manipulation_msgs::RecognizeObjectResult result;
+  result.object = goal->object;
+
+  // a filtered request for the last object can be answered from its ranked candidates
   if (goal->name.size() > 0)
   {
-    graspdb_->loadGraspModelsByObjectName(goal->name, candidates);
-  }
-  else
-  {
-    graspdb_->loadGraspModels(candidates);
+    bool ranked_point_cloud;
+    vector<PointCloudRecognizer::RankedCandidate> ranked;
+    {
+      boost::mutex::scoped_lock lock(ranked_mutex_);
+      ranked_point_cloud = this->isRankedPointCloud(goal->object.point_cloud, library);
+      if (ranked_point_cloud)
+      {
+        ranked = ranked_;
+      }
+    }
+
+    if (ranked_point_cloud)
+    {
+      for (size_t i = 0; i < ranked.size(); i++)
+      {
+        const PCLGraspModel &model = library->at(ranked[i].index);
+        if (boost::iequals(model.getObjectName(), goal->name))
+        {
+          recognizer_->applyRecognition(result.object, model, ranked[i].score, ranked[i].tf_icp);
+          goal_handle.setSucceeded(result, "Object successfully recognized.");
+          return;
+        }
+      }
+
+      // if every candidate was registered and every match was ranked, no model with this name can match
+      if (recognizer_->getMaxICPCandidates() < 1 && ranked.size() < (size_t) num_ranked_results_)
+      {
+        goal_handle.setSucceeded(result, "Object could not be recognized.");
+        return;
+      }
+    }
   }
 
-  // convert to PCL grasp models
-  vector<PCLGraspModel> pcl_candidates;
-  for (size_t i = 0; i < candidates.size(); i++)
+  // populate candidates based on the name if it exists
+  const vector<PCLGraspModel> no_candidates;
+  const vector<PCLGraspModel> *filtered_candidates = library.get();
+  if (goal->name.size() > 0)
   {
-    pcl_candidates.push_back(PCLGraspModel(candidates[i]));
+    filtered_candidates = GraspModelCache::findModelsByObjectName(name_index, goal->name);
+    if (filtered_candidates == NULL)
+    {
+      filtered_candidates = &no_candidates;
+    }
   }
-
-  // copy the information to the result
-  rail_manipulation_msgs::RecognizeObjectResult result;
-  result.object = goal->object;
+  const vector<PCLGraspModel> &pcl_candidates = *filtered_candidates;
 
   // perform recognition
   feedback.message = "Running recognition...";
-  as_.publishFeedback(feedback);
-  PointCloudRecognizer recognizer;
-  if (!recognizer.recognizeObject(result.object, pcl_candidates))
+  goal_handle.publishFeedback(feedback);
+  bool recognized;
+  if (goal->name.size() > 0)
+  {
+    recognized = recognizer_->recognizeObject(result.object, pcl_candidates);
+  } else
+  {
+    // keep the runners up from the same sweep
+    vector<PointCloudRecognizer::RankedCandidate> ranked;
+    recognized = recognizer_->recognizeObject(result.object, pcl_candidates, (size_t) max(num_ranked_results_, 1),
+                                              ranked);
+    boost::mutex::scoped_lock lock(ranked_mutex_);
+    ranked_.swap(ranked);
+    ranked_point_cloud_ = goal->object.point_cloud;
+    ranked_library_ = library;
+  }
+
+  if (!recognized)
   {
-    as_.setSucceeded(result, "Object could not be recognized.");
+    goal_handle.setSucceeded(result, "Object could not be recognized.");
   }
   else
   {
-    as_.setSucceeded(result, "Object successfully recognized.");
+    goal_handle.setSucceeded(result, "Object successfully recognized.");
   }
 }
+
+bool ObjectRecognizer::isRankedPointCloud(const sensor_msgs::PointCloud2 &pc,
+    const GraspModelCache::ModelLibraryConstPtr &library) const
+{
+  // check the cheap fields before the data (ranked indices refer to the library they were computed against)
+  return ranked_library_ && ranked_library_ == library && pc.header.stamp == ranked_point_cloud_.header.stamp
+      && pc.header.frame_id == ranked_point_cloud_.header.frame_id && pc.width == ranked_point_cloud_.width
+      && pc.height == ranked_point_cloud_.height && pc.data == ranked_point_cloud_.data;
+}
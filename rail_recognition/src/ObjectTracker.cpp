@@ -0,0 +1,332 @@
+/*!
+ * \file ObjectTracker.cpp
+ * \brief Frame to frame tracking of recognized segmented objects.
+ *
+ * The object tracker matches newly segmented objects to the objects recognized in the previous frame and carries the
+ * recognition results forward so only new or significantly changed objects need to be recognized again.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/ObjectTracker.h"
+
+// ROS
+#include <sensor_msgs/point_cloud2_iterator.h>
+
+// C++ Standard Library
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+/*! The smallest spatial hash cell size in meters. */
+static const double MIN_CELL_SIZE = 0.001;
+/*! The number of bits used for each axis of a spatial hash cell key. */
+static const int CELL_BITS = 21;
+
+ObjectTracker::ObjectTracker()
+{
+  max_centroid_distance_ = DEFAULT_MAX_CENTROID_DISTANCE;
+  max_point_count_change_ = DEFAULT_MAX_POINT_COUNT_CHANGE;
+  min_bounding_box_overlap_ = DEFAULT_MIN_BOUNDING_BOX_OVERLAP;
+  max_color_distance_ = DEFAULT_MAX_COLOR_DISTANCE;
+}
+
+double ObjectTracker::getMaxCentroidDistance() const
+{
+  return max_centroid_distance_;
+}
+
+void ObjectTracker::setMaxCentroidDistance(const double max_centroid_distance)
+{
+  max_centroid_distance_ = max_centroid_distance;
+  // existing cells were hashed with the old size
+  this->clear();
+}
+
+double ObjectTracker::getMaxPointCountChange() const
+{
+  return max_point_count_change_;
+}
+
+void ObjectTracker::setMaxPointCountChange(const double max_point_count_change)
+{
+  max_point_count_change_ = max_point_count_change;
+}
+
+double ObjectTracker::getMinBoundingBoxOverlap() const
+{
+  return min_bounding_box_overlap_;
+}
+
+void ObjectTracker::setMinBoundingBoxOverlap(const double min_bounding_box_overlap)
+{
+  min_bounding_box_overlap_ = min_bounding_box_overlap;
+}
+
+double ObjectTracker::getMaxColorDistance() const
+{
+  return max_color_distance_;
+}
+
+void ObjectTracker::setMaxColorDistance(const double max_color_distance)
+{
+  max_color_distance_ = max_color_distance;
+}
+
+size_t ObjectTracker::track(rail_manipulation_msgs::SegmentedObjectList &objects)
+{
+  if (tracks_.empty())
+  {
+    return 0;
+  }
+
+  size_t matched = 0;
+  vector<bool> used(tracks_.size(), false);
+  for (size_t i = 0; i < objects.objects.size(); i++)
+  {
+    rail_manipulation_msgs::SegmentedObject &object = objects.objects[i];
+    if (object.recognized)
+    {
+      continue;
+    }
+
+    Signature signature;
+    ObjectTracker::computeSignature(object.point_cloud, signature);
+    if (signature.num_points == 0)
+    {
+      continue;
+    }
+
+    // a match must be within one cell of this centroid
+    int best = -1;
+    double best_distance = numeric_limits<double>::infinity();
+    for (int dx = -1; dx <= 1; dx++)
+    {
+      for (int dy = -1; dy <= 1; dy++)
+      {
+        for (int dz = -1; dz <= 1; dz++)
+        {
+          boost::unordered_map<uint64_t, vector<size_t> >::const_iterator it = cells_.find(
+              this->computeCell(signature.centroid, dx, dy, dz));
+          if (it == cells_.end())
+          {
+            continue;
+          }
+
+          for (size_t j = 0; j < it->second.size(); j++)
+          {
+            const size_t index = it->second[j];
+            const Signature &previous = tracks_[index].signature;
+            const double distance = signature.centroid.distance(previous.centroid);
+            if (!used[index] && distance < best_distance && this->matches(signature, previous))
+            {
+              best = (int) index;
+              best_distance = distance;
+            }
+          }
+        }
+      }
+    }
+
+    if (best >= 0)
+    {
+      used[best] = true;
+      matched++;
+
+      // carry the previous results forward
+      const rail_manipulation_msgs::SegmentedObject &previous = tracks_[best].object;
+      object.name = previous.name;
+      object.model_id = previous.model_id;
+      object.confidence = previous.confidence;
+      object.orientation = previous.orientation;
+      object.recognized = true;
+
+      // grasps move with the object
+      const tf2::Vector3 offset = signature.centroid - tracks_[best].signature.centroid;
+      object.grasps = previous.grasps;
+      for (size_t j = 0; j < object.grasps.size(); j++)
+      {
+        object.grasps[j].header.stamp = object.point_cloud.header.stamp;
+        object.grasps[j].pose.position.x += offset.x();
+        object.grasps[j].pose.position.y += offset.y();
+        object.grasps[j].pose.position.z += offset.z();
+      }
+    }
+  }
+
+  return matched;
+}
+
+void ObjectTracker::update(const rail_manipulation_msgs::SegmentedObjectList &objects)
+{
+  this->clear();
+  for (size_t i = 0; i < objects.objects.size(); i++)
+  {
+    // only recognized objects have results worth carrying forward
+    if (!objects.objects[i].recognized)
+    {
+      continue;
+    }
+
+    Track track;
+    ObjectTracker::computeSignature(objects.objects[i].point_cloud, track.signature);
+    if (track.signature.num_points == 0)
+    {
+      continue;
+    }
+
+    // the point cloud is summarized by the signature
+    track.object.name = objects.objects[i].name;
+    track.object.model_id = objects.objects[i].model_id;
+    track.object.confidence = objects.objects[i].confidence;
+    track.object.orientation = objects.objects[i].orientation;
+    track.object.grasps = objects.objects[i].grasps;
+
+    cells_[this->computeCell(track.signature.centroid)].push_back(tracks_.size());
+    tracks_.push_back(track);
+  }
+}
+
+void ObjectTracker::clear()
+{
+  tracks_.clear();
+  cells_.clear();
+}
+
+void ObjectTracker::computeSignature(const sensor_msgs::PointCloud2 &pc, Signature &signature)
+{
+  signature.frame_id = pc.header.frame_id;
+  signature.centroid.setZero();
+  signature.min.setValue(numeric_limits<double>::infinity(), numeric_limits<double>::infinity(),
+                         numeric_limits<double>::infinity());
+  signature.max = -signature.min;
+  signature.num_points = 0;
+  signature.r = 0;
+  signature.g = 0;
+  signature.b = 0;
+  signature.has_color = false;
+
+  const size_t size = pc.width * pc.height;
+  if (size == 0)
+  {
+    return;
+  }
+
+  // the iterators require the fields to exist
+  bool has_xyz = false;
+  for (size_t i = 0; i < pc.fields.size(); i++)
+  {
+    has_xyz |= (pc.fields[i].name == "x");
+    signature.has_color |= (pc.fields[i].name == "rgb" || pc.fields[i].name == "rgba");
+  }
+  if (!has_xyz)
+  {
+    return;
+  }
+
+  sensor_msgs::PointCloud2ConstIterator<float> iter_x(pc, "x");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_y(pc, "y");
+  sensor_msgs::PointCloud2ConstIterator<float> iter_z(pc, "z");
+  double sum_x = 0, sum_y = 0, sum_z = 0;
+  for (size_t i = 0; i < size; i++, ++iter_x, ++iter_y, ++iter_z)
+  {
+    if (isfinite(*iter_x) && isfinite(*iter_y) && isfinite(*iter_z))
+    {
+      const tf2::Vector3 point(*iter_x, *iter_y, *iter_z);
+      sum_x += point.x();
+      sum_y += point.y();
+      sum_z += point.z();
+      signature.min.setMin(point);
+      signature.max.setMax(point);
+      signature.num_points++;
+    }
+  }
+
+  if (signature.num_points == 0)
+  {
+    return;
+  }
+  signature.centroid.setValue(sum_x / signature.num_points, sum_y / signature.num_points,
+                              sum_z / signature.num_points);
+
+  if (signature.has_color)
+  {
+    // colors are averaged over every point, including those without valid coordinates
+    sensor_msgs::PointCloud2ConstIterator<uint8_t> iter_r(pc, "r");
+    sensor_msgs::PointCloud2ConstIterator<uint8_t> iter_g(pc, "g");
+    sensor_msgs::PointCloud2ConstIterator<uint8_t> iter_b(pc, "b");
+    for (size_t i = 0; i < size; i++, ++iter_r, ++iter_g, ++iter_b)
+    {
+      signature.r += *iter_r;
+      signature.g += *iter_g;
+      signature.b += *iter_b;
+    }
+    signature.r /= size;
+    signature.g /= size;
+    signature.b /= size;
+  }
+}
+
+double ObjectTracker::computeBoundingBoxOverlap(const Signature &s1, const Signature &s2)
+{
+  // volume of the intersection
+  double intersection = 1.0, volume1 = 1.0, volume2 = 1.0;
+  for (int i = 0; i < 3; i++)
+  {
+    const double low = max(s1.min[i], s2.min[i]);
+    const double high = min(s1.max[i], s2.max[i]);
+    intersection *= max(0.0, high - low);
+    volume1 *= s1.max[i] - s1.min[i];
+    volume2 *= s2.max[i] - s2.min[i];
+  }
+
+  const double union_volume = volume1 + volume2 - intersection;
+  if (union_volume <= 0)
+  {
+    // both boxes are degenerate (e.g., a flat or single point cloud) so only identical boxes overlap
+    return (s1.min == s2.min && s1.max == s2.max) ? 1.0 : 0.0;
+  }
+  return intersection / union_volume;
+}
+
+bool ObjectTracker::matches(const Signature &s1, const Signature &s2) const
+{
+  if (s1.frame_id != s2.frame_id || s1.centroid.distance(s2.centroid) > max_centroid_distance_)
+  {
+    return false;
+  }
+
+  // relative change in size
+  const double n1 = s1.num_points, n2 = s2.num_points;
+  if (fabs(n1 - n2) / max(n1, n2) > max_point_count_change_)
+  {
+    return false;
+  }
+
+  if (s1.has_color && s2.has_color)
+  {
+    const double dr = s1.r - s2.r, dg = s1.g - s2.g, db = s1.b - s2.b;
+    if (sqrt(dr * dr + dg * dg + db * db) > max_color_distance_)
+    {
+      return false;
+    }
+  }
+
+  // most expensive check last
+  return ObjectTracker::computeBoundingBoxOverlap(s1, s2) >= min_bounding_box_overlap_;
+}
+
+uint64_t ObjectTracker::computeCell(const tf2::Vector3 &point, const int dx, const int dy, const int dz) const
+{
+  const double cell_size = max(max_centroid_distance_, MIN_CELL_SIZE);
+  const uint64_t mask = (((uint64_t) 1) << CELL_BITS) - 1;
+  const uint64_t x = ((uint64_t) ((int64_t) floor(point.x() / cell_size) + dx)) & mask;
+  const uint64_t y = ((uint64_t) ((int64_t) floor(point.y() / cell_size) + dy)) & mask;
+  const uint64_t z = ((uint64_t) ((int64_t) floor(point.z() / cell_size) + dz)) & mask;
+  return (x << (2 * CELL_BITS)) | (y << CELL_BITS) | z;
+}
@@ -4,7 +4,9 @@
  *
  * The PCLGraspModel is simply a wrapper around the graspdb GrapsModel with a PCL point cloud. A flag can also be set
  * to mark the grasp model as an original (as apposed to newly generated during model generation). All accessors to
- * the ROS point cloud message are disabled.
+ * the ROS point cloud message are disabled. A search tree and normals for the point cloud are built on first use and
+ * reused for every registration against the model. The derived statistics are stored with the model as versioned
+ * features so they are not recomputed when the model is loaded again.
  *
  * \author Russell Toris, WPI - rctoris@wpi.edu
  * \date April 8, 2015
@@ -14,12 +16,61 @@
 #include "rail_recognition/PCLGraspModel.h"
 #include "rail_recognition/PointCloudMetrics.h"
 
+// PCL
+#include <pcl/features/normal_3d.h>
+
+// C++ Standard Library
+#include <algorithm>
+#include <cstring>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
+/*! The magic bytes at the start of every features blob. */
+static const char FEATURES_MAGIC[8] = {'R', 'A', 'I', 'L', 'F', 'E', 'A', 'T'};
+/*! Written in native byte order to detect features from a machine with a different byte order. */
+static const uint32_t FEATURES_BYTE_ORDER = 0x01020304;
+
+/*!
+ * \brief Write a value to a features blob.
+ *
+ * Append the raw bytes of a value to a features blob.
+ *
+ * \param features The features blob.
+ * \param value The value to write.
+ */
+template<typename T>
+static void writeFeature(vector<uint8_t> &features, const T &value)
+{
+  const uint8_t *bytes = (const uint8_t *) &value;
+  features.insert(features.end(), bytes, bytes + sizeof(T));
+}
+
+/*!
+ * \brief Read a value from a features blob.
+ *
+ * Read the raw bytes of a value from a features blob and advance the offset. The caller must check the size of the
+ * blob first.
+ *
+ * \param features The features blob.
+ * \param offset The offset to read at (advanced past the value).
+ * \return The value read.
+ */
+template<typename T>
+static T readFeature(const vector<uint8_t> &features, size_t &offset)
+{
+  T value;
+  memcpy(&value, &features[offset], sizeof(T));
+  offset += sizeof(T);
+  return value;
+}
+
 PCLGraspModel::PCLGraspModel(const graspdb::GraspModel &grasp_model)
-    : graspdb::GraspModel(grasp_model),
-      pc_(new pcl::PointCloud<pcl::PointXYZRGB>)
+    : graspdb::GraspModel(grasp_model.getID(), grasp_model.getObjectName(), grasp_model.getGrasps(),
+                          sensor_msgs::PointCloud2(), grasp_model.getCreated()),
+      pc_(new pcl::PointCloud<pcl::PointXYZRGB>),
+      extents_(Eigen::Vector3f::Zero()),
+      index_(new SearchIndex)
 {
   // default to false
   original_ = false;
@@ -27,7 +78,12 @@ PCLGraspModel::PCLGraspModel(const graspdb::GraspModel &grasp_model)
   // copy the point cloud if it exists
   if (grasp_model.getPointCloud().data.size() > 0)
   {
-    this->setPointCloud(grasp_model.getPointCloud());
+    point_cloud_metrics::rosPointCloud2ToPCLPointCloud(grasp_model.getPointCloud(), pc_);
+    // only compute the statistics if they were not stored with the model
+    if (!this->decodeFeatures(grasp_model.getFeatures()))
+    {
+      this->resetSearchIndex();
+    }
   } else
   {
     // simply store the header information
@@ -38,6 +94,74 @@ PCLGraspModel::PCLGraspModel(const graspdb::GraspModel &grasp_model)
   }
 }
 
+PCLGraspModel::PCLGraspModel(const graspdb::GraspModel &grasp_model,
+    const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc, const geometry_msgs::Point &centroid, const double avg_r,
+    const double avg_g, const double avg_b, const Eigen::Vector3f &extents,
+    const point_cloud_metrics::ColorHistogram &color_histogram)
+    : graspdb::GraspModel(grasp_model.getID(), grasp_model.getObjectName(), grasp_model.getGrasps(),
+                          sensor_msgs::PointCloud2(), grasp_model.getCreated()),
+      pc_(pc),
+      centroid_(centroid),
+      extents_(extents),
+      color_histogram_(color_histogram),
+      index_(new SearchIndex)
+{
+  original_ = false;
+  avg_r_ = avg_r;
+  avg_g_ = avg_g;
+  avg_b_ = avg_b;
+}
+
+void PCLGraspModel::consume(graspdb::GraspModel &grasp_model)
+{
+  // take over the ID, name, grasps, and point cloud message without copying them
+  graspdb::GraspModel::swap(grasp_model);
+  graspdb::GraspModel empty;
+  grasp_model.swap(empty);
+
+  // convert into a new point cloud since copies of this model may share the old one
+  pc_.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+  const sensor_msgs::PointCloud2 &point_cloud = graspdb::GraspModel::getPointCloud();
+  if (point_cloud.data.size() > 0)
+  {
+    point_cloud_metrics::rosPointCloud2ToPCLPointCloud(point_cloud, pc_);
+    graspdb::GraspModel::releasePointCloud();
+    // only compute the statistics if they were not stored with the model
+    if (!this->decodeFeatures(graspdb::GraspModel::getFeatures()))
+    {
+      this->resetSearchIndex();
+    }
+  } else
+  {
+    // simply store the header information
+    pc_->header.frame_id = point_cloud.header.frame_id;
+    graspdb::GraspModel::releasePointCloud();
+    index_.reset(new SearchIndex);
+    avg_r_ = 0;
+    avg_g_ = 0;
+    avg_b_ = 0;
+    centroid_ = geometry_msgs::Point();
+    extents_ = Eigen::Vector3f::Zero();
+    color_histogram_ = point_cloud_metrics::ColorHistogram();
+  }
+  // the point cloud may be modified in place, so the stored features are rebuilt by toGraspModel
+  graspdb::GraspModel::setFeatures(vector<uint8_t>());
+}
+
+void PCLGraspModel::swap(PCLGraspModel &other)
+{
+  graspdb::GraspModel::swap(other);
+  std::swap(original_, other.original_);
+  pc_.swap(other.pc_);
+  std::swap(avg_r_, other.avg_r_);
+  std::swap(avg_g_, other.avg_g_);
+  std::swap(avg_b_, other.avg_b_);
+  std::swap(centroid_, other.centroid_);
+  std::swap(extents_, other.extents_);
+  std::swap(color_histogram_, other.color_histogram_);
+  index_.swap(other.index_);
+}
+
 bool PCLGraspModel::isOriginal() const
 {
   return original_;
@@ -67,8 +191,8 @@ void PCLGraspModel::setPointCloud(const sensor_msgs::PointCloud2 &point_cloud)
 {
   // copy the point cloud
   point_cloud_metrics::rosPointCloud2ToPCLPointCloud(point_cloud, pc_);
-  // compute RGB information
-  point_cloud_metrics::calculateAvgColors(pc_, avg_r_, avg_g_, avg_b_);
+  // compute RGB information and invalidate any old search structures
+  this->resetSearchIndex();
 }
 
 double PCLGraspModel::getAverageRed() const
@@ -86,6 +210,68 @@ double PCLGraspModel::getAverageBlue() const
   return avg_b_;
 }
 
+const geometry_msgs::Point &PCLGraspModel::getCentroid() const
+{
+  return centroid_;
+}
+
+const Eigen::Vector3f &PCLGraspModel::getPrincipalExtents() const
+{
+  return extents_;
+}
+
+const point_cloud_metrics::ColorHistogram &PCLGraspModel::getColorHistogram() const
+{
+  return color_histogram_;
+}
+
+pcl::search::KdTree<pcl::PointXYZRGB>::Ptr PCLGraspModel::getSearchTree() const
+{
+  boost::mutex::scoped_lock lock(index_->mutex);
+  // build the tree on first use
+  if (!index_->search_tree)
+  {
+    index_->search_tree.reset(new pcl::search::KdTree<pcl::PointXYZRGB>);
+    index_->search_tree->setInputCloud(pc_);
+  }
+  return index_->search_tree;
+}
+
+pcl::PointCloud<pcl::Normal>::ConstPtr PCLGraspModel::getNormals() const
+{
+  boost::mutex::scoped_lock lock(index_->mutex);
+  // estimate the normals on first use
+  if (!index_->normals)
+  {
+    index_->normals.reset(new pcl::PointCloud<pcl::Normal>);
+    if (!pc_->empty())
+    {
+      // the estimator uses its own tree so the shared tree is never rebuilt while in use
+      pcl::NormalEstimation<pcl::PointXYZRGB, pcl::Normal> estimator;
+      estimator.setInputCloud(pc_);
+      estimator.setRadiusSearch(NORMAL_SEARCH_RADIUS);
+      estimator.compute(*index_->normals);
+    }
+  }
+  return index_->normals;
+}
+
+void PCLGraspModel::resetSearchIndex()
+{
+  // copies may still be using the old index
+  index_.reset(new SearchIndex);
+
+  // recompute the centroid, colors, and shape and color descriptors in as few passes as possible
+  point_cloud_metrics::PointCloudStatistics statistics;
+  point_cloud_metrics::calculatePointCloudStatistics(pc_, statistics);
+  centroid_ = statistics.centroid;
+  avg_r_ = statistics.avg_r;
+  avg_g_ = statistics.avg_g;
+  avg_b_ = statistics.avg_b;
+  extents_ = point_cloud_metrics::calculatePrincipalExtents(pc_);
+  point_cloud_metrics::calculateColorHistogram(pc_, color_histogram_);
+}
+
 graspdb::GraspModel PCLGraspModel::toGraspModel() const
 {
   // convert the point cloud to a ROS message
@@ -94,5 +280,75 @@ graspdb::GraspModel PCLGraspModel::toGraspModel() const
 
   // convert the basic values
   graspdb::GraspModel grasp_model(this->getID(), this->getObjectName(), this->getGrasps(), msg, this->getCreated());
+
+  // store the statistics so they are not recomputed when the model is loaded
+  vector<uint8_t> features;
+  this->encodeFeatures(features);
+  grasp_model.setFeatures(features);
   return grasp_model;
 }
+
+void PCLGraspModel::encodeFeatures(vector<uint8_t> &features) const
+{
+  features.clear();
+  features.insert(features.end(), FEATURES_MAGIC, FEATURES_MAGIC + sizeof(FEATURES_MAGIC));
+  writeFeature(features, (uint32_t) FEATURES_VERSION);
+  writeFeature(features, FEATURES_BYTE_ORDER);
+  writeFeature(features, (uint32_t) pc_->size());
+  writeFeature(features, (uint32_t) point_cloud_metrics::COLOR_HISTOGRAM_BINS);
+  writeFeature(features, centroid_.x);
+  writeFeature(features, centroid_.y);
+  writeFeature(features, centroid_.z);
+  writeFeature(features, avg_r_);
+  writeFeature(features, avg_g_);
+  writeFeature(features, avg_b_);
+  for (int i = 0; i < 3; i++)
+  {
+    writeFeature(features, extents_[i]);
+  }
+  for (int i = 0; i < point_cloud_metrics::COLOR_HISTOGRAM_BINS; i++)
+  {
+    writeFeature(features, color_histogram_.bins[i]);
+  }
+}
+
+bool PCLGraspModel::decodeFeatures(const vector<uint8_t> &features)
+{
+  // the layout is fixed, so any valid blob is exactly this size
+  const size_t header_size = sizeof(FEATURES_MAGIC) + 4 * sizeof(uint32_t);
+  const size_t num_floats = 3 + point_cloud_metrics::COLOR_HISTOGRAM_BINS;
+  const size_t size = header_size + 6 * sizeof(double) + num_floats * sizeof(float);
+  if (features.size() != size || memcmp(&features[0], FEATURES_MAGIC, sizeof(FEATURES_MAGIC)) != 0)
+  {
+    return false;
+  }
+
+  size_t offset = sizeof(FEATURES_MAGIC);
+  const uint32_t version = readFeature<uint32_t>(features, offset);
+  const uint32_t byte_order = readFeature<uint32_t>(features, offset);
+  const uint32_t num_points = readFeature<uint32_t>(features, offset);
+  const uint32_t num_bins = readFeature<uint32_t>(features, offset);
+  if (version != FEATURES_VERSION || byte_order != FEATURES_BYTE_ORDER || num_points != pc_->size()
+      || num_bins != (uint32_t) point_cloud_metrics::COLOR_HISTOGRAM_BINS)
+  {
+    return false;
+  }
+
+  // copies may still be using the old index
+  index_.reset(new SearchIndex);
+  centroid_.x = readFeature<double>(features, offset);
+  centroid_.y = readFeature<double>(features, offset);
+  centroid_.z = readFeature<double>(features, offset);
+  avg_r_ = readFeature<double>(features, offset);
+  avg_g_ = readFeature<double>(features, offset);
+  avg_b_ = readFeature<double>(features, offset);
+  for (int i = 0; i < 3; i++)
+  {
+    extents_[i] = readFeature<float>(features, offset);
+  }
+  for (int i = 0; i < point_cloud_metrics::COLOR_HISTOGRAM_BINS; i++)
+  {
+    color_histogram_.bins[i] = readFeature<float>(features, offset);
+  }
+  return true;
+}
@@ -16,30 +16,157 @@
 #include <pcl_conversions/pcl_conversions.h>
 
 // PCL
+#include <pcl/common/centroid.h>
 #include <pcl/common/transforms.h>
 #include <pcl/filters/extract_indices.h>
+#include <pcl/filters/voxel_grid.h>
 #include <pcl/kdtree/kdtree_flann.h>
 #include <pcl/registration/icp.h>
 
+// Boost
+#include <boost/bind.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
-void point_cloud_metrics::rosPointCloud2ToPCLPointCloud(const sensor_msgs::PointCloud2 in,
+/*!
+ * Find the offset of a 4 byte field of a point cloud message.
+ *
+ * \param in The point cloud message.
+ * \param name The name of the field.
+ * \param alternate_name An alternate name of the field (or NULL).
+ * \param allow_uint32 If the field may also be of type UINT32 (otherwise only FLOAT32 is accepted).
+ * \return The offset of the field in each point, or -1 if the field does not exist or can not be mapped.
+ */
+static int findFieldOffset(const sensor_msgs::PointCloud2 &in, const char *name, const char *alternate_name,
+    const bool allow_uint32)
+{
+  for (size_t i = 0; i < in.fields.size(); i++)
+  {
+    const sensor_msgs::PointField &field = in.fields[i];
+    if ((field.name == name || (alternate_name != NULL && field.name == alternate_name)) && field.count >= 1
+        && (field.datatype == sensor_msgs::PointField::FLOAT32
+            || (allow_uint32 && field.datatype == sensor_msgs::PointField::UINT32))
+        && field.offset + sizeof(float) <= in.point_step)
+    {
+      return (int) field.offset;
+    }
+  }
+  return -1;
+}
+
+void point_cloud_metrics::rosPointCloud2ToPCLPointCloud(const sensor_msgs::PointCloud2 &in,
     const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &out)
 {
-  pcl::PCLPointCloud2 converter;
-  pcl_conversions::toPCL(in, converter);
-  pcl::fromPCLPointCloud2(converter, *out);
+  // map the fields directly onto the PCL point layout
+  const int x = findFieldOffset(in, "x", NULL, false);
+  const int y = findFieldOffset(in, "y", NULL, false);
+  const int z = findFieldOffset(in, "z", NULL, false);
+  const int rgb = findFieldOffset(in, "rgb", "rgba", true);
+  const size_t num_points = (size_t) in.width * in.height;
+  const bool mappable = x >= 0 && y >= 0 && z >= 0 && !in.is_bigendian
+      && (size_t) in.row_step >= (size_t) in.width * in.point_step
+      && in.data.size() >= (size_t) in.row_step * in.height;
+  if (!mappable)
+  {
+    // anything unusual goes through the generic PCL conversion
+    pcl::PCLPointCloud2 converter;
+    pcl_conversions::toPCL(in, converter);
+    pcl::fromPCLPointCloud2(converter, *out);
+    return;
+  }
+
+  pcl_conversions::toPCL(in.header, out->header);
+  out->width = in.width;
+  out->height = in.height;
+  out->is_dense = (in.is_dense != 0);
+  out->points.resize(num_points);
+  if (num_points == 0)
+  {
+    return;
+  }
+
+  const pcl::PointXYZRGB default_point;
+  const int pcl_rgb = (int) ((const uint8_t *) &default_point.rgba - (const uint8_t *) &default_point);
+  if (in.point_step == sizeof(pcl::PointXYZRGB) && x == 0 && y == sizeof(float) && z == 2 * sizeof(float)
+      && rgb == pcl_rgb && in.row_step == in.width * in.point_step)
+  {
+    // the message already uses the PCL layout (e.g., it was created by PCL), so copy it in one pass
+    memcpy(&out->points[0], &in.data[0], num_points * sizeof(pcl::PointXYZRGB));
+    for (size_t i = 0; i < num_points; i++)
+    {
+      // the padding after z is not part of the message
+      out->points[i].data[3] = 1.0f;
+    }
+  } else
+  {
+    // copy each mapped field (e.g., from a packed message)
+    size_t index = 0;
+    for (uint32_t row = 0; row < in.height; row++)
+    {
+      const uint8_t *point = &in.data[row * in.row_step];
+      for (uint32_t col = 0; col < in.width; col++, index++, point += in.point_step)
+      {
+        pcl::PointXYZRGB &p = out->points[index];
+        p = default_point;
+        memcpy(&p.x, point + x, sizeof(float));
+        memcpy(&p.y, point + y, sizeof(float));
+        memcpy(&p.z, point + z, sizeof(float));
+        if (rgb >= 0)
+        {
+          memcpy(&p.rgba, point + rgb, sizeof(uint32_t));
+        }
+      }
+    }
+  }
 }
 
 void point_cloud_metrics::pclPointCloudToROSPointCloud2(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &in,
     sensor_msgs::PointCloud2 &out)
 {
-  // convert to PCL PointCloud2
-  pcl::PCLPointCloud2 converter;
-  pcl::toPCLPointCloud2(*in, converter);
-  // convert to ROS message
-  pcl_conversions::fromPCL(converter, out);
+  // the same fields and layout PCL uses for PointXYZRGB
+  const pcl::PointXYZRGB default_point;
+  const uint32_t pcl_rgb = (uint32_t) ((const uint8_t *) &default_point.rgba - (const uint8_t *) &default_point);
+  const char *names[] = {"x", "y", "z", "rgb"};
+  const uint32_t offsets[] = {0, sizeof(float), 2 * sizeof(float), pcl_rgb};
+  out.fields.resize(4);
+  for (size_t i = 0; i < out.fields.size(); i++)
+  {
+    out.fields[i].name = names[i];
+    out.fields[i].offset = offsets[i];
+    out.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+    out.fields[i].count = 1;
+  }
+
+  pcl_conversions::fromPCL(in->header, out.header);
+  const size_t num_points = in->points.size();
+  if ((size_t) in->width * in->height == num_points)
+  {
+    out.width = in->width;
+    out.height = in->height;
+  } else
+  {
+    out.width = num_points;
+    out.height = 1;
+  }
+  out.is_bigendian = false;
+  out.is_dense = in->is_dense;
+  out.point_step = sizeof(pcl::PointXYZRGB);
+  out.row_step = out.point_step * out.width;
+
+  // a single copy of the points
+  out.data.resize(num_points * sizeof(pcl::PointXYZRGB));
+  if (num_points > 0)
+  {
+    memcpy(&out.data[0], &in->points[0], out.data.size());
+  }
 }
 
 void point_cloud_metrics::transformToOrigin(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
@@ -89,22 +216,91 @@ void point_cloud_metrics::transformToOrigin(const pcl::PointCloud<pcl::PointXYZR
   point_cloud_metrics::transformToOrigin(pc, grasps, centroid);
 }
 
+/*!
+ * \struct OutlierSearch
+ * \brief The state shared by the tasks of a parallel outlier search.
+ */
+struct OutlierSearch
+{
+  /*! The search tree over the point cloud. */
+  const pcl::KdTreeFLANN<pcl::PointXYZRGB> *search_tree;
+  /*! The point cloud being filtered. */
+  const pcl::PointCloud<pcl::PointXYZRGB> *pc;
+  /*! The search radius and the minimum number of neighbors to keep a point. */
+  double search_radius, min_num_neighbors;
+  /*! The number of points searched by each task. */
+  size_t chunk_size;
+  /*! The search result buffers for each thread. */
+  vector<vector<int> > indices;
+  /*! The search result distance buffers for each thread. */
+  vector<vector<float> > distances;
+  /*! The keep flag of each point (bytes so tasks never share a word). */
+  vector<char> keep;
+};
+
+/*!
+ * Check a chunk of the points of a parallel outlier search.
+ *
+ * \param chunk The index of the chunk of points to check.
+ * \param thread The index of the thread running the task.
+ * \param search The shared search state.
+ */
+static void outlierSearchTask(const size_t chunk, const size_t thread, OutlierSearch &search)
+{
+  const size_t start = chunk * search.chunk_size;
+  const size_t end = min(start + search.chunk_size, search.pc->size());
+  for (size_t i = start; i < end; i++)
+  {
+    // check how many neighbors pass the test
+    int neighbors = search.search_tree->radiusSearch(search.pc->points[i], search.search_radius,
+                                                     search.indices[thread], search.distances[thread]);
+    search.keep[i] = (neighbors >= search.min_num_neighbors);
+  }
+}
+
 void point_cloud_metrics::filterPointCloudOutliers(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
     const double filter_outlier_search_radius, const double filter_outlier_min_num_neighbors)
 {
+  // a single thread pool runs everything in the calling thread
+  ThreadPool serial;
+  point_cloud_metrics::filterPointCloudOutliers(serial, pc, filter_outlier_search_radius,
+                                                filter_outlier_min_num_neighbors);
+}
+
+void point_cloud_metrics::filterPointCloudOutliers(ThreadPool &thread_pool,
+    const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc, const double filter_outlier_search_radius,
+    const double filter_outlier_min_num_neighbors)
+{
+  if (pc->empty())
+  {
+    return;
+  }
+
   // use a KD tree to search
   pcl::KdTreeFLANN<pcl::PointXYZRGB> search_tree;
   search_tree.setInputCloud(pc);
-  vector<int> indices;
-  vector<float> distances;
+
+  // split the points into a few chunks per thread to balance the load
+  const size_t num_threads = thread_pool.getNumThreads();
+  const size_t num_chunks = min(pc->size(), num_threads * 4);
+  OutlierSearch search;
+  search.search_tree = &search_tree;
+  search.pc = pc.get();
+  search.search_radius = filter_outlier_search_radius;
+  search.min_num_neighbors = filter_outlier_min_num_neighbors;
+  search.chunk_size = (pc->size() + num_chunks - 1) / num_chunks;
+  search.indices.resize(num_threads);
+  search.distances.resize(num_threads);
+  search.keep.resize(pc->size(), false);
 
   // check each point
+  thread_pool.run(num_chunks, boost::bind(&outlierSearchTask, _1, _2, boost::ref(search)));
+
+  // compact the points we wish to keep in their original order
   pcl::IndicesPtr to_keep(new vector<int>);
-  for (size_t i = 0; i < pc->size(); i++)
+  for (size_t i = 0; i < search.keep.size(); i++)
   {
-    // check how many neighbors pass the test
-    int neighbors = search_tree.radiusSearch(pc->at(i), filter_outlier_search_radius, indices, distances);
-    if (neighbors >= filter_outlier_min_num_neighbors)
+    if (search.keep[i])
     {
       to_keep->push_back(i);
     }
@@ -117,30 +313,88 @@ void point_cloud_metrics::filterPointCloudOutliers(const pcl::PointCloud<pcl::Po
   extract.filter(*pc);
 }
 
-void point_cloud_metrics::filterRedundantPoints(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
+size_t point_cloud_metrics::filterRedundantPoints(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
     const double filter_redundant_search_radius)
 {
   // non-empty clouds only
-  if (pc->size() > 0)
+  if (pc->empty())
   {
-    // use a KD tree to search
-    pcl::KdTreeFLANN<pcl::PointXYZRGB> search_tree;
-    search_tree.setInputCloud(pc);
+    return 0;
+  }
 
-    // use int to prevent overflow
-    for (int i = ((int) pc->size()) - 1; i >= 0; i--)
+  // use a KD tree to search
+  pcl::KdTreeFLANN<pcl::PointXYZRGB> search_tree;
+  search_tree.setInputCloud(pc);
+  vector<int> indices;
+  vector<float> distances;
+
+  // each kept point marks its neighbors (which includes the point itself) as redundant
+  vector<bool> redundant(pc->size(), false);
+  pcl::IndicesPtr to_keep(new vector<int>);
+  for (size_t i = 0; i < pc->size(); i++)
+  {
+    if (!redundant[i])
     {
-      // see if the number of neighbors is non-empty (includes the point itself)
-      vector<int> indices;
-      vector<float> distances;
-      int neighbors = search_tree.radiusSearch(pc->at(i), filter_redundant_search_radius, indices, distances);
-      if (neighbors >= 2)
+      to_keep->push_back(i);
+      search_tree.radiusSearch(pc->at(i), filter_redundant_search_radius, indices, distances);
+      for (size_t j = 0; j < indices.size(); j++)
       {
-        // remove this point
-        pc->erase(pc->begin() + i);
+        redundant[indices[j]] = true;
       }
     }
   }
+
+  // extract the points we wish to keep in one pass
+  const size_t removed = pc->size() - to_keep->size();
+  if (removed > 0)
+  {
+    pcl::ExtractIndices<pcl::PointXYZRGB> extract;
+    extract.setInputCloud(pc);
+    extract.setIndices(to_keep);
+    extract.filter(*pc);
+  }
+  return removed;
+}
+
+size_t point_cloud_metrics::limitPointCloudSize(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &pc,
+    const size_t max_points, const double min_leaf_size)
+{
+  const size_t original = pc->size();
+  if (max_points == 0 || original <= max_points)
+  {
+    return 0;
+  }
+
+  // every pass resamples the original points
+  pcl::PointCloud<pcl::PointXYZRGB>::Ptr input(new pcl::PointCloud<pcl::PointXYZRGB>);
+  input->swap(*pc);
+  pcl::VoxelGrid<pcl::PointXYZRGB> grid;
+  grid.setInputCloud(input);
+  double leaf = max(min_leaf_size, 1e-6) * sqrt((double) original / (double) max_points);
+  for (int i = 0; i < POINT_BUDGET_MAX_PASSES; i++)
+  {
+    grid.setLeafSize((float) leaf, (float) leaf, (float) leaf);
+    grid.filter(*pc);
+    if (pc->size() <= max_points)
+    {
+      break;
+    }
+    leaf *= max(sqrt((double) pc->size() / (double) max_points), 1.05);
+  }
+
+  // keep evenly spaced points if the voxel grid could not meet the budget
+  if (pc->size() > max_points)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB> sampled;
+    sampled.header = pc->header;
+    sampled.reserve(max_points);
+    for (size_t i = 0; i < max_points; i++)
+    {
+      sampled.push_back(pc->points[i * pc->size() / max_points]);
+    }
+    pc->swap(sampled);
+  }
+  return original - pc->size();
 }
 
 geometry_msgs::Point point_cloud_metrics::computeCentroid(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc)
@@ -156,24 +410,310 @@ geometry_msgs::Point point_cloud_metrics::computeCentroid(const pcl::PointCloud<
   return ros_centroid;
 }
 
+Eigen::Vector3f point_cloud_metrics::calculatePrincipalExtents(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc)
+{
+  Eigen::Vector3f extents = Eigen::Vector3f::Zero();
+  if (pc->empty())
+  {
+    return extents;
+  }
+
+  // find the principal axes
+  Eigen::Matrix3f covariance;
+  Eigen::Vector4f centroid;
+  pcl::computeMeanAndCovarianceMatrix(*pc, covariance, centroid);
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+  const Eigen::Matrix3f axes_t = solver.eigenvectors().transpose();
+
+  // project each point onto the axes
+  Eigen::Vector3f min_projection = Eigen::Vector3f::Constant(numeric_limits<float>::max());
+  Eigen::Vector3f max_projection = Eigen::Vector3f::Constant(-numeric_limits<float>::max());
+  for (size_t i = 0; i < pc->size(); i++)
+  {
+    const Eigen::Vector3f projection = axes_t * (pc->points[i].getVector3fMap() - centroid.head<3>());
+    min_projection = min_projection.cwiseMin(projection);
+    max_projection = max_projection.cwiseMax(projection);
+  }
+
+  // sort from largest to smallest
+  extents = max_projection - min_projection;
+  sort(extents.data(), extents.data() + 3, greater<float>());
+  return extents;
+}
+
 double point_cloud_metrics::calculateRegistrationMetricDistanceError(
     const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &base, const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target)
 {
   // search using a KD tree
-  pcl::KdTreeFLANN<pcl::PointXYZRGB> search_tree;
+  pcl::search::KdTree<pcl::PointXYZRGB> search_tree;
   search_tree.setInputCloud(base);
+  return point_cloud_metrics::calculateRegistrationMetricDistanceError(search_tree, target);
+}
 
+double point_cloud_metrics::calculateRegistrationMetricDistanceError(
+    const pcl::search::KdTree<pcl::PointXYZRGB> &base_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target)
+{
+  // an infinite bound never stops early
+  MetricWorkspace workspace;
+  double score;
+  point_cloud_metrics::calculateBoundedRegistrationMetricDistanceError(base_search_tree, target,
+                                                                       numeric_limits<double>::infinity(), workspace,
+                                                                       score);
+  return score;
+}
+
+bool point_cloud_metrics::calculateBoundedRegistrationMetricDistanceError(
+    const pcl::search::KdTree<pcl::PointXYZRGB> &base_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target, const double max_distance_error,
+    MetricWorkspace &workspace, double &distance_error)
+{
   // search for the nearest point to each point
   double score = 0;
   for (size_t i = 0; i < target->size(); i++)
   {
-    vector<int> indices;
-    vector<float> distances;
-    search_tree.nearestKSearch(target->at(i), 1, indices, distances);
-    score += (double) distances[0];
+    base_search_tree.nearestKSearch(target->at(i), 1, workspace.indices, workspace.distances);
+    score += (double) workspace.distances[0];
+
+    // the sum can only grow, so stop once the bound is passed
+    if (score > max_distance_error)
+    {
+      distance_error = score;
+      return false;
+    }
   }
 
-  return score;
+  distance_error = score;
+  return true;
+}
+
+/*!
+ * Compute the variance from exact integer sums.
+ *
+ * \param sum The sum of the values.
+ * \param sum_of_squares The sum of the squared values.
+ * \param n The number of values.
+ * \return The variance of the values.
+ */
+static double varianceFromSums(const uint64_t sum, const uint64_t sum_of_squares, const uint64_t n)
+{
+  // n * sum_of_squares stays within 64 bits for up to 16 million 8-bit values, so the numerator is exact
+  if (n <= 16000000)
+  {
+    return (double) (n * sum_of_squares - sum * sum) / ((double) n * (double) n);
+  } else
+  {
+    double mean = (double) sum / (double) n;
+    return max(0.0, (double) sum_of_squares / (double) n - mean * mean);
+  }
+}
+
+point_cloud_metrics::PointCloudStatistics::PointCloudStatistics()
+{
+  avg_r = 0;
+  avg_g = 0;
+  avg_b = 0;
+  std_dev_r = 0;
+  std_dev_g = 0;
+  std_dev_b = 0;
+}
+
+point_cloud_metrics::RegistrationMetrics::RegistrationMetrics()
+{
+  overlap = 0;
+  color_error = 0;
+  distance_error = 0;
+}
+
+void point_cloud_metrics::calculatePointCloudStatistics(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc,
+    PointCloudStatistics &statistics)
+{
+  statistics = PointCloudStatistics();
+  const size_t n = pc->size();
+  if (n == 0)
+  {
+    return;
+  }
+
+  // integer color sums are exact and the loop is branch free for dense clouds
+  uint64_t sum_r = 0, sum_g = 0, sum_b = 0;
+  uint64_t sum_rr = 0, sum_gg = 0, sum_bb = 0;
+  double sum_x = 0, sum_y = 0, sum_z = 0;
+  size_t num_finite = 0;
+  const bool dense = pc->is_dense;
+  const pcl::PointXYZRGB *points = &pc->points[0];
+  for (size_t i = 0; i < n; i++)
+  {
+    const pcl::PointXYZRGB &point = points[i];
+
+    // unpack the colors from a single load
+    const uint32_t rgba = point.rgba;
+    const uint32_t r = (rgba >> 16) & 0xff;
+    const uint32_t g = (rgba >> 8) & 0xff;
+    const uint32_t b = rgba & 0xff;
+    sum_r += r;
+    sum_g += g;
+    sum_b += b;
+    sum_rr += r * r;
+    sum_gg += g * g;
+    sum_bb += b * b;
+
+    // accumulate the centroid
+    if (dense || (pcl_isfinite(point.x) && pcl_isfinite(point.y) && pcl_isfinite(point.z)))
+    {
+      sum_x += point.x;
+      sum_y += point.y;
+      sum_z += point.z;
+      num_finite++;
+    }
+  }
+
+  // compute the final values
+  if (num_finite > 0)
+  {
+    statistics.centroid.x = sum_x / (double) num_finite;
+    statistics.centroid.y = sum_y / (double) num_finite;
+    statistics.centroid.z = sum_z / (double) num_finite;
+  }
+  statistics.avg_r = (double) sum_r / (double) n;
+  statistics.avg_g = (double) sum_g / (double) n;
+  statistics.avg_b = (double) sum_b / (double) n;
+  statistics.std_dev_r = sqrt(varianceFromSums(sum_r, sum_rr, n));
+  statistics.std_dev_g = sqrt(varianceFromSums(sum_g, sum_gg, n));
+  statistics.std_dev_b = sqrt(varianceFromSums(sum_b, sum_bb, n));
+}
+
+point_cloud_metrics::ColorHistogram::ColorHistogram()
+{
+  fill(bins, bins + COLOR_HISTOGRAM_BINS, 0.0f);
+}
+
+/*!
+ * Find the color histogram bin of an RGB color.
+ *
+ * \param r The red value.
+ * \param g The green value.
+ * \param b The blue value.
+ * \return The index of the bin.
+ */
+static int colorHistogramBin(const int r, const int g, const int b)
+{
+  const int max_value = max(r, max(g, b));
+  const int min_value = min(r, min(g, b));
+  const double value = (double) max_value / 255.0;
+  const double saturation = (max_value == 0) ? 0.0 : (double) (max_value - min_value) / (double) max_value;
+
+  // dark and unsaturated points are binned by value alone
+  if (saturation < point_cloud_metrics::COLOR_HISTOGRAM_MIN_CHROMA
+      || value < point_cloud_metrics::COLOR_HISTOGRAM_MIN_CHROMA)
+  {
+    const int gray = min((int) (value * point_cloud_metrics::COLOR_HISTOGRAM_GRAY_BINS),
+                         point_cloud_metrics::COLOR_HISTOGRAM_GRAY_BINS - 1);
+    return point_cloud_metrics::COLOR_HISTOGRAM_HUE_BINS * 4 + gray;
+  }
+
+  // hue in [0, 6)
+  const double delta = (double) (max_value - min_value);
+  double hue;
+  if (max_value == r)
+  {
+    hue = (double) (g - b) / delta;
+    if (hue < 0)
+    {
+      hue += 6.0;
+    }
+  } else if (max_value == g)
+  {
+    hue = (double) (b - r) / delta + 2.0;
+  } else
+  {
+    hue = (double) (r - g) / delta + 4.0;
+  }
+  const int hue_bin = min((int) (hue * point_cloud_metrics::COLOR_HISTOGRAM_HUE_BINS / 6.0),
+                          point_cloud_metrics::COLOR_HISTOGRAM_HUE_BINS - 1);
+  const int saturation_bin = (saturation >= 0.6) ? 1 : 0;
+  const int value_bin = (value >= 0.6) ? 1 : 0;
+  return (hue_bin * 2 + saturation_bin) * 2 + value_bin;
+}
+
+void point_cloud_metrics::calculateColorHistogram(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc,
+    ColorHistogram &histogram)
+{
+  // count with integers so the fractions are exact up to the final division
+  vector<uint32_t> counts(COLOR_HISTOGRAM_BINS, 0);
+  for (size_t i = 0; i < pc->size(); i++)
+  {
+    const pcl::PointXYZRGB &point = pc->points[i];
+    counts[colorHistogramBin(point.r, point.g, point.b)]++;
+  }
+
+  const float scale = pc->empty() ? 0.0f : 1.0f / (float) pc->size();
+  for (int i = 0; i < COLOR_HISTOGRAM_BINS; i++)
+  {
+    histogram.bins[i] = (float) counts[i] * scale;
+  }
+}
+
+float point_cloud_metrics::calculateColorHistogramDistance(const ColorHistogram &a, const ColorHistogram &b)
+{
+  float distance = 0;
+  for (int i = 0; i < COLOR_HISTOGRAM_BINS; i++)
+  {
+    distance += fabs(a.bins[i] - b.bins[i]);
+  }
+  return 0.5f * distance;
+}
+
+double point_cloud_metrics::calculateAvgColorDistance(const pcl::PointXYZRGB &point,
+    const pcl::PointCloud<pcl::PointXYZRGB> &pc, const vector<int> &indices, ColorDistanceScratch &scratch)
+{
+  const size_t n = indices.size();
+  if (n == 0)
+  {
+    return 0;
+  }
+
+  // buffers only grow
+  if (scratch.distances.size() < n)
+  {
+    scratch.r.resize(n);
+    scratch.g.resize(n);
+    scratch.b.resize(n);
+    scratch.distances.resize(n);
+  }
+  int *r = &scratch.r[0];
+  int *g = &scratch.g[0];
+  int *b = &scratch.b[0];
+  double *d = &scratch.distances[0];
+
+  // gather the neighbor colors into separate arrays
+  for (size_t j = 0; j < n; j++)
+  {
+    const pcl::PointXYZRGB &neighbor = pc.points[indices[j]];
+    r[j] = neighbor.r;
+    g[j] = neighbor.g;
+    b[j] = neighbor.b;
+  }
+
+  // squared distances are exact integers, so this matches the scalar calculation
+  const int point_r = point.r;
+  const int point_g = point.g;
+  const int point_b = point.b;
+  for (size_t j = 0; j < n; j++)
+  {
+    const int dr = r[j] - point_r;
+    const int dg = g[j] - point_g;
+    const int db = b[j] - point_b;
+    d[j] = sqrt((double) (dr * dr + dg * dg + db * db));
+  }
+
+  // sum in neighbor order
+  double sum = 0;
+  for (size_t j = 0; j < n; j++)
+  {
+    sum += d[j];
+  }
+  return sum / (double) n;
 }
 
 void point_cloud_metrics::calculateAvgColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc, double &avg_r,
@@ -197,16 +737,18 @@ void point_cloud_metrics::calculateAvgColors(const pcl::PointCloud<pcl::PointXYZ
   avg_b /= (double) pc->size();
 }
 
-double point_cloud_metrics::calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc,
+void point_cloud_metrics::calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc,
     double &std_dev_r, double &std_dev_g, double &std_dev_b)
 {
-  // calculate the averages first
-  double avg_r, avg_g, avg_b;
-  point_cloud_metrics::calculateAvgColors(pc, avg_r, avg_g, avg_b);
-  point_cloud_metrics::calculateStdDevColors(pc, std_dev_r, std_dev_g, std_dev_b, avg_r, avg_g, avg_b);
+  // a single pass computes the averages and deviations together
+  PointCloudStatistics statistics;
+  point_cloud_metrics::calculatePointCloudStatistics(pc, statistics);
+  std_dev_r = statistics.std_dev_r;
+  std_dev_g = statistics.std_dev_g;
+  std_dev_b = statistics.std_dev_b;
 }
 
-double point_cloud_metrics::calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc,
+void point_cloud_metrics::calculateStdDevColors(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc,
     double &std_dev_r, double &std_dev_g, double &std_dev_b, const double avg_r, const double avg_g, const double avg_b)
 {
   double variance_r = 0;
@@ -215,9 +757,12 @@ double point_cloud_metrics::calculateStdDevColors(const pcl::PointCloud<pcl::Poi
   for (size_t i = 0; i < pc->size(); i++)
   {
     const pcl::PointXYZRGB &point = pc->at(i);
-    variance_r += pow(point.r - avg_r, 2);
-    variance_g += pow(point.g - avg_r, 2);
-    variance_b += pow(point.b - avg_r, 2);
+    double dr = point.r - avg_r;
+    double dg = point.g - avg_g;
+    double db = point.b - avg_b;
+    variance_r += dr * dr;
+    variance_g += dg * dg;
+    variance_b += db * db;
   }
   variance_r /= (double) pc->size();
   variance_g /= (double) pc->size();
@@ -233,8 +778,29 @@ void point_cloud_metrics::calculateRegistrationMetricOverlap(const pcl::PointClo
     const double metric_overlap_search_radius)
 {
   // search with a KD tree
-  pcl::KdTreeFLANN<pcl::PointXYZRGB> search_tree;
+  pcl::search::KdTree<pcl::PointXYZRGB> search_tree;
   search_tree.setInputCloud(base);
+  point_cloud_metrics::calculateRegistrationMetricOverlap(search_tree, target, overlap, color_error,
+                                                          metric_overlap_search_radius);
+}
+
+void point_cloud_metrics::calculateRegistrationMetricOverlap(
+    const pcl::search::KdTree<pcl::PointXYZRGB> &base_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target, double &overlap, double &color_error,
+    const double metric_overlap_search_radius)
+{
+  // a minimum of 0 never stops early
+  MetricWorkspace workspace;
+  point_cloud_metrics::calculateBoundedRegistrationMetricOverlap(base_search_tree, target, 0, workspace, overlap,
+                                                                 color_error, metric_overlap_search_radius);
+}
+
+bool point_cloud_metrics::calculateBoundedRegistrationMetricOverlap(
+    const pcl::search::KdTree<pcl::PointXYZRGB> &base_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target, const double min_overlap, MetricWorkspace &workspace,
+    double &overlap, double &color_error, const double metric_overlap_search_radius)
+{
+  const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &base = base_search_tree.getInputCloud();
 
   // search each point
   double score = 0;
@@ -242,58 +808,276 @@ void point_cloud_metrics::calculateRegistrationMetricOverlap(const pcl::PointClo
   for (size_t i = 0; i < target->size(); i++)
   {
     // get the current point
-    vector<int> indices;
-    vector<float> distances;
     const pcl::PointXYZRGB &search_point = target->at(i);
     // perform a radius search to see how many neighbors are found
-    int neighbors = search_tree.radiusSearch(search_point, metric_overlap_search_radius, indices, distances);
+    int neighbors = base_search_tree.radiusSearch(search_point, metric_overlap_search_radius, workspace.indices,
+                                                  workspace.distances);
     // check if there are enough neighbors
     if (neighbors > 0)
     {
       score++;
       // check the average RGB color distance
-      double rgb_distance = 0;
-      for (size_t j = 0; j < indices.size(); j++)
+      error += point_cloud_metrics::calculateAvgColorDistance(search_point, *base, workspace.indices,
+                                                              workspace.color_scratch);
+    } else
+    {
+      // stop once the remaining points can no longer reach the minimum
+      double best_overlap = (score + (double) (target->size() - i - 1)) / (double) target->size();
+      if (best_overlap < min_overlap)
       {
-        const pcl::PointXYZRGB &point = base->at(indices[j]);
-        rgb_distance += sqrt(pow(search_point.r - point.r, 2) + pow(search_point.g - point.g, 2) +
-                             pow(search_point.b - point.b, 2));
+        overlap = best_overlap;
+        color_error = numeric_limits<double>::infinity();
+        return false;
       }
-      // normalize the distance
-      rgb_distance /= neighbors;
-      error += rgb_distance;
     }
   }
 
   // normalize the errors
   color_error = error / score;
   overlap = score / (double) target->size();
+  return true;
 }
 
 bool point_cloud_metrics::classifyMerge(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &base,
     const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target)
 {
   // calculate the metrics we need
-  double overlap, color_error;
-  point_cloud_metrics::calculateRegistrationMetricOverlap(base, target, overlap, color_error);
+  point_cloud_metrics::RegistrationMetrics metrics;
+  point_cloud_metrics::calculateRegistrationMetricOverlap(base, target, metrics.overlap, metrics.color_error);
+  return point_cloud_metrics::classifyMerge(metrics);
+}
 
+bool point_cloud_metrics::classifyMerge(const RegistrationMetrics &metrics)
+{
   // values found via decision tree training
-  return (overlap > 0.471303) && (color_error <= 97.0674);
+  return (metrics.overlap > DEFAULT_MERGE_MIN_OVERLAP) && (metrics.color_error <= DEFAULT_MERGE_MAX_COLOR_ERROR);
+}
+
+/*!
+ * Apply the termination criteria to the given ICP object.
+ *
+ * \param parameters The ICP parameters.
+ * \param icp The ICP object to configure.
+ */
+static void configureICP(const point_cloud_metrics::ICPParameters &parameters,
+    pcl::IterativeClosestPoint<pcl::PointXYZRGB, pcl::PointXYZRGB> &icp)
+{
+  icp.setMaximumIterations(parameters.max_iterations);
+  icp.setMaxCorrespondenceDistance(parameters.max_correspondence_distance);
+  icp.setTransformationEpsilon(parameters.transformation_epsilon);
+  icp.setEuclideanFitnessEpsilon(parameters.euclidean_fitness_epsilon);
+}
+
+/*!
+ * Run ICP on each coarse voxel level and return the resulting initial guess for the full resolution pass.
+ *
+ * \param target The target point cloud.
+ * \param source The source point cloud.
+ * \param parameters The ICP parameters.
+ * \param initial_guess The initial guess for the coarsest level.
+ * \return The initial guess for the full resolution pass (the initial guess if there are no coarse levels).
+ */
+static Eigen::Matrix4f coarseAlignment(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &source, const point_cloud_metrics::ICPParameters &parameters,
+    const Eigen::Matrix4f &initial_guess)
+{
+  Eigen::Matrix4f guess = initial_guess;
+  for (size_t i = 0; i < parameters.voxel_sizes.size(); i++)
+  {
+    const float leaf = (float) parameters.voxel_sizes[i];
+    if (leaf <= 0)
+    {
+      continue;
+    }
+
+    // downsample both point clouds
+    pcl::VoxelGrid<pcl::PointXYZRGB> grid;
+    grid.setLeafSize(leaf, leaf, leaf);
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr coarse_target(new pcl::PointCloud<pcl::PointXYZRGB>);
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr coarse_source(new pcl::PointCloud<pcl::PointXYZRGB>);
+    grid.setInputCloud(target);
+    grid.filter(*coarse_target);
+    grid.setInputCloud(source);
+    grid.filter(*coarse_source);
+    if (coarse_target->empty() || coarse_source->empty())
+    {
+      continue;
+    }
+
+    // refine the guess at this level
+    pcl::IterativeClosestPoint<pcl::PointXYZRGB, pcl::PointXYZRGB> icp;
+    configureICP(parameters, icp);
+    icp.setInputSource(coarse_source);
+    icp.setInputTarget(coarse_target);
+    pcl::PointCloud<pcl::PointXYZRGB> aligned;
+    icp.align(aligned, guess);
+    if (icp.hasConverged())
+    {
+      guess = icp.getFinalTransformation();
+    }
+  }
+
+  return guess;
+}
+
+point_cloud_metrics::ICPParameters::ICPParameters()
+{
+  // PCL defaults
+  max_iterations = 10;
+  max_correspondence_distance = sqrt(numeric_limits<double>::max());
+  transformation_epsilon = 0;
+  euclidean_fitness_epsilon = -numeric_limits<double>::max();
+  principal_axis_initialization = false;
+}
+
+void point_cloud_metrics::loadICPParameters(const ros::NodeHandle &node, ICPParameters &parameters)
+{
+  node.getParam("icp_voxel_sizes", parameters.voxel_sizes);
+  node.getParam("icp_max_iterations", parameters.max_iterations);
+  node.getParam("icp_max_correspondence_distance", parameters.max_correspondence_distance);
+  node.getParam("icp_transformation_epsilon", parameters.transformation_epsilon);
+  node.getParam("icp_euclidean_fitness_epsilon", parameters.euclidean_fitness_epsilon);
+  node.getParam("icp_principal_axis_initialization", parameters.principal_axis_initialization);
 }
 
 tf2::Transform point_cloud_metrics::performICP(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target,
-    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &source, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &result)
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &source, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &result,
+    const ICPParameters &parameters)
 {
+  // seed with the principal axes and align the coarse levels first
+  Eigen::Matrix4f guess = Eigen::Matrix4f::Identity();
+  if (parameters.principal_axis_initialization)
+  {
+    pcl::search::KdTree<pcl::PointXYZRGB> search_tree;
+    search_tree.setInputCloud(target);
+    guess = point_cloud_metrics::selectPrincipalAxisAlignment(search_tree, source);
+  }
+  guess = coarseAlignment(target, source, parameters, guess);
+
   // set the ICP point clouds
   pcl::IterativeClosestPoint<pcl::PointXYZRGB, pcl::PointXYZRGB> icp;
+  configureICP(parameters, icp);
   icp.setInputSource(source);
   icp.setInputTarget(target);
   // run the alignment
-  icp.align(*result);
+  icp.align(*result, guess);
+
+  return point_cloud_metrics::icpToTF2Transform(icp.getFinalTransformation());
+}
+
+tf2::Transform point_cloud_metrics::performICP(const pcl::search::KdTree<pcl::PointXYZRGB>::Ptr &target_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &source, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &result,
+    const ICPParameters &parameters)
+{
+  // seed with the principal axes and align the coarse levels first
+  Eigen::Matrix4f guess = Eigen::Matrix4f::Identity();
+  if (parameters.principal_axis_initialization)
+  {
+    guess = point_cloud_metrics::selectPrincipalAxisAlignment(*target_search_tree, source);
+  }
+  guess = coarseAlignment(target_search_tree->getInputCloud(), source, parameters, guess);
+
+  // set the ICP point clouds
+  pcl::IterativeClosestPoint<pcl::PointXYZRGB, pcl::PointXYZRGB> icp;
+  configureICP(parameters, icp);
+  icp.setInputSource(source);
+  icp.setInputTarget(target_search_tree->getInputCloud());
+#if PCL_VERSION_COMPARE(>=, 1, 7, 2)
+  // reuse the existing tree without rebuilding it
+  icp.setSearchMethodTarget(target_search_tree, true);
+#endif
+  // run the alignment
+  icp.align(*result, guess);
+
+  return point_cloud_metrics::icpToTF2Transform(icp.getFinalTransformation());
+}
 
-  // get the resulting transform
-  Eigen::Matrix4f transform = icp.getFinalTransformation();
+void point_cloud_metrics::calculatePrincipalAxes(const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &pc,
+    Eigen::Matrix3f &axes, Eigen::Vector3f &centroid)
+{
+  Eigen::Matrix3f covariance;
+  Eigen::Vector4f mean;
+  pcl::computeMeanAndCovarianceMatrix(*pc, covariance, mean);
+  centroid = mean.head<3>();
+
+  // eigenvalues are in ascending order
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+  const Eigen::Matrix3f &eigenvectors = solver.eigenvectors();
+  axes.col(0) = eigenvectors.col(2);
+  axes.col(1) = eigenvectors.col(1);
+  axes.col(2) = axes.col(0).cross(axes.col(1));
+}
 
+/*!
+ * Score an initial alignment by the mean squared nearest distance of a sample of the source points.
+ *
+ * \param target_search_tree The search tree over the target point cloud.
+ * \param source The source point cloud.
+ * \param transform The initial alignment of the source.
+ * \param indices The search index buffer.
+ * \param distances The search distance buffer.
+ * \return The mean squared nearest distance of the sampled points.
+ */
+static double scoreAlignment(const pcl::search::KdTree<pcl::PointXYZRGB> &target_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB> &source, const Eigen::Matrix4f &transform, vector<int> &indices,
+    vector<float> &distances)
+{
+  const size_t step = max(source.size() / (size_t) point_cloud_metrics::PRINCIPAL_AXIS_HYPOTHESIS_SAMPLES,
+                          (size_t) 1);
+  double error = 0;
+  size_t samples = 0;
+  pcl::PointXYZRGB query;
+  for (size_t i = 0; i < source.size(); i += step, samples++)
+  {
+    query.getVector3fMap() = transform.topLeftCorner<3, 3>() * source.points[i].getVector3fMap()
+        + transform.topRightCorner<3, 1>();
+    target_search_tree.nearestKSearch(query, 1, indices, distances);
+    error += distances.empty() ? numeric_limits<double>::infinity() : (double) distances[0];
+  }
+  return error / (double) samples;
+}
+
+Eigen::Matrix4f point_cloud_metrics::selectPrincipalAxisAlignment(
+    const pcl::search::KdTree<pcl::PointXYZRGB> &target_search_tree,
+    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &source)
+{
+  const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &target = target_search_tree.getInputCloud();
+  Eigen::Matrix4f best = Eigen::Matrix4f::Identity();
+  if (!target || target->size() < 3 || source->size() < 3)
+  {
+    // too few points for stable axes
+    return best;
+  }
+
+  Eigen::Matrix3f target_axes, source_axes;
+  Eigen::Vector3f target_centroid, source_centroid;
+  point_cloud_metrics::calculatePrincipalAxes(target, target_axes, target_centroid);
+  point_cloud_metrics::calculatePrincipalAxes(source, source_axes, source_centroid);
+
+  // every right-handed choice of axis signs (symmetric objects make several of these equivalent)
+  const float signs[4][3] = {{1, 1, 1}, {1, -1, -1}, {-1, 1, -1}, {-1, -1, 1}};
+  vector<int> indices;
+  vector<float> distances;
+  double best_error = scoreAlignment(target_search_tree, *source, best, indices, distances);
+  for (int i = 0; i < 4; i++)
+  {
+    const Eigen::Vector3f flip(signs[i][0], signs[i][1], signs[i][2]);
+    const Eigen::Matrix3f rotation = target_axes * flip.asDiagonal() * source_axes.transpose();
+    Eigen::Matrix4f hypothesis = Eigen::Matrix4f::Identity();
+    hypothesis.topLeftCorner<3, 3>() = rotation;
+    hypothesis.topRightCorner<3, 1>() = target_centroid - rotation * source_centroid;
+    const double error = scoreAlignment(target_search_tree, *source, hypothesis, indices, distances);
+    if (error < best_error)
+    {
+      best_error = error;
+      best = hypothesis;
+    }
+  }
+  return best;
+}
+
+tf2::Transform point_cloud_metrics::icpToTF2Transform(const Eigen::Matrix4f &transform)
+{
   // tanslate to a TF2 transform
   tf2::Matrix3x3 rotation(transform(0, 0), transform(0, 1), transform(0, 2),
                           transform(1, 0), transform(1, 1), transform(1, 2),
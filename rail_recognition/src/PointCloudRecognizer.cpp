@@ -18,11 +18,192 @@
 #include <pcl/kdtree/kdtree_flann.h>
 #include <pcl/registration/icp.h>
 
+// Eigen
+#include <Eigen/Geometry>
+
+// Boost
+#include <boost/bind.hpp>
+
+// C++ Standard Library
+#include <algorithm>
+
 using namespace std;
 using namespace rail::pick_and_place;
 
-PointCloudRecognizer::PointCloudRecognizer()
+/*!
+ * \struct CancellationLatch
+ * \brief A cancellation check that remembers if it ever cancelled the batch.
+ *
+ * Once the wrapped check returns true every later poll does too, so the batch can tell afterwards whether any work
+ * was actually skipped (a check that only turns true after the last poll does not cancel anything).
+ */
+struct CancellationLatch
+{
+  /*! The wrapped cancellation check. */
+  boost::function<bool()> check;
+  /*! If the check returned true. */
+  bool tripped;
+  /*! Mutex for the tripped flag. */
+  boost::mutex mutex;
+
+  /*!
+   * \brief Creates a new CancellationLatch.
+   *
+   * Creates a new CancellationLatch around the given check.
+   *
+   * \param check The cancellation check to wrap.
+   */
+  CancellationLatch(const boost::function<bool()> &check) : check(check), tripped(false)
+  {
+  }
+
+  /*!
+   * \brief Poll the cancellation check.
+   *
+   * Poll the wrapped check unless it already cancelled the batch.
+   *
+   * \return True if the batch is cancelled.
+   */
+  bool poll()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    if (!tripped)
+    {
+      tripped = check();
+    }
+    return tripped;
+  }
+
+  /*!
+   * \brief Check if the batch was cancelled.
+   *
+   * \return True if any poll cancelled the batch.
+   */
+  bool isTripped()
+  {
+    boost::mutex::scoped_lock lock(mutex);
+    return tripped;
+  }
+};
+
+PointCloudRecognizer::PointCloudRecognizer(const int num_threads)
+    : thread_pool_(new ThreadPool(num_threads)), workspace_pool_(new WorkspacePool)
+{
+  max_icp_candidates_ = 0;
+  max_grasps_ = 0;
+  max_color_histogram_distance_ = DEFAULT_MAX_COLOR_HISTOGRAM_DISTANCE;
+  bounded_scoring_ = true;
+  workspace_pool_->num_workspaces = thread_pool_->getNumThreads();
+  this->setLatencyRecorder(NULL);
+}
+
+PointCloudRecognizer::ScopedWorkspaces::ScopedWorkspaces(WorkspacePool &pool)
+    : pool_(pool)
+{
+  boost::mutex::scoped_lock lock(pool_.mutex);
+  if (pool_.available.empty())
+  {
+    // every set is in use, so this batch gets a new one
+    workspaces_.reset(new ScoringWorkspaces);
+    workspaces_->workspaces.resize(pool_.num_workspaces);
+  } else
+  {
+    workspaces_ = pool_.available.back();
+    pool_.available.pop_back();
+  }
+}
+
+PointCloudRecognizer::ScopedWorkspaces::~ScopedWorkspaces()
+{
+  boost::mutex::scoped_lock lock(pool_.mutex);
+  pool_.available.push_back(workspaces_);
+}
+
+PointCloudRecognizer::ScoringWorkspaces &PointCloudRecognizer::ScopedWorkspaces::get() const
+{
+  return *workspaces_;
+}
+
+int PointCloudRecognizer::getNumThreads() const
+{
+  return thread_pool_->getNumThreads();
+}
+
+int PointCloudRecognizer::getMaxICPCandidates() const
+{
+  return max_icp_candidates_;
+}
+
+void PointCloudRecognizer::setMaxICPCandidates(const int max_icp_candidates)
+{
+  max_icp_candidates_ = max_icp_candidates;
+}
+
+int PointCloudRecognizer::getMaxGrasps() const
+{
+  return max_grasps_;
+}
+
+void PointCloudRecognizer::setMaxGrasps(const int max_grasps)
+{
+  max_grasps_ = max_grasps;
+}
+
+double PointCloudRecognizer::getMaxColorHistogramDistance() const
 {
+  return max_color_histogram_distance_;
+}
+
+void PointCloudRecognizer::setMaxColorHistogramDistance(const double max_color_histogram_distance)
+{
+  max_color_histogram_distance_ = max_color_histogram_distance;
+}
+
+bool PointCloudRecognizer::isBoundedScoring() const
+{
+  return bounded_scoring_;
+}
+
+void PointCloudRecognizer::setBoundedScoring(const bool bounded_scoring)
+{
+  bounded_scoring_ = bounded_scoring;
+}
+
+const point_cloud_metrics::ICPParameters &PointCloudRecognizer::getICPParameters() const
+{
+  return icp_parameters_;
+}
+
+void PointCloudRecognizer::setICPParameters(const point_cloud_metrics::ICPParameters &icp_parameters)
+{
+  icp_parameters_ = icp_parameters;
+}
+
+graspdb::LatencyRecorder *PointCloudRecognizer::getLatencyRecorder() const
+{
+  return latency_recorder_;
+}
+
+void PointCloudRecognizer::setLatencyRecorder(graspdb::LatencyRecorder *latency_recorder)
+{
+  latency_recorder_ = latency_recorder;
+  recognize_stage_ = 0;
+  convert_stage_ = 0;
+  filter_stage_ = 0;
+  icp_stage_ = 0;
+  overlap_stage_ = 0;
+  distance_stage_ = 0;
+  grasps_stage_ = 0;
+  if (latency_recorder_ != NULL)
+  {
+    recognize_stage_ = latency_recorder_->addStage("recognizer.recognize");
+    convert_stage_ = latency_recorder_->addStage("recognizer.convert");
+    filter_stage_ = latency_recorder_->addStage("recognizer.filter");
+    icp_stage_ = latency_recorder_->addStage("recognizer.icp");
+    overlap_stage_ = latency_recorder_->addStage("recognizer.overlap_metric");
+    distance_stage_ = latency_recorder_->addStage("recognizer.distance_metric");
+    grasps_stage_ = latency_recorder_->addStage("recognizer.grasp_ranking");
+  }
 }
 
 bool PointCloudRecognizer::recognizeObject(rail_manipulation_msgs::SegmentedObject &object,
@@ -40,148 +221,531 @@ bool PointCloudRecognizer::recognizeObject(rail_manipulation_msgs::SegmentedObje
     return false;
   }
 
+  vector<rail_manipulation_msgs::SegmentedObject *> objects(1, &object);
+  return this->recognize(objects, candidates, boost::function<bool()>(), 1, NULL) == 1;
+}
+
+bool PointCloudRecognizer::recognizeObject(rail_manipulation_msgs::SegmentedObject &object,
+    const vector<PCLGraspModel> &candidates, const size_t max_results, vector<RankedCandidate> &ranked) const
+{
+  ranked.clear();
+
+  // make sure we have some candidates
+  if (candidates.empty())
+  {
+    ROS_WARN("Candidate object list is empty. Nothing to compare segmented object to.");
+    return false;
+  }
+  if (object.point_cloud.data.empty())
+  {
+    ROS_WARN("Segmented object point cloud is empty. Nothing to compare candidate objects to.");
+    return false;
+  }
+
+  vector<rail_manipulation_msgs::SegmentedObject *> objects(1, &object);
+  vector<vector<RankedCandidate> > results;
+  bool recognized = this->recognize(objects, candidates, boost::function<bool()>(), max_results, &results) == 1;
+  ranked.swap(results[0]);
+  return recognized;
+}
+
+size_t PointCloudRecognizer::recognizeObjects(rail_manipulation_msgs::SegmentedObjectList &objects,
+    const vector<PCLGraspModel> &candidates, const boost::function<bool()> &cancelled, bool *was_cancelled) const
+{
+  if (was_cancelled != NULL)
+  {
+    *was_cancelled = false;
+  }
+
+  // make sure we have some candidates
+  if (candidates.empty())
+  {
+    ROS_WARN("Candidate object list is empty. Nothing to compare segmented objects to.");
+    return 0;
+  }
+
+  // only consider objects that still need to be recognized
+  vector<rail_manipulation_msgs::SegmentedObject *> unrecognized;
+  for (size_t i = 0; i < objects.objects.size(); i++)
+  {
+    rail_manipulation_msgs::SegmentedObject &object = objects.objects[i];
+    if (!object.recognized)
+    {
+      if (object.point_cloud.data.empty())
+      {
+        ROS_WARN("Segmented object point cloud is empty. Nothing to compare candidate objects to.");
+      } else
+      {
+        unrecognized.push_back(&object);
+      }
+    }
+  }
+
+  return this->recognize(unrecognized, candidates, cancelled, 1, NULL, was_cancelled);
+}
+
+size_t PointCloudRecognizer::recognize(const vector<rail_manipulation_msgs::SegmentedObject *> &objects,
+    const vector<PCLGraspModel> &candidates, const boost::function<bool()> &cancelled, const size_t max_results,
+    vector<vector<RankedCandidate> > *ranked, bool *was_cancelled) const
+{
+  if (was_cancelled != NULL)
+  {
+    *was_cancelled = false;
+  }
+  if (ranked != NULL)
+  {
+    ranked->assign(objects.size(), vector<RankedCandidate>());
+  }
+  if (objects.empty())
+  {
+    return 0;
+  }
+  graspdb::LatencyRecorder::ScopedTimer timer(latency_recorder_, recognize_stage_);
+
+  // only a poll that returned true skipped any work
+  CancellationLatch latch(cancelled);
+  boost::function<bool()> poll;
+  if (cancelled)
+  {
+    poll = boost::bind(&CancellationLatch::poll, &latch);
+  }
+
+  // pre-process every object up front (in parallel if enabled)
+  vector<PreparedObject> prepared(objects.size());
+  if (objects.size() == 1)
+  {
+    // a single object filters its point cloud in parallel instead
+    this->prepareObjectTask(0, objects, thread_pool_.get(), prepared);
+  } else
+  {
+    // tasks can not use the thread pool themselves
+    ThreadPool *filter_pool = NULL;
+    thread_pool_->run(objects.size(), boost::bind(&PointCloudRecognizer::prepareObjectTask, this, _1,
+                                                  boost::cref(objects), filter_pool, boost::ref(prepared)));
+  }
+
+  // prune the candidates for each object before running any registration
+  vector<pair<size_t, size_t> > pairs;
+  for (size_t i = 0; i < objects.size(); i++)
+  {
+    vector<size_t> selected;
+    this->selectCandidates(candidates, prepared[i], selected);
+    for (size_t j = 0; j < selected.size(); j++)
+    {
+      pairs.push_back(make_pair(i, selected[j]));
+    }
+  }
+
+  // anything above the confidence threshold can never be picked
+  ScoreBounds bounds;
+  bounds.values.resize(objects.size(), SCORE_CONFIDENCE_THRESHOLD);
+  bounds.cancelled = poll;
+  bounds.max_results = max(max_results, (size_t) 1);
+  bounds.best.resize(objects.size());
+
+  // score every remaining (object, candidate) pair as a single flat batch
+  const size_t num_slots = objects.size() * candidates.size();
+  vector<double> scores(num_slots, numeric_limits<double>::infinity());
+  vector<tf2::Transform> icp_tfs(num_slots);
+  {
+    // each batch in flight uses its own workspaces (the thread pool still runs one batch at a time)
+    ScopedWorkspaces workspaces(*workspace_pool_);
+    if (DeviceModelLibrary::isGPUEnabled())
+    {
+      this->scoreOnDevice(pairs, candidates, prepared, poll, workspaces.get(), scores, icp_tfs);
+    } else
+    {
+      thread_pool_->run(pairs.size(), boost::bind(&PointCloudRecognizer::scoreTask, this, _1, _2,
+                                                  boost::cref(pairs), boost::cref(candidates), boost::cref(prepared),
+                                                  boost::ref(bounds), boost::ref(workspaces.get()),
+                                                  boost::ref(scores), boost::ref(icp_tfs)));
+    }
+  }
+
+  // skipped pairs leave partial results, so a cancelled batch must not update anything
+  if (latch.isTripped())
+  {
+    if (was_cancelled != NULL)
+    {
+      *was_cancelled = true;
+    }
+    return 0;
+  }
+
+  size_t recognized = 0;
+  vector<pair<double, size_t> > matches;
+  for (size_t i = 0; i < objects.size(); i++)
+  {
+    // only matches that meet the confidence threshold are ranked
+    const size_t offset = i * candidates.size();
+    matches.clear();
+    for (size_t j = 0; j < candidates.size(); j++)
+    {
+      if (scores[offset + j] <= SCORE_CONFIDENCE_THRESHOLD)
+      {
+        matches.push_back(make_pair(scores[offset + j], j));
+      }
+    }
+
+    // ties resolve in candidate order, the same as the serial search
+    const size_t num_results = min(bounds.max_results, matches.size());
+    partial_sort(matches.begin(), matches.begin() + num_results, matches.end());
+    if (ranked != NULL)
+    {
+      vector<RankedCandidate> &results = (*ranked)[i];
+      results.resize(num_results);
+      for (size_t j = 0; j < num_results; j++)
+      {
+        results[j].index = matches[j].second;
+        results[j].score = matches[j].first;
+        results[j].tf_icp = icp_tfs[offset + matches[j].second];
+      }
+    }
+
+    // the best match is used for the object
+    if (num_results > 0)
+    {
+      const size_t best = matches[0].second;
+      this->applyRecognition(*objects[i], candidates[best], matches[0].first, icp_tfs[offset + best]);
+      recognized++;
+    }
+  }
+
+  return recognized;
+}
+
+void PointCloudRecognizer::prepareObjectTask(const size_t index,
+    const vector<rail_manipulation_msgs::SegmentedObject *> &objects, ThreadPool *filter_pool,
+    vector<PreparedObject> &prepared) const
+{
+  const rail_manipulation_msgs::SegmentedObject &object = *objects[index];
+  PreparedObject &result = prepared[index];
+
   // convert to a PCL point cloud
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr object_point_cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
-  point_cloud_metrics::rosPointCloud2ToPCLPointCloud(object.point_cloud, object_point_cloud);
+  result.point_cloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+  {
+    graspdb::LatencyRecorder::ScopedTimer timer(latency_recorder_, convert_stage_);
+    point_cloud_metrics::rosPointCloud2ToPCLPointCloud(object.point_cloud, result.point_cloud);
+  }
 
   // pre-process input cloud
-  double object_r, object_g, object_b, object_std_dev_r, object_std_dev_g, object_std_dev_b;
-  point_cloud_metrics::calculateAvgColors(object_point_cloud, object_r, object_g, object_b);
-  point_cloud_metrics::calculateStdDevColors(object_point_cloud, object_std_dev_r, object_std_dev_g,
-                                             object_std_dev_b, object_r, object_g, object_b);
-  point_cloud_metrics::filterPointCloudOutliers(object_point_cloud);
-  point_cloud_metrics::transformToOrigin(object_point_cloud, object.centroid);
-
-  // perform recognition
-  double min_score = numeric_limits<double>::infinity();
-  size_t min_index;
-  tf2::Transform min_icp_tf;
+  graspdb::LatencyRecorder::ScopedTimer timer(latency_recorder_, filter_stage_);
+  point_cloud_metrics::PointCloudStatistics statistics;
+  point_cloud_metrics::calculatePointCloudStatistics(result.point_cloud, statistics);
+  result.avg_r = statistics.avg_r;
+  result.avg_g = statistics.avg_g;
+  result.avg_b = statistics.avg_b;
+  result.std_dev_r = statistics.std_dev_r;
+  result.std_dev_g = statistics.std_dev_g;
+  result.std_dev_b = statistics.std_dev_b;
+  if (filter_pool != NULL)
+  {
+    point_cloud_metrics::filterPointCloudOutliers(*filter_pool, result.point_cloud);
+  } else
+  {
+    point_cloud_metrics::filterPointCloudOutliers(result.point_cloud);
+  }
+  point_cloud_metrics::transformToOrigin(result.point_cloud, object.centroid);
+  result.extents = point_cloud_metrics::calculatePrincipalExtents(result.point_cloud);
+  point_cloud_metrics::calculateColorHistogram(result.point_cloud, result.color_histogram);
+}
+
+void PointCloudRecognizer::selectCandidates(const vector<PCLGraspModel> &candidates, const PreparedObject &object,
+    vector<size_t> &selected) const
+{
+  // rank the candidates by shape distance (ties broken by index)
+  vector<pair<float, size_t> > ranked;
   for (size_t i = 0; i < candidates.size(); i++)
   {
-    const pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr &candidate_point_cloud = candidates[i].getPCLPointCloud();
+    const PCLGraspModel &candidate = candidates[i];
 
     // quick check for a valid point cloud
-    if (!candidate_point_cloud->empty())
+    if (!candidate.getPCLPointCloud()->empty())
     {
       // do an average color check
-      if (fabs(object_r - candidates[i].getAverageRed()) <= object_std_dev_r / 1.5
-          && fabs(object_g - candidates[i].getAverageGreen()) <= object_std_dev_g / 1.5
-          && fabs(object_b - candidates[i].getAverageBlue()) <= object_std_dev_b / 1.5)
+      if (fabs(object.avg_r - candidate.getAverageRed()) <= object.std_dev_r / 1.5
+          && fabs(object.avg_g - candidate.getAverageGreen()) <= object.std_dev_g / 1.5
+          && fabs(object.avg_b - candidate.getAverageBlue()) <= object.std_dev_b / 1.5)
       {
-        tf2::Transform cur_icp_tf;
-        double score = this->scoreRegistration(candidate_point_cloud, object_point_cloud, cur_icp_tf);
-        if (score < min_score)
+        // then compare the color distributions, which also separates multicolored objects with similar averages
+        if (max_color_histogram_distance_ >= 1.0
+            || point_cloud_metrics::calculateColorHistogramDistance(object.color_histogram,
+                                                                    candidate.getColorHistogram())
+                <= max_color_histogram_distance_)
         {
-          min_score = score;
-          min_index = i;
-          min_icp_tf = cur_icp_tf;
+          float distance = (object.extents - candidate.getPrincipalExtents()).norm();
+          ranked.push_back(make_pair(distance, i));
         }
       }
     }
   }
 
-  // check if there is enough confidence
-  if (min_score > SCORE_CONFIDENCE_THRESHOLD)
+  // only keep the closest shapes if a limit is set
+  if (max_icp_candidates_ > 0 && ranked.size() > (size_t) max_icp_candidates_)
   {
-    return false;
+    partial_sort(ranked.begin(), ranked.begin() + max_icp_candidates_, ranked.end());
+    ranked.resize(max_icp_candidates_);
   }
 
-  // fill in recognition information
-  object.name = candidates[min_index].getObjectName();
-  object.model_id = candidates[min_index].getID();
-  object.confidence = min_score;
-  object.recognized = true;
-  // TODO infer object orientation
-  object.orientation.w = 1.0;
-  object.grasps.clear();
+  // keep the candidate order so the reduction matches the serial search
+  size_t start = selected.size();
+  for (size_t i = 0; i < ranked.size(); i++)
+  {
+    selected.push_back(ranked[i].second);
+  }
+  sort(selected.begin() + start, selected.end());
+}
+
+void PointCloudRecognizer::scoreTask(const size_t index, const size_t thread,
+    const vector<pair<size_t, size_t> > &pairs,
+    const vector<PCLGraspModel> &candidates, const vector<PreparedObject> &objects, ScoreBounds &bounds,
+    ScoringWorkspaces &workspaces, vector<double> &scores, vector<tf2::Transform> &icp_tfs) const
+{
+  // skip any remaining work once the batch is cancelled
+  if (bounds.cancelled && bounds.cancelled())
+  {
+    return;
+  }
 
-  // extract possible grasps for this model
-  vector<graspdb::Grasp> possible_grasps;
-  this->computeGraspList(min_icp_tf, object.centroid, candidates[min_index].getGrasps(), possible_grasps);
+  const size_t object_index = pairs[index].first;
+  const size_t candidate_index = pairs[index].second;
 
-  // sort and remove any grasps with 0 success rates
-  vector<double> success_rates;
-  for (size_t i = 0; i < possible_grasps.size(); i++)
+  // grab the current best score for this object
+  double bound = numeric_limits<double>::infinity();
+  if (bounded_scoring_)
   {
-    double rate = possible_grasps[i].getSuccessRate();
-    geometry_msgs::PoseStamped pose = possible_grasps[i].getGraspPose().toROSPoseStampedMessage();
-    // fix the frame ID
-    pose.header.frame_id = object.point_cloud.header.frame_id;
+    boost::mutex::scoped_lock lock(bounds.mutex);
+    bound = bounds.values[object_index];
+  }
+
+  // each task only writes to its own slot
+  const size_t slot = object_index * candidates.size() + candidate_index;
+  double score = this->scoreRegistration(candidates[candidate_index], objects[object_index].point_cloud, bound,
+                                         workspaces.workspaces[thread], icp_tfs[slot]);
+  scores[slot] = score;
 
-    // check the success rate -- any non-zero or non-attempted grasp
-    if (rate > 0 || possible_grasps[i].getAttempts() == 0)
+  // tighten the bound for the remaining candidates once enough results are found
+  if (bounded_scoring_)
+  {
+    boost::mutex::scoped_lock lock(bounds.mutex);
+    if (score <= bounds.values[object_index])
     {
-      // place it in order
-      bool inserted = false;
-      for (size_t j = 0; j < success_rates.size(); j++)
+      vector<double> &best = bounds.best[object_index];
+      best.insert(upper_bound(best.begin(), best.end(), score), score);
+      if (best.size() > bounds.max_results)
       {
-        if (rate <= success_rates[j])
-        {
-          object.grasps.insert(object.grasps.begin() + j, pose);
-          success_rates.insert(success_rates.begin() + j, rate);
-          inserted = true;
-          break;
-        }
+        best.pop_back();
       }
-
-      if (!inserted)
+      if (best.size() == bounds.max_results)
       {
-        object.grasps.push_back(pose);
-        success_rates.push_back(rate);
+        bounds.values[object_index] = best.back();
       }
     }
   }
+}
+
+void PointCloudRecognizer::scoreOnDevice(const vector<pair<size_t, size_t> > &pairs,
+    const vector<PCLGraspModel> &candidates, const vector<PreparedObject> &objects,
+    const boost::function<bool()> &cancelled, ScoringWorkspaces &workspaces, vector<double> &scores,
+    vector<tf2::Transform> &icp_tfs) const
+{
+  // ICP still runs on the CPU
+  vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> aligned(pairs.size());
+  thread_pool_->run(pairs.size(), boost::bind(&PointCloudRecognizer::registerTask, this, _1, boost::cref(pairs),
+                                              boost::cref(candidates), boost::cref(objects), boost::cref(cancelled),
+                                              boost::ref(aligned), boost::ref(icp_tfs)));
+  if (cancelled && cancelled())
+  {
+    return;
+  }
+
+  // keep the candidates resident between batches
+  if (!workspaces.device_library || !workspaces.device_library->matches(candidates))
+  {
+    workspaces.device_library.reset(new DeviceModelLibrary(candidates));
+  }
+
+  // every metric of every pair is computed in the same batched searches
+  vector<DeviceModelLibrary::Registration> registrations(pairs.size());
+  for (size_t i = 0; i < pairs.size(); i++)
+  {
+    registrations[i] = make_pair(pairs[i].second, aligned[i]);
+  }
+  vector<point_cloud_metrics::RegistrationMetrics> metrics;
+  {
+    graspdb::LatencyRecorder::ScopedTimer timer(latency_recorder_, overlap_stage_);
+    workspaces.device_library->calculateRegistrationMetrics(registrations, metrics);
+  }
 
-  return true;
+  for (size_t i = 0; i < pairs.size(); i++)
+  {
+    // the same weighted result as the CPU path (empty point clouds never overlap)
+    if (metrics[i].overlap >= OVERLAP_THRESHOLD)
+    {
+      const size_t slot = pairs[i].first * candidates.size() + pairs[i].second;
+      scores[slot] = ALPHA * (3.0 * metrics[i].distance_error) + (1.0 - ALPHA) * (metrics[i].color_error / 100.0);
+    }
+  }
 }
 
-double PointCloudRecognizer::scoreRegistration(pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr candidate,
-    pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr object, tf2::Transform &tf_icp) const
+void PointCloudRecognizer::registerTask(const size_t index, const vector<pair<size_t, size_t> > &pairs,
+    const vector<PCLGraspModel> &candidates, const vector<PreparedObject> &objects,
+    const boost::function<bool()> &cancelled, vector<pcl::PointCloud<pcl::PointXYZRGB>::Ptr> &aligned,
+    vector<tf2::Transform> &icp_tfs) const
 {
-  // use ICP to for matching
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr aligned(new pcl::PointCloud<pcl::PointXYZRGB>);
-  tf_icp = point_cloud_metrics::performICP(candidate, object, aligned);
+  // skip any remaining work once the batch is cancelled
+  if (cancelled && cancelled())
+  {
+    return;
+  }
+
+  const PCLGraspModel &candidate = candidates[pairs[index].second];
+  const size_t slot = pairs[index].first * candidates.size() + pairs[index].second;
+  aligned[index].reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+  graspdb::LatencyRecorder::ScopedTimer timer(latency_recorder_, icp_stage_);
+  icp_tfs[slot] = point_cloud_metrics::performICP(candidate.getSearchTree(), objects[pairs[index].first].point_cloud,
+                                                  aligned[index], icp_parameters_);
+}
+
+void PointCloudRecognizer::applyRecognition(rail_manipulation_msgs::SegmentedObject &object,
+    const PCLGraspModel &model, const double score, const tf2::Transform &tf_icp) const
+{
+  // fill in recognition information
+  object.name = model.getObjectName();
+  object.model_id = model.getID();
+  object.confidence = score;
+  object.recognized = true;
+  // the model is stored in its canonical orientation, so the object is rotated by the inverse ICP rotation
+  const tf2::Quaternion orientation = tf_icp.inverse().getRotation();
+  object.orientation.x = orientation.x();
+  object.orientation.y = orientation.y();
+  object.orientation.z = orientation.z();
+  object.orientation.w = orientation.w();
+
+  // rank and transform the grasps for this model
+  graspdb::LatencyRecorder::ScopedTimer timer(latency_recorder_, grasps_stage_);
+  this->computeGraspList(tf_icp, object.centroid, model.getGrasps(), object.point_cloud.header.frame_id,
+                         object.grasps);
+}
+
+double PointCloudRecognizer::scoreRegistration(const PCLGraspModel &candidate,
+    pcl::PointCloud<pcl::PointXYZRGB>::ConstPtr object, const double bound,
+    point_cloud_metrics::MetricWorkspace &workspace, tf2::Transform &tf_icp) const
+{
+  // the search tree is built once per model and reused
+  const pcl::search::KdTree<pcl::PointXYZRGB>::Ptr search_tree = candidate.getSearchTree();
+
+  // use ICP to for matching (the aligned point cloud keeps its storage between calls)
+  if (!workspace.aligned)
+  {
+    workspace.aligned.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+  }
+  const pcl::PointCloud<pcl::PointXYZRGB>::Ptr &aligned = workspace.aligned;
+  {
+    graspdb::LatencyRecorder::ScopedTimer timer(latency_recorder_, icp_stage_);
+    tf_icp = point_cloud_metrics::performICP(search_tree, object, aligned, icp_parameters_);
+  }
 
   // check overlap first to determine if a the registration should be scored further
   double overlap, color_error;
-  point_cloud_metrics::calculateRegistrationMetricOverlap(candidate, aligned, overlap, color_error);
-  if (overlap < OVERLAP_THRESHOLD)
+  double min_overlap = bounded_scoring_ ? OVERLAP_THRESHOLD : 0.0;
+  bool overlap_valid;
+  {
+    graspdb::LatencyRecorder::ScopedTimer timer(latency_recorder_, overlap_stage_);
+    overlap_valid = point_cloud_metrics::calculateBoundedRegistrationMetricOverlap(*search_tree, aligned, min_overlap,
+                                                                                   workspace, overlap, color_error);
+  }
+  if (!overlap_valid || overlap < OVERLAP_THRESHOLD)
   {
     return numeric_limits<double>::infinity();
   }
 
+  // find the largest distance error that could still meet the bound
+  double color_score = (1.0 - ALPHA) * (color_error / 100.0);
+  double max_distance_error = numeric_limits<double>::infinity();
+  if (bounded_scoring_ && bound < numeric_limits<double>::infinity())
+  {
+    // pad slightly so rounding can never cut off a score equal to the bound
+    max_distance_error = (bound - color_score) / (3.0 * ALPHA);
+    max_distance_error += fabs(max_distance_error) * 1e-9 + 1e-12;
+    if (max_distance_error < 0)
+    {
+      return numeric_limits<double>::infinity();
+    }
+  }
+
   // calculate the distance and color error
-  double distance_error = point_cloud_metrics::calculateRegistrationMetricDistanceError(candidate, aligned);
+  double distance_error;
+  bool distance_valid;
+  {
+    graspdb::LatencyRecorder::ScopedTimer timer(latency_recorder_, distance_stage_);
+    distance_valid = point_cloud_metrics::calculateBoundedRegistrationMetricDistanceError(*search_tree, aligned,
+                                                                                          max_distance_error,
+                                                                                          workspace, distance_error);
+  }
+  if (!distance_valid)
+  {
+    return numeric_limits<double>::infinity();
+  }
 
   // calculate the final weighted result
-  double result = ALPHA * (3.0 * distance_error) + (1.0 - ALPHA) * (color_error / 100.0);
+  double result = ALPHA * (3.0 * distance_error) + color_score;
   return result;
 }
 
 void PointCloudRecognizer::computeGraspList(const tf2::Transform &tf_icp, const geometry_msgs::Point &centroid,
-    const vector<graspdb::Grasp> &candidate_grasps, vector<graspdb::Grasp> &grasps) const
+    const vector<graspdb::Grasp> &candidate_grasps, const string &frame_id,
+    vector<geometry_msgs::PoseStamped> &grasps) const
 {
-  // ensure an empty list
-  grasps.clear();
-
-  // transform each pose
+  // remove any grasps with 0 success rates -- keep any non-zero or non-attempted grasp
+  vector<pair<double, size_t> > ranked;
+  ranked.reserve(candidate_grasps.size());
   for (size_t i = 0; i < candidate_grasps.size(); i++)
   {
-    // convert to tf2 matrix
-    tf2::Transform tf_pose = candidate_grasps[i].getGraspPose().toTF2Transform();
+    const double rate = candidate_grasps[i].getSuccessRate();
+    if (rate > 0 || candidate_grasps[i].getAttempts() == 0)
+    {
+      // negate so the highest rate sorts first (ties broken by model order)
+      ranked.push_back(make_pair(-rate, i));
+    }
+  }
 
-    // push back the basic information
-    grasps.push_back(candidate_grasps[i]);
+  // only order the grasps that are kept
+  const size_t num_grasps = (max_grasps_ > 0) ? min((size_t) max_grasps_, ranked.size()) : ranked.size();
+  partial_sort(ranked.begin(), ranked.begin() + num_grasps, ranked.end());
 
-    // use the inverse for the result
-    tf2::Transform result = tf_icp.inverseTimes(tf_pose);
+  // the inverse ICP transform followed by the shift back from the origin is the same for every grasp
+  const tf2::Transform tf_inverse = tf_icp.inverse();
+  const tf2::Matrix3x3 &basis = tf_inverse.getBasis();
+  Eigen::Matrix3d rotation;
+  rotation << basis[0][0], basis[0][1], basis[0][2],
+      basis[1][0], basis[1][1], basis[1][2],
+      basis[2][0], basis[2][1], basis[2][2];
+  const Eigen::Quaterniond q_correction(rotation);
+  const Eigen::Vector3d t_correction(tf_inverse.getOrigin().x() + centroid.x, tf_inverse.getOrigin().y() + centroid.y,
+                                     tf_inverse.getOrigin().z() + centroid.z);
 
-    // correct for the origin transform
-    result.getOrigin().setX(result.getOrigin().getX() + centroid.x);
-    result.getOrigin().setY(result.getOrigin().getY() + centroid.y);
-    result.getOrigin().setZ(result.getOrigin().getZ() + centroid.z);
+  // fill the result once
+  grasps.clear();
+  grasps.resize(num_grasps);
+  for (size_t i = 0; i < num_grasps; i++)
+  {
+    const graspdb::Pose &grasp_pose = candidate_grasps[ranked[i].second].getGraspPose();
+    const graspdb::Position &position = grasp_pose.getPosition();
+    const graspdb::Orientation &orientation = grasp_pose.getOrientation();
+    const Eigen::Vector3d p = rotation * Eigen::Vector3d(position.getX(), position.getY(), position.getZ())
+        + t_correction;
+    const Eigen::Quaterniond q = q_correction * Eigen::Quaterniond(orientation.getW(), orientation.getX(),
+                                                                   orientation.getY(), orientation.getZ()).normalized();
 
-    // copy over the values
-    grasps[i].setGraspPose(graspdb::Pose(grasps[i].getGraspPose().getRobotFixedFrameID(), result));
+    geometry_msgs::PoseStamped &pose = grasps[i];
+    pose.header.frame_id = frame_id;
+    pose.pose.position.x = p.x();
+    pose.pose.position.y = p.y();
+    pose.pose.position.z = p.z();
+    pose.pose.orientation.x = q.x();
+    pose.pose.orientation.y = q.y();
+    pose.pose.orientation.z = q.z();
+    pose.pose.orientation.w = q.w();
   }
 }
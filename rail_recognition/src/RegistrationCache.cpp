@@ -0,0 +1,157 @@
+/*!
+ * \file RegistrationCache.cpp
+ * \brief A persistent cache of pairwise registration results.
+ *
+ * The registration cache stores the ICP transform, overlap, color error, and merge decision for each registered pair
+ * of point clouds in an append-only file so later model generation runs can skip pairs that were already registered.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/RegistrationCache.h"
+
+// ROS
+#include <ros/ros.h>
+
+// C++ Standard Library
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+/*! The number of values stored after the key on each line (rotation, translation, overlap, color error, merge). */
+static const size_t NUM_ENTRY_VALUES = 15;
+
+RegistrationCache::Entry::Entry() : tf_icp(tf2::Transform::getIdentity())
+{
+  overlap = 0;
+  color_error = 0;
+  merge = false;
+}
+
+RegistrationCache::RegistrationCache(const string &file_name) : file_name_(file_name)
+{
+  this->load();
+}
+
+const string &RegistrationCache::getFileName() const
+{
+  return file_name_;
+}
+
+size_t RegistrationCache::size() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return entries_.size();
+}
+
+bool RegistrationCache::find(const string &key, Entry &entry) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  boost::unordered_map<string, Entry>::const_iterator it = entries_.find(key);
+  if (it != entries_.end())
+  {
+    entry = it->second;
+    return true;
+  } else
+  {
+    return false;
+  }
+}
+
+bool RegistrationCache::insert(const string &key, const Entry &entry)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  entries_[key] = entry;
+
+  // append so results are kept even if the run is stopped
+  ofstream file(file_name_.c_str(), ios::out | ios::app);
+  if (!file.is_open())
+  {
+    ROS_WARN("Could not write to the registration cache %s.", file_name_.c_str());
+    return false;
+  }
+
+  // doubles round trip exactly with 17 significant digits
+  file.precision(17);
+  const tf2::Matrix3x3 &rotation = entry.tf_icp.getBasis();
+  const tf2::Vector3 &translation = entry.tf_icp.getOrigin();
+  file << key;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      file << " " << rotation[i][j];
+    }
+  }
+  file << " " << translation.x() << " " << translation.y() << " " << translation.z() << " " << entry.overlap << " "
+      << entry.color_error << " " << (entry.merge ? 1 : 0) << endl;
+  return true;
+}
+
+string RegistrationCache::createKey(const string &base_source, const string &target_source,
+    const string &signature)
+{
+  return base_source + "|" + target_source + "|" + signature;
+}
+
+void RegistrationCache::load()
+{
+  ifstream file(file_name_.c_str());
+  if (!file.is_open())
+  {
+    // nothing cached yet
+    return;
+  }
+
+  string line;
+  size_t skipped = 0;
+  while (getline(file, line))
+  {
+    if (line.empty())
+    {
+      continue;
+    }
+
+    // read the key and each value (strtod also handles infinite and NaN values)
+    istringstream ss(line);
+    string key, token;
+    vector<double> values;
+    ss >> key;
+    while (ss >> token)
+    {
+      char *end;
+      values.push_back(strtod(token.c_str(), &end));
+      if (*end != '\0')
+      {
+        values.clear();
+        break;
+      }
+    }
+
+    if (key.empty() || values.size() != NUM_ENTRY_VALUES)
+    {
+      skipped++;
+      continue;
+    }
+
+    Entry entry;
+    entry.tf_icp.setBasis(tf2::Matrix3x3(values[0], values[1], values[2], values[3], values[4], values[5], values[6],
+                                         values[7], values[8]));
+    entry.tf_icp.setOrigin(tf2::Vector3(values[9], values[10], values[11]));
+    entry.overlap = values[12];
+    entry.color_error = values[13];
+    entry.merge = (values[14] != 0);
+    entries_[key] = entry;
+  }
+
+  if (skipped > 0)
+  {
+    ROS_WARN("Skipped %lu malformed lines in the registration cache %s.", skipped, file_name_.c_str());
+  }
+}
@@ -0,0 +1,148 @@
+/*!
+ * \file ThreadPool.cpp
+ * \brief A fixed size pool of worker threads for data parallel tasks.
+ *
+ * The thread pool keeps a set of worker threads alive and uses them to run a number of independent, indexed tasks.
+ * The calling thread also works on the tasks and blocks until every task has finished.
+ *
+ * \author Russell Toris, WPI - rctoris@wpi.edu
+ * \date April 16, 2015
+ */
+
+// RAIL Recognition
+#include "rail_recognition/ThreadPool.h"
+
+// Boost
+#include <boost/bind.hpp>
+
+using namespace std;
+using namespace rail::pick_and_place;
+
+ThreadPool::ThreadPool(const int num_threads)
+{
+  // use the hardware value if needed
+  num_threads_ = (num_threads < 1) ? (int) boost::thread::hardware_concurrency() : num_threads;
+  if (num_threads_ < 1)
+  {
+    num_threads_ = 1;
+  }
+
+  task_ = NULL;
+  num_tasks_ = 0;
+  next_task_ = 0;
+  running_tasks_ = 0;
+  generation_ = 0;
+  shutdown_ = false;
+
+  // the calling thread is also used (as thread 0), so create one less worker
+  for (int i = 1; i < num_threads_; i++)
+  {
+    workers_.create_thread(boost::bind(&ThreadPool::workerLoop, this, (size_t) i));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  // signal the workers to stop
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    shutdown_ = true;
+  }
+  work_condition_.notify_all();
+  workers_.join_all();
+}
+
+int ThreadPool::getNumThreads() const
+{
+  return num_threads_;
+}
+
+void ThreadPool::run(const size_t num_tasks, const boost::function<void(size_t, size_t)> &task)
+{
+  // check for the simple serial case
+  if (num_threads_ == 1 || num_tasks <= 1)
+  {
+    for (size_t i = 0; i < num_tasks; i++)
+    {
+      task(i, 0);
+    }
+    return;
+  }
+
+  // only a single batch can run at a time
+  boost::mutex::scoped_lock run_lock(run_mutex_);
+
+  // publish the new batch
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    task_ = &task;
+    num_tasks_ = num_tasks;
+    next_task_ = 0;
+    running_tasks_ = 0;
+    generation_++;
+  }
+  work_condition_.notify_all();
+
+  // help out
+  this->runTasks(0);
+
+  // wait for everything to finish
+  boost::mutex::scoped_lock lock(mutex_);
+  while (next_task_ < num_tasks_ || running_tasks_ > 0)
+  {
+    done_condition_.wait(lock);
+  }
+  task_ = NULL;
+}
+
+void ThreadPool::workerLoop(const size_t thread_index)
+{
+  unsigned long last_generation = 0;
+  while (true)
+  {
+    // wait for a new batch
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (!shutdown_ && generation_ == last_generation)
+      {
+        work_condition_.wait(lock);
+      }
+      if (shutdown_)
+      {
+        return;
+      }
+      last_generation = generation_;
+    }
+
+    this->runTasks(thread_index);
+  }
+}
+
+void ThreadPool::runTasks(const size_t thread_index)
+{
+  while (true)
+  {
+    // claim the next task
+    size_t index;
+    const boost::function<void(size_t, size_t)> *task;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (task_ == NULL || next_task_ >= num_tasks_)
+      {
+        return;
+      }
+      index = next_task_++;
+      task = task_;
+      running_tasks_++;
+    }
+
+    (*task)(index, thread_index);
+
+    // mark it as done
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      running_tasks_--;
+    }
+    done_condition_.notify_all();
+  }
+}